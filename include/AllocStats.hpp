@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+/*
+ * Heap allocation counters. Linking AllocStats.cpp replaces the global
+ * operator new/delete with thin malloc/free wrappers that bump a counter,
+ * which is how the pipeline proves its steady state doesn't allocate.
+ */
+
+namespace util
+{
+
+    // operator new calls made by the calling thread so far
+    uint64_t threadHeapAllocations();
+
+    // operator new calls made by the whole process so far
+    uint64_t heapAllocations();
+
+} // namespace util
@@ -0,0 +1,118 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FramePool.hpp"
+#include "LatencyHistogram.hpp"
+#include "WriteBackend.hpp"
+
+/*
+ * Frame files written from pool buffers through a WriteBackend, so the write
+ * stage hands a frame to the disk and goes straight back for the next one.
+ *
+ * writeFile() opens a new file with O_DIRECT, preallocates it with fallocate()
+ * and queues the whole buffer as one write. The PixelBuffer lease (and the fd)
+ * are held until the write completes; then the file is cut to its real length
+ * and closed, and the buffer goes back to the pool. writeAt() is the same for a
+ * file the caller keeps open (the .gsq container).
+ *
+ * O_DIRECT keeps frames out of the page cache, which is what turns the usual
+ * sawtooth (fast until dirty pages hit the writeback threshold, then stalls)
+ * into a flat rate the disk can actually sustain. It needs address, offset and
+ * length aligned to the device's logical block size: pool buffers are
+ * page-aligned and lengths are rounded up to kAlignment, so the buffer must
+ * have padded(bytes) of room. Filesystems that refuse O_DIRECT (tmpfs, some
+ * FUSE) get ordinary buffered writes, still asynchronous.
+ *
+ * At most `depth` writes are in flight; beyond that writeFile() blocks, which
+ * backs the pipeline up the same way a slow synchronous write would.
+ */
+class AsyncWriter
+{
+public:
+    static constexpr size_t kAlignment = FramePool::kAlignment;
+    static size_t padded(size_t bytes) { return (bytes + kAlignment - 1) & ~(kAlignment - 1); }
+
+    // Called once per write, on a backend thread, after the file is closed/complete
+    using DoneFn = std::function<void(bool ok)>;
+
+    struct Stats
+    {
+        uint64_t writes{0}; // completed, ok or not
+        uint64_t failed{0};
+        uint64_t bytes{0};
+        uint64_t directFiles{0};   // opened with O_DIRECT
+        uint64_t bufferedFiles{0}; // O_DIRECT refused (or off): page cache
+        unsigned maxInFlight{0};
+        LatencyHistogram::Summary latency; // queued → on disk
+    };
+
+    AsyncWriter(std::unique_ptr<WriteBackend> backend, unsigned depth, bool direct, DoneFn done);
+    ~AsyncWriter(); // waits for everything in flight
+
+    AsyncWriter(const AsyncWriter &) = delete;
+    AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+    const char *backendName() const { return backend_->name(); }
+    bool direct() const { return direct_; }
+
+    // `data` lies inside `lease`, is kAlignment-aligned and has padded(bytes) of
+    // room; the padding is zeroed here. False if the file couldn't be created or
+    // the write queued (the lease is released either way; done is not called).
+    bool writeFile(const std::string &path, PixelBuffer &&lease, uint8_t *data, size_t bytes);
+
+    // Same rules, into an open fd at an aligned offset; `bytes` must already be
+    // a multiple of kAlignment if the fd is O_DIRECT. If the write is queued but
+    // then fails, `failed(ctx, offset)` runs (on a backend thread, before done)
+    // so the owner of the fd can forget what it expected there.
+    using FailFn = void (*)(void *ctx, uint64_t offset);
+    bool writeAt(int fd, uint64_t offset, PixelBuffer &&lease, const uint8_t *data, size_t bytes,
+                 FailFn failed = nullptr, void *ctx = nullptr);
+
+    // Open `path` for writing, with O_DIRECT if `direct` and the filesystem takes
+    // it; `isDirect` says which. -1 on failure.
+    static int openFile(const std::string &path, bool direct, bool &isDirect);
+
+    // Block until nothing is in flight
+    void drain();
+    unsigned inFlight() const;
+
+    Stats stats() const;
+
+private:
+    struct Slot
+    {
+        AsyncWriter *owner{nullptr};
+        PixelBuffer lease;
+        int fd{-1};
+        bool ownsFd{false};
+        bool truncate{false}; // written padded: cut back to `bytes` before close
+        size_t bytes{0};
+        int64_t queuedNs{0};
+        uint64_t offset{0};
+        FailFn failed{nullptr};
+        void *failedCtx{nullptr};
+    };
+
+    bool queue(int fd, bool ownsFd, bool truncate, uint64_t offset, PixelBuffer &&lease, const uint8_t *data,
+               size_t len, size_t bytes, FailFn failed = nullptr, void *ctx = nullptr);
+    static void onDone(void *ctx, bool ok);
+    void complete(Slot &s, bool ok);
+
+    std::unique_ptr<WriteBackend> backend_;
+    const bool direct_;
+    DoneFn done_;
+
+    mutable std::mutex m_;
+    std::condition_variable cv_;
+    std::vector<Slot> slots_;
+    std::vector<unsigned> free_;
+    Stats stats_; // guarded by m_, except latency
+    LatencyHistogram latency_;
+};
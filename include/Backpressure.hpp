@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * What to give up when the sink can't keep up (--degrade), instead of letting
+ * the queues fill until the camera runs out of buffers and frames vanish at
+ * random.
+ *
+ *   drop-oldest     while on, shed the frames that have waited longest until
+ *                   the first queue has room for the new one (capacity - 1),
+ *                   so what gets written is recent
+ *   decimate        shed every other frame
+ *   raw10p          write DNG/RAW frames as packed .r10p instead (no unpack,
+ *                   1.25 instead of 2 bytes per pixel; gs_convert makes the DNG)
+ *   no-compression  write lossless-JPEG DNGs uncompressed (CPU-bound encoders)
+ *
+ * Each rule turns on when the fullest pipeline queue reaches `highFill` of its
+ * capacity, or the writer latency (completion → written, averaged over the last
+ * few frames) reaches `highLatencyNs`; it turns off once both are back under
+ * the low marks. update() runs once per frame on the completion thread and is
+ * the only writer; every transition is logged and counted.
+ */
+enum class DegradeAction
+{
+    DropOldest,
+    Decimate,
+    PackedRaw10,
+    NoCompression
+};
+
+struct DegradeRule
+{
+    DegradeAction action{DegradeAction::DropOldest};
+    double highFill{0.75}, lowFill{0.25}; // of the fullest queue's capacity
+    int64_t highLatencyNs{0}, lowLatencyNs{0}; // 0: queue depth only
+};
+
+class Backpressure
+{
+public:
+    // "ACTION[:HIGH%/LOW%[:HIGHms/LOWms]]", e.g. "decimate:80/30:50/20"
+    static bool parse(const std::string &spec, DegradeRule &rule);
+    static const char *name(DegradeAction a);
+
+    explicit Backpressure(const std::vector<DegradeRule> &rules);
+
+    // Completion thread: re-evaluate every rule. `tag` prefixes the log lines.
+    void update(double fill, int64_t latencyNs, uint64_t frame, const std::string &tag);
+    bool active(DegradeAction a) const;
+    // Frames this action was applied to
+    void affected(DegradeAction a, uint64_t n = 1);
+
+    void report(std::ostream &os, const std::string &tag) const;
+
+private:
+    struct State
+    {
+        DegradeRule rule;
+        bool on{false};
+        uint64_t since{0}; // frame it last turned on at
+        std::atomic<uint64_t> transitions{0};
+        std::atomic<uint64_t> frames{0};
+    };
+    static void bump(std::atomic<uint64_t> &c, uint64_t n = 1)
+    {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); // single writer
+    }
+
+    std::vector<State> states_;
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+ * Fixed-capacity blocking FIFO used between pipeline stages.
+ * Storage is a ring allocated once up front, so push/pop never touch the heap.
+ * close() wakes everyone up: producers fail, consumers drain what is left.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+        : slots_(capacity ? capacity : 1)
+    {
+    }
+
+    // Blocks while full. Returns false if the queue was closed.
+    bool push(T &&v)
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        notFull_.wait(lk, [&]
+                      { return closed_ || count_ < slots_.size(); });
+        if (closed_)
+            return false;
+        put(std::move(v));
+        lk.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Never blocks. Returns false if full or closed (v is left untouched).
+    bool tryPush(T &&v)
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        if (closed_ || count_ == slots_.size())
+            return false;
+        put(std::move(v));
+        lk.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Blocks while empty. Returns false once closed and fully drained.
+    bool pop(T &out)
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        notEmpty_.wait(lk, [&]
+                       { return closed_ || count_ > 0; });
+        if (count_ == 0)
+            return false;
+        out = std::move(slots_[head_]);
+        head_ = (head_ + 1) % slots_.size();
+        count_--;
+        lk.unlock();
+        notFull_.notify_one();
+        return true;
+    }
+
+    // Never blocks. The oldest element, if there is one.
+    bool tryPop(T &out)
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        if (count_ == 0)
+            return false;
+        out = std::move(slots_[head_]);
+        head_ = (head_ + 1) % slots_.size();
+        count_--;
+        lk.unlock();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            closed_ = true;
+        }
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        return count_;
+    }
+
+    size_t maxSize() const
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        return highWater_;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    void put(T &&v)
+    {
+        slots_[(head_ + count_) % slots_.size()] = std::move(v);
+        count_++;
+        if (count_ > highWater_)
+            highWater_ = count_;
+    }
+
+    mutable std::mutex m_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::vector<T> slots_;
+    size_t head_{0};
+    size_t count_{0};
+    size_t highWater_{0};
+    bool closed_{false};
+};
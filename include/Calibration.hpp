@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Raw10Kernels.hpp"
+
+/*
+ * Sensor calibration applied while unpacking: black levels, an optional dark
+ * frame and a defective-pixel map.
+ *
+ * Black levels are per 2x2 CFA position and go into the DNG's BlackLevel; the
+ * samples keep them. A dark frame removes what differs from pixel to pixel
+ * (fixed-pattern offsets, warm pixels): each sample loses (dark - black of its
+ * channel), so the pedestal stays where the DNG says it is and the noise below
+ * it isn't clipped away. Defective pixels are replaced by the mean of their
+ * nearest same-colour neighbours in the row.
+ *
+ * All of it runs on each row right after the unpack kernel produced it, while
+ * the row is still in L1, so correction adds no pass over the frame.
+ *
+ * File (.gscal, little-endian): CalibrationHeader, then width*height uint16
+ * dark samples if hasDark, then defectCount uint32 pixel indices (y*width + x),
+ * ascending.
+ */
+
+#pragma pack(push, 1)
+struct CalibrationHeader
+{
+    char magic[8]{'G', 'S', 'C', 'A', 'L', '0', '0', '1'};
+    uint32_t version{1};
+    uint32_t width{0}; // of the sensor mode it was taken in
+    uint32_t height{0};
+    uint16_t black[4]{}; // per CFA position: (y & 1) * 2 + (x & 1)
+    uint32_t frames{0};  // dark frames averaged (0: not from --calibrate-dark)
+    uint32_t defectCount{0};
+    uint8_t hasDark{0};
+    uint8_t reserved[11]{};
+};
+#pragma pack(pop)
+static_assert(sizeof(CalibrationHeader) == 48, "CalibrationHeader layout is part of the file format");
+
+class ThreadPool;
+
+class Calibration
+{
+public:
+    static constexpr const char *extension() { return ".gscal"; }
+    static constexpr uint16_t kWhiteLevel = 1023;
+
+    // Reads and validates a file written by save()
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+
+    // Black levels only, for any frame size (no dark frame, no defects)
+    void setBlackLevels(const uint16_t black[4]);
+    // Dark frame (mean samples) and defects for a width×height mode; black
+    // levels and the frame count come from `hdr`
+    void set(const CalibrationHeader &hdr, std::vector<uint16_t> dark, std::vector<uint32_t> defects);
+    // Adds "x y" lines from a text file ('#' starts a comment) to the defect map.
+    // Needs the frame size, from set()/load() or given here.
+    bool loadDefects(const std::string &path, uint32_t width, uint32_t height);
+
+    const CalibrationHeader &header() const { return hdr_; }
+    const uint16_t *blackLevels() const { return hdr_.black; }
+    bool hasDark() const { return !fpn_.empty(); }
+    size_t defects() const { return defects_.size(); }
+    // Whether this applies to a width×height frame (black levels alone fit any)
+    bool fits(uint32_t width, uint32_t height) const;
+    // Anything to do per sample (a dark frame or defects)
+    bool correctsPixels() const { return hasDark() || !defects_.empty(); }
+
+    // Correct `cols` samples of frame row `y` that start at column `x0`, in place
+    void correctRow(uint16_t *row, uint32_t y, uint32_t x0, uint32_t cols) const;
+
+    // raw10::unpack() with every row corrected as it comes out of the kernel.
+    // (x0, y0): where this window sits in the calibrated frame (--roi).
+    // `kernel` null = raw10::selected().
+    bool unpack(const uint8_t *src, size_t srcBytes, size_t stride, uint32_t width, uint32_t height,
+                uint16_t *dst, size_t dstSize, uint32_t x0 = 0, uint32_t y0 = 0,
+                const util::raw10::Kernel *kernel = nullptr) const;
+
+private:
+    void prepare();
+
+    CalibrationHeader hdr_;
+    std::vector<uint16_t> dark_;
+    std::vector<int16_t> fpn_;       // dark - black of the pixel's channel
+    std::vector<uint32_t> defects_;  // ascending y*width + x
+    std::vector<uint32_t> rowFirst_; // defects_ index of each row's first defect, height + 1 entries
+};
+
+/*
+ * --calibrate-dark: sums N frames per pixel, then turns the mean into a
+ * Calibration. Each frame's rows are unpacked and added in bands spread over
+ * a ThreadPool; bands never overlap, so no locks and no atomics per sample.
+ */
+class DarkAccumulator
+{
+public:
+    DarkAccumulator(uint32_t width, uint32_t height);
+
+    // One packed frame, `stride` bytes per line. One caller at a time.
+    bool add(const uint8_t *packed, size_t bytes, size_t stride, ThreadPool *pool);
+
+    uint32_t frames() const { return frames_.load(std::memory_order_relaxed); }
+
+    // Mean frame as the dark frame, each channel's median as its black level,
+    // and as defects every pixel more than `hotThreshold` DN above its channel's
+    // black level (0: 8 robust sigmas, at least 16 DN)
+    bool result(Calibration &out, unsigned hotThreshold = 0) const;
+
+private:
+    const uint32_t width_, height_;
+    std::vector<uint32_t> sum_;
+    std::atomic<uint32_t> frames_{0};
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <libcamera/controls.h>
+#include <libcamera/request.h>
+
+#include "ExposureSchedule.hpp"
+
+/*
+ * The manual controls our capture requests carry: exposure, analogue gain,
+ * frame duration and AE off. Which of them the camera has, and their limits,
+ * are looked up once here instead of on every request.
+ *
+ * libcamera controls stay in effect until changed, so the list only has to ride
+ * on one request: the first one queued, and the first one queued after each
+ * change. For every other request apply() is one atomic compare: nothing is
+ * built, merged or allocated on the re-queue path, and the IPA isn't handed the
+ * same values 60 times a second.
+ *
+ * The setters can be called from any thread while streaming. Values are
+ * clamped to the camera's limits; setting a value it already has is a no-op.
+ *
+ * An exposure schedule is the exception: its values change every frame, so
+ * each request carries a step (bindNext()) and the shared list leaves exposure
+ * and gain out. A request's controls don't reach the frame that request
+ * returns: the Raspberry Pi pipeline hands sensor controls to DelayedControls,
+ * which lands them `lead` frames later. So the step a request carries is the
+ * one meant for the frame `lead` requests further on, and which step a frame
+ * really got is read back from its metadata (matchStep()).
+ */
+class CaptureControls
+{
+public:
+    explicit CaptureControls(const libcamera::ControlInfoMap &info);
+
+    void setExposureUs(int32_t us);
+    void setAnalogueGain(float gain);
+    void setFrameDurationNs(int64_t ns);
+    // All at once, carried by a single request
+    void set(int32_t exposureUs, float gain, int64_t frameDurationNs);
+
+    int32_t exposureUs() const;
+    float analogueGain() const;
+    int64_t frameDurationNs() const;
+
+    // Call before (re)queueing `req`. True if this request took the controls.
+    bool apply(libcamera::Request *req);
+
+    // Set before streaming; steps are clamped like the setters. `lead`: how
+    // many frames after its request's own a control takes effect.
+    void setSchedule(const std::vector<ExposureStep> &steps, unsigned lead);
+    bool scheduled() const { return !steps_.empty(); }
+    const std::vector<ExposureStep> &schedule() const { return steps_; }
+    unsigned lead() const { return lead_; }
+    // Put the step `lead` frames ahead on `req` and return the index of the
+    // step meant for the frame `req` itself returns. Callers serialize this
+    // with queueRequest(), so steps reach the camera in the order they were
+    // handed out.
+    uint32_t bindNext(libcamera::Request *req);
+    // The step a frame's metadata shows: `expected` if it fits, else the first
+    // one that does; -1 if none. Exposure is to the sensor's line steps, gain
+    // to its 0.1 dB ones; `exposure` false compares gain only (triggered
+    // frames expose for the pulse).
+    int matchStep(int32_t exposureUs, float gain, uint32_t expected, bool exposure) const;
+
+private:
+    // m_ held. Rebuild the cached list and mark it pending.
+    void changed();
+
+    const libcamera::ControlInfoMap &info_;
+    bool hasExposure_{false};
+    bool hasGain_{false};
+    bool hasDuration_{false};
+    bool hasAe_{false};
+
+    mutable std::mutex m_;
+    int32_t exposureUs_{0};
+    float gain_{1.0f};
+    int64_t durationNs_{0};
+    libcamera::ControlList list_;
+
+    std::vector<ExposureStep> steps_; // fixed once streaming
+    unsigned lead_{0};
+    uint64_t nextStep_{0}; // bindNext()'s caller serializes
+
+    // Bumped per change; a request takes the list when it's ahead of applied_
+    std::atomic<uint64_t> generation_{0};
+    std::atomic<uint64_t> applied_{0};
+};
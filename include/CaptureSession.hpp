@@ -0,0 +1,266 @@
+#pragma once
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <libcamera/libcamera.h>
+#include <libcamera/framebuffer_allocator.h>
+#include <libcamera/request.h>
+
+#include "AsyncWriter.hpp"
+#include "Backpressure.hpp"
+#include "Calibration.hpp"
+#include "CaptureControls.hpp"
+#include "DngWriter.hpp"
+#include "DropDetector.hpp"
+#include "FrameMatcher.hpp"
+#include "FramePool.hpp"
+#include "JobServer.hpp"
+#include "OutputMode.hpp"
+#include "Pipeline.hpp"
+#include "PreTriggerRing.hpp"
+#include "PreviewSink.hpp"
+#include "SeqFile.hpp"
+#include "StatsReporter.hpp"
+#include "ThreadPool.hpp"
+#include "Trigger.hpp"
+#include "Util.hpp"
+#include "Wakeup.hpp"
+
+// What the command line asks of every camera
+struct CaptureOptions
+{
+    unsigned frames{0};
+    int exposureUs{0};
+    float analogueGain{1.0f};
+    float fps{0.0f};
+    std::vector<ExposureStep> exposureSchedule; // empty: exposureUs/analogueGain throughout
+    unsigned scheduleLead{0};                   // frames between a request and its controls taking effect
+    bool externalTrigger{false};                // frames start on XTR pulses (SensorTriggerMode)
+    std::string bayer;
+    std::string outDir;
+
+    // Output: exactly one of these, or the pre-trigger ring
+    bool writeDng{false};
+    bool writeRaw{false};
+    bool writeRaw10p{false};
+    bool writeSeq{false};
+    bool writePgm{false};
+    bool writeTiff{false};
+    bool dngPieces{false}; // strip/tile/compressed DNG straight from the packed plane
+    uint32_t dngStripRows{0};
+    uint32_t dngTileW{0}, dngTileH{0};
+    DngCompression dngCompression{DngCompression::None};
+    OutputMode output; // binned / single-channel / 8-bit samples (DNG, RAW, PGM, TIFF)
+
+    unsigned workers{1};
+    unsigned writers{1};
+    unsigned bufferCount{0};
+    size_t poolBuffers{0}; // 0: sized from the queue depths
+
+    uint32_t sizeW{0}, sizeH{0}; // 0: the pipeline's default mode
+    bool haveRoi{false};
+    uint32_t roiX{0}, roiY{0}, roiW{0}, roiH{0};
+
+    double statsInterval{0.0};
+    long long maxDrops{-1}; // < 0: never abort
+
+    bool asyncWrites{false};
+    unsigned writeDepth{0};
+    bool directIo{true};
+
+    bool preTrigger{false};
+    size_t preTriggerFrames{0};
+    size_t postTriggerFrames{0};
+
+    unsigned previewEvery{0}; // 0: no preview stage
+
+    std::vector<DegradeRule> degrade; // what to give up when the sink falls behind
+
+    // Calibration applied while unpacking: a .gscal file, a defect list, and
+    // black levels that override the file's
+    std::string calibrationPath; // --calibrate-dark: where the result goes instead
+    std::string defectsPath;
+    bool haveBlack{false};
+    uint16_t black[4]{};
+    unsigned calibrateDarkFrames{0}; // > 0: average this many frames, write nothing else
+};
+
+// What every session in the process uses together
+struct CaptureShared
+{
+    AsyncWriter *writer{nullptr};     // null: each stage writes synchronously
+    ThreadPool *encodePool{nullptr};  // strip/tile DNG pieces
+    Trigger *trigger{nullptr};        // pre-trigger bursts
+    FrameMatcher *matcher{nullptr};   // several cameras: common file numbers
+    Wakeup *wakeup{nullptr};          // rung when the main loop should look
+    PreviewSink *preview{nullptr};    // binned live images, latest wins
+    std::atomic<unsigned> *saved{nullptr};
+    const volatile std::sig_atomic_t *stop{nullptr};
+};
+
+/*
+ * One camera from configuration to teardown: stream setup and buffer mapping,
+ * its controls, drop detection, frame pool and worker pipeline, and the sink
+ * its frames end up in. The libcamera completion callback only hands requests
+ * to the pipeline, exactly as with a single camera; any number of sessions can
+ * run side by side and share the writer, the encode pool and the main thread.
+ *
+ * Shutdown is split so several sessions can go down in the right order:
+ * stopCapture() on all of them, finish() on all of them, drain the shared
+ * writer, then closeOutputs(). After that, rearm() readies the next run
+ * (--serve) on the same configuration, buffers and frame pool.
+ */
+class CaptureSession
+{
+public:
+    // `label` goes into file names and messages; empty for a lone camera.
+    CaptureSession(std::shared_ptr<libcamera::Camera> camera, unsigned index, const std::string &label,
+                   const CaptureOptions &opt, const CaptureShared &shared);
+    ~CaptureSession();
+
+    CaptureSession(const CaptureSession &) = delete;
+    CaptureSession &operator=(const CaptureSession &) = delete;
+
+    // Acquire and configure the camera, map its buffers and build the pipeline.
+    // False (after saying why) if anything is missing.
+    bool open();
+    // Queue every request and start streaming
+    bool start();
+
+    // Stop handing out requests and stop the camera (cancels what's queued)
+    void stopCapture();
+    // Drain the pipeline and close a pre-trigger burst in progress
+    void finish();
+    // Finalize the SEQ container (or write the dark calibration); call once the
+    // shared writer has drained
+    void closeOutputs();
+
+    // Another run after closeOutputs(): the job's frames/exposure/gain/outdir,
+    // a fresh pipeline, controls and counters; start() again to stream.
+    bool rearm(const CaptureJob &job);
+
+    // --fps as a frame duration, clamped to what we program (≥ 1 ms)
+    static int64_t frameDurationNs(float fps);
+
+    bool done() const { return pipeline_ && pipeline_->retired() >= opt_.frames; }
+    // Frames through the pipeline this run (dropped ones included)
+    uint64_t frames() const { return pipeline_ ? pipeline_->retired() : 0; }
+    // util::monotonicNs() of this run's first completed request (0: none yet)
+    int64_t firstFrameNs() const { return firstFrameNs_.load(std::memory_order_acquire); }
+    // Never delivered by the sensor/ISP, or refused by a full pipeline
+    uint64_t lost() const;
+
+    StatsReporter &reporter() { return *reporter_; }
+    // This run's pipeline and sensor-side drop detector (--soak watches them)
+    const Pipeline &pipeline() const { return *pipeline_; }
+    const DropDetector *drops() const { return drops_.get(); }
+    const std::string &label() const { return label_; }
+    const std::string &seqPath() const { return seqPath_; }
+    bool seqDirect() const { return seqDirect_; }
+
+    // Exit report: stages, drops, pool
+    void report(std::ostream &os) const;
+
+private:
+    bool configure();
+    bool mapBuffers();
+    bool loadCalibration();
+    // Everything a run needs on top of the configured camera. The pool is
+    // allocated by the first run and reused by the rest.
+    bool prepareRun();
+    void buildStages();
+    void onRequestComplete(libcamera::Request *req);
+    void recycle(libcamera::Request *req);
+    // --degrade on a completed frame: false if it was shed instead of submitted
+    bool degrade(Frame &f);
+    // Controls (and a schedule step) onto `req`, then to the camera
+    bool queue(libcamera::Request *req);
+
+    // outdir/imx296_[label_]NNNNNN<ext> in a per-thread string
+    const std::string &pathFor(const Frame &f, const char *ext) const;
+    SeqFrameInfo seqInfo(const Frame &f) const;
+    DngFrameInfo dngInfo(const Frame &f) const;
+    // "label: " in front of messages, when there's more than one camera
+    std::string tag() const { return label_.empty() ? std::string() : label_ + ": "; }
+
+    // One mmap per buffer: addr/len are what munmap needs, which is not where
+    // the plane starts (see mapBuffers()).
+    struct BufferMap
+    {
+        libcamera::FrameBuffer *fb{nullptr};
+        void *addr{nullptr};
+        size_t len{0};
+        util::PlaneView view; // fb->cookie() points here
+    };
+
+    std::shared_ptr<libcamera::Camera> camera_;
+    const unsigned index_;
+    const std::string label_;
+    CaptureOptions opt_; // rearm() changes the per-job fields
+    const CaptureShared shared_;
+
+    bool acquired_{false};
+    bool started_{false};
+    bool connected_{false}; // requestCompleted, once for every run
+    std::unique_ptr<libcamera::CameraConfiguration> config_;
+    libcamera::Stream *stream_{nullptr};
+    std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
+    std::vector<std::unique_ptr<libcamera::Request>> requests_;
+    std::vector<BufferMap> maps_;
+
+    // Geometry: the stream's, then the --roi window inside it
+    size_t packedStride_{0};
+    uint32_t streamW_{0}, streamH_{0};
+    uint32_t outW_{0}, outH_{0};
+    uint32_t winX_{0}, winY_{0};
+    size_t windowOffset_{0};
+    size_t seqBytes_{0};
+    int64_t frameDurationNs_{0};
+    int64_t clockOffsetNs_{0}; // CLOCK_REALTIME - CLOCK_MONOTONIC at open()
+
+    std::unique_ptr<CaptureControls> controls_;
+    // Exposure schedule: the step meant for the frame each request last
+    // returns (+ 1; it carries the one `lead` ahead), indexed by request cookie,
+    // and the lock that keeps steps in queue order
+    std::vector<uint32_t> requestStep_;
+    std::mutex queueMutex_;
+    std::atomic<uint64_t> offSchedule_{0};
+    std::unique_ptr<DropDetector> drops_;
+    std::unique_ptr<DngWriter> dng_;
+    std::unique_ptr<DngWriter> dngPlain_; // --degrade no-compression: dng_ without LJ92
+    // OutputMode samples (and PGM/TIFF output): made in the unpack stage right
+    // behind outHeader_ bytes of room, where the write stage puts the file header
+    bool reduced_{false};
+    size_t outHeader_{0};
+    size_t outBytes_{0};
+    std::string pgmHeader_;
+    std::unique_ptr<Backpressure> backpressure_;
+    bool packedDegrade_{false}; // --degrade raw10p applies to this output
+    uint64_t decimated_{0};     // frames seen while decimating; completion thread only
+    std::unique_ptr<Calibration> calib_;
+    std::unique_ptr<DarkAccumulator> dark_;
+    std::unique_ptr<FramePool> pool_;
+    size_t poolSize_{0};
+    bool needsPixels_{false};
+    std::unique_ptr<Pipeline> pipeline_;
+    std::unique_ptr<StatsReporter> reporter_;
+
+    SeqFileHeader seqHdr_;
+    SeqWriter seq_;
+    std::string seqPath_;
+    bool seqDirect_{false};
+    std::unique_ptr<PreTriggerRing> ring_;
+
+    // Capture is the only thing that happens on libcamera's thread. Once the
+    // target count is reached we stop handing out (and re-queueing) requests.
+    std::atomic<bool> capturing_{true};
+    uint64_t captured_{0}; // touched by the completion thread only
+    std::atomic<int64_t> firstFrameNs_{0};
+    std::atomic<uint64_t> dropsSeen_{0}; // pipeline drops the retire hook has woken main for
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "DngWriter.hpp"
+
+/*
+ * Reads back what DngWriter writes, to check it (gs_convert --verify): a
+ * little-endian TIFF whose first IFD is a 16-bit CFA image in strips or tiles,
+ * uncompressed or lossless JPEG. Not a general DNG reader; anything else is
+ * refused rather than guessed at.
+ */
+struct DngImage
+{
+    uint32_t width{0};
+    uint32_t height{0};
+    std::vector<uint16_t> pixels; // width * height, row-major
+    bool hasRecord{false};        // DNGPrivateData held a gs_cam DngFrameRecord
+    DngFrameRecord record;
+};
+
+class DngReader
+{
+public:
+    // `file` is the whole file (e.g. a util::MappedFile). `out.pixels` is
+    // reused, so a caller decoding frame after frame doesn't allocate.
+    static bool decode(const uint8_t *file, size_t bytes, DngImage &out);
+};
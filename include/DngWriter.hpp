@@ -11,8 +11,10 @@
  * We write a baseline TIFF with DNG tags:
  *  - CFARepeatPatternDim, CFAPattern, CFAPlaneColor
  *  - CFA layout guessed from user-specified mosaic
- *  - BitsPerSample = 16, BlackLevel = 0 (or 64 if your pipeline expects), WhiteLevel = 1023
+ *  - BitsPerSample = 16, BlackLevel = 0 unless calibrated (one value per CFA position), WhiteLevel = 1023
  *  - ColorMatrix (identity-ish placeholder) – acceptable for RAW workflows
+ *  - Per frame: ExposureTime, ISOSpeedRatings, DateTimeOriginal/SubSecTimeOriginal
+ *    (UTC) and DNGPrivateData holding a DngFrameRecord (sensor timestamp, sequence, …)
  */
 
 enum class BayerPattern
@@ -23,24 +25,190 @@ enum class BayerPattern
     GBRG
 };
 
+// "RGGB" etc. (as normalized by util::parseBayer) → enum; unknown strings map to RGGB
+BayerPattern toBayer(const std::string &s);
+
+enum class DngCompression
+{
+    None,        // 16-bit samples as they are
+    LosslessJpeg // Compression = 7: LJ92, one JPEG per tile
+};
+
 struct DngMeta
 {
     uint32_t width{0};
     uint32_t height{0};
     BayerPattern bayer{BayerPattern::RGGB};
     uint16_t bitsPerSample{16};    // we store as 16-bit
-    uint16_t blackLevel{0};        // adjust if you characterize the sensor (often 64–256)
+    uint16_t blackLevel[4]{};      // per CFA position, (y & 1) * 2 + (x & 1); see Calibration
     uint16_t whiteLevel{1023};     // 10-bit max
     float analogGain{1.0f};        // optional metadata
     float exposureSeconds{0.008f}; // optional metadata (8ms default)
     float cfaIlluminant{21.0f};    // D65-ish placeholder
+    // Image layout: one strip by default. rowsPerStrip > 0 → multiple strips;
+    // tileWidth/tileLength > 0 → DNG tiles (rounded up to multiples of 16, and
+    // no bigger than the image rounded the same way).
+    uint32_t rowsPerStrip{0};
+    uint32_t tileWidth{0};
+    uint32_t tileLength{0};
+    // LosslessJpeg always writes tiles: unless set, about kDefaultCompressedTile
+    // square, picked to divide the frame
+    DngCompression compression{DngCompression::None};
+    // Image data starts on a multiple of this (the header is zero-padded up to
+    // it). FramePool::kAlignment lets header + pixels go out as one O_DIRECT write.
+    uint32_t dataAlignment{16};
+    // Reduced outputs (OutputMode), single strip only, 8 or 16 bits: one value
+    // per pixel instead of a mosaic (LinearRaw), or a plain grayscale TIFF
+    // without the DNG tags (the frame record stays)
+    bool mono{false};
+    bool plainTiff{false};
+};
+
+class Calibration;
+
+// Samples to encode: either already-unpacked 16-bit pixels, or the packed RAW10
+// plane, which each strip/tile then unpacks itself on whatever core encodes it.
+// Only for 16-bit DNGs (bitsPerSample 16); the DngSource paths refuse others.
+struct DngSource
+{
+    const uint16_t *pixels{nullptr};
+    size_t pixelStride{0}; // samples per row; 0 = width
+
+    const uint8_t *packed{nullptr};
+    size_t packedStride{0}; // bytes per row
+    size_t packedBytes{0};
+
+    // Packed only: corrected as each row is unpacked. (originX, originY) is where
+    // the image sits in the calibrated frame.
+    const Calibration *calibration{nullptr};
+    uint32_t originX{0}, originY{0};
+};
+
+class ThreadPool;
+
+// Values that change from frame to frame. They are patched into a copy of the
+// prebuilt header, so changing them costs a few stores, not a re-encode.
+struct DngFrameInfo
+{
+    float exposureSeconds{0.0f}; // ExposureTime
+    float analogGain{1.0f};      // ISOSpeedRatings = gain * 100
+    // DNGPrivateData (DngFrameRecord below)
+    int64_t sensorTimestampNs{0};
+    uint64_t sequence{0};
+    uint64_t index{0};
+    uint32_t flags{0}; // FrameFlags
+    uint32_t droppedBefore{0};
+    uint32_t scheduleStep{0};
+    // CLOCK_REALTIME - timestamp clock (util::realtimeOffsetNs()): DateTimeOriginal
+    // is sensorTimestampNs + this. 0 leaves the date blank ("unknown" in EXIF).
+    int64_t clockOffsetNs{0};
+};
+
+// What DNGPrivateData holds: the null-terminated maker name (as DNG asks), then
+// these fields, little-endian. Readers can tell the layout by `version`.
+#pragma pack(push, 1)
+struct DngFrameRecord
+{
+    char maker[8]{'g', 's', '_', 'c', 'a', 'm', 0, 0};
+    uint32_t version{1};
+    uint32_t bytes{56}; // sizeof(DngFrameRecord)
+    int64_t sensorTimestampNs{0}; // SensorTimestamp, CLOCK_MONOTONIC
+    uint64_t sequence{0};         // sensor frame sequence
+    uint64_t index{0};            // file number
+    uint32_t flags{0};            // FrameFlags (DropDetector.hpp)
+    uint32_t droppedBefore{0};
+    uint32_t scheduleStep{0}; // --exposure-schedule step + 1 (0: none)
+    uint8_t reserved[4]{};
 };
+#pragma pack(pop)
+static_assert(sizeof(DngFrameRecord) == 56, "DngFrameRecord layout is part of the file format");
 
 class DngWriter
 {
 public:
+    // Target side of the default compressed tile
+    static constexpr uint32_t kDefaultCompressedTile = 256;
+
+    // Builds the TIFF header + IFD + metadata blob once for this geometry/CFA.
+    explicit DngWriter(const DngMeta &meta);
+
+    const DngMeta &meta() const { return meta_; }
+
+    // Bytes in front of the image data (which starts right after, meta.dataAlignment aligned).
+    size_t headerSize() const { return header_.size(); }
+    size_t pixelBytes() const { return size_t(meta_.width) * meta_.height * (meta_.bitsPerSample / 8); }
+
+    // Strips or tiles the image is stored as
+    bool tiled() const { return tileW_ != 0; }
+    bool compressed() const { return meta_.compression == DngCompression::LosslessJpeg; }
+    size_t pieceCount() const { return pieces_; }
+
+    // Copy the header template into `dst` (headerSize() bytes) and patch in `fi`.
+    void buildHeader(uint8_t *dst, const DngFrameInfo &fi) const;
+
+    // open + one writev (header, strip) + close. Thread-safe; needs no heap after
+    // the first call on each thread.
+    bool writeFrame(const std::string &path, const uint16_t *pixels, const DngFrameInfo &fi) const;
+
+    // Multi-strip / tiled / compressed path: every piece is unpacked (if the source
+    // is packed), encoded (LJ92 if compressed) and pwrite()n as soon as it is ready, spread over `pool` (nullptr:
+    // calling thread only). The header with the final offsets goes out last.
+    // `fileBytes`, if given, receives the size of the file written.
+    bool writeFrame(const std::string &path, const DngSource &src, const DngFrameInfo &fi,
+                    ThreadPool *pool, uint64_t *fileBytes = nullptr) const;
+
+    // Bytes encode() needs for one frame: exact when uncompressed; compressed, the
+    // worst case (tile sizes are only known once they are coded).
+    size_t encodedSize() const;
+
+    // Encode one frame into caller memory (a network buffer, a ring slot, …):
+    // the same pieces and header as writeFrame(), without a file in between.
+    // Uncompressed pieces are unpacked straight to where they go in dst.
+    // Returns the bytes used, or 0 if the source is incomplete or dst is too
+    // small (encodedSize() always fits). Thread-safe.
+    size_t encode(const DngSource &src, const DngFrameInfo &fi, uint8_t *dst, size_t dstSize,
+                  ThreadPool *pool = nullptr) const;
+
+    // One-off helpers: build the header and write a single frame using meta's exposure/gain.
     // Writes 16-bit little-endian Bayer samples line-packed
     static bool write(const std::string &path,
                       const DngMeta &meta,
                       const std::vector<uint16_t> &pixels /* size = w*h */);
+
+    // Same, from caller-owned storage: h rows of w samples, `pixelStride` apart (0 = w)
+    static bool write(const std::string &path,
+                      const DngMeta &meta,
+                      const uint16_t *pixels,
+                      size_t pixelStride = 0);
+
+private:
+    bool sourceOk(const DngSource &src) const;
+    // Rows in piece i (tiles: always tileH_, padding included)
+    uint32_t pieceRows(size_t i) const;
+    // Gather, encode and place every piece, spread over `pool`. target(off, bytes)
+    // may return where an uncompressed piece can be unpacked in place; everything
+    // else goes to put(data, bytes, off). Patches the piece table in `hdr` and
+    // returns the end of the data, or 0 on failure.
+    template <typename Target, typename Put>
+    uint64_t encodePieces(const DngSource &src, uint8_t *hdr, ThreadPool *pool, Target &&target,
+                          Put &&put) const;
+
+    // Produce piece i's samples (strip: width × rows; tile: tileW_ × tileH_) into dst
+    void gatherPiece(const DngSource &src, size_t i, uint16_t *dst, uint32_t &rows) const;
+
+    DngMeta meta_;
+    std::vector<uint8_t> header_;
+    // Where the per-frame values live inside header_
+    uint32_t exposureOff_{0};
+    uint32_t isoOff_{0};
+    uint32_t dateOff_{0};
+    uint32_t subSecOff_{0};
+    uint32_t recordOff_{0};
+    // Layout: pieces are strips of stripRows_ or tiles of tileW_ × tileH_
+    uint32_t stripRows_{0};
+    uint32_t tileW_{0}, tileH_{0};
+    uint32_t tilesAcross_{1};
+    size_t pieces_{1};
+    uint32_t offsetsOff_{0}; // StripOffsets / TileOffsets values
+    uint32_t countsOff_{0};  // StripByteCounts / TileByteCounts values
 };
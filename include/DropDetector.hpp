@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "LatencyHistogram.hpp"
+
+// Frame::flags / SeqFrameHeader::flags bits
+enum FrameFlags : uint32_t
+{
+    FrameDropBefore = 1u << 0, // sensor frames went missing right before this one
+    FrameOffInterval = 1u << 1, // arrived further from the expected frame time than the tolerance
+    FrameOffSchedule = 1u << 2  // metadata exposure/gain match no schedule step
+};
+
+/*
+ * Watches the sensor's frame sequence numbers and timestamps as requests
+ * complete, so a frame that never reached us is counted instead of silently
+ * closing up the file numbering.
+ *
+ * Gaps come from FrameBuffer::metadata().sequence, which the driver increments
+ * for every frame the sensor produced, delivered or not. Timing is checked
+ * against the configured frame duration: the SensorTimestamp delta should be
+ * (sequence delta) × interval, and the error goes into a jitter histogram.
+ *
+ * observe() must be called from one thread (the completion callback); the
+ * counters can be read from anywhere.
+ */
+class DropDetector
+{
+public:
+    struct Result
+    {
+        uint32_t dropsBefore{0}; // frames missing between the previous one and this one
+        uint32_t flags{0};       // FrameFlags
+    };
+
+    // frameIntervalNs: the FrameDurationLimits we asked for (0 = check sequence
+    // numbers only). Frames further than `tolerance` × interval from where they
+    // should be are flagged FrameOffInterval.
+    explicit DropDetector(int64_t frameIntervalNs, double tolerance = 0.25);
+
+    Result observe(uint64_t sequence, int64_t sensorTimestampNs);
+
+    uint64_t frames() const { return frames_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t gaps() const { return gaps_.load(std::memory_order_relaxed); }
+    uint64_t offInterval() const { return offInterval_.load(std::memory_order_relaxed); }
+    int64_t intervalNs() const { return intervalNs_; }
+
+    // |actual - expected| frame time
+    LatencyHistogram::Summary jitter() const { return jitter_.summary(); }
+
+private:
+    static void bump(std::atomic<uint64_t> &c, uint64_t n = 1)
+    {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); // single writer
+    }
+
+    const int64_t intervalNs_;
+    const int64_t toleranceNs_;
+    bool have_{false};
+    uint64_t lastSequence_{0};
+    int64_t lastTimestampNs_{0};
+
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> gaps_{0};
+    std::atomic<uint64_t> offInterval_{0};
+    LatencyHistogram jitter_;
+};
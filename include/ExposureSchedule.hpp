@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * A per-frame exposure/gain sequence that repeats for the whole capture
+ * (exposure brackets, HDR stacks, gain sweeps). Steps are put on requests as
+ * they're queued, a fixed lead ahead of the frame they're meant for
+ * (CaptureControls::bindNext()), and each frame is tagged with the step its
+ * metadata shows.
+ *
+ * Spec: "US[:GAIN],US[:GAIN],..." or "@FILE" with one "US [GAIN]" per line
+ * ('#' starts a comment). A step without a gain uses `defaultGain`.
+ */
+struct ExposureStep
+{
+    int32_t exposureUs{0};
+    float gain{1.0f};
+};
+
+class ExposureSchedule
+{
+public:
+    // False (after saying why) on a bad spec or an unreadable file
+    bool parse(const std::string &spec, float defaultGain);
+
+    bool empty() const { return steps_.empty(); }
+    size_t size() const { return steps_.size(); }
+    const std::vector<ExposureStep> &steps() const { return steps_; }
+    int32_t maxExposureUs() const;
+
+private:
+    bool parseStep(const std::string &text, const char *sep, float defaultGain);
+
+    std::vector<ExposureStep> steps_;
+};
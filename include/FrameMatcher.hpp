@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "LatencyHistogram.hpp"
+
+/*
+ * Pairs frames from several cameras into matched sets by SensorTimestamp.
+ *
+ * Each camera reports its frames in order with add(). A frame joins the open
+ * set whose first frame started within `toleranceNs` of it (and doesn't have
+ * one from this camera yet), otherwise it opens a new set. Set ids count up in
+ * time order, so they make a common file number: every camera's frame from the
+ * same moment gets the same one, even after one of them dropped a frame.
+ *
+ * A set is complete when every camera is in; its skew (latest minus earliest
+ * start) goes into a histogram. A set that can no longer complete (every
+ * camera it's missing has moved past it) is counted as incomplete.
+ */
+class FrameMatcher
+{
+public:
+    struct Stats
+    {
+        uint64_t matched{0};
+        uint64_t incomplete{0};
+        int64_t lastSkewNs{0};
+        LatencyHistogram::Summary skew;
+    };
+
+    FrameMatcher(unsigned cameras, int64_t toleranceNs);
+
+    // Thread-safe. Returns the id of the set this frame belongs to.
+    uint64_t add(unsigned camera, int64_t timestampNs);
+
+    unsigned cameras() const { return cameras_; }
+    Stats stats() const;
+    // Forget every set and count, ids from 0 again (the next --serve job)
+    void reset();
+
+private:
+    struct Set
+    {
+        uint64_t id{0};
+        int64_t firstNs{0};
+        int64_t minNs{0};
+        int64_t maxNs{0};
+        uint32_t have{0}; // bit per camera
+    };
+
+    // mu_ held: retire sets that are complete or can't be completed any more
+    void expire();
+
+    const unsigned cameras_;
+    const int64_t toleranceNs_;
+    const uint32_t all_;
+
+    mutable std::mutex mu_;
+    std::deque<Set> open_;
+    std::vector<int64_t> lastNs_; // latest start seen per camera
+    uint64_t nextId_{0};
+    uint64_t matched_{0};
+    uint64_t incomplete_{0};
+    int64_t lastSkewNs_{0};
+    LatencyHistogram skew_;
+};
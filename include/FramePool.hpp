@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+ * Preallocated, reusable pixel buffers for the pipeline.
+ *
+ * All buffers are allocated (page-aligned, never zero-filled) when the pool is
+ * built from the stream geometry, so after start-up leasing is a free-list pop.
+ * If every buffer is out, lease() allocates one more rather than stalling the
+ * camera; that shows up as a miss in stats(), which should stay at 0 once the
+ * pool is sized right.
+ *
+ * `headroomBytes` reserves space in front of the pixels (data() starts that far
+ * into the allocation, base() at its start), e.g. for a file header, so header
+ * and pixels can go out as one aligned write.
+ */
+
+class FramePool;
+
+// Move-only lease on one pool buffer; goes back to the pool when destroyed.
+class PixelBuffer
+{
+public:
+    PixelBuffer() = default;
+    ~PixelBuffer() { reset(); }
+
+    PixelBuffer(PixelBuffer &&o) noexcept { *this = std::move(o); }
+    PixelBuffer &operator=(PixelBuffer &&o) noexcept;
+    PixelBuffer(const PixelBuffer &) = delete;
+    PixelBuffer &operator=(const PixelBuffer &) = delete;
+
+    uint16_t *data() { return data_; }
+    const uint16_t *data() const { return data_; }
+    size_t size() const { return size_; } // in pixels
+    // Start of the allocation: the pool's headroom, then data()
+    uint8_t *base() { return base_; }
+    explicit operator bool() const { return data_ != nullptr; }
+
+    // Return the buffer early
+    void reset();
+
+private:
+    friend class FramePool;
+    FramePool *pool_{nullptr};
+    uint32_t slot_{0};
+    uint8_t *base_{nullptr};
+    uint16_t *data_{nullptr};
+    size_t size_{0};
+};
+
+class FramePool
+{
+public:
+    struct Stats
+    {
+        size_t buffers{0};  // allocated so far (initial + misses)
+        size_t inUse{0};
+        size_t maxInUse{0};
+        uint64_t leases{0};
+        uint64_t misses{0}; // leases that had to allocate
+    };
+
+    static constexpr size_t kAlignment = 4096;
+
+    FramePool(size_t buffers, size_t pixelsPerBuffer, size_t headroomBytes = 0);
+    ~FramePool();
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    // Thread-safe. Returns an empty PixelBuffer only if allocation itself fails.
+    PixelBuffer lease();
+
+    size_t pixelsPerBuffer() const { return pixels_; }
+    size_t headroomBytes() const { return headroom_; }
+    // Allocation size: headroom + pixels, rounded up to kAlignment
+    size_t bufferBytes() const;
+    Stats stats() const;
+
+private:
+    friend class PixelBuffer;
+    void giveBack(uint32_t slot);
+    uint8_t *allocate() const;
+
+    const size_t pixels_;
+    const size_t headroom_;
+    mutable std::mutex m_;
+    std::vector<uint8_t *> slots_;
+    std::vector<uint32_t> free_;
+    Stats stats_;
+};
@@ -32,4 +32,16 @@ struct Imx296Defaults
 
     // If you’re streaming to disk, a modest queue helps avoid backpressure.
     static inline unsigned defaultBufferCount() { return 8; }
+
+    // Pipeline threads: unpack workers and encode/write workers.
+    static inline unsigned defaultWorkerCount() { return 2; }
+    static inline unsigned defaultWriterCount() { return 1; }
+
+    // Frames between the request an exposure/gain rides on and the frame it shows
+    // up in: the Raspberry Pi pipeline delays sensor controls (DelayedControls)
+    // by the IMX296 helper's exposure delay. Override with --schedule-lead.
+    static inline unsigned defaultScheduleLead() { return 2; }
+
+    // Frames that may wait between pipeline stages before unpack blocks.
+    static inline unsigned defaultQueueDepth() { return 4; }
 };
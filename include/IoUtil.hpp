@@ -0,0 +1,70 @@
+#pragma once
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+/*
+ * Small POSIX I/O and clock helpers shared by the file writers and the
+ * pipeline. No libcamera here, so the offline tools can use them too.
+ */
+
+namespace util
+{
+
+    // CLOCK_MONOTONIC in ns: the clock V4L2/libcamera buffer and sensor timestamps use
+    inline int64_t monotonicNs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    // CLOCK_REALTIME - CLOCK_MONOTONIC right now: added to a sensor timestamp it
+    // gives wall-clock time. Read between two monotonic samples, so it's good to
+    // well under a microsecond.
+    inline int64_t realtimeOffsetNs()
+    {
+        timespec a, r, b;
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        clock_gettime(CLOCK_REALTIME, &r);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        const int64_t mono = (int64_t(a.tv_sec) + int64_t(b.tv_sec)) * 500000000 + (a.tv_nsec + b.tv_nsec) / 2;
+        return int64_t(r.tv_sec) * 1000000000 + r.tv_nsec - mono;
+    }
+
+    // writev() until every byte went out; copes with short writes and IOV_MAX.
+    // `iov` is consumed (advanced in place). Returns false on error.
+    bool writevAll(int fd, struct iovec *iov, int iovcnt);
+
+    // pwrite()/pread() the whole range at `offset`; false on error or EOF.
+    bool pwriteAll(int fd, const void *buf, size_t len, uint64_t offset);
+    bool preadAll(int fd, void *buf, size_t len, uint64_t offset);
+
+    // Create/truncate `path` and write `bytes` from `data` with a single write path (no iostreams).
+    bool writeFile(const char *path, const void *data, size_t bytes);
+
+    // Read-only mapping of a whole file, for readers that want frames in place
+    // instead of a pread() into a buffer each. Unmapped on destruction.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        bool open(const char *path);
+        // Maps an fd the caller keeps open (and closes)
+        bool map(int fd);
+
+        const uint8_t *data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        const uint8_t *data_{nullptr};
+        size_t size_{0};
+    };
+
+} // namespace util
@@ -0,0 +1,67 @@
+#pragma once
+#include <csignal>
+#include <string>
+
+#include "Wakeup.hpp"
+
+// One capture run asked for over the --serve socket. Zero/empty fields keep
+// what the command line said.
+struct CaptureJob
+{
+    unsigned frames{0};
+    int exposureUs{0};
+    float analogueGain{0.0f};
+    std::string outDir;
+};
+
+/*
+ * --serve: gs_cam stays up with every camera configured, its buffers mapped
+ * and its pools allocated, and takes capture jobs over a Unix socket, so a
+ * burst costs a camera start instead of a whole process start-up.
+ *
+ * One client at a time, one line per job:
+ *
+ *   capture [frames=N] [exposure-us=US] [gain=X.Y] [outdir=DIR]
+ *   quit
+ *
+ * and the reply is the run's report, ending in a line that starts with "ok"
+ * or "error". e.g. echo "capture frames=50" | socat - UNIX-CONNECT:/run/gs_cam.sock
+ */
+class JobServer
+{
+public:
+    enum class Next
+    {
+        Job,  // `job` holds the request; reply() when it's done
+        Quit, // a client asked us to exit
+        Stop  // SIGINT/SIGTERM
+    };
+
+    JobServer() = default;
+    ~JobServer();
+
+    JobServer(const JobServer &) = delete;
+    JobServer &operator=(const JobServer &) = delete;
+
+    // Replaces a stale socket file at `path` (one nobody listens on)
+    bool listen(const std::string &path);
+    const std::string &path() const { return path_; }
+
+    // Sleep until a client sends a job, or `stop` is set (`wakeup` rings for
+    // it). Malformed lines are answered here and waited past.
+    Next next(CaptureJob &job, const Wakeup &wakeup, const volatile std::sig_atomic_t *stop);
+
+    // Answer the current client and hang up
+    void reply(const std::string &text);
+
+    // "capture frames=…" → job; false (and why, in `error`) if it isn't one
+    static bool parse(const std::string &line, CaptureJob &job, bool &quit, std::string &error);
+
+private:
+    // A line from a freshly accepted client, within a few seconds, or empty
+    std::string readLine(int fd) const;
+
+    int listenFd_{-1};
+    int clientFd_{-1};
+    std::string path_;
+};
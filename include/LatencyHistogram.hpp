@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free latency histogram for the capture path.
+ *
+ * Buckets are log-linear: 8 per power of two, so any recorded value is known to
+ * within 12.5%, from 1 ns to hours, in a fixed 4 KB of counters. record() is a
+ * couple of relaxed atomic adds and can be called from any number of threads;
+ * summary() may run concurrently and sees a slightly fuzzy but consistent view.
+ */
+class LatencyHistogram
+{
+    static constexpr int kSubBits = 3;
+    static constexpr int kSub = 1 << kSubBits;
+    static constexpr int kBuckets = (64 - kSubBits + 1) * kSub;
+
+public:
+    struct Summary
+    {
+        uint64_t count{0};
+        uint64_t p50{0}; // ns, upper edge of the bucket holding the percentile
+        uint64_t p99{0};
+        uint64_t max{0}; // exact
+        double mean{0.0};
+    };
+
+    // The counts at one moment, for a summary of what came after it
+    struct Snapshot
+    {
+        uint64_t buckets[kBuckets]{};
+        uint64_t sum{0};
+    };
+
+    void record(uint64_t ns);
+    Summary summary() const;
+    // Only what was recorded since `since` was taken; `now` (may be `since`
+    // itself) gets the current counts for the next window. The max is the
+    // bucket edge, not exact.
+    Summary summary(const Snapshot &since, Snapshot *now) const;
+    // Back to empty; not while anyone records
+    void reset();
+
+private:
+    static Summary summarize(const uint64_t *counts, uint64_t total, uint64_t sum, uint64_t max);
+    static int bucketOf(uint64_t v);
+    static uint64_t bucketTop(int b);
+
+    std::atomic<uint64_t> buckets_[kBuckets]{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Lossless JPEG (ITU T.81 process 14, "LJ92") encoder for CFA data, the way DNG
+ * stores compressed raw tiles (Compression = 7).
+ *
+ * A w×h Bayer tile is coded as a (w/2)×h image with two interleaved components,
+ * so component 0 holds the even columns and component 1 the odd ones. With
+ * predictor 1 (left neighbour) every sample is then predicted from the nearest
+ * sample of the same colour instead of its neighbour through the CFA, which is
+ * what keeps the differences small. Predictor 1 is also the only one every raw
+ * reader we care about decodes.
+ *
+ * Huffman tables are optimal per tile: one pass collects the difference
+ * categories, a second one emits the codes. Both are table lookups plus a clz,
+ * and the bit writer flushes 32 bits at a time.
+ *
+ * decode() reads it back (gs_convert --verify): any single-scan predictor-1
+ * stream, components interleaved, which covers what encode() writes.
+ */
+
+namespace util
+{
+    namespace ljpeg
+    {
+
+        // Worst case for encode() (every sample needing 31 bits, fully byte-stuffed)
+        size_t maxEncodedSize(uint32_t width, uint32_t height);
+
+        // Encode `height` rows of `width` samples, `stride` samples apart. `width`
+        // must be even; `precision` is the JPEG sample precision (2..16).
+        // Returns the number of bytes written to dst, or 0 if the input is not
+        // encodable or dst is too small.
+        size_t encode(const uint16_t *src, uint32_t width, uint32_t height, size_t stride,
+                      uint8_t precision, uint8_t *dst, size_t dstSize);
+
+        // Decode into `height` rows of `width` samples (columns × components, as
+        // encode() took them), `stride` samples apart. False if the stream is
+        // malformed, uses anything but predictor 1, or isn't that size.
+        bool decode(const uint8_t *src, size_t bytes, uint16_t *dst, uint32_t width, uint32_t height,
+                    size_t stride);
+
+    } // namespace ljpeg
+} // namespace util
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Calibration;
+
+/*
+ * Reduced outputs for jobs that don't need every 16-bit Bayer sample:
+ *
+ *   --bin sum|avg        each 2x2 CFA quad becomes one value (12-bit sum or
+ *                        10-bit mean): a half-size luminance image
+ *   --channel R|Gr|Gb|B  one CFA position of every quad, half size
+ *   --bits 8[:SHIFT]     8-bit samples: value >> SHIFT (default: the top 8
+ *                        bits), saturating; --lut FILE maps values instead
+ *
+ * reduce() makes them straight from the packed plane, one output row at a time:
+ * the selected unpack kernel turns the one or two lines it needs into 16-bit
+ * samples in a per-thread scratch, calibration corrects them there (as in
+ * Calibration::unpack()), and raw10::rowOps() combine and narrow them while they
+ * are still in L1. The full 16-bit frame is never written to memory, and what
+ * is written is 1/2 (8-bit), 1/4 (binned) or 1/8 (both) of it.
+ */
+class OutputMode
+{
+public:
+    enum class Spatial
+    {
+        Full,
+        BinSum,     // 2x2 sum, 0..4092
+        BinAverage, // 2x2 mean, 0..1023
+        Channel     // one CFA position, 0..1023
+    };
+
+    // Each false (after saying why) on a bad value
+    bool setBin(const std::string &how);
+    // R/Gr/Gb/B need the mosaic (util::parseBayer form); TL/TR/BL/BR don't
+    bool setChannel(const std::string &name, const std::string &bayer);
+    bool setBits(const std::string &spec);
+    // Text, one 0..255 output per line for inputs 0, 1, …; '#' starts a comment.
+    // Missing entries repeat the last one. Implies 8 bits.
+    bool loadLut(const std::string &path);
+
+    Spatial spatial() const { return spatial_; }
+    unsigned bits() const { return bits_; }
+    // Anything but full-size 16-bit samples
+    bool reduces() const { return spatial_ != Spatial::Full || bits_ != 16; }
+    // One value per output pixel rather than a mosaic
+    bool mono() const { return spatial_ != Spatial::Full; }
+    // "2x2 mean, 8-bit (>> 2)" etc., for the start-up line
+    std::string describe() const;
+
+    uint32_t width(uint32_t inW) const { return spatial_ == Spatial::Full ? inW : inW / 2; }
+    uint32_t height(uint32_t inH) const { return spatial_ == Spatial::Full ? inH : inH / 2; }
+    size_t bytes(uint32_t inW, uint32_t inH) const { return size_t(width(inW)) * height(inH) * (bits_ / 8); }
+
+    // What a value (or black level) from the sensor's 10 bits ends up as
+    uint16_t whiteLevel() const;
+    // Output black level(s) from the four CFA ones: per position when Full,
+    // otherwise all four the same
+    void blackLevels(const uint16_t in[4], uint16_t out[4]) const;
+
+    // `height` lines of `width` pixels, `stride` bytes apart (0: no padding),
+    // to width()×height() samples in dst: little-endian 16-bit unless
+    // `bigEndian` (PGM), or bytes. (x0, y0): the window's place in the
+    // calibrated frame, even for binned/channel output. Bounds-checked like
+    // raw10::unpack(); thread-safe.
+    bool reduce(const uint8_t *src, size_t srcBytes, size_t stride, uint32_t width, uint32_t height,
+                uint8_t *dst, size_t dstBytes, bool bigEndian = false, const Calibration *cal = nullptr,
+                uint32_t x0 = 0, uint32_t y0 = 0) const;
+
+private:
+    // Largest value the spatial step produces
+    uint32_t maxValue() const { return spatial_ == Spatial::BinSum ? 4 * 1023 : 1023; }
+    // 8-bit without a LUT: how far values move down
+    unsigned shift() const { return shift_ >= 0 ? unsigned(shift_) : (maxValue() > 1023 ? 4 : 2); }
+    uint16_t narrow(uint32_t v) const;
+
+    Spatial spatial_{Spatial::Full};
+    unsigned channel_{0}; // CFA position: (y & 1) * 2 + (x & 1)
+    unsigned bits_{16};
+    int shift_{-1}; // 8-bit: < 0 keeps the top 8 bits of maxValue()
+    std::vector<uint8_t> lut_;
+};
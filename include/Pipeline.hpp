@@ -0,0 +1,188 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.hpp"
+#include "FramePool.hpp"
+#include "LatencyHistogram.hpp"
+
+namespace libcamera
+{
+    class FrameBuffer;
+    class Request;
+}
+
+/*
+ * One captured frame travelling through the pipeline.
+ * While `request` is set we still own the camera buffer behind `buffer`;
+ * Pipeline::release() hands it back and clears both pointers.
+ */
+struct Frame
+{
+    libcamera::Request *request{nullptr};
+    const libcamera::FrameBuffer *buffer{nullptr};
+    uint64_t index{0}; // output file number
+    // From the completed request's metadata
+    uint64_t sequence{0};
+    int64_t sensorTimestampNs{0};
+    int32_t exposureUs{0};
+    float analogueGain{0.0f};
+    // --exposure-schedule step + 1 the metadata shows (0: no schedule)
+    uint32_t scheduleStep{0};
+    // From the DropDetector: sensor frames missing right before this one, FrameFlags
+    uint32_t dropsBefore{0};
+    uint32_t flags{0};
+    // util::monotonicNs() when the request completed; submit() fills it in if 0
+    int64_t completedNs{0};
+    // Set by a stage that wrote the frame out; added to that stage's byte count
+    uint64_t bytesWritten{0};
+    // --degrade, decided at completion: write it packed (.r10p) / uncompressed
+    bool writePacked{false};
+    bool uncompressed{false};
+    PixelBuffer pixels; // leased from the FramePool by whichever stage needs it
+};
+
+/*
+ * capture → stage 0 → stage 1 → … worker pipeline.
+ *
+ * The libcamera completion callback only calls submit(), which never blocks;
+ * the real work (unpack, encode, write) runs on each stage's worker threads.
+ * Stages are connected by bounded queues, so a slow stage backs up into the
+ * previous one instead of growing memory without limit.
+ */
+class Pipeline
+{
+public:
+    // Returns false to drop the frame (it is released and counted as failed).
+    using StageFn = std::function<bool(Frame &)>;
+    // Called exactly once per submitted request, from whichever thread releases it.
+    using RecycleFn = std::function<void(libcamera::Request *)>;
+    // Called with the new retired() count each time a frame leaves the pipeline.
+    using RetireFn = std::function<void(uint64_t)>;
+    // Called first thing on every worker thread: its stage and number within it.
+    using ThreadInitFn = std::function<void(const std::string &stage, unsigned worker)>;
+
+    struct StageStats
+    {
+        std::string name;
+        size_t depth{0};    // frames waiting right now
+        size_t maxDepth{0}; // high-water mark since start()
+        size_t capacity{0};
+        uint64_t processed{0};
+        uint64_t failed{0};
+        uint64_t allocs{0}; // heap allocations inside this stage after warm-up
+        uint64_t bytes{0};  // Frame::bytesWritten summed
+        LatencyHistogram::Summary done;    // request completion → this stage finished the frame
+        LatencyHistogram::Summary service; // time spent inside the stage function
+    };
+
+    explicit Pipeline(RecycleFn recycle);
+    ~Pipeline();
+
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    // Configure before start(). Stages run in the order they are added.
+    void addStage(const std::string &name, unsigned workers, size_t capacity, StageFn fn);
+
+    // Frames with index < n are warm-up: their heap allocations aren't counted
+    // in StageStats::allocs (thread-local caches, first file opens, etc.).
+    void setWarmupFrames(uint64_t n) { warmup_ = n; }
+
+    // Configure before start(). Runs on whichever thread retired the frame
+    // (a worker, or the camera thread for drops), so keep it short.
+    void setRetireHook(RetireFn fn) { onRetire_ = std::move(fn); }
+
+    // Configure before start(), e.g. to pin workers (ThreadPlacement)
+    void setThreadInit(ThreadInitFn fn) { onThreadInit_ = std::move(fn); }
+
+    bool start();
+
+    // Hand a frame to the first stage. Safe from the camera thread: never blocks.
+    // Returns false if the first queue is full or closed (the frame is released).
+    bool submit(Frame &&f);
+
+    // Give the camera buffer back early, e.g. once its bytes have been copied out.
+    void release(Frame &f);
+
+    // Let a frame go on purpose (--degrade): released and retired, counted in
+    // shed() rather than dropped(). Any thread.
+    void shed(Frame &f);
+    // Shed the longest-waiting frames until the first queue holds at most `keep`;
+    // returns how many went
+    size_t shedOldest(size_t keep);
+
+    // Stop accepting frames, drain every queue in order and join all workers.
+    void finish();
+
+    // Frames that left the pipeline (written, failed or dropped).
+    uint64_t retired() const { return retired_.load(std::memory_order_acquire); }
+    // Frames handed to submit(), and those it had to drop because the first queue was full
+    uint64_t submitted() const { return submitted_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t shedCount() const { return shed_.load(std::memory_order_relaxed); }
+
+    // Backpressure signals: how full the fullest stage queue is (0..1), and
+    // completion → last stage done, smoothed over the last few frames
+    double fill() const;
+    size_t frontCapacity() const { return stages_.empty() ? 0 : stages_.front()->queue.capacity(); }
+    int64_t writerLatencyNs() const { return writerLatency_.load(std::memory_order_relaxed); }
+
+    // SensorTimestamp (start of the frame on the sensor) → request completion
+    LatencyHistogram::Summary sensorLatency() const { return sensorLatency_.summary(); }
+    // Request completion → the request given back to the camera (release())
+    LatencyHistogram::Summary requeueLatency() const { return requeueLatency_.summary(); }
+
+    std::vector<StageStats> stats() const;
+
+    // Where the last stats(window) call left off, per stage
+    struct Window
+    {
+        std::vector<LatencyHistogram::Snapshot> done, service;
+    };
+    // As stats(), but done/service only cover frames since the last call with
+    // this window (since start() on the first); counters stay cumulative
+    std::vector<StageStats> stats(Window &window) const;
+
+private:
+    struct Stage
+    {
+        std::string name;
+        StageFn fn;
+        unsigned workers{1};
+        BoundedQueue<Frame> queue;
+        std::vector<std::thread> threads;
+        std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> failed{0};
+        std::atomic<uint64_t> allocs{0};
+        std::atomic<uint64_t> bytes{0};
+        LatencyHistogram done;
+        LatencyHistogram service;
+
+        Stage(const std::string &n, unsigned w, size_t cap, StageFn f)
+            : name(n), fn(std::move(f)), workers(w ? w : 1), queue(cap) {}
+    };
+
+    void run(size_t stageIdx, unsigned worker);
+    void retire(Frame &f);
+
+    RecycleFn recycle_;
+    RetireFn onRetire_;
+    ThreadInitFn onThreadInit_;
+    std::vector<std::unique_ptr<Stage>> stages_;
+    std::atomic<uint64_t> retired_{0};
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> shed_{0};
+    std::atomic<int64_t> writerLatency_{0};
+    LatencyHistogram sensorLatency_;
+    LatencyHistogram requeueLatency_;
+    uint64_t warmup_{0};
+    bool started_{false};
+    bool finished_{false};
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AsyncWriter.hpp"
+#include "FramePool.hpp"
+#include "SeqFile.hpp"
+
+/*
+ * Pre-trigger capture: the camera runs continuously and only the last
+ * `preFrames` frames are kept, in RAM, with no disk I/O at all. Each one sits in
+ * a pool buffer already laid out as a .gsq record (header space, then the packed
+ * RAW10 payload), so RAM holds 1.25 bytes per pixel and a flush is just a write.
+ *
+ * On a trigger the whole ring goes into a new container, followed by the next
+ * `postFrames` frames as they arrive. Everything is written through the
+ * AsyncWriter, which needs room for at least preFrames + 1 writes (main raises
+ * --write-depth to that): the flush then queues without waiting, and the
+ * post-trigger frames behind it aren't held up. Another trigger during a burst
+ * extends it to `postFrames` from then on. Once a burst is complete its
+ * container is closed the next time nothing is in flight; a new burst doesn't
+ * wait for that.
+ *
+ * Not thread-safe: push() from one thread (a single-worker pipeline stage).
+ */
+class PreTriggerRing
+{
+public:
+    PreTriggerRing(size_t preFrames, size_t postFrames, const SeqFileHeader &hdr, const std::string &outDir,
+                   AsyncWriter &writer);
+    ~PreTriggerRing();
+
+    PreTriggerRing(const PreTriggerRing &) = delete;
+    PreTriggerRing &operator=(const PreTriggerRing &) = delete;
+
+    // Pool buffers must hold this many bytes: one record for a stride × height payload
+    static size_t recordBytes(const SeqFileHeader &hdr)
+    {
+        return AsyncWriter::padded(sizeof(SeqFrameHeader) + size_t(hdr.stride) * hdr.height);
+    }
+    // Where the packed payload goes inside a record buffer
+    static uint8_t *payload(PixelBuffer &record) { return record.base() + sizeof(SeqFrameHeader); }
+
+    // One frame, its payload already copied to payload(record). `triggers`: how
+    // many fired since the previous frame. False if a burst couldn't be written.
+    bool push(PixelBuffer &&record, const SeqFrameInfo &info, unsigned triggers);
+
+    // Close the burst in progress (if any), waiting for its writes
+    bool finish();
+
+    bool bursting() const { return remaining_ > 0; }
+    uint64_t bursts() const { return bursts_; }
+    uint64_t framesWritten() const { return written_; }
+    uint64_t bytesQueued() const { return bytes_; }
+    const std::string &lastPath() const { return path_; }
+
+private:
+    struct Slot
+    {
+        PixelBuffer record;
+        SeqFrameInfo info;
+    };
+
+    bool startBurst();
+    bool write(PixelBuffer &&record, const SeqFrameInfo &info);
+    // Writer idle: close the finished burst and any left from earlier ones
+    bool closeLanded();
+
+    std::vector<Slot> ring_;
+    size_t head_{0}; // oldest frame
+    size_t count_{0};
+    const size_t post_;
+    size_t remaining_{0}; // frames still to write in this burst
+
+    SeqFileHeader hdr_;
+    std::string outDir_;
+    AsyncWriter &writer_;
+    struct Closing
+    {
+        std::unique_ptr<SeqWriter> seq;
+        std::string path;
+    };
+    std::unique_ptr<SeqWriter> seq_; // open while a burst is written or closing
+    std::string path_;
+    std::vector<Closing> closing_; // done, but their writes may still be landing
+    uint64_t bursts_{0};
+    uint64_t written_{0};
+    uint64_t bytes_{0};
+};
@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Wakeup.hpp"
+
+/*
+ * Live preview for aiming and focusing while a recording runs: small 8-bit
+ * images (see util::raw10::bin2x2To8) streamed to any number of TCP clients.
+ *
+ * Each camera has a triple buffer. The capture side fills frameBuffer() and
+ * calls publish(), which only swaps two pointers under a short lock; a sender
+ * thread picks up whichever image is newest and pushes it out on non-blocking
+ * sockets. A client still busy with an older image skips the ones in between
+ * (latest frame wins), so neither a slow nor a stalled viewer can ever hold
+ * up capture.
+ *
+ * On the wire, per image: PreviewHeader, then width*height 8-bit samples.
+ */
+
+#pragma pack(push, 1)
+struct PreviewHeader
+{
+    char magic[4]{'G', 'S', 'P', 'V'};
+    uint16_t version{1};
+    uint16_t camera{0};       // --camera order
+    uint32_t width{0};
+    uint32_t height{0};
+    uint64_t index{0};        // output file number (matched set with several cameras)
+    int64_t timestampNs{0};   // SensorTimestamp
+    uint32_t payloadBytes{0}; // width * height, right behind this header
+    uint32_t reserved{0};
+};
+#pragma pack(pop)
+
+static_assert(sizeof(PreviewHeader) == 40, "PreviewHeader is a wire format");
+
+class PreviewSink
+{
+public:
+    struct Stats
+    {
+        uint64_t published{0};
+        uint64_t sent{0};    // images that reached a client (one per client)
+        uint64_t skipped{0}; // images a busy client never saw
+        unsigned clients{0};
+    };
+
+    static constexpr unsigned kMaxClients = 8;
+
+    explicit PreviewSink(unsigned cameras);
+    ~PreviewSink();
+
+    PreviewSink(const PreviewSink &) = delete;
+    PreviewSink &operator=(const PreviewSink &) = delete;
+
+    // "PORT" or "ADDR:PORT" (default address: every interface). Starts the
+    // sender thread; false (after saying why) if the socket can't be set up.
+    bool listen(const std::string &spec);
+
+    // Where the next image for `camera` goes: width*height bytes, valid until
+    // publish(). One producer per camera.
+    uint8_t *frameBuffer(unsigned camera, uint32_t width, uint32_t height);
+    // Make that image the camera's latest. Never blocks on the network.
+    void publish(unsigned camera, uint64_t index, int64_t timestampNs);
+
+    const std::string &endpoint() const { return endpoint_; }
+    Stats stats() const;
+
+private:
+    struct Image
+    {
+        PreviewHeader hdr;
+        std::vector<uint8_t> pixels;
+    };
+
+    // back: being filled; ready: newest published; sending: the sender's copy
+    struct Slot
+    {
+        Image images[3];
+        Image *back{&images[0]};
+        Image *ready{&images[1]};
+        Image *sending{&images[2]};
+        bool fresh{false};
+    };
+
+    struct Client
+    {
+        int fd{-1};
+        std::vector<uint8_t> out; // header + pixels of the image in flight
+        size_t sent{0};
+        bool busy() const { return sent < out.size(); }
+    };
+
+    void run();
+    void acceptClients();
+    // Push what's pending; false once the client has gone away
+    bool flush(Client &c);
+
+    std::vector<Slot> slots_;
+    mutable std::mutex m_; // back/ready/sending swaps and `fresh`
+    int listenFd_{-1};
+    std::string endpoint_;
+    std::vector<Client> clients_; // sender thread only
+    Wakeup wake_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+
+    std::atomic<uint64_t> published_{0};
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> skipped_{0};
+    std::atomic<unsigned> clientCount_{0};
+};
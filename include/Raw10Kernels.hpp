@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * RAW10 (CSI-2 packed) line unpackers.
+ *
+ * Every kernel produces exactly the same output as the scalar one: each group of
+ * 5 bytes holds 4 pixels, bytes 0..3 are the 8 MSBs and byte 4 carries the 2 LSBs
+ * of each pixel. Vector kernels handle 16 or 32 pixels per iteration and fall back
+ * to the scalar loop for whatever does not fill a whole vector step.
+ *
+ * `srcBytes` is how many bytes may be read starting at `src`. It can be larger than
+ * the line itself (e.g. the rest of the buffer), which lets the vector loads run
+ * right up to the end of the line instead of stopping one vector early.
+ */
+
+namespace util
+{
+    namespace raw10
+    {
+
+        using RowFn = void (*)(const uint8_t *src, size_t srcBytes, uint16_t *dst, uint32_t width);
+
+        struct Kernel
+        {
+            const char *name;
+            RowFn fn;
+        };
+
+        void unpackRowScalar(const uint8_t *src, size_t srcBytes, uint16_t *dst, uint32_t width);
+
+#if defined(__x86_64__) || defined(__i386__)
+        void unpackRowSsse3(const uint8_t *src, size_t srcBytes, uint16_t *dst, uint32_t width);
+        void unpackRowAvx2(const uint8_t *src, size_t srcBytes, uint16_t *dst, uint32_t width);
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+        void unpackRowNeon(const uint8_t *src, size_t srcBytes, uint16_t *dst, uint32_t width);
+#endif
+
+        // Kernels this CPU can run, fastest last. "scalar" is always first.
+        std::vector<Kernel> available();
+
+        // Best available kernel, picked once on first use. GS_UNPACK_KERNEL=<name>
+        // in the environment forces a specific one (handy for A/B comparisons).
+        const Kernel &selected();
+
+        // Whole frame with the selected kernel: `height` lines, `stride` bytes apart,
+        // into a tightly packed width*height destination. `srcBytes` bounds the source.
+        void unpackFrame(const uint8_t *src, size_t srcBytes, size_t stride,
+                         uint32_t width, uint32_t height, uint16_t *dst);
+
+        // The same from any plain pointer (mapped camera buffer, file, synthetic
+        // frame), bounds-checked: false unless `srcBytes` covers `height` lines of
+        // `stride` bytes (the last one only up to its pixels; stride 0 = no
+        // padding) and dst holds width*height samples. `kernel` null = selected().
+        bool unpack(const uint8_t *src, size_t srcBytes, size_t stride, uint32_t width, uint32_t height,
+                    uint16_t *dst, size_t dstSize, const Kernel *kernel = nullptr);
+
+        // Preview decimation straight from the packed plane, without unpacking the
+        // frame first: each 2x2 Bayer quad becomes one 8-bit pixel (the mean of its
+        // four samples). dst gets (width/2)*(height/2) bytes; same bounds checks
+        // as unpack().
+        bool bin2x2To8(const uint8_t *src, size_t srcBytes, size_t stride, uint32_t width, uint32_t height,
+                       uint8_t *dst, size_t dstSize);
+
+        // Row steps behind OutputMode, on freshly unpacked (10-bit) lines, with
+        // the same scalar/vector split as the unpackers:
+        //   bin:    dst[x] = (2x2 quad sum at columns 2x, 2x+1 of r0/r1 + round) >> shift
+        //   pick:   dst[x] = src[2x + phase] (one CFA position)
+        //   narrow: dst[x] = min(src[x] >> shift, 255)
+        struct RowOps
+        {
+            const char *name;
+            void (*bin)(const uint16_t *r0, const uint16_t *r1, uint16_t *dst, uint32_t outW, unsigned round,
+                        unsigned shift);
+            void (*pick)(const uint16_t *src, uint16_t *dst, uint32_t outW, unsigned phase);
+            void (*narrow)(const uint16_t *src, uint8_t *dst, uint32_t n, unsigned shift);
+        };
+
+        // Best for this CPU ("sse2", "neon" or "scalar"), picked once
+        const RowOps &rowOps();
+        const RowOps &scalarRowOps();
+#if defined(__SSE2__)
+        const RowOps &sse2RowOps();
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+        const RowOps &neonRowOps();
+#endif
+
+    } // namespace raw10
+} // namespace util
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * "Packed RAW10" frame file (.r10p): a 32-byte header followed by the CSI-2 plane
+ * exactly as the sensor delivered it (4 pixels per 5 bytes, `stride` bytes per line).
+ * That's 1.25 bytes/pixel on disk instead of 2, and the payload is written straight
+ * from the mmap'd camera buffer — no unpack, no copy.
+ *
+ * gs_convert turns these into DNG later.
+ */
+
+#pragma pack(push, 1)
+struct Raw10PHeader
+{
+    char magic[8]{'G', 'S', 'R', 'A', 'W', '1', '0', 'P'};
+    uint32_t version{1};
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t stride{0}; // bytes per line in the payload
+    uint8_t bayer{0};   // BayerPattern
+    uint8_t reserved[7]{};
+};
+#pragma pack(pop)
+static_assert(sizeof(Raw10PHeader) == 32, "Raw10PHeader layout is part of the file format");
+
+class Raw10PFile
+{
+public:
+    static constexpr const char *extension() { return ".r10p"; }
+
+    // Header + `bytes` of packed data in a single writev().
+    static bool write(const std::string &path, const Raw10PHeader &hdr,
+                      const uint8_t *packed, size_t bytes);
+
+    // Reads and validates a file written by write(). `packed` gets stride*height bytes.
+    static bool read(const std::string &path, Raw10PHeader &hdr, std::vector<uint8_t> &packed);
+
+    // Same checks on a file already in memory (util::MappedFile); `packed`
+    // points into it
+    static bool view(const uint8_t *file, size_t bytes, Raw10PHeader &hdr, const uint8_t *&packed);
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+
+/*
+ * IMX296 external trigger mode (--external-trigger). The Raspberry Pi imx296
+ * driver switches it with a module parameter it reads when streaming starts:
+ * once set, the sensor stops free-running and each frame starts on a low pulse
+ * at the camera's XTR input, exposing for as long as the pulse stays low.
+ * Frames still come back through the same requests, stamped by the driver at
+ * frame start (SensorTimestamp), which is what the trigger times can be checked
+ * against.
+ *
+ * enable() remembers the parameter's value and the destructor puts it back, so
+ * the next free-running capture (ours or anyone's) isn't left waiting for
+ * pulses.
+ */
+class SensorTriggerMode
+{
+public:
+    SensorTriggerMode() = default;
+    ~SensorTriggerMode();
+
+    SensorTriggerMode(const SensorTriggerMode &) = delete;
+    SensorTriggerMode &operator=(const SensorTriggerMode &) = delete;
+
+    // Needs write access to the parameter (root, usually). False, after saying
+    // why, if the driver doesn't have it or it can't be set.
+    bool enable();
+    bool enabled() const { return enabled_; }
+
+    static const char *parameterPath() { return "/sys/module/imx296/parameters/trigger_mode"; }
+
+private:
+    static bool writeParameter(const std::string &value);
+
+    std::string previous_;
+    bool enabled_{false};
+};
@@ -0,0 +1,195 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "IoUtil.hpp"
+
+/*
+ * Single-file sequence container (.gsq) for long captures.
+ *
+ * Layout (all little-endian):
+ *   [SeqFileHeader, zero-padded to `alignment`]
+ *   [SeqFrameHeader][payload][zero pad to `alignment`]   × N frames
+ *   [SeqIndexEntry × N][SeqIndexFooter]                   written by close()
+ *
+ * Every record starts on an `alignment` boundary and goes out as one large sequential
+ * writev (record header + payload straight from the source buffer + padding).
+ * The file header's indexOffset is patched in on close(); if a capture dies before
+ * that, SeqReader rebuilds the index by walking the records.
+ *
+ * Space is fallocate()d in large chunks ahead of the write position, so the
+ * filesystem isn't allocating extents frame by frame. For asynchronous O_DIRECT
+ * writers, stage() lays a record out in an aligned buffer and hands back its
+ * offset; the records are already aligned, so that needs no format change.
+ */
+
+enum class SeqFormat : uint8_t
+{
+    Raw10Packed = 0, // CSI-2 RAW10, `stride` bytes per line
+    Raw16 = 1,       // little-endian 16-bit, width*2 bytes per line
+};
+
+#pragma pack(push, 1)
+struct SeqFileHeader
+{
+    char magic[8]{'G', 'S', 'S', 'E', 'Q', 'V', '0', '1'};
+    uint32_t version{1};
+    uint32_t headerBytes{64};
+    uint32_t alignment{4096};
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t stride{0}; // bytes per line in each payload
+    uint8_t bayer{0};   // BayerPattern
+    uint8_t format{0};  // SeqFormat
+    uint8_t reserved0[2]{};
+    uint64_t indexOffset{0}; // 0 → not finalized
+    uint64_t frameCount{0};
+    int64_t clockOffsetNs{0}; // CLOCK_REALTIME - timestamp clock at capture (0: unknown)
+    uint8_t reserved[4]{};
+};
+
+struct SeqFrameHeader
+{
+    uint32_t magic{0x52465347}; // "GSFR"
+    uint32_t headerBytes{64};
+    uint64_t recordBytes{0};  // header + payload + padding
+    uint64_t payloadBytes{0};
+    uint64_t sequence{0};     // sensor frame sequence
+    int64_t timestampNs{0};   // SensorTimestamp
+    uint32_t exposureUs{0};
+    float analogueGain{0.0f};
+    uint32_t flags{0};         // FrameFlags (DropDetector.hpp)
+    uint32_t droppedBefore{0}; // sensor frames missing right before this one
+    uint32_t scheduleStep{0};  // --exposure-schedule step + 1 (0: none)
+    uint8_t reserved[4]{};
+};
+
+struct SeqIndexEntry
+{
+    uint64_t offset{0}; // file offset of the SeqFrameHeader
+    uint64_t sequence{0};
+    int64_t timestampNs{0};
+};
+
+struct SeqIndexFooter
+{
+    uint32_t magic{0x58495347}; // "GSIX"
+    uint32_t version{1};
+    uint64_t count{0};
+};
+#pragma pack(pop)
+static_assert(sizeof(SeqFileHeader) == 64, "SeqFileHeader layout is part of the file format");
+static_assert(sizeof(SeqFrameHeader) == 64, "SeqFrameHeader layout is part of the file format");
+static_assert(sizeof(SeqIndexEntry) == 24, "SeqIndexEntry layout is part of the file format");
+static_assert(sizeof(SeqIndexFooter) == 16, "SeqIndexFooter layout is part of the file format");
+
+// Per-frame values recorded alongside the payload
+struct SeqFrameInfo
+{
+    uint64_t sequence{0};
+    int64_t timestampNs{0};
+    uint32_t exposureUs{0};
+    float analogueGain{0.0f};
+    uint32_t flags{0};
+    uint32_t droppedBefore{0};
+    uint32_t scheduleStep{0};
+};
+
+class SeqWriter
+{
+public:
+    static constexpr const char *extension() { return ".gsq"; }
+
+    SeqWriter() = default;
+    ~SeqWriter();
+
+    SeqWriter(const SeqWriter &) = delete;
+    SeqWriter &operator=(const SeqWriter &) = delete;
+
+    // `expectedFrames` only pre-sizes the index so append() doesn't reallocate.
+    // `direct`: records are written with O_DIRECT where the filesystem allows it
+    // (see direct()), which means stage() + aligned buffers instead of append().
+    bool open(const std::string &path, const SeqFileHeader &hdr, size_t expectedFrames = 0, bool direct = false);
+
+    // One record, one writev. Not thread-safe: call from a single writer thread.
+    bool append(const SeqFrameInfo &info, const uint8_t *payload, size_t bytes);
+
+    // Size of the record for a `payloadBytes` payload: a multiple of the alignment
+    size_t recordBytes(size_t payloadBytes) const;
+
+    // Build the next record (header, a copy of the payload, zero padding) in
+    // `record`, which needs recordBytes(bytes) of space, and claim its place in
+    // the file; the caller writes it to fd() at the returned offset. A payload
+    // already sitting at record + sizeof(SeqFrameHeader) isn't copied. Same
+    // threading rule as append(). Every record must be on disk before close().
+    uint64_t stage(const SeqFrameInfo &info, const uint8_t *payload, size_t bytes, uint8_t *record);
+    // The write of the record stage() put `at` never made it: close() leaves it
+    // out of the index. Thread-safe (it's an AsyncWriter::FailFn, via onWriteFailed).
+    void discard(uint64_t at);
+    static void onWriteFailed(void *seq, uint64_t at) { static_cast<SeqWriter *>(seq)->discard(at); }
+
+    // Write the trailing index and patch the header. Safe to call twice.
+    bool close();
+
+    bool isOpen() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    bool direct() const { return direct_; }
+    // Records in the index; until close() that includes any still being written
+    uint64_t frames() const { return index_.size(); }
+    // File size so far (header + records, including alignment padding)
+    uint64_t bytesWritten() const { return offset_; }
+
+private:
+    SeqFrameHeader frameHeader(const SeqFrameInfo &info, size_t bytes) const;
+    // Keep the preallocated extent ahead of `end`
+    void reserve(uint64_t end);
+
+    int fd_{-1};
+    bool direct_{false};
+    SeqFileHeader hdr_{};
+    uint64_t offset_{0};
+    uint64_t allocated_{0}; // fallocate()d so far; UINT64_MAX once it's known not to work
+    std::vector<SeqIndexEntry> index_;
+    std::mutex discardM_;
+    std::vector<uint64_t> discarded_; // offsets of records whose write failed
+};
+
+class SeqReader
+{
+public:
+    SeqReader() = default;
+    ~SeqReader();
+
+    SeqReader(const SeqReader &) = delete;
+    SeqReader &operator=(const SeqReader &) = delete;
+
+    // Reads the header and the index (or rebuilds it from the records).
+    bool open(const std::string &path);
+
+    const SeqFileHeader &header() const { return hdr_; }
+    size_t frames() const { return index_.size(); }
+    const SeqIndexEntry &entry(size_t i) const { return index_[i]; }
+
+    // Frame i's record header and payload.
+    bool read(size_t i, SeqFrameHeader &fh, std::vector<uint8_t> &payload) const;
+
+    // Map the whole container once, after which view() hands out payloads in
+    // place: no copy, and safe from any number of threads
+    bool map();
+    bool view(size_t i, SeqFrameHeader &fh, const uint8_t *&payload) const;
+
+    // True if the file was closed cleanly (index present), false if it was rebuilt.
+    bool finalized() const { return finalized_; }
+
+private:
+    bool scan(uint64_t fileSize);
+
+    int fd_{-1};
+    util::MappedFile map_;
+    SeqFileHeader hdr_{};
+    std::vector<SeqIndexEntry> index_;
+    bool finalized_{false};
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "DropDetector.hpp"
+#include "Pipeline.hpp"
+
+/*
+ * Long-run qualification (--soak): "will this board, card and writer sustain
+ * the frame rate for an hour?"
+ *
+ * The capture runs as usual while sample() is called from the main loop every
+ * `interval`. Each sample records, per camera, the frame rate and bandwidth
+ * over the interval, frames the sensor lost or the pipeline refused, every
+ * stage's done-latency p50/p99/max over the interval (Pipeline::stats(Window))
+ * and heap allocations after warm-up, plus the process's RSS. Slow drifts
+ * (heap or page-cache growth, an SD card that starts garbage-collecting after
+ * 20 minutes) show up as a trend across samples rather than vanishing into a
+ * whole-run average.
+ *
+ * writeReport() puts the samples, whole-run per-stage histograms and a flat
+ * "summary" object in one JSON file. A previous report can serve as the
+ * baseline: compare() fails if sustained fps dropped or the latency p99 grew
+ * by more than the tolerances.
+ */
+class SoakMonitor
+{
+public:
+    struct Tolerance
+    {
+        double fps{0.02}; // fraction of the baseline's sustained fps we may lose
+        double p99{0.25}; // fraction its completion → written p99 may grow by
+    };
+
+    // "3600", "90s", "45m", "1.5h" → seconds; false (after saying why) otherwise
+    static bool parseDuration(const std::string &s, double &seconds);
+    // "FPS%[/P99%]", e.g. "2/25"
+    static bool parseTolerance(const std::string &s, Tolerance &tol);
+
+    // targetFps: what the run should sustain (0: don't judge the rate, e.g.
+    // externally triggered); `config` is echoed into the report
+    SoakMonitor(double durationSec, double intervalSec, double targetFps, const std::string &config);
+
+    // Before start(); the pipeline and detector must outlive the monitor
+    void addCamera(const std::string &label, const Pipeline &pipeline, const DropDetector *drops);
+
+    void start();
+    // Milliseconds until the next sample or the end of the soak, whichever is sooner
+    int msUntilDue() const;
+    bool expired() const;
+    // Take a sample (and print its line) if one is due; `force` takes the last,
+    // partial one when the run ends
+    void sample(std::ostream &os, bool force = false);
+
+    // Lost frames and a rate below the target both mean the setup didn't keep up
+    bool sustained() const;
+    void report(std::ostream &os) const;
+    bool writeReport(const std::string &path) const;
+    // False (after saying why) if the baseline can't be read or we regressed
+    bool compare(const std::string &baselinePath, const Tolerance &tol, std::ostream &os) const;
+
+private:
+    struct StageSample
+    {
+        uint64_t p50{0}, p99{0}, max{0}; // done latency over the interval, ns
+        size_t depth{0};
+    };
+    struct CameraSample
+    {
+        double fps{0.0};
+        double mbPerSec{0.0};
+        uint64_t frames{0};  // submitted so far
+        uint64_t missing{0}; // so far, from the sensor's sequence numbers
+        uint64_t dropped{0}; // so far, pipeline full
+        uint64_t shed{0};
+        uint64_t allocs{0}; // inside stages, after warm-up, so far
+        std::vector<StageSample> stages;
+    };
+    struct Sample
+    {
+        double t{0.0}; // seconds since start()
+        uint64_t rssKiB{0};
+        uint64_t heapAllocs{0}; // process-wide operator new calls so far
+        std::vector<CameraSample> cameras;
+    };
+    struct Camera
+    {
+        std::string label;
+        const Pipeline *pipeline;
+        const DropDetector *drops;
+        Pipeline::Window window;
+        uint64_t lastFrames{0};
+        uint64_t lastBytes{0};
+        std::vector<std::string> stageNames;
+    };
+    // What a report boils down to, and what a baseline is compared on
+    struct Summary
+    {
+        double seconds{0.0};
+        double fps{0.0};         // frames submitted / seconds, the slowest camera
+        double minIntervalFps{0.0};
+        uint64_t lost{0};        // missing + dropped, all cameras
+        uint64_t shed{0};        // let go under --degrade
+        uint64_t p99{0};         // completion → last stage, whole run, worst camera
+        uint64_t worstIntervalP99{0};
+        uint64_t max{0};
+        uint64_t allocs{0};
+        uint64_t rssStartKiB{0}, rssMaxKiB{0}, rssEndKiB{0};
+    };
+    Summary summarize() const;
+
+    int64_t durationNs_;
+    int64_t intervalNs_;
+    double targetFps_;
+    std::string config_;
+    std::vector<Camera> cameras_;
+    std::vector<Sample> samples_;
+    int64_t startNs_{0};
+    int64_t lastNs_{0};
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "DropDetector.hpp"
+#include "Pipeline.hpp"
+
+/*
+ * Live and end-of-run reporting on top of Pipeline's counters and histograms.
+ *
+ * tick() is meant for the main loop: every `interval` seconds it prints one line
+ * with the frame rate and write bandwidth over that interval, queue depths and
+ * the completion → written latency so far. writeJson() dumps everything the
+ * pipeline measured (per-stage p50/p99/max, bytes, drops) for later analysis.
+ * With a DropDetector attached, sensor-side gaps and frame timing are included.
+ */
+class StatsReporter
+{
+public:
+    StatsReporter(const Pipeline &pipeline, double intervalSec, const DropDetector *drops = nullptr);
+
+    // Shown in front of every stats line and as "camera" in the JSON; for
+    // telling several cameras apart.
+    void setLabel(const std::string &label) { label_ = label; }
+
+    // Start of the measured run; rates and the JSON duration count from here.
+    void start();
+
+    // Print a stats line if the interval has passed. Cheap otherwise.
+    void tick(std::ostream &os);
+
+    // Milliseconds until the next line is due (rounded up), -1 with the live line
+    // off: how long the main loop may sleep between ticks.
+    int msUntilTick() const;
+
+    bool writeJson(const std::string &path) const;
+
+private:
+    const Pipeline &pipeline_;
+    const DropDetector *drops_;
+    int64_t intervalNs_;
+    std::string label_;
+    int64_t startNs_{0};
+    int64_t lastNs_{0};
+    uint64_t lastSubmitted_{0};
+    uint64_t lastBytes_{0};
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Which cores our threads run on and at what scheduling class, by role:
+ *
+ *   Capture  libcamera's completion thread (placed on its first callback)
+ *   Worker   pipeline stages that hold the camera buffer before anything is
+ *            written: unpack, pre-trigger ring, dark accumulation, preview
+ *   Writer   stages that write files, the DNG encode pool, async write threads,
+ *            and the rest: the preview sender, stdin/gpio trigger watchers
+ *
+ * Keeping Capture and Worker on their own cores, ahead of everything else under
+ * SCHED_FIFO, is what keeps completion → re-queue short while the writers and
+ * the kernel's writeback fight over the rest.
+ *
+ * configure() before any thread starts; every thread we own calls enter() once,
+ * first thing, and libcamera's thread calls it from the completion callback.
+ * Failures (no permission for SCHED_FIFO, a CPU that isn't online) say so once
+ * and leave the thread as it was.
+ */
+enum class ThreadRole
+{
+    Capture,
+    Worker,
+    Writer
+};
+
+class ThreadPlacement
+{
+public:
+    struct Policy
+    {
+        std::vector<int> cpus; // empty: wherever the scheduler likes
+        int fifoPriority{0};   // > 0: SCHED_FIFO at this priority
+    };
+
+    static void configure(ThreadRole role, const Policy &policy);
+    static bool configured();
+
+    // Apply `role`'s policy to the calling thread and record it as `name` for
+    // report(). rename: also set the thread's name (our own threads only).
+    static void enter(ThreadRole role, const std::string &name, bool rename = true);
+
+    // mlockall() what's mapped now: pools, camera buffers, stacks. Call once they
+    // are all allocated. False (after saying why) if the limit is too low.
+    static bool lockMemory();
+
+    // One line per role: CPUs, policy and the threads that took it
+    static void report(std::ostream &os);
+
+    // "0-1,3" → {0, 1, 3}
+    static bool parseCpuList(const std::string &s, std::vector<int> &cpus);
+};
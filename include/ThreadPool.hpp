@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Fixed set of worker threads for data-parallel jobs (DNG tiles/strips, …).
+ *
+ * parallelFor() may be called from several threads at once; each call becomes a
+ * job whose items are claimed one at a time through an atomic counter, so idle
+ * workers keep pulling from whichever job still has items left. The calling
+ * thread works on its own job too, so a pool of 0 threads degrades to a loop.
+ * No heap allocation per call: the job lives on the caller's stack.
+ */
+class ThreadPool
+{
+public:
+    // init(i), if given, runs first thing on worker i (e.g. ThreadPlacement)
+    explicit ThreadPool(unsigned threads, void (*init)(unsigned) = nullptr);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned threads() const { return static_cast<unsigned>(workers_.size()); }
+
+    // Run fn(i) for i in [0, n) and return once all of them have finished.
+    template <typename F>
+    void parallelFor(size_t n, F &&fn)
+    {
+        using Fn = std::remove_reference_t<F>;
+        Job job;
+        job.n = n;
+        job.ctx = &fn;
+        job.call = [](void *ctx, size_t i)
+        { (*static_cast<Fn *>(ctx))(i); };
+        run(job);
+    }
+
+private:
+    struct Job
+    {
+        size_t n{0};
+        void *ctx{nullptr};
+        void (*call)(void *, size_t){nullptr};
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        unsigned users{0};  // workers currently inside drain(); guarded by m_
+        Job *link{nullptr}; // intrusive list of active jobs
+    };
+
+    void run(Job &job);
+    void worker();
+    // Claim and run items of `job` until none are left. Returns true if any ran.
+    static bool drain(Job &job);
+
+    std::mutex m_;
+    std::condition_variable wake_;
+    std::condition_variable finished_;
+    Job *jobs_{nullptr};
+    bool stop_{false};
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Trigger sources for pre-trigger capture: SIGUSR1, a line on stdin, or an
+ * edge on a GPIO line (kernel GPIO character device, uapi v2; no libgpiod).
+ *
+ * Every source only bumps one counter, so the capture side just calls take()
+ * once per frame. Watchers run on their own threads and stop when the Trigger
+ * is destroyed.
+ */
+class Trigger
+{
+public:
+    Trigger();
+    ~Trigger();
+
+    Trigger(const Trigger &) = delete;
+    Trigger &operator=(const Trigger &) = delete;
+
+    // "signal" (SIGUSR1), "stdin" (every line) or "gpio:CHIP:LINE[:rising|falling|both]",
+    // CHIP being e.g. gpiochip0 or a /dev path. Can be called once per source.
+    bool watch(const std::string &spec);
+
+    // Triggers seen since the last call
+    unsigned take() { return pending_.exchange(0, std::memory_order_acq_rel); }
+
+    // Counts as a trigger; async-signal-safe, so it doubles as the SIGUSR1 handler
+    static void fire(int = 0) { pending_.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    bool watchStdin();
+    bool watchGpio(const std::string &chip, unsigned line, const std::string &edge);
+    // Wait until `fd` is readable or we're stopping; false when stopping
+    bool waitReadable(int fd) const;
+
+    static std::atomic<unsigned> pending_; // static: the signal handler has no `this`
+    int stopPipe_[2]{-1, -1};
+    int gpioFd_{-1};
+    std::vector<std::thread> threads_;
+};
@@ -11,15 +11,40 @@ namespace util
     // Map string → Bayer code fourcc used in DNG tags (we store string; DNG code mapping is in DngWriter)
     bool parseBayer(const std::string &s, std::string &norm);
 
+    // "WxH" (also "WXH") → width/height; both must be non-zero
+    bool parseSize(const std::string &s, uint32_t &width, uint32_t &height);
+
+    // "X,Y,WxH" or "X,Y,W,H" → rectangle; width/height must be non-zero
+    bool parseRect(const std::string &s, uint32_t &x, uint32_t &y, uint32_t &width, uint32_t &height);
+
     // Ensure directory exists (mkdir -p equivalent)
     bool ensureDir(const std::string &path);
 
+    // What CaptureSession::mapBuffers() points fb->cookie() at: where the
+    // frame's first pixel is (plane offset and any ROI window applied) and how
+    // many bytes of the plane follow it.
+    struct PlaneView
+    {
+        const uint8_t *data{nullptr};
+        size_t length{0};
+    };
+
+    // Start of the (single) plane's frame data per the buffer's PlaneView;
+    // length = bytes from there to the end of the plane. nullptr if unmapped.
+    const uint8_t *mappedPlane(const libcamera::FrameBuffer *fb, size_t &length);
+
     // Unpack RAW10 CSI-2 packed buffer to 16-bit little-endian samples (aligned to 10 LSBs).
+    // `stride` is bytes per line as the stream reports it (0 = no row padding).
     // dst must have width*height elements; returns false on size mismatch.
     bool unpackRaw10To16(const libcamera::FrameBuffer *fb,
-                         uint32_t width, uint32_t height,
+                         uint32_t width, uint32_t height, size_t stride,
                          std::vector<uint16_t> &dst);
 
+    // Same, into caller-owned storage of width*height samples (e.g. a FramePool buffer).
+    bool unpackRaw10To16(const libcamera::FrameBuffer *fb,
+                         uint32_t width, uint32_t height, size_t stride,
+                         uint16_t *dst, size_t dstSize);
+
     // Quick & simple filename helper
     std::string joinPath(const std::string &a, const std::string &b);
 
@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * What the main thread sleeps on while we stream: an eventfd that workers,
+ * libcamera's completion thread and signal handlers ring when something the
+ * main loop cares about has happened (last frame retired, too many drops,
+ * Ctrl-C). wait() blocks in poll(), so an idle main thread costs no wakeups
+ * and reacts as soon as it's rung instead of on the next polling tick.
+ */
+class Wakeup
+{
+public:
+    Wakeup();
+    ~Wakeup();
+
+    Wakeup(const Wakeup &) = delete;
+    Wakeup &operator=(const Wakeup &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+
+    // Async-signal-safe: one write() on the eventfd
+    void notify() const;
+
+    // Sleep until notify() or `timeoutMs` (< 0: no timeout). True if woken by
+    // notify(); every notification since the last wait() is consumed at once.
+    bool wait(int timeoutMs) const;
+
+    // For poll() loops that watch other fds as well; wait(0) once it's readable
+    int fd() const { return fd_; }
+
+private:
+    int fd_{-1};
+};
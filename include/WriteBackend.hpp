@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+ * Asynchronous positional writes for the file sinks.
+ *
+ * submit() queues one pwrite-style operation and returns straight away; the
+ * write happens in the kernel (io_uring) or on the backend's own threads
+ * (pwrite pool), and `done` is called from there once every byte is out or the
+ * write failed. Buffer and fd belong to the caller until then.
+ *
+ * A backend keeps up to `depth` writes in flight; submit() blocks while that
+ * many are outstanding. Neither implementation allocates per write.
+ */
+
+struct WriteOp
+{
+    int fd{-1};
+    const void *buf{nullptr};
+    size_t len{0};
+    uint64_t offset{0};
+    void (*done)(void *ctx, bool ok){nullptr};
+    void *ctx{nullptr};
+};
+
+enum class WriteBackendKind
+{
+    Auto,    // io_uring if the kernel lets us, pwrite pool otherwise
+    IoUring, // raw io_uring syscalls (Linux 5.1+), no liburing needed
+    Pwrite   // `depth` threads doing blocking pwrite()
+};
+
+class WriteBackend
+{
+public:
+    virtual ~WriteBackend() = default;
+
+    virtual const char *name() const = 0;
+
+    // Queue `op`. Blocks while `depth` writes are in flight; false only if the
+    // write couldn't be queued at all (`done` is not called then).
+    virtual bool submit(const WriteOp &op) = 0;
+
+    // nullptr if the requested kind isn't available here (io_uring compiled out,
+    // too old a kernel, or disabled by kernel.io_uring_disabled / seccomp).
+    // The destructor waits for everything in flight.
+    static std::unique_ptr<WriteBackend> create(WriteBackendKind kind, unsigned depth);
+};
+
+// Implementations, normally reached through WriteBackend::create()
+std::unique_ptr<WriteBackend> makeUringBackend(unsigned depth);
+std::unique_ptr<WriteBackend> makePwriteBackend(unsigned depth);
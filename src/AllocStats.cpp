@@ -0,0 +1,40 @@
+#include "AllocStats.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local uint64_t t_allocs = 0;
+    std::atomic<uint64_t> g_allocs{0};
+} // namespace
+
+namespace util
+{
+
+    uint64_t threadHeapAllocations() { return t_allocs; }
+
+    uint64_t heapAllocations() { return g_allocs.load(std::memory_order_relaxed); }
+
+} // namespace util
+
+// libstdc++ routes new[] and the nothrow forms through these two, so this is all we need.
+// Aligned (C++17 align_val_t) new/delete keep their default implementation.
+void *operator new(std::size_t n)
+{
+    t_allocs++;
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,175 @@
+#include "AsyncWriter.hpp"
+#include "IoUtil.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+AsyncWriter::AsyncWriter(std::unique_ptr<WriteBackend> backend, unsigned depth, bool direct, DoneFn done)
+    : backend_(std::move(backend)), direct_(direct), done_(std::move(done))
+{
+    slots_.resize(depth ? depth : 1);
+    free_.reserve(slots_.size());
+    for (size_t i = slots_.size(); i-- > 0;)
+    {
+        slots_[i].owner = this;
+        free_.push_back(static_cast<unsigned>(i));
+    }
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    drain();
+}
+
+int AsyncWriter::openFile(const std::string &path, bool direct, bool &isDirect)
+{
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    isDirect = false;
+    if (direct)
+    {
+        const int fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        if (fd >= 0)
+        {
+            isDirect = true;
+            return fd;
+        }
+        if (errno != EINVAL) // EINVAL: this filesystem doesn't do O_DIRECT
+            return -1;
+    }
+    return ::open(path.c_str(), flags, 0644);
+}
+
+bool AsyncWriter::writeFile(const std::string &path, PixelBuffer &&lease, uint8_t *data, size_t bytes)
+{
+    bool isDirect = false;
+    const int fd = openFile(path, direct_, isDirect);
+    if (fd < 0)
+    {
+        lease.reset();
+        return false;
+    }
+
+    const size_t len = isDirect ? padded(bytes) : bytes;
+    std::memset(data + bytes, 0, len - bytes);
+    // Whole extent up front, so the filesystem doesn't allocate block by block
+    // under the write. Not every filesystem can; that only costs the hint.
+    if (len)
+        (void)::fallocate(fd, 0, 0, static_cast<off_t>(len));
+
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        (isDirect ? stats_.directFiles : stats_.bufferedFiles)++;
+    }
+    if (queue(fd, true, len != bytes, 0, std::move(lease), data, len, bytes))
+        return true;
+    ::close(fd);
+    ::unlink(path.c_str());
+    return false;
+}
+
+bool AsyncWriter::writeAt(int fd, uint64_t offset, PixelBuffer &&lease, const uint8_t *data, size_t bytes,
+                          FailFn failed, void *ctx)
+{
+    return queue(fd, false, false, offset, std::move(lease), data, bytes, bytes, failed, ctx);
+}
+
+bool AsyncWriter::queue(int fd, bool ownsFd, bool truncate, uint64_t offset, PixelBuffer &&lease,
+                        const uint8_t *data, size_t len, size_t bytes, FailFn failed, void *ctx)
+{
+    unsigned idx;
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        cv_.wait(lk, [&]
+                 { return !free_.empty(); });
+        idx = free_.back();
+        free_.pop_back();
+        const unsigned inFlight = static_cast<unsigned>(slots_.size() - free_.size());
+        if (inFlight > stats_.maxInFlight)
+            stats_.maxInFlight = inFlight;
+    }
+
+    Slot &s = slots_[idx];
+    s.lease = std::move(lease);
+    s.fd = fd;
+    s.ownsFd = ownsFd;
+    s.truncate = truncate;
+    s.bytes = bytes;
+    s.queuedNs = util::monotonicNs();
+    s.offset = offset;
+    s.failed = failed;
+    s.failedCtx = ctx;
+
+    WriteOp op;
+    op.fd = fd;
+    op.buf = data;
+    op.len = len;
+    op.offset = offset;
+    op.done = &AsyncWriter::onDone;
+    op.ctx = &s;
+    if (backend_->submit(op))
+        return true;
+
+    // Never queued: give the slot back without counting a write
+    s.lease.reset();
+    std::lock_guard<std::mutex> lk(m_);
+    free_.push_back(idx);
+    cv_.notify_all();
+    return false;
+}
+
+void AsyncWriter::onDone(void *ctx, bool ok)
+{
+    Slot &s = *static_cast<Slot *>(ctx);
+    s.owner->complete(s, ok);
+}
+
+void AsyncWriter::complete(Slot &s, bool ok)
+{
+    if (s.ownsFd)
+    {
+        if (ok && s.truncate && ::ftruncate(s.fd, static_cast<off_t>(s.bytes)) != 0)
+            ok = false;
+        if (::close(s.fd) != 0)
+            ok = false;
+    }
+    latency_.record(static_cast<uint64_t>(util::monotonicNs() - s.queuedNs));
+    s.lease.reset();
+    const size_t bytes = s.bytes;
+    if (!ok && s.failed)
+        s.failed(s.failedCtx, s.offset);
+
+    // Report before the slot is free, so drain() returning means every done ran
+    if (done_)
+        done_(ok);
+
+    std::lock_guard<std::mutex> lk(m_);
+    stats_.writes++;
+    if (ok)
+        stats_.bytes += bytes;
+    else
+        stats_.failed++;
+    free_.push_back(static_cast<unsigned>(&s - slots_.data()));
+    cv_.notify_all();
+}
+
+void AsyncWriter::drain()
+{
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk, [&]
+             { return free_.size() == slots_.size(); });
+}
+
+unsigned AsyncWriter::inFlight() const
+{
+    std::lock_guard<std::mutex> lk(m_);
+    return static_cast<unsigned>(slots_.size() - free_.size());
+}
+
+AsyncWriter::Stats AsyncWriter::stats() const
+{
+    std::lock_guard<std::mutex> lk(m_);
+    Stats s = stats_;
+    s.latency = latency_.summary();
+    return s;
+}
@@ -0,0 +1,127 @@
+#include "Backpressure.hpp"
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+
+const char *Backpressure::name(DegradeAction a)
+{
+    switch (a)
+    {
+    case DegradeAction::DropOldest:
+        return "drop-oldest";
+    case DegradeAction::Decimate:
+        return "decimate";
+    case DegradeAction::PackedRaw10:
+        return "raw10p";
+    case DegradeAction::NoCompression:
+        return "no-compression";
+    }
+    return "?";
+}
+
+bool Backpressure::parse(const std::string &spec, DegradeRule &rule)
+{
+    rule = DegradeRule{};
+    const std::string action = spec.substr(0, spec.find(':'));
+    bool known = false;
+    for (DegradeAction a : {DegradeAction::DropOldest, DegradeAction::Decimate, DegradeAction::PackedRaw10,
+                            DegradeAction::NoCompression})
+        if (action == name(a))
+        {
+            rule.action = a;
+            known = true;
+        }
+    if (!known)
+        return false;
+    if (action.size() == spec.size())
+        return true;
+
+    // :HIGH/LOW percent of queue capacity, then optionally :HIGH/LOW ms of writer latency
+    double hi = 0, lo = 0, hiMs = 0, loMs = 0;
+    char tail = 0;
+    const char *rest = spec.c_str() + action.size();
+    const int n = std::sscanf(rest, ":%lf/%lf:%lf/%lf%c", &hi, &lo, &hiMs, &loMs, &tail);
+    if ((n != 2 && n != 4) || hi <= 0 || hi > 100 || lo < 0 || lo >= hi)
+        return false;
+    if (n == 2 && std::sscanf(rest, ":%lf/%lf%c", &hi, &lo, &tail) != 2)
+        return false;
+    if (n == 4 && (hiMs <= 0 || loMs < 0 || loMs >= hiMs))
+        return false;
+    rule.highFill = hi / 100.0;
+    rule.lowFill = lo / 100.0;
+    if (n == 4)
+    {
+        rule.highLatencyNs = static_cast<int64_t>(hiMs * 1e6);
+        rule.lowLatencyNs = static_cast<int64_t>(loMs * 1e6);
+    }
+    return true;
+}
+
+Backpressure::Backpressure(const std::vector<DegradeRule> &rules)
+    : states_(rules.size())
+{
+    for (size_t i = 0; i < rules.size(); i++)
+        states_[i].rule = rules[i];
+}
+
+void Backpressure::update(double fill, int64_t latencyNs, uint64_t frame, const std::string &tag)
+{
+    for (State &s : states_)
+    {
+        const DegradeRule &r = s.rule;
+        const bool latency = r.highLatencyNs > 0;
+        bool change;
+        if (!s.on)
+            change = fill >= r.highFill || (latency && latencyNs >= r.highLatencyNs);
+        else
+            change = fill <= r.lowFill && (!latency || latencyNs <= r.lowLatencyNs);
+        if (!change)
+            continue;
+
+        // Transitions are rare (the marks are apart), so a line each is fine here
+        s.on = !s.on;
+        std::cerr << tag << "Backpressure: " << name(r.action) << (s.on ? " on" : " off") << " at frame " << frame
+                  << " (fullest queue " << int(fill * 100 + 0.5) << "%, writer " << std::fixed
+                  << std::setprecision(1) << latencyNs / 1e6 << " ms";
+        if (!s.on)
+            std::cerr << ", after " << frame - s.since << " frame(s)";
+        std::cerr << ")\n"
+                  << std::defaultfloat;
+        if (s.on)
+        {
+            s.since = frame;
+            bump(s.transitions);
+        }
+    }
+}
+
+bool Backpressure::active(DegradeAction a) const
+{
+    for (const State &s : states_)
+        if (s.rule.action == a && s.on)
+            return true;
+    return false;
+}
+
+void Backpressure::affected(DegradeAction a, uint64_t n)
+{
+    for (State &s : states_)
+        if (s.rule.action == a)
+        {
+            bump(s.frames, n);
+            return;
+        }
+}
+
+void Backpressure::report(std::ostream &os, const std::string &tag) const
+{
+    for (const State &s : states_)
+    {
+        const DegradeRule &r = s.rule;
+        os << tag << "Degrade " << name(r.action) << " (on at " << int(r.highFill * 100 + 0.5) << "%";
+        if (r.highLatencyNs)
+            os << " or " << r.highLatencyNs / 1000000.0 << " ms";
+        os << "): " << s.transitions.load(std::memory_order_relaxed) << " time(s), "
+           << s.frames.load(std::memory_order_relaxed) << " frame(s)" << (s.on ? ", still on" : "") << "\n";
+    }
+}
@@ -0,0 +1,311 @@
+#include "Calibration.hpp"
+#include "IoUtil.hpp"
+#include "Raw10Kernels.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+namespace
+{
+    inline unsigned channelOf(uint32_t x, uint32_t y) { return ((y & 1) << 1) | (x & 1); }
+
+    // Median of a 10-bit histogram
+    uint32_t histMedian(const std::vector<uint64_t> &hist, uint64_t total)
+    {
+        uint64_t seen = 0;
+        for (uint32_t v = 0; v < hist.size(); ++v)
+        {
+            seen += hist[v];
+            if (2 * seen >= total)
+                return v;
+        }
+        return 0;
+    }
+} // namespace
+
+bool Calibration::load(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    CalibrationHeader hdr;
+    if (!f || !f.read(reinterpret_cast<char *>(&hdr), sizeof(hdr)))
+        return false;
+
+    const CalibrationHeader ref{};
+    if (std::memcmp(hdr.magic, ref.magic, sizeof(hdr.magic)) != 0 || hdr.version != 1)
+        return false;
+    const size_t pixels = size_t(hdr.width) * hdr.height;
+    if ((hdr.hasDark || hdr.defectCount) && !pixels)
+        return false;
+    if (hdr.defectCount > pixels)
+        return false;
+
+    std::vector<uint16_t> dark(hdr.hasDark ? pixels : 0);
+    std::vector<uint32_t> defects(hdr.defectCount);
+    if (!f.read(reinterpret_cast<char *>(dark.data()), dark.size() * 2) ||
+        !f.read(reinterpret_cast<char *>(defects.data()), defects.size() * 4))
+        return false;
+    set(hdr, std::move(dark), std::move(defects));
+    return true;
+}
+
+bool Calibration::save(const std::string &path) const
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    struct iovec iov[3];
+    iov[0].iov_base = const_cast<CalibrationHeader *>(&hdr_);
+    iov[0].iov_len = sizeof(hdr_);
+    iov[1].iov_base = const_cast<uint16_t *>(dark_.data());
+    iov[1].iov_len = dark_.size() * 2;
+    iov[2].iov_base = const_cast<uint32_t *>(defects_.data());
+    iov[2].iov_len = defects_.size() * 4;
+
+    bool ok = util::writevAll(fd, iov, 3);
+    if (::close(fd) != 0)
+        ok = false;
+    return ok;
+}
+
+void Calibration::setBlackLevels(const uint16_t black[4])
+{
+    std::copy(black, black + 4, hdr_.black);
+    prepare();
+}
+
+void Calibration::set(const CalibrationHeader &hdr, std::vector<uint16_t> dark, std::vector<uint32_t> defects)
+{
+    hdr_ = hdr;
+    dark_ = std::move(dark);
+    defects_ = std::move(defects);
+    prepare();
+}
+
+bool Calibration::loadDefects(const std::string &path, uint32_t width, uint32_t height)
+{
+    if (correctsPixels() && (width != hdr_.width || height != hdr_.height))
+        return false;
+    std::ifstream f(path);
+    if (!f)
+        return false;
+    hdr_.width = width;
+    hdr_.height = height;
+
+    std::string line;
+    while (std::getline(f, line))
+    {
+        line = line.substr(0, line.find('#'));
+        unsigned x = 0, y = 0;
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        if (std::sscanf(line.c_str(), "%u%*[ ,\t]%u", &x, &y) != 2 || x >= width || y >= height)
+            return false;
+        defects_.push_back(y * width + x);
+    }
+    prepare();
+    return true;
+}
+
+bool Calibration::fits(uint32_t width, uint32_t height) const
+{
+    return !correctsPixels() || (width == hdr_.width && height == hdr_.height);
+}
+
+void Calibration::prepare()
+{
+    const uint32_t w = hdr_.width, h = hdr_.height;
+    const size_t pixels = size_t(w) * h;
+
+    std::sort(defects_.begin(), defects_.end());
+    defects_.erase(std::unique(defects_.begin(), defects_.end()), defects_.end());
+    defects_.erase(std::lower_bound(defects_.begin(), defects_.end(), uint32_t(std::min<size_t>(pixels, UINT32_MAX))),
+                   defects_.end());
+    hdr_.defectCount = static_cast<uint32_t>(defects_.size());
+    if (dark_.size() != pixels)
+        dark_.clear();
+    hdr_.hasDark = !dark_.empty();
+
+    // Per-pixel offsets relative to the channel's black level: what correctRow()
+    // subtracts, so the pedestal stays at the black level
+    fpn_.assign(dark_.size(), 0);
+    for (uint32_t y = 0; y < h && !dark_.empty(); ++y)
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            const size_t i = size_t(y) * w + x;
+            fpn_[i] = static_cast<int16_t>(int(dark_[i]) - hdr_.black[channelOf(x, y)]);
+        }
+
+    rowFirst_.assign(defects_.empty() ? 0 : h + 1, 0);
+    if (!defects_.empty())
+    {
+        size_t d = 0;
+        for (uint32_t y = 0; y <= h; ++y)
+        {
+            while (d < defects_.size() && defects_[d] < size_t(y) * w)
+                ++d;
+            rowFirst_[y] = static_cast<uint32_t>(d);
+        }
+    }
+}
+
+void Calibration::correctRow(uint16_t *row, uint32_t y, uint32_t x0, uint32_t cols) const
+{
+    const uint32_t w = hdr_.width;
+    if (!fpn_.empty())
+    {
+        // Plain loop on purpose: the compiler turns it into the same vector width
+        // the unpack kernel used
+        const int16_t *off = fpn_.data() + size_t(y) * w + x0;
+        for (uint32_t i = 0; i < cols; ++i)
+        {
+            const int v = int(row[i]) - off[i];
+            row[i] = static_cast<uint16_t>(std::min(std::max(v, 0), int(kWhiteLevel)));
+        }
+    }
+    if (defects_.empty())
+        return;
+
+    // Nearest same-colour neighbours in the row: two columns away on either side
+    const size_t rowBase = size_t(y) * w;
+    for (uint32_t d = rowFirst_[y]; d < rowFirst_[y + 1]; ++d)
+    {
+        const uint32_t x = static_cast<uint32_t>(defects_[d] - rowBase);
+        if (x < x0 || x >= x0 + cols)
+            continue;
+        const uint32_t i = x - x0;
+        uint32_t sum = 0, n = 0;
+        if (i >= 2)
+        {
+            sum += row[i - 2];
+            n++;
+        }
+        if (i + 2 < cols)
+        {
+            sum += row[i + 2];
+            n++;
+        }
+        if (n)
+            row[i] = static_cast<uint16_t>((sum + n / 2) / n);
+    }
+}
+
+bool Calibration::unpack(const uint8_t *src, size_t srcBytes, size_t stride, uint32_t width, uint32_t height,
+                         uint16_t *dst, size_t dstSize, uint32_t x0, uint32_t y0,
+                         const util::raw10::Kernel *kernel) const
+{
+    if (!correctsPixels())
+        return util::raw10::unpack(src, srcBytes, stride, width, height, dst, dstSize, kernel);
+
+    const size_t lineBytes = (size_t(width) * 10 + 7) / 8;
+    if (stride == 0)
+        stride = lineBytes;
+    if (!src || !dst || width == 0 || height == 0 || stride < lineBytes ||
+        dstSize < size_t(width) * height || srcBytes < stride * (height - 1) + lineBytes ||
+        uint64_t(x0) + width > hdr_.width || uint64_t(y0) + height > hdr_.height)
+        return false;
+
+    const util::raw10::RowFn unpackRow = (kernel ? *kernel : util::raw10::selected()).fn;
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const size_t rowOff = y * stride;
+        uint16_t *out = dst + size_t(y) * width;
+        unpackRow(src + rowOff, srcBytes - rowOff, out, width);
+        correctRow(out, y0 + y, x0, width); // still in L1
+    }
+    return true;
+}
+
+DarkAccumulator::DarkAccumulator(uint32_t width, uint32_t height)
+    : width_(width), height_(height), sum_(size_t(width) * height, 0)
+{
+}
+
+bool DarkAccumulator::add(const uint8_t *packed, size_t bytes, size_t stride, ThreadPool *pool)
+{
+    const size_t lineBytes = (size_t(width_) * 10 + 7) / 8;
+    if (!packed || !height_ || stride < lineBytes || bytes < stride * (height_ - 1) + lineBytes)
+        return false;
+
+    // Bands of rows: big enough to amortize the claim, small enough to balance
+    constexpr uint32_t kBandRows = 16;
+    const util::raw10::RowFn unpackRow = util::raw10::selected().fn;
+    auto band = [&](size_t b)
+    {
+        thread_local std::vector<uint16_t> row;
+        if (row.size() < width_)
+            row.resize(width_);
+        const uint32_t end = std::min<uint32_t>(height_, uint32_t(b + 1) * kBandRows);
+        for (uint32_t y = uint32_t(b) * kBandRows; y < end; ++y)
+        {
+            const size_t off = y * stride;
+            unpackRow(packed + off, bytes - off, row.data(), width_);
+            uint32_t *s = sum_.data() + size_t(y) * width_;
+            for (uint32_t x = 0; x < width_; ++x)
+                s[x] += row[x];
+        }
+    };
+    const size_t bands = (height_ + kBandRows - 1) / kBandRows;
+    if (pool)
+        pool->parallelFor(bands, band);
+    else
+        for (size_t b = 0; b < bands; ++b)
+            band(b);
+    frames_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool DarkAccumulator::result(Calibration &out, unsigned hotThreshold) const
+{
+    const uint32_t n = frames();
+    if (!n)
+        return false;
+
+    std::vector<uint16_t> mean(sum_.size());
+    std::vector<std::vector<uint64_t>> hist(4, std::vector<uint64_t>(Calibration::kWhiteLevel + 1, 0));
+    uint64_t count[4]{};
+    for (uint32_t y = 0; y < height_; ++y)
+        for (uint32_t x = 0; x < width_; ++x)
+        {
+            const size_t i = size_t(y) * width_ + x;
+            mean[i] = static_cast<uint16_t>(std::min<uint32_t>((sum_[i] + n / 2) / n, Calibration::kWhiteLevel));
+            const unsigned c = channelOf(x, y);
+            hist[c][mean[i]]++;
+            count[c]++;
+        }
+
+    // Per channel: the median is the black level, and the median absolute
+    // deviation sets how far above it a pixel has to sit to count as hot
+    CalibrationHeader hdr;
+    hdr.width = width_;
+    hdr.height = height_;
+    hdr.frames = n;
+    uint32_t threshold[4];
+    for (unsigned c = 0; c < 4; ++c)
+    {
+        const uint32_t med = histMedian(hist[c], count[c]);
+        std::vector<uint64_t> dev(Calibration::kWhiteLevel + 1, 0);
+        for (uint32_t v = 0; v < hist[c].size(); ++v)
+            dev[v > med ? v - med : med - v] += hist[c][v];
+        const double sigma = 1.4826 * histMedian(dev, count[c]);
+        hdr.black[c] = static_cast<uint16_t>(med);
+        threshold[c] = hotThreshold ? hotThreshold : std::max<uint32_t>(16, uint32_t(std::ceil(8 * sigma)));
+    }
+
+    std::vector<uint32_t> defects;
+    for (uint32_t y = 0; y < height_; ++y)
+        for (uint32_t x = 0; x < width_; ++x)
+        {
+            const size_t i = size_t(y) * width_ + x;
+            const unsigned c = channelOf(x, y);
+            if (mean[i] > hdr.black[c] + threshold[c])
+                defects.push_back(static_cast<uint32_t>(i));
+        }
+    out.set(hdr, std::move(mean), std::move(defects));
+    return true;
+}
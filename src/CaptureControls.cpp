@@ -0,0 +1,174 @@
+#include "CaptureControls.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <libcamera/control_ids.h>
+
+namespace
+{
+    // Clamp to the camera's [min, max] where it reports one
+    template <typename T>
+    T clampTo(const libcamera::ControlInfoMap &info, const libcamera::ControlId &id, T v, const char *what)
+    {
+        const auto it = info.find(&id);
+        if (it == info.end())
+            return v;
+        T lo = v, hi = v;
+        if (!it->second.min().isNone())
+            lo = it->second.min().get<T>();
+        if (!it->second.max().isNone())
+            hi = it->second.max().get<T>();
+        const T c = std::min(std::max(v, lo), std::max(lo, hi));
+        if (c != v)
+            std::cerr << "Note: " << what << " " << v << " is outside the camera's range, using " << c << "\n";
+        return c;
+    }
+} // namespace
+
+CaptureControls::CaptureControls(const libcamera::ControlInfoMap &info)
+    : info_(info), list_(info)
+{
+    hasExposure_ = info.contains(libcamera::controls::ExposureTime);
+    hasGain_ = info.contains(libcamera::controls::AnalogueGain);
+    hasDuration_ = info.contains(libcamera::controls::FrameDurationLimits);
+    hasAe_ = info.contains(libcamera::controls::AeEnable);
+}
+
+void CaptureControls::setExposureUs(int32_t us)
+{
+    std::lock_guard<std::mutex> lk(m_);
+    us = clampTo<int32_t>(info_, libcamera::controls::ExposureTime, us, "exposure (us)");
+    if (us != exposureUs_)
+    {
+        exposureUs_ = us;
+        changed();
+    }
+}
+
+void CaptureControls::setAnalogueGain(float gain)
+{
+    std::lock_guard<std::mutex> lk(m_);
+    gain = clampTo<float>(info_, libcamera::controls::AnalogueGain, gain, "analogue gain");
+    if (gain != gain_)
+    {
+        gain_ = gain;
+        changed();
+    }
+}
+
+void CaptureControls::setFrameDurationNs(int64_t ns)
+{
+    std::lock_guard<std::mutex> lk(m_);
+    ns = clampTo<int64_t>(info_, libcamera::controls::FrameDurationLimits, ns, "frame duration (ns)");
+    if (ns != durationNs_)
+    {
+        durationNs_ = ns;
+        changed();
+    }
+}
+
+void CaptureControls::set(int32_t exposureUs, float gain, int64_t frameDurationNs)
+{
+    std::lock_guard<std::mutex> lk(m_);
+    exposureUs_ = clampTo<int32_t>(info_, libcamera::controls::ExposureTime, exposureUs, "exposure (us)");
+    gain_ = clampTo<float>(info_, libcamera::controls::AnalogueGain, gain, "analogue gain");
+    durationNs_ = clampTo<int64_t>(info_, libcamera::controls::FrameDurationLimits, frameDurationNs,
+                                   "frame duration (ns)");
+    changed();
+}
+
+int32_t CaptureControls::exposureUs() const
+{
+    std::lock_guard<std::mutex> lk(m_);
+    return exposureUs_;
+}
+
+float CaptureControls::analogueGain() const
+{
+    std::lock_guard<std::mutex> lk(m_);
+    return gain_;
+}
+
+int64_t CaptureControls::frameDurationNs() const
+{
+    std::lock_guard<std::mutex> lk(m_);
+    return durationNs_;
+}
+
+void CaptureControls::changed()
+{
+    // Everything we manage goes out together, so a request never carries a
+    // half-updated set
+    list_.clear();
+    if (hasExposure_ && steps_.empty())
+        list_.set(libcamera::controls::ExposureTime, exposureUs_); // microseconds
+    if (hasGain_ && steps_.empty())
+        list_.set(libcamera::controls::AnalogueGain, gain_);
+    if (hasDuration_)
+        list_.set(libcamera::controls::FrameDurationLimits,
+                  libcamera::Span<const int64_t, 2>({durationNs_, durationNs_}));
+    // Manual exposure/gain only stick with AE/AGC off
+    if (hasAe_)
+        list_.set(libcamera::controls::AeEnable, false);
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+bool CaptureControls::apply(libcamera::Request *req)
+{
+    const uint64_t gen = generation_.load(std::memory_order_acquire);
+    uint64_t seen = applied_.load(std::memory_order_relaxed);
+    // Requests are re-queued from several pipeline threads: exactly one of them
+    // claims each change
+    if (seen == gen || !applied_.compare_exchange_strong(seen, gen, std::memory_order_acq_rel))
+        return false;
+
+    std::lock_guard<std::mutex> lk(m_);
+    req->controls().merge(list_);
+    return true;
+}
+
+void CaptureControls::setSchedule(const std::vector<ExposureStep> &steps, unsigned lead)
+{
+    std::lock_guard<std::mutex> lk(m_);
+    steps_ = steps;
+    lead_ = lead;
+    for (ExposureStep &s : steps_)
+    {
+        s.exposureUs = clampTo<int32_t>(info_, libcamera::controls::ExposureTime, s.exposureUs, "exposure (us)");
+        s.gain = clampTo<float>(info_, libcamera::controls::AnalogueGain, s.gain, "analogue gain");
+    }
+    nextStep_ = 0;
+    changed();
+}
+
+uint32_t CaptureControls::bindNext(libcamera::Request *req)
+{
+    const uint64_t n = nextStep_++;
+    const uint32_t own = static_cast<uint32_t>(n % steps_.size());
+    // Set on the request itself, but for the frame `lead_` after its own:
+    // that's the one these values will reach. The first `lead_` frames get whatever
+    // the sensor had.
+    const ExposureStep &ahead = steps_[(n + lead_) % steps_.size()];
+    if (hasExposure_)
+        req->controls().set(libcamera::controls::ExposureTime, ahead.exposureUs);
+    if (hasGain_)
+        req->controls().set(libcamera::controls::AnalogueGain, ahead.gain);
+    return own;
+}
+
+int CaptureControls::matchStep(int32_t exposureUs, float gain, uint32_t expected, bool exposure) const
+{
+    const auto fits = [&](const ExposureStep &s)
+    {
+        const bool expOk = !exposure || std::abs(exposureUs - s.exposureUs) <= std::max(30, s.exposureUs / 50);
+        return expOk && std::fabs(gain - s.gain) <= 0.02f * s.gain;
+    };
+    if (expected < steps_.size() && fits(steps_[expected]))
+        return static_cast<int>(expected);
+    for (size_t i = 0; i < steps_.size(); i++)
+        if (fits(steps_[i]))
+            return static_cast<int>(i);
+    return -1;
+}
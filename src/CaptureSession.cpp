@@ -0,0 +1,1109 @@
+#include "CaptureSession.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/formats.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Imx296Defaults.hpp"
+#include "IoUtil.hpp"
+#include "Raw10Kernels.hpp"
+#include "Raw10PFile.hpp"
+#include "ThreadPlacement.hpp"
+
+CaptureSession::CaptureSession(std::shared_ptr<libcamera::Camera> camera, unsigned index, const std::string &label,
+                               const CaptureOptions &opt, const CaptureShared &shared)
+    : camera_(std::move(camera)), index_(index), label_(label), opt_(opt), shared_(shared)
+{
+}
+
+CaptureSession::~CaptureSession()
+{
+    stopCapture();
+    finish();
+    ring_.reset();
+    pipeline_.reset();
+
+    // Unmap buffers
+    for (const BufferMap &m : maps_)
+    {
+        munmap(m.addr, m.len);
+        m.fb->setCookie(0);
+    }
+    requests_.clear();
+    if (allocator_ && stream_)
+        allocator_->free(stream_);
+    allocator_.reset();
+    if (acquired_)
+        camera_->release();
+}
+
+int64_t CaptureSession::frameDurationNs(float fps)
+{
+    // Calculate frame duration from FPS
+    const int64_t ns = static_cast<int64_t>(1e9 / std::max(1.0f, fps));
+    // Minimal sanity
+    return std::max<int64_t>(ns, 1'000'000);
+}
+
+bool CaptureSession::open()
+{
+    if (camera_->acquire())
+    {
+        std::cerr << tag() << "Failed to acquire camera.\n";
+        return false;
+    }
+    acquired_ = true;
+
+    if (!configure() || !mapBuffers() || !loadCalibration())
+        return false;
+
+    frameDurationNs_ = frameDurationNs(opt_.fps);
+    return prepareRun();
+}
+
+bool CaptureSession::rearm(const CaptureJob &job)
+{
+    if (started_ || !pipeline_)
+        return false;
+    if (job.frames)
+        opt_.frames = job.frames;
+    if (job.exposureUs)
+        opt_.exposureUs = job.exposureUs;
+    if (job.analogueGain > 0)
+        opt_.analogueGain = job.analogueGain;
+    if (!job.outDir.empty())
+        opt_.outDir = job.outDir;
+
+    // The last run's pipeline has drained (finish()); the reporter looks at it
+    reporter_.reset();
+    pipeline_.reset();
+    backpressure_.reset();
+    dngPlain_.reset();
+    captured_ = 0;
+    decimated_ = 0;
+    offSchedule_.store(0, std::memory_order_relaxed);
+    firstFrameNs_.store(0, std::memory_order_relaxed);
+    capturing_.store(true, std::memory_order_release);
+    return prepareRun();
+}
+
+bool CaptureSession::prepareRun()
+{
+    // Sensor timestamps → wall clock, for DNG dates (taken once: NTP slewing
+    // during a run is far below the sub-second precision we store)
+    clockOffsetNs_ = util::realtimeOffsetNs();
+
+    // Sequence gaps and timing against the frame duration we program below.
+    // Triggered frames come whenever the pulses do: sequence numbers only.
+    drops_.reset(new DropDetector(opt_.externalTrigger ? 0 : frameDurationNs_));
+
+    // Controls: exposure, gain, frame duration (fps), AE off. Validated once;
+    // they ride on the first request queued and then only on the first one after
+    // a change (CaptureControls::set*), since libcamera keeps them in effect.
+    // Global shutter is sensor-defined for IMX296; no rolling->global switch control needed.
+    controls_.reset(new CaptureControls(camera_->controls()));
+    controls_->set(opt_.exposureUs, opt_.analogueGain, frameDurationNs_);
+    if (!opt_.exposureSchedule.empty())
+    {
+        controls_->setSchedule(opt_.exposureSchedule, opt_.scheduleLead);
+        requestStep_.assign(requests_.size(), 0);
+        std::cout << tag() << "Exposure schedule: " << opt_.exposureSchedule.size()
+                  << " step(s), repeating; controls lead frames by " << opt_.scheduleLead << "\n";
+        int32_t longest = 0;
+        for (const ExposureStep &s : controls_->schedule())
+            longest = std::max(longest, s.exposureUs);
+        if (!opt_.externalTrigger && int64_t(longest) * 1000 > frameDurationNs_)
+            std::cerr << tag() << "Note: a " << longest << " us step is longer than the " << frameDurationNs_ / 1000
+                      << " us frame (--fps); the camera will shorten it\n";
+    }
+    if (opt_.externalTrigger)
+        std::cout << tag() << "External trigger: each frame starts on an XTR pulse and exposes for its width\n";
+
+    const BayerPattern bayerPattern = toBayer(opt_.bayer);
+
+    // DNG header template (TIFF header, IFD, CFA/colour tags) built once per session
+    DngMeta dngMeta;
+    dngMeta.width = outW_;
+    dngMeta.height = outH_;
+    dngMeta.bayer = bayerPattern;
+    dngMeta.bitsPerSample = 16;
+    dngMeta.whiteLevel = 1023;
+    if (calib_)
+        std::copy(calib_->blackLevels(), calib_->blackLevels() + 4, dngMeta.blackLevel);
+    dngMeta.analogGain = opt_.analogueGain;
+    dngMeta.exposureSeconds = opt_.exposureUs / 1e6f;
+    dngMeta.rowsPerStrip = opt_.dngStripRows;
+    dngMeta.tileWidth = opt_.dngTileW;
+    dngMeta.tileLength = opt_.dngTileH;
+    dngMeta.compression = opt_.dngCompression;
+    // Async DNG: the header fills the pool buffer's headroom, pixels follow page-aligned
+    dngMeta.dataAlignment = shared_.writer ? static_cast<uint32_t>(FramePool::kAlignment) : 16;
+    // Reduced samples: whatever OutputMode makes, with its own size and levels.
+    // PGM has its few bytes of header; RAW none.
+    reduced_ = opt_.output.reduces() || opt_.writePgm || opt_.writeTiff;
+    if (reduced_)
+    {
+        const OutputMode &om = opt_.output;
+        dngMeta.width = om.width(outW_);
+        dngMeta.height = om.height(outH_);
+        dngMeta.bitsPerSample = uint16_t(om.bits());
+        dngMeta.whiteLevel = om.whiteLevel();
+        om.blackLevels(calib_ ? calib_->blackLevels() : dngMeta.blackLevel, dngMeta.blackLevel);
+        dngMeta.mono = om.mono();
+        dngMeta.plainTiff = opt_.writeTiff;
+        pgmHeader_ = "P5\n" + std::to_string(dngMeta.width) + " " + std::to_string(dngMeta.height) + "\n" +
+                     std::to_string(om.bits() == 8 ? 255 : om.whiteLevel()) + "\n";
+    }
+    dng_.reset(new DngWriter(dngMeta));
+    if (reduced_)
+    {
+        outHeader_ = opt_.writeDng || opt_.writeTiff ? dng_->headerSize() : opt_.writePgm ? pgmHeader_.size() : 0;
+        outBytes_ = opt_.output.bytes(outW_, outH_);
+        std::cout << tag() << "Output: " << opt_.output.describe() << ", " << dngMeta.width << "x" << dngMeta.height
+                  << " (" << (outBytes_ + 1023) / 1024 << " KiB a frame)\n";
+    }
+
+    // Working copies for the unpacked paths: enough for every frame that can sit
+    // between unpack and write (or in an async write), so steady state never
+    // allocates. Async SEQ copies each record into one for its O_DIRECT write.
+    seqBytes_ = packedStride_ * outH_;
+    // Pre-trigger holds the whole ring on top of that.
+    const bool packedRecords = opt_.preTrigger || (opt_.writeSeq && shared_.writer);
+    needsPixels_ = (opt_.writeDng && !opt_.dngPieces) || opt_.writeRaw || opt_.writePgm || opt_.writeTiff ||
+                   packedRecords;
+    // Each stage queue holds up to one frame per request, so by default the pool
+    // covers a full write queue plus the frames the workers and writers are on;
+    // --pool-buffers overrides (misses fall back to the heap and show up in the
+    // exit report).
+    poolSize_ = opt_.poolBuffers ? opt_.poolBuffers
+                                 : requests_.size() + opt_.workers + opt_.writers +
+                                       (shared_.writer ? opt_.writeDepth : 0) +
+                                       (opt_.preTrigger ? opt_.preTriggerFrames : 0);
+    const size_t poolPixels = packedRecords ? AsyncWriter::padded(sizeof(SeqFrameHeader) + seqBytes_) / 2
+                                            : size_t(outW_) * outH_;
+    if (!pool_)
+    {
+        // Warm from here on: later runs (--serve) lease the same pages
+        const size_t headroom = reduced_ ? outHeader_
+                                : shared_.writer && opt_.writeDng && !opt_.preTrigger ? dng_->headerSize()
+                                                                                      : 0;
+        pool_.reset(new FramePool(needsPixels_ ? poolSize_ : 0, poolPixels, headroom));
+        const size_t copies = needsPixels_ ? poolSize_ : 0;
+        std::cout << tag() << "Queue depth: " << requests_.size() << " camera buffer(s)";
+        if (requests_.size() != opt_.bufferCount)
+            std::cout << " (" << opt_.bufferCount << " requested)";
+        std::cout << ", stage queues of " << requests_.size() << ", " << copies << " working cop"
+                  << (copies == 1 ? "y" : "ies");
+        if (shared_.writer)
+            std::cout << ", " << opt_.writeDepth << " write(s) in flight";
+        std::cout << "\n";
+    }
+
+    if (!opt_.degrade.empty())
+    {
+        backpressure_.reset(new Backpressure(opt_.degrade));
+        // Packed frames ride in the same pool buffers as unpacked ones: header,
+        // then compact rows, which always fit in 2 bytes per pixel plus headroom
+        const size_t packedFile = sizeof(Raw10PHeader) + (size_t(outW_) * 10 + 7) / 8 * outH_;
+        packedDegrade_ = (opt_.writeDng || opt_.writeRaw) && !opt_.preTrigger &&
+                         (opt_.dngPieces || AsyncWriter::padded(packedFile) <= pool_->bufferBytes());
+        if (dng_->compressed())
+        {
+            DngMeta plain = dngMeta;
+            plain.compression = DngCompression::None;
+            dngPlain_.reset(new DngWriter(plain));
+        }
+        std::cout << tag() << "Backpressure:";
+        for (const DegradeRule &r : opt_.degrade)
+        {
+            std::cout << " " << Backpressure::name(r.action) << " at " << int(r.highFill * 100 + 0.5) << "/"
+                      << int(r.lowFill * 100 + 0.5) << "%";
+            if (r.highLatencyNs)
+                std::cout << " or " << r.highLatencyNs / 1e6 << "/" << r.lowLatencyNs / 1e6 << " ms";
+        }
+        std::cout << "\n";
+    }
+
+    pipeline_.reset(new Pipeline([this](libcamera::Request *req)
+                                 { recycle(req); }));
+    // Until every request and pool buffer has been through once, allocations
+    // are expected (thread-local names, first opens); don't count those.
+    pipeline_->setWarmupFrames(requests_.size() + poolSize_);
+    // Last frame out: wake the main thread instead of letting it poll for it.
+    // Pipeline drops retire too, so --max-drops is re-checked on each new one
+    // (only new ones: every frame after the first drop would wake it otherwise).
+    dropsSeen_.store(0, std::memory_order_relaxed);
+    pipeline_->setRetireHook([this](uint64_t n)
+                             {
+        const uint64_t drops = opt_.maxDrops >= 0 ? pipeline_->dropped() : 0;
+        const bool newDrop = drops && dropsSeen_.exchange(drops, std::memory_order_relaxed) != drops;
+        if (n >= opt_.frames || newDrop)
+            shared_.wakeup->notify(); });
+    // Stages that write files are writers; the rest sit between the camera and
+    // the re-queue, so they get the capture-side cores (ThreadPlacement)
+    pipeline_->setThreadInit([this](const std::string &stage, unsigned worker)
+                             {
+        const ThreadRole role = stage == "write" || stage == "dng" ? ThreadRole::Writer : ThreadRole::Worker;
+        ThreadPlacement::enter(role, (label_.empty() ? "" : label_ + "-") + stage + "#" + std::to_string(worker)); });
+    reporter_.reset(new StatsReporter(*pipeline_, opt_.statsInterval, drops_.get()));
+    reporter_->setLabel(label_);
+
+    // Container header for SEQ output and pre-trigger bursts. Payloads keep the
+    // ISP's row padding; the header records the stride.
+    seqHdr_.width = outW_;
+    seqHdr_.height = outH_;
+    seqHdr_.stride = static_cast<uint32_t>(packedStride_);
+    seqHdr_.bayer = static_cast<uint8_t>(bayerPattern);
+    seqHdr_.format = static_cast<uint8_t>(SeqFormat::Raw10Packed);
+    seqHdr_.clockOffsetNs = clockOffsetNs_;
+
+    buildStages();
+    return !opt_.writeSeq || seq_.isOpen();
+}
+
+bool CaptureSession::configure()
+{
+    config_ = camera_->generateConfiguration({libcamera::StreamRole::Raw});
+    if (!config_ || config_->size() != 1)
+    {
+        std::cerr << tag() << "Failed to generate RAW config.\n";
+        return false;
+    }
+
+    libcamera::StreamConfiguration &streamCfg = config_->at(0);
+
+    // Request RAW10 packed format (CSI-2). If not supported, libcamera will pick nearest.
+    streamCfg.pixelFormat = libcamera::formats::SBGGR10_CSI2P; // mosaic overridden later by DNG tag; buffer layout is the same
+    // The raw stream's size picks the sensor mode; smaller ones (e.g. a shorter
+    // vertical window) read out faster. Default: whatever the pipeline prefers.
+    const libcamera::Size requestedSize(opt_.sizeW, opt_.sizeH);
+    if (opt_.sizeW)
+        streamCfg.size = requestedSize;
+    // How many frames can be queued to (or held back from) the sensor at once;
+    // validate() may clamp it to what the pipeline handler supports.
+    streamCfg.bufferCount = opt_.bufferCount;
+
+    if (config_->validate() == libcamera::CameraConfiguration::Status::Invalid)
+    {
+        std::cerr << tag() << "Camera configuration invalid.\n";
+        return false;
+    }
+    if (opt_.sizeW && streamCfg.size != requestedSize)
+        std::cerr << tag() << "Note: " << requestedSize.toString() << " isn't a mode of this camera, using "
+                  << streamCfg.size.toString() << " (see --list-modes)\n";
+    if (streamCfg.bufferCount != opt_.bufferCount)
+        std::cerr << tag() << "Note: " << opt_.bufferCount << " buffer(s) requested, the camera uses "
+                  << streamCfg.bufferCount << "\n";
+    if (camera_->configure(config_.get()))
+    {
+        std::cerr << tag() << "Camera configure failed.\n";
+        return false;
+    }
+    stream_ = streamCfg.stream();
+
+    // Bytes per line as the ISP lays the buffer out. Rows are usually padded past
+    // width*10/8 for alignment, so everything below steps by this, not the width.
+    packedStride_ = streamCfg.stride ? streamCfg.stride : (size_t(streamCfg.size.width) * 10 + 7) / 8;
+    if (packedStride_ < (size_t(streamCfg.size.width) * 10 + 7) / 8)
+    {
+        std::cerr << tag() << "Stream stride " << streamCfg.stride << " too small for " << streamCfg.size.width
+                  << " RAW10 pixels (format " << streamCfg.pixelFormat.toString() << ").\n";
+        return false;
+    }
+
+    // --roi: only this window of each frame goes downstream. The raw stream is
+    // whatever the sensor mode delivers (ScalerCrop only crops what the ISP
+    // outputs), so the window is a view into the camera buffer: its first pixel
+    // plus the stream's stride, nothing copied.
+    streamW_ = outW_ = streamCfg.size.width;
+    streamH_ = outH_ = streamCfg.size.height;
+    if (opt_.haveRoi)
+    {
+        // Whole 5-byte pixel groups, and an even origin/size so the CFA phase
+        // (and --bayer) is the frame's
+        const uint32_t x = opt_.roiX & ~3u, y = opt_.roiY & ~1u, w = opt_.roiW & ~1u, h = opt_.roiH & ~1u;
+        if (!w || !h || uint64_t(x) + w > outW_ || uint64_t(y) + h > outH_)
+        {
+            std::cerr << tag() << "ROI " << opt_.roiX << "," << opt_.roiY << "," << opt_.roiW << "x" << opt_.roiH
+                      << " doesn't fit the " << outW_ << "x" << outH_ << " frame.\n";
+            return false;
+        }
+        if (x != opt_.roiX || y != opt_.roiY || w != opt_.roiW || h != opt_.roiH)
+            std::cerr << tag() << "Note: ROI aligned to " << x << "," << y << "," << w << "x" << h << "\n";
+        windowOffset_ = size_t(y) * packedStride_ + size_t(x) / 4 * 5;
+        winX_ = x;
+        winY_ = y;
+        outW_ = w;
+        outH_ = h;
+    }
+    std::cout << tag() << "Stream: " << streamCfg.pixelFormat.toString() << " " << streamCfg.size.toString()
+              << ", stride " << packedStride_;
+    if (opt_.haveRoi)
+        std::cout << ", window " << outW_ << "x" << outH_ << " at " << (windowOffset_ % packedStride_) / 5 * 4 << ","
+                  << windowOffset_ / packedStride_;
+    std::cout << "\n";
+    return true;
+}
+
+bool CaptureSession::loadCalibration()
+{
+    if (opt_.calibrateDarkFrames)
+    {
+        // Always the whole mode, so the result fits any --roi later
+        dark_.reset(new DarkAccumulator(streamW_, streamH_));
+        std::cout << tag() << "Dark calibration: averaging " << opt_.calibrateDarkFrames << " frame(s)"
+                  << " (cover the lens)\n";
+        return true;
+    }
+    if (opt_.calibrationPath.empty() && opt_.defectsPath.empty() && !opt_.haveBlack)
+        return true;
+
+    calib_.reset(new Calibration);
+    if (!opt_.calibrationPath.empty() && !calib_->load(opt_.calibrationPath))
+    {
+        std::cerr << tag() << "Failed to read calibration " << opt_.calibrationPath << "\n";
+        return false;
+    }
+    if (!opt_.defectsPath.empty() && !calib_->loadDefects(opt_.defectsPath, streamW_, streamH_))
+    {
+        std::cerr << tag() << "Failed to read defect list " << opt_.defectsPath << " (\"x y\" per line, inside "
+                  << streamW_ << "x" << streamH_ << ")\n";
+        return false;
+    }
+    if (opt_.haveBlack)
+        calib_->setBlackLevels(opt_.black);
+    if (!calib_->fits(streamW_, streamH_))
+    {
+        std::cerr << tag() << "Calibration was taken at " << calib_->header().width << "x"
+                  << calib_->header().height << ", the stream is " << streamW_ << "x" << streamH_ << "\n";
+        return false;
+    }
+
+    const uint16_t *bl = calib_->blackLevels();
+    std::cout << tag() << "Calibration: black " << bl[0] << "/" << bl[1] << "/" << bl[2] << "/" << bl[3];
+    if (calib_->hasDark())
+        std::cout << ", dark frame";
+    std::cout << ", " << calib_->defects() << " defective pixel(s)";
+    if (calib_->correctsPixels() && (opt_.writeRaw10p || opt_.writeSeq || opt_.preTrigger))
+        std::cout << " (packed output stays uncorrected: gs_convert --calibration applies it)";
+    std::cout << "\n";
+    return true;
+}
+
+bool CaptureSession::mapBuffers()
+{
+    allocator_.reset(new libcamera::FrameBufferAllocator(camera_));
+    if (allocator_->allocate(stream_) < 0)
+    {
+        std::cerr << tag() << "Buffer allocation failed.\n";
+        return false;
+    }
+    const auto &buffers = allocator_->buffers(stream_);
+    if (buffers.empty())
+    {
+        std::cerr << tag() << "No buffers allocated.\n";
+        return false;
+    }
+
+    // How much of the buffer past the window's first pixel we read: whole rows
+    // for the packed outputs (their records carry the stride padding too)
+    const size_t lineBytes = (size_t(outW_) * 10 + 7) / 8;
+    const size_t windowBytes = (opt_.preTrigger || opt_.writeSeq || opt_.writeRaw10p)
+                                   ? packedStride_ * outH_
+                                   : packedStride_ * (outH_ - 1) + lineBytes;
+
+    requests_.reserve(buffers.size());
+    maps_.reserve(buffers.size());
+    for (auto &buf : buffers)
+    {
+        auto req = camera_->createRequest(requests_.size()); // cookie: index into requestStep_
+        if (!req)
+        {
+            std::cerr << tag() << "Failed to create request.\n";
+            return false;
+        }
+        if (req->addBuffer(stream_, buf.get()))
+        {
+            std::cerr << tag() << "Failed to add buffer to request.\n";
+            return false;
+        }
+        // The plane start goes into fb->cookie() for util::mappedPlane().
+        // In production, use MappedBuffer RAII per frame.
+        libcamera::FrameBuffer *fb = buf.get();
+        if (fb->planes().size() != 1)
+        {
+            std::cerr << tag() << "Unexpected plane count.\n";
+            return false;
+        }
+        // Planes can start anywhere inside their dmabuf (several buffers often
+        // share one), but mmap offsets must be page-aligned: map from the page
+        // the plane starts in and step over the difference.
+        const libcamera::FrameBuffer::Plane &plane = fb->planes()[0];
+        static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t mapOffset = plane.offset - plane.offset % pageSize;
+        const size_t mapLen = plane.offset - mapOffset + plane.length;
+        void *addr = mmap(nullptr, mapLen, PROT_READ, MAP_SHARED, plane.fd.get(), static_cast<off_t>(mapOffset));
+        if (addr == MAP_FAILED)
+        {
+            std::perror("mmap");
+            return false;
+        }
+        if (plane.length < windowOffset_ + windowBytes)
+        {
+            // Only a window at the bottom edge with X > 0 can run past the end
+            std::cerr << tag() << "Camera buffer too small for the ROI (try moving it up a row or to x=0).\n";
+            munmap(addr, mapLen);
+            return false;
+        }
+        const uint8_t *planeStart = static_cast<uint8_t *>(addr) + (plane.offset - mapOffset);
+        maps_.push_back({fb, addr, mapLen, {planeStart + windowOffset_, plane.length - windowOffset_}});
+        fb->setCookie(reinterpret_cast<uintptr_t>(&maps_.back().view)); // maps_ never reallocates (reserved)
+        requests_.push_back(std::move(req));
+    }
+    return true;
+}
+
+const std::string &CaptureSession::pathFor(const Frame &f, const char *ext) const
+{
+    // outdir/imx296_NNNNNN<ext>, built in a per-thread string that keeps its
+    // capacity, so naming files costs no heap allocation after the first frame.
+    thread_local std::string path;
+    char name[48];
+    if (label_.empty())
+        std::snprintf(name, sizeof(name), "imx296_%06llu", static_cast<unsigned long long>(f.index));
+    else
+        std::snprintf(name, sizeof(name), "imx296_%s_%06llu", label_.c_str(), static_cast<unsigned long long>(f.index));
+    path.assign(opt_.outDir);
+    if (!path.empty() && path.back() != '/')
+        path += '/';
+    path += name;
+    path += ext;
+    return path;
+}
+
+SeqFrameInfo CaptureSession::seqInfo(const Frame &f) const
+{
+    SeqFrameInfo info;
+    info.sequence = f.sequence;
+    info.timestampNs = f.sensorTimestampNs;
+    info.exposureUs = static_cast<uint32_t>(f.exposureUs);
+    info.analogueGain = f.analogueGain;
+    info.flags = f.flags;
+    info.droppedBefore = f.dropsBefore;
+    info.scheduleStep = f.scheduleStep;
+    return info;
+}
+
+DngFrameInfo CaptureSession::dngInfo(const Frame &f) const
+{
+    // All from the completed request, never the command line
+    DngFrameInfo fi;
+    fi.exposureSeconds = f.exposureUs / 1e6f;
+    fi.analogGain = f.analogueGain;
+    fi.sensorTimestampNs = f.sensorTimestampNs;
+    fi.sequence = f.sequence;
+    fi.index = f.index;
+    fi.flags = f.flags;
+    fi.droppedBefore = f.dropsBefore;
+    fi.scheduleStep = f.scheduleStep;
+    fi.clockOffsetNs = clockOffsetNs_;
+    return fi;
+}
+
+void CaptureSession::buildStages()
+{
+    Pipeline &pipeline = *pipeline_;
+    const size_t queue = requests_.size();
+
+    const Calibration *fusedCal = calib_ && calib_->correctsPixels() ? calib_.get() : nullptr;
+
+    if (shared_.preview && opt_.previewEvery)
+    {
+        // Ahead of whatever writes the frame: every Nth one is binned 2x2 to 8
+        // bits straight from the mmap and handed to the preview sink, then the
+        // frame moves on untouched. Preview trouble never costs a frame.
+        const uint32_t pw = outW_ / 2, ph = outH_ / 2;
+        std::cout << tag() << "Preview: every " << opt_.previewEvery << " frame(s), " << pw << "x" << ph
+                  << " 8-bit\n";
+        pipeline.addStage("preview", 1, queue, [this, pw, ph](Frame &f)
+                          {
+            if (f.index % opt_.previewEvery != 0)
+                return true;
+            size_t length = 0;
+            const uint8_t *packed = util::mappedPlane(f.buffer, length);
+            uint8_t *img = shared_.preview->frameBuffer(index_, pw, ph);
+            if (img && packed &&
+                util::raw10::bin2x2To8(packed, length, packedStride_, outW_, outH_, img, size_t(pw) * ph))
+                shared_.preview->publish(index_, f.index, f.sensorTimestampNs);
+            return true; });
+    }
+
+    if (dark_)
+    {
+        // --calibrate-dark: every frame is added into the per-pixel sums, rows
+        // spread over the encode pool, and nothing is written until the end
+        pipeline.addStage("dark", 1, queue, [this](Frame &f)
+                          {
+            size_t length = 0;
+            const uint8_t *packed = util::mappedPlane(f.buffer, length); // no --roi here: the whole mode
+            const bool ok = dark_->add(packed, length, packedStride_, shared_.encodePool);
+            pipeline_->release(f);
+            if (!ok)
+                std::cerr << tag() << "Dark frame accumulation failed.\n";
+            return ok; });
+    }
+    else if (opt_.preTrigger)
+    {
+        // Every frame is copied, still packed, into a pool buffer laid out as a
+        // .gsq record, and the camera buffer goes straight back. The ring keeps
+        // the last N; a trigger sends them (and the next M) to the async writer.
+        ring_.reset(new PreTriggerRing(opt_.preTriggerFrames, opt_.postTriggerFrames, seqHdr_, opt_.outDir,
+                                       *shared_.writer));
+        std::cout << tag() << "Pre-trigger: keeping " << opt_.preTriggerFrames << " frame(s) ("
+                  << (opt_.preTriggerFrames * pool_->bufferBytes() >> 20) << " MiB), then "
+                  << opt_.postTriggerFrames << " after each trigger\n";
+
+        pipeline.addStage("ring", 1, queue, [this](Frame &f)
+                          {
+            size_t length = 0;
+            const uint8_t *packed = util::mappedPlane(f.buffer, length);
+            PixelBuffer rec = pool_->lease();
+            const bool ok = rec && packed && length >= seqBytes_;
+            if (ok)
+                std::memcpy(PreTriggerRing::payload(rec), packed, seqBytes_);
+            pipeline_->release(f);
+            if (!ok)
+            {
+                std::cerr << tag() << "Pre-trigger copy failed.\n";
+                return false;
+            }
+            const uint64_t before = ring_->bytesQueued();
+            const bool pushed = ring_->push(std::move(rec), seqInfo(f), shared_.trigger->take());
+            f.bytesWritten = ring_->bytesQueued() - before;
+            return pushed; });
+    }
+    else if (opt_.writeSeq)
+    {
+        // One append-only container for the whole run, packed RAW10 payloads.
+        // Records must go out in order, so this stage is single-threaded.
+        char stamp[48];
+        const std::time_t now = std::time(nullptr);
+        const size_t n = std::strftime(stamp, sizeof(stamp), "imx296_%Y%m%d_%H%M%S", std::localtime(&now));
+        if (!label_.empty())
+            std::snprintf(stamp + n, sizeof(stamp) - n, "_%s", label_.c_str());
+        seqPath_ = util::joinPath(opt_.outDir, stamp) + SeqWriter::extension();
+        // A run that ends on the clock (--soak) has no real frame count: reserve
+        // index room for over an hour at 60 fps and let it grow past that
+        const size_t expected = std::min<size_t>(opt_.frames, size_t(1) << 18);
+        if (!seq_.open(seqPath_, seqHdr_, expected, shared_.writer && opt_.directIo))
+            std::cerr << tag() << "Failed to create " << seqPath_ << "\n";
+        seqDirect_ = seq_.direct();
+
+        pipeline.addStage("write", 1, queue, [this](Frame &f)
+                          {
+            size_t length = 0;
+            const uint8_t *packed = util::mappedPlane(f.buffer, length);
+            const size_t bytes = seqBytes_;
+            const SeqFrameInfo info = seqInfo(f);
+            if (shared_.writer)
+            {
+                // Copy the record out so the camera buffer goes straight back,
+                // then queue it at the offset it was given
+                PixelBuffer rec = pool_->lease();
+                bool ok = rec && packed && length >= bytes;
+                if (ok)
+                {
+                    uint8_t *dst = rec.base();
+                    const uint64_t at = seq_.stage(info, packed, bytes, dst);
+                    pipeline_->release(f);
+                    f.bytesWritten = seq_.recordBytes(bytes);
+                    ok = shared_.writer->writeAt(seq_.fd(), at, std::move(rec), dst, f.bytesWritten,
+                                                 &SeqWriter::onWriteFailed, &seq_);
+                    if (!ok)
+                        seq_.discard(at);
+                }
+                if (!ok)
+                    std::cerr << tag() << "SEQ append failed.\n";
+                return ok;
+            }
+            const uint64_t before = seq_.bytesWritten();
+            bool ok = packed && length >= bytes && seq_.append(info, packed, bytes);
+            f.bytesWritten = seq_.bytesWritten() - before;
+            pipeline_->release(f);
+            if (ok)
+                (*shared_.saved)++;
+            else
+                std::cerr << tag() << "SEQ append failed.\n";
+            return ok; });
+    }
+    else if (opt_.writeRaw10p)
+    {
+        // Packed RAW10: no unpack stage at all. The writer streams the CSI-2 plane
+        // straight out of the mmap (row padding and all, as recorded in the
+        // header's stride) and only then gives the buffer back.
+        Raw10PHeader hdr;
+        hdr.width = outW_;
+        hdr.height = outH_;
+        hdr.stride = static_cast<uint32_t>(packedStride_);
+        hdr.bayer = seqHdr_.bayer;
+
+        pipeline.addStage("write", opt_.writers, queue, [this, hdr](Frame &f)
+                          {
+            size_t length = 0;
+            const uint8_t *packed = util::mappedPlane(f.buffer, length);
+            const size_t bytes = packedStride_ * outH_;
+            bool ok = packed && length >= bytes &&
+                      Raw10PFile::write(pathFor(f, Raw10PFile::extension()), hdr, packed, bytes);
+            if (ok)
+                f.bytesWritten = sizeof(Raw10PHeader) + bytes;
+            pipeline_->release(f);
+            if (ok)
+                (*shared_.saved)++;
+            else
+                std::cerr << tag() << "RAW10P write failed.\n";
+            return ok; });
+    }
+    else if (opt_.dngPieces)
+    {
+        // Strip/tile DNG: each piece unpacks its own rows from the mmap on
+        // whichever core picks it up and is written as soon as it's ready.
+        // The camera buffer goes back once the whole frame is on disk.
+        Raw10PHeader packedHdr;
+        packedHdr.width = outW_;
+        packedHdr.height = outH_;
+        packedHdr.stride = static_cast<uint32_t>(packedStride_);
+        packedHdr.bayer = seqHdr_.bayer;
+
+        pipeline.addStage("dng", opt_.writers, queue, [this, fusedCal, packedHdr](Frame &f)
+                          {
+            if (f.writePacked)
+            {
+                // --degrade raw10p: the plane as it is, like --outfmt RAW10P
+                size_t length = 0;
+                const uint8_t *packed = util::mappedPlane(f.buffer, length);
+                const size_t bytes = packedStride_ * outH_;
+                const bool ok = packed && length >= bytes &&
+                                Raw10PFile::write(pathFor(f, Raw10PFile::extension()), packedHdr, packed, bytes);
+                if (ok)
+                    f.bytesWritten = sizeof(Raw10PHeader) + bytes;
+                pipeline_->release(f);
+                if (ok)
+                    (*shared_.saved)++;
+                else
+                    std::cerr << tag() << "RAW10P write failed.\n";
+                return ok;
+            }
+
+            DngSource src;
+            src.packed = util::mappedPlane(f.buffer, src.packedBytes);
+            src.packedStride = packedStride_;
+            src.calibration = fusedCal;
+            src.originX = winX_;
+            src.originY = winY_;
+
+            const DngWriter &dng = f.uncompressed && dngPlain_ ? *dngPlain_ : *dng_;
+            const bool ok = src.packed && dng.writeFrame(pathFor(f, ".dng"), src, dngInfo(f), shared_.encodePool,
+                                                         &f.bytesWritten);
+            pipeline_->release(f);
+            if (ok)
+                (*shared_.saved)++;
+            else
+                std::cerr << tag() << "DNG write failed.\n";
+            return ok; });
+    }
+    else
+    {
+        // Stage 1: RAW10 → 16-bit into a pooled buffer. The camera buffer is
+        // returned right after this.
+        // Black level/defect correction happens on each row as it is unpacked.
+        // --degrade raw10p instead copies the packed rows, compacted, in behind
+        // room for the .r10p header.
+        const size_t lineBytes = (size_t(outW_) * 10 + 7) / 8;
+        Raw10PHeader packedHdr;
+        packedHdr.width = outW_;
+        packedHdr.height = outH_;
+        packedHdr.stride = static_cast<uint32_t>(lineBytes);
+        packedHdr.bayer = seqHdr_.bayer;
+
+        pipeline.addStage("unpack", opt_.workers, queue, [this, fusedCal, lineBytes](Frame &f)
+                          {
+            f.pixels = pool_->lease();
+            bool ok;
+            if (f.writePacked)
+            {
+                size_t length = 0;
+                const uint8_t *packed = util::mappedPlane(f.buffer, length);
+                ok = f.pixels && packed && length >= packedStride_ * (outH_ - 1) + lineBytes;
+                uint8_t *dst = ok ? f.pixels.base() + sizeof(Raw10PHeader) : nullptr;
+                for (uint32_t y = 0; ok && y < outH_; ++y)
+                    std::memcpy(dst + y * lineBytes, packed + y * packedStride_, lineBytes);
+            }
+            else if (reduced_)
+            {
+                // Binned/channel/8-bit samples in one pass over the packed rows
+                size_t length = 0;
+                const uint8_t *packed = util::mappedPlane(f.buffer, length);
+                ok = f.pixels && packed &&
+                     opt_.output.reduce(packed, length, packedStride_, outW_, outH_, f.pixels.base() + outHeader_,
+                                        pool_->bufferBytes() - outHeader_, opt_.writePgm, fusedCal, winX_, winY_);
+            }
+            else if (fusedCal)
+            {
+                size_t length = 0;
+                const uint8_t *packed = util::mappedPlane(f.buffer, length);
+                ok = packed && fusedCal->unpack(packed, length, packedStride_, outW_, outH_, f.pixels.data(),
+                                                f.pixels.size(), winX_, winY_);
+            }
+            else
+                ok = util::unpackRaw10To16(f.buffer, outW_, outH_, packedStride_, f.pixels.data(),
+                                           f.pixels.size());
+            pipeline_->release(f);
+            if (!ok)
+                std::cerr << tag() << "Unpack RAW10 failed.\n";
+            return ok; });
+
+        // Stage 2: encode + write. The DNG header is prebuilt, so "encoding" is
+        // patching a few per-frame values before one writev.
+        pipeline.addStage("write", opt_.writers, queue, [this, packedHdr](Frame &f)
+                          {
+            bool ok = true;
+            if (f.writePacked)
+            {
+                uint8_t *file = f.pixels.base();
+                const size_t payload = size_t(packedHdr.stride) * outH_;
+                f.bytesWritten = sizeof(Raw10PHeader) + payload;
+                const std::string &path = pathFor(f, Raw10PFile::extension());
+                if (shared_.writer)
+                {
+                    std::memcpy(file, &packedHdr, sizeof(packedHdr));
+                    ok = shared_.writer->writeFile(path, std::move(f.pixels), file, f.bytesWritten);
+                }
+                else if ((ok = Raw10PFile::write(path, packedHdr, file + sizeof(Raw10PHeader), payload)))
+                    (*shared_.saved)++;
+                if (!ok)
+                    std::cerr << tag() << "RAW10P write failed.\n";
+                return ok;
+            }
+            if (reduced_)
+            {
+                // Header into the room the unpack stage left, then header and
+                // samples go out as one write, async or not
+                const char *ext = opt_.writeDng ? ".dng" : opt_.writeTiff ? ".tif" : opt_.writePgm ? ".pgm" : ".raw";
+                uint8_t *file = f.pixels.base();
+                if (opt_.writeDng || opt_.writeTiff)
+                    dng_->buildHeader(file, dngInfo(f));
+                else if (opt_.writePgm)
+                    std::memcpy(file, pgmHeader_.data(), pgmHeader_.size());
+                f.bytesWritten = outHeader_ + outBytes_;
+                const std::string &path = pathFor(f, ext);
+                if (shared_.writer)
+                    ok = shared_.writer->writeFile(path, std::move(f.pixels), file, f.bytesWritten);
+                else if ((ok = util::writeFile(path.c_str(), file, f.bytesWritten)))
+                    (*shared_.saved)++;
+                if (!ok)
+                    std::cerr << tag() << "Write of " << path << " failed.\n";
+                return ok;
+            }
+            const bool writeDng = opt_.writeDng;
+            if (shared_.writer)
+            {
+                // Header into the headroom right in front of the pixels, then one
+                // aligned write of the whole file; the lease travels with it
+                uint8_t *file = reinterpret_cast<uint8_t *>(f.pixels.data());
+                size_t bytes = f.pixels.size() * 2;
+                if (writeDng)
+                {
+                    file = f.pixels.base();
+                    dng_->buildHeader(file, dngInfo(f));
+                    bytes = dng_->headerSize() + dng_->pixelBytes();
+                }
+                f.bytesWritten = bytes;
+                ok = shared_.writer->writeFile(pathFor(f, writeDng ? ".dng" : ".raw"), std::move(f.pixels), file,
+                                               bytes);
+                if (!ok)
+                    std::cerr << tag() << (writeDng ? "DNG" : "RAW") << " write failed.\n";
+                return ok;
+            }
+            if (writeDng)
+            {
+                ok = dng_->writeFrame(pathFor(f, ".dng"), f.pixels.data(), dngInfo(f));
+                if (ok)
+                    f.bytesWritten = dng_->headerSize() + dng_->pixelBytes();
+                else
+                    std::cerr << tag() << "DNG write failed.\n";
+            }
+            else
+            {
+                // Dump as raw16 little-endian (10 bits valid)
+                ok = util::writeFile(pathFor(f, ".raw").c_str(), f.pixels.data(), f.pixels.size() * 2);
+                if (ok)
+                    f.bytesWritten = f.pixels.size() * 2;
+                else
+                    std::cerr << tag() << "RAW write failed.\n";
+            }
+            if (ok)
+                (*shared_.saved)++;
+            return ok; });
+    }
+}
+
+bool CaptureSession::start()
+{
+    if (!connected_)
+    {
+        camera_->requestCompleted.connect(this, &CaptureSession::onRequestComplete);
+        connected_ = true;
+    }
+    else
+    {
+        // Back from the last run, cancelled by its stop()
+        for (auto &r : requests_)
+            r->reuse(libcamera::Request::ReuseBuffers);
+    }
+    pipeline_->start();
+
+    // Queue all initial requests
+    for (auto &r : requests_)
+    {
+        if (!queue(r.get()))
+        {
+            std::cerr << tag() << "Queue request failed.\n";
+            return false;
+        }
+    }
+
+    if (camera_->start())
+    {
+        std::cerr << tag() << "Camera start failed.\n";
+        return false;
+    }
+    started_ = true;
+    reporter_->start();
+    return true;
+}
+
+// Give a request back to the camera. Runs on a pipeline worker as soon as the
+// stage that needed the buffer bytes is done with them.
+void CaptureSession::recycle(libcamera::Request *req)
+{
+    if (!capturing_.load(std::memory_order_acquire) || *shared_.stop)
+        return;
+    req->reuse(libcamera::Request::ReuseBuffers);
+    if (!queue(req))
+        std::cerr << tag() << "Re-queue request failed.\n";
+}
+
+bool CaptureSession::queue(libcamera::Request *req)
+{
+    if (!controls_->scheduled())
+    {
+        controls_->apply(req);
+        return camera_->queueRequest(req) == 0;
+    }
+    // Steps are handed out and queued under one lock: two workers recycling at
+    // once would otherwise queue them swapped, and the lead (bindNext()) only
+    // holds if requests reach the camera in the order their steps were counted.
+    std::lock_guard<std::mutex> lk(queueMutex_);
+    controls_->apply(req);
+    requestStep_[req->cookie()] = controls_->bindNext(req) + 1;
+    return camera_->queueRequest(req) == 0;
+}
+
+// Completion callback: hand the buffer to the pipeline and return.
+void CaptureSession::onRequestComplete(libcamera::Request *req)
+{
+    // libcamera's thread: placed once, from the inside (it isn't ours to create)
+    thread_local bool placed = false;
+    if (!placed)
+    {
+        ThreadPlacement::enter(ThreadRole::Capture, "libcamera", false);
+        placed = true;
+    }
+    if (req->status() == libcamera::Request::RequestCancelled)
+        return;
+    if (!capturing_.load(std::memory_order_acquire))
+        return;
+
+    const auto &buffers = req->buffers();
+    auto it = buffers.begin();
+    if (it == buffers.end())
+    {
+        std::cerr << tag() << "No buffer in request.\n";
+        return;
+    }
+
+    Frame f;
+    f.completedNs = util::monotonicNs();
+    if (!firstFrameNs_.load(std::memory_order_relaxed))
+    {
+        firstFrameNs_.store(f.completedNs, std::memory_order_release);
+        shared_.wakeup->notify(); // the main thread prints time to first frame
+    }
+    f.request = req;
+    f.buffer = it->second;
+
+    const libcamera::ControlList &md = req->metadata();
+    f.sequence = f.buffer->metadata().sequence;
+    f.sensorTimestampNs = md.get(libcamera::controls::SensorTimestamp).value_or(int64_t(f.buffer->metadata().timestamp));
+    // With several cameras the file number is the matched set's, so frames taken
+    // together share it even when one camera dropped some
+    f.index = shared_.matcher ? shared_.matcher->add(index_, f.sensorTimestampNs) : captured_;
+    captured_++;
+    const DropDetector::Result dr = drops_->observe(f.sequence, f.sensorTimestampNs);
+    f.dropsBefore = dr.dropsBefore;
+    f.flags = dr.flags;
+    if (dr.dropsBefore && opt_.maxDrops >= 0)
+        shared_.wakeup->notify(); // main loop checks --max-drops
+    f.exposureUs = md.get(libcamera::controls::ExposureTime).value_or(opt_.exposureUs);
+    f.analogueGain = md.get(libcamera::controls::AnalogueGain).value_or(opt_.analogueGain);
+    if (!requestStep_.empty())
+    {
+        // The frame is tagged with the step its metadata (above) shows, which
+        // is the one meant for it unless the lead is off or the sensor dropped
+        // a frame. Off schedule: no step fits, and it keeps the intended one.
+        // Triggered exposure is the pulse's, so only gain counts.
+        const uint32_t meant = requestStep_[req->cookie()] - 1;
+        const int got = controls_->matchStep(f.exposureUs, f.analogueGain, meant, !opt_.externalTrigger);
+        f.scheduleStep = (got >= 0 ? uint32_t(got) : meant) + 1;
+        if (got < 0)
+        {
+            f.flags |= FrameOffSchedule;
+            offSchedule_.store(offSchedule_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    if (captured_ >= opt_.frames || *shared_.stop)
+        capturing_.store(false, std::memory_order_release);
+    if (backpressure_ && !degrade(f))
+        return;
+    if (!pipeline_->submit(std::move(f)))
+        std::cerr << tag() << "Pipeline full, frame dropped.\n";
+}
+
+bool CaptureSession::degrade(Frame &f)
+{
+    Backpressure &bp = *backpressure_;
+    bp.update(pipeline_->fill(), pipeline_->writerLatencyNs(), f.index, tag());
+    if (bp.active(DegradeAction::Decimate) && (decimated_++ & 1))
+    {
+        bp.affected(DegradeAction::Decimate);
+        pipeline_->shed(f);
+        return false;
+    }
+    if (!bp.active(DegradeAction::Decimate))
+        decimated_ = 0;
+    // Room for this frame, made by the one that has waited longest, so what
+    // reaches the disk stays recent instead of submit() refusing the newest
+    if (bp.active(DegradeAction::DropOldest))
+        bp.affected(DegradeAction::DropOldest, pipeline_->shedOldest(pipeline_->frontCapacity() - 1));
+    if (packedDegrade_ && bp.active(DegradeAction::PackedRaw10))
+    {
+        f.writePacked = true;
+        bp.affected(DegradeAction::PackedRaw10);
+    }
+    else if (dngPlain_ && bp.active(DegradeAction::NoCompression))
+    {
+        f.uncompressed = true;
+        bp.affected(DegradeAction::NoCompression);
+    }
+    return true;
+}
+
+void CaptureSession::stopCapture()
+{
+    capturing_.store(false, std::memory_order_release);
+    if (started_)
+        camera_->stop(); // cancels whatever is still queued
+    started_ = false;
+}
+
+void CaptureSession::finish()
+{
+    if (pipeline_)
+        pipeline_->finish(); // drain frames already handed off
+    if (ring_)
+        ring_->finish(); // closes a burst still in progress
+}
+
+void CaptureSession::closeOutputs()
+{
+    if (dark_)
+    {
+        const std::string path = !opt_.calibrationPath.empty()
+                                     ? opt_.calibrationPath
+                                     : util::joinPath(opt_.outDir, "imx296_dark" + (label_.empty() ? "" : "_" + label_) +
+                                                                      Calibration::extension());
+        Calibration cal;
+        if (!dark_->result(cal) || !cal.save(path))
+        {
+            std::cerr << tag() << "Failed to write dark calibration " << path << "\n";
+            return;
+        }
+        const uint16_t *bl = cal.blackLevels();
+        std::cout << tag() << "Dark calibration: " << cal.header().frames << " frame(s), black " << bl[0] << "/"
+                  << bl[1] << "/" << bl[2] << "/" << bl[3] << ", " << cal.defects() << " hot pixel(s) → " << path
+                  << "\n";
+    }
+    if (!seq_.isOpen())
+        return;
+    if (seq_.close())
+        std::cout << tag() << "Sequence: " << seq_.frames() << " frame(s) in " << seqPath_ << "\n";
+    else
+        std::cerr << tag() << "Failed to finalize " << seqPath_ << "\n";
+}
+
+uint64_t CaptureSession::lost() const
+{
+    return (drops_ ? drops_->dropped() : 0) + (pipeline_ ? pipeline_->dropped() : 0);
+}
+
+void CaptureSession::report(std::ostream &os) const
+{
+    if (!pipeline_)
+        return;
+    for (const auto &st : pipeline_->stats())
+    {
+        os << tag() << "Stage " << st.name << ": " << st.processed << " ok, " << st.failed
+           << " failed, max queue depth " << st.maxDepth << "/" << st.capacity
+           << ", heap allocs after warm-up " << st.allocs << ", done p50/p99/max "
+           << std::fixed << std::setprecision(2) << st.done.p50 / 1e6 << "/" << st.done.p99 / 1e6
+           << "/" << st.done.max / 1e6 << " ms\n"
+           << std::defaultfloat;
+    }
+    const LatencyHistogram::Summary rq = pipeline_->requeueLatency();
+    if (rq.count)
+        os << tag() << "Completion → re-queue p50/p99/max " << std::fixed << std::setprecision(3) << rq.p50 / 1e6
+           << "/" << rq.p99 / 1e6 << "/" << rq.max / 1e6 << " ms\n"
+           << std::defaultfloat;
+    if (ring_)
+        os << tag() << "Pre-trigger: " << ring_->bursts() << " burst(s), " << ring_->framesWritten()
+           << " frame(s) written" << (ring_->bursts() ? ", last " + ring_->lastPath() : std::string()) << "\n";
+    if (backpressure_)
+    {
+        backpressure_->report(os, tag());
+        if (pipeline_->shedCount())
+            os << tag() << "Shed " << pipeline_->shedCount() << " frame(s) under backpressure\n";
+    }
+    if (pipeline_->dropped())
+        os << tag() << "Dropped " << pipeline_->dropped() << " frame(s): pipeline full\n";
+    if (drops_->dropped() || drops_->offInterval())
+        os << tag() << "Sensor: " << drops_->dropped() << " frame(s) missing in " << drops_->gaps() << " gap(s), "
+           << drops_->offInterval() << " frame(s) off the " << frameDurationNs_ / 1000 << " us interval\n";
+    if (controls_ && controls_->scheduled())
+        os << tag() << "Exposure schedule: " << controls_->schedule().size() << " step(s), "
+           << offSchedule_.load(std::memory_order_relaxed) << " frame(s) off their step (flagged in SEQ records)\n";
+    if (needsPixels_)
+    {
+        const FramePool::Stats ps = pool_->stats();
+        os << tag() << "Frame pool: " << ps.buffers << " buffer(s), max in use " << ps.maxInUse
+           << ", " << ps.leases << " lease(s), " << ps.misses << " miss(es)\n";
+    }
+}
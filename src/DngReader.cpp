@@ -0,0 +1,162 @@
+#include "DngReader.hpp"
+#include "LosslessJpeg.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    uint16_t get16(const uint8_t *p)
+    {
+        uint16_t v;
+        std::memcpy(&v, p, 2);
+        return v;
+    }
+    uint32_t get32(const uint8_t *p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    // One IFD entry's values as integers (SHORT or LONG), or its raw bytes
+    struct Field
+    {
+        uint16_t type{0};
+        uint32_t count{0};
+        const uint8_t *data{nullptr}; // inline in the entry or at its offset
+
+        uint32_t at(uint32_t i) const { return type == 3 ? get16(data + 2 * i) : get32(data + 4 * i); }
+    };
+
+    bool field(const uint8_t *file, size_t bytes, const uint8_t *entry, Field &f)
+    {
+        f.type = get16(entry + 2);
+        f.count = get32(entry + 4);
+        const size_t size = f.type == 3 ? 2 : f.type == 4 ? 4 : f.type == 5 ? 8 : 1;
+        const uint64_t total = uint64_t(size) * f.count;
+        if (total <= 4)
+        {
+            f.data = entry + 8;
+            return true;
+        }
+        const uint32_t off = get32(entry + 8);
+        if (off > bytes || bytes - off < total)
+            return false;
+        f.data = file + off;
+        return true;
+    }
+} // namespace
+
+bool DngReader::decode(const uint8_t *file, size_t bytes, DngImage &out)
+{
+    if (!file || bytes < 8 || get16(file) != 0x4949 || get16(file + 2) != 42)
+        return false;
+    const uint32_t ifd = get32(file + 4);
+    if (ifd > bytes || bytes - ifd < 2)
+        return false;
+    const uint16_t entries = get16(file + ifd);
+    if ((bytes - ifd - 2) / 12 < entries)
+        return false;
+
+    uint32_t width = 0, height = 0, bits = 0, compression = 1, rowsPerStrip = 0, tileW = 0, tileH = 0;
+    Field offsets, counts, record;
+    bool tiled = false;
+    for (uint16_t i = 0; i < entries; i++)
+    {
+        const uint8_t *e = file + ifd + 2 + 12 * i;
+        Field f;
+        if (!field(file, bytes, e, f))
+            return false;
+        switch (get16(e))
+        {
+        case 256:
+            width = f.at(0);
+            break;
+        case 257:
+            height = f.at(0);
+            break;
+        case 258:
+            bits = f.at(0);
+            break;
+        case 259:
+            compression = f.at(0);
+            break;
+        case 278:
+            rowsPerStrip = f.at(0);
+            break;
+        case 273:
+            offsets = f;
+            break;
+        case 279:
+            counts = f;
+            break;
+        case 322:
+            tileW = f.at(0);
+            break;
+        case 323:
+            tileH = f.at(0);
+            break;
+        case 324:
+            offsets = f;
+            tiled = true;
+            break;
+        case 325:
+            counts = f;
+            break;
+        case 50740:
+            record = f;
+            break;
+        }
+    }
+    if (!width || !height || bits != 16 || (compression != 1 && compression != 7) || !offsets.data ||
+        !counts.data || offsets.count != counts.count)
+        return false;
+    if (tiled ? (!tileW || !tileH) : compression != 1)
+        return false; // we only ever compress tiles
+    if (!tiled)
+    {
+        rowsPerStrip = rowsPerStrip ? std::min(rowsPerStrip, height) : height;
+        tileW = width;
+        tileH = rowsPerStrip;
+    }
+    const uint32_t across = (width + tileW - 1) / tileW;
+    const uint32_t down = (height + tileH - 1) / tileH;
+    if (offsets.count != uint64_t(across) * down)
+        return false;
+
+    out.width = width;
+    out.height = height;
+    out.pixels.resize(size_t(width) * height);
+    thread_local std::vector<uint16_t> tile;
+    for (uint32_t i = 0; i < offsets.count; i++)
+    {
+        const uint32_t off = offsets.at(i), len = counts.at(i);
+        if (off > bytes || bytes - off < len)
+            return false;
+        const uint32_t x0 = (i % across) * tileW, y0 = (i / across) * tileH;
+        const uint32_t cols = std::min(tileW, width - x0), rows = std::min(tileH, height - y0);
+        // Strips hold only their own rows; tiles are always whole, edges padded
+        const uint32_t storedRows = tiled ? tileH : rows;
+        const uint8_t *src = file + off;
+        if (compression == 7)
+        {
+            tile.resize(size_t(tileW) * tileH);
+            if (!util::ljpeg::decode(src, len, tile.data(), tileW, tileH, tileW))
+                return false;
+            src = reinterpret_cast<const uint8_t *>(tile.data());
+        }
+        else if (len < size_t(tileW) * storedRows * 2)
+            return false;
+        for (uint32_t y = 0; y < rows; y++)
+            std::memcpy(out.pixels.data() + size_t(y0 + y) * width + x0, src + size_t(y) * tileW * 2,
+                        size_t(cols) * 2);
+    }
+
+    out.hasRecord = false;
+    if (record.data && record.count >= sizeof(DngFrameRecord))
+    {
+        std::memcpy(&out.record, record.data, sizeof(DngFrameRecord));
+        out.hasRecord = std::memcmp(out.record.maker, DngFrameRecord{}.maker, sizeof(out.record.maker)) == 0;
+    }
+    return true;
+}
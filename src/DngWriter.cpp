@@ -1,14 +1,28 @@
 #include "DngWriter.hpp"
+#include "Calibration.hpp"
+#include "IoUtil.hpp"
+#include "LosslessJpeg.hpp"
+#include "Raw10Kernels.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
 #include <vector>
 #include <array>
 #include <cstdint>
-#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
 
 /*
  * Minimal TIFF/DNG writer. We keep this short and clear.
  * For production, consider libtiff + full DNG tag coverage.
+ *
+ * Everything in front of the pixel strip is identical from frame to frame except
+ * a couple of values, so we lay it out once per session (IfdBuilder below) and
+ * per frame only copy it, patch those values and writev() header + strip.
  */
 
 namespace
@@ -53,26 +67,30 @@ namespace
         TAG_RowsPerStrip = 278,
         TAG_StripByteCounts = 279,
         TAG_PlanarConfig = 284,
+        TAG_TileWidth = 322,
+        TAG_TileLength = 323,
+        TAG_TileOffsets = 324,
+        TAG_TileByteCounts = 325,
         TAG_CFARepeatPattern = 33421,
         TAG_CFAPattern = 33422,
+        TAG_ExposureTime = 33434,
+        TAG_ISOSpeedRatings = 34855,
+        TAG_DateTimeOriginal = 36867,
+        TAG_OffsetTimeOriginal = 36881,
+        TAG_SubSecTimeOriginal = 37521,
         // DNG specific
         TAG_DNGVersion = 50706,
         TAG_UniqueCameraModel = 50708,
         TAG_CFAPlaneColor = 50710,
+        TAG_BlackLevelRepeatDim = 50713,
         TAG_BlackLevel = 50714,
         TAG_WhiteLevel = 50717,
         TAG_DefaultScale = 50733,
+        TAG_DNGPrivateData = 50740,
         TAG_CalibrationIlluminant1 = 50778,
         TAG_ColorMatrix1 = 50721,
     };
 
-    uint16_t bayerToPlane(const BayerPattern b)
-    {
-        // 0=Red, 1=Green, 2=Blue, order of planes in CFA
-        // DNG spec expects a 3-byte array for CFAPlaneColor = {0,1,2}
-        return 0; // not used per-plane here (we supply array)
-    }
-
     std::array<uint8_t, 4> bayerPattern2x2(const BayerPattern b)
     {
         // 2x2 CFAPattern values: 0=Red,1=Green,2=Blue
@@ -90,9 +108,158 @@ namespace
         return {0, 1, 1, 2};
     }
 
+    size_t typeSize(uint16_t type)
+    {
+        switch (type)
+        {
+        case TYPE_SHORT:
+            return 2;
+        case TYPE_LONG:
+            return 4;
+        case TYPE_RATIONAL:
+            return 8;
+        default:
+            return 1; // BYTE, ASCII
+        }
+    }
+
+    void put16(uint8_t *p, uint16_t v) { std::memcpy(p, &v, 2); }
+    void put32(uint8_t *p, uint32_t v) { std::memcpy(p, &v, 4); }
+
+    /*
+     * Collects IFD entries, then lays out header + IFD + out-of-line values in one
+     * buffer. Values that fit in 4 bytes go inline in the entry, as TIFF requires;
+     * entries are emitted sorted by tag.
+     */
+    class IfdBuilder
+    {
+    public:
+        void add(uint16_t tag, uint16_t type, uint32_t count, const void *data)
+        {
+            Entry e{tag, type, count, {}};
+            const uint8_t *p = static_cast<const uint8_t *>(data);
+            e.data.assign(p, p + typeSize(type) * count);
+            entries_.push_back(std::move(e));
+        }
+        void shorts(uint16_t tag, std::vector<uint16_t> v) { add(tag, TYPE_SHORT, uint32_t(v.size()), v.data()); }
+        void longs(uint16_t tag, std::vector<uint32_t> v) { add(tag, TYPE_LONG, uint32_t(v.size()), v.data()); }
+        void bytes(uint16_t tag, std::vector<uint8_t> v) { add(tag, TYPE_BYTE, uint32_t(v.size()), v.data()); }
+        void ascii(uint16_t tag, const std::string &s) { add(tag, TYPE_ASCII, uint32_t(s.size() + 1), s.c_str()); }
+        void rationals(uint16_t tag, const std::vector<std::pair<uint32_t, uint32_t>> &v)
+        {
+            std::vector<uint32_t> flat;
+            for (const auto &r : v)
+            {
+                flat.push_back(r.first);
+                flat.push_back(r.second);
+            }
+            add(tag, TYPE_RATIONAL, uint32_t(v.size()), flat.data());
+        }
+
+        // Header + IFD + data, padded to `align`. valueOffset() is valid afterwards.
+        std::vector<uint8_t> build(size_t align)
+        {
+            std::stable_sort(entries_.begin(), entries_.end(),
+                             [](const Entry &a, const Entry &b)
+                             { return a.tag < b.tag; });
+
+            const uint32_t ifdOff = sizeof(TiffHeader);
+            const uint32_t ifdBytes = 2 + uint32_t(entries_.size()) * sizeof(IfdEntry) + 4;
+            uint32_t dataOff = ifdOff + ifdBytes;
+            for (const auto &e : entries_)
+            {
+                if (e.data.size() > 4)
+                    dataOff += uint32_t((e.data.size() + 1) & ~size_t(1)); // word-aligned values
+            }
+            std::vector<uint8_t> out((dataOff + align - 1) / align * align, 0);
+
+            TiffHeader hdr{0x4949, 42, ifdOff}; // little-endian
+            std::memcpy(out.data(), &hdr, sizeof(hdr));
+            put16(&out[ifdOff], uint16_t(entries_.size()));
+
+            uint32_t entryOff = ifdOff + 2;
+            uint32_t valOff = ifdOff + ifdBytes;
+            for (auto &e : entries_)
+            {
+                put16(&out[entryOff], e.tag);
+                put16(&out[entryOff + 2], e.type);
+                put32(&out[entryOff + 4], e.count);
+                if (e.data.size() <= 4)
+                {
+                    e.valueAt = entryOff + 8;
+                }
+                else
+                {
+                    e.valueAt = valOff;
+                    put32(&out[entryOff + 8], valOff);
+                    valOff += uint32_t((e.data.size() + 1) & ~size_t(1));
+                }
+                std::memcpy(&out[e.valueAt], e.data.data(), e.data.size());
+                entryOff += sizeof(IfdEntry);
+            }
+            put32(&out[entryOff], 0); // no next IFD
+            return out;
+        }
+
+        uint32_t valueOffset(uint16_t tag) const
+        {
+            for (const auto &e : entries_)
+            {
+                if (e.tag == tag)
+                    return e.valueAt;
+            }
+            return 0;
+        }
+
+    private:
+        struct Entry
+        {
+            uint16_t tag;
+            uint16_t type;
+            uint32_t count;
+            std::vector<uint8_t> data;
+            uint32_t valueAt{0};
+        };
+        std::vector<Entry> entries_;
+    };
+
+    // Seconds → rational with microsecond resolution (what the sensor controls are in)
+    std::pair<uint32_t, uint32_t> exposureRational(float seconds)
+    {
+        const double us = std::max(0.0, double(seconds) * 1e6);
+        return {static_cast<uint32_t>(std::lround(std::min(us, 4.0e9))), 1000000u};
+    }
+
+    uint32_t roundUp16(uint32_t v) { return (v + 15) & ~15u; }
+
+    // Default tile side for an `extent`-pixel edge: the multiple of 16 around
+    // kDefaultCompressedTile that pads it least (one that divides it pads
+    // nothing: 208 across and 272 down for the IMX296's 1456x1088), nearest the
+    // target on a tie. Edges up to the target are one tile.
+    uint32_t defaultTile(uint32_t extent)
+    {
+        const uint32_t target = DngWriter::kDefaultCompressedTile;
+        if (roundUp16(extent) <= target)
+            return roundUp16(extent);
+        uint32_t best = target;
+        uint64_t bestPad = UINT64_MAX, bestOff = 0;
+        for (uint32_t t = target / 2; t <= target * 2; t += 16)
+        {
+            const uint64_t pad = uint64_t((extent + t - 1) / t) * t - extent;
+            const uint64_t off = t > target ? t - target : target - t;
+            if (pad < bestPad || (pad == bestPad && off < bestOff))
+            {
+                best = t;
+                bestPad = pad;
+                bestOff = off;
+            }
+        }
+        return best;
+    }
+
 } // namespace
 
-static BayerPattern toBayer(const std::string &s)
+BayerPattern toBayer(const std::string &s)
 {
     if (s == "RGGB")
         return BayerPattern::RGGB;
@@ -105,184 +272,425 @@ static BayerPattern toBayer(const std::string &s)
     return BayerPattern::RGGB;
 }
 
-bool DngWriter::write(const std::string &path, const DngMeta &meta,
-                      const std::vector<uint16_t> &pixels)
+DngWriter::DngWriter(const DngMeta &meta)
+    : meta_(meta)
 {
     const uint32_t w = meta.width, h = meta.height;
-    if (pixels.size() != size_t(w) * h)
-        return false;
+    const std::string model = "Raspberry Pi Global Shutter Camera IMX296";
+    const auto patt = bayerPattern2x2(meta.bayer);
+
+    IfdBuilder ifd;
+    ifd.longs(TAG_ImageWidth, {w});
+    ifd.longs(TAG_ImageLength, {h});
+    // BitsPerSample = 16 for a single sample per pixel (Bayer)
+    ifd.shorts(TAG_BitsPerSample, {meta.bitsPerSample});
+    ifd.shorts(TAG_Compression, {uint16_t(compressed() ? 7 : 1)}); // 7 = lossless JPEG
+    const bool cfa = !meta.mono && !meta.plainTiff;
+    ifd.shorts(TAG_Photometric, {uint16_t(meta.plainTiff ? 1 : cfa ? 32803 : 34892)}); // BlackIsZero, CFA, LinearRaw
+    ifd.shorts(TAG_SamplesPerPixel, {1});
+    ifd.shorts(TAG_PlanarConfig, {1}); // contig
+
+    // Layout. Offsets are contiguous in the template (what the single-writev path
+    // uses); the parallel path patches them per frame in completion order.
+    std::vector<uint32_t> counts;
+    if (compressed() && !(meta.tileWidth && meta.tileLength))
+    {
+        // Compressed DNGs are read tile by tile in practice, so we always tile them
+        meta_.tileWidth = defaultTile(w);
+        meta_.tileLength = defaultTile(h);
+    }
+    if (meta_.tileWidth && meta_.tileLength)
+    {
+        // DNG: multiples of 16; a tile past the image edge would be all padding
+        tileW_ = std::min(roundUp16(meta_.tileWidth), roundUp16(w));
+        tileH_ = std::min(roundUp16(meta_.tileLength), roundUp16(h));
+        tilesAcross_ = (w + tileW_ - 1) / tileW_;
+        pieces_ = size_t(tilesAcross_) * ((h + tileH_ - 1) / tileH_);
+        // Edge tiles are padded. Compressed sizes are only known per frame.
+        counts.assign(pieces_, compressed() ? 0 : uint32_t(size_t(tileW_) * tileH_ * (meta.bitsPerSample / 8)));
+        ifd.longs(TAG_TileWidth, {tileW_});
+        ifd.longs(TAG_TileLength, {tileH_});
+        ifd.longs(TAG_TileOffsets, std::vector<uint32_t>(pieces_, 0));
+        ifd.longs(TAG_TileByteCounts, counts);
+    }
+    else
+    {
+        stripRows_ = (meta.rowsPerStrip && meta.rowsPerStrip < h) ? meta.rowsPerStrip : h;
+        pieces_ = (h + stripRows_ - 1) / stripRows_;
+        for (size_t i = 0; i < pieces_; i++)
+            counts.push_back(uint32_t(size_t(w) * std::min(stripRows_, h - uint32_t(i) * stripRows_) *
+                                      (meta.bitsPerSample / 8)));
+        ifd.longs(TAG_RowsPerStrip, {stripRows_});
+        ifd.longs(TAG_StripOffsets, std::vector<uint32_t>(pieces_, 0)); // patched below, once the header size is known
+        ifd.longs(TAG_StripByteCounts, counts);
+    }
+    if (cfa)
+    {
+        ifd.shorts(TAG_CFARepeatPattern, {2, 2});
+        ifd.bytes(TAG_CFAPattern, {patt[0], patt[1], patt[2], patt[3]});
+        ifd.bytes(TAG_CFAPlaneColor, {0, 1, 2});
+    }
+    if (!meta.plainTiff)
+    {
+        ifd.bytes(TAG_DNGVersion, {1, 4, 0, 0}); // DNG 1.4.0.0
+        ifd.ascii(TAG_UniqueCameraModel, model);
+        const uint16_t *bl = meta.blackLevel;
+        if (!cfa || (bl[0] == bl[1] && bl[0] == bl[2] && bl[0] == bl[3]))
+        {
+            ifd.shorts(TAG_BlackLevel, {bl[0]});
+        }
+        else
+        {
+            // One level per CFA position, in the same 2x2 order as CFAPattern
+            ifd.shorts(TAG_BlackLevelRepeatDim, {2, 2});
+            ifd.shorts(TAG_BlackLevel, {bl[0], bl[1], bl[2], bl[3]});
+        }
+        ifd.shorts(TAG_WhiteLevel, {meta.whiteLevel});
+        ifd.rationals(TAG_DefaultScale, {{1, 1}, {1, 1}});
+    }
+    if (cfa)
+    {
+        // A monochrome DNG has one colour plane and needs no matrix
+        ifd.shorts(TAG_CalibrationIlluminant1, {static_cast<uint16_t>(meta.cfaIlluminant)});
+        // ColorMatrix1 (placeholder identity)
+        // 3x3 matrix as rationals. Use identity to avoid lying—RAW editors will still open fine.
+        ifd.rationals(TAG_ColorMatrix1, {{1, 1}, {0, 1}, {0, 1}, {0, 1}, {1, 1}, {0, 1}, {0, 1}, {0, 1}, {1, 1}});
+    }
+    // Per-frame values: placeholders, patched by buildHeader(). The date stays
+    // blank (EXIF for "unknown") when a frame has no wall-clock time; it's UTC.
+    ifd.rationals(TAG_ExposureTime, {exposureRational(meta.exposureSeconds)});
+    ifd.shorts(TAG_ISOSpeedRatings, {100});
+    ifd.ascii(TAG_DateTimeOriginal, "    :  :     :  :  ");
+    ifd.ascii(TAG_SubSecTimeOriginal, "      "); // microseconds
+    ifd.ascii(TAG_OffsetTimeOriginal, "+00:00");
+    const DngFrameRecord record;
+    ifd.add(TAG_DNGPrivateData, TYPE_BYTE, sizeof(record), &record);
+
+    header_ = ifd.build(std::max<uint32_t>(16, meta.dataAlignment));
+    offsetsOff_ = ifd.valueOffset(tiled() ? TAG_TileOffsets : TAG_StripOffsets);
+    countsOff_ = ifd.valueOffset(tiled() ? TAG_TileByteCounts : TAG_StripByteCounts);
+    uint32_t off = static_cast<uint32_t>(header_.size());
+    for (size_t i = 0; i < pieces_; i++)
+    {
+        put32(&header_[offsetsOff_ + 4 * i], off);
+        off += counts[i];
+    }
+    exposureOff_ = ifd.valueOffset(TAG_ExposureTime);
+    isoOff_ = ifd.valueOffset(TAG_ISOSpeedRatings);
+    dateOff_ = ifd.valueOffset(TAG_DateTimeOriginal);
+    subSecOff_ = ifd.valueOffset(TAG_SubSecTimeOriginal);
+    recordOff_ = ifd.valueOffset(TAG_DNGPrivateData);
+}
+
+void DngWriter::buildHeader(uint8_t *dst, const DngFrameInfo &fi) const
+{
+    std::memcpy(dst, header_.data(), header_.size());
+
+    const auto exp = exposureRational(fi.exposureSeconds);
+    put32(dst + exposureOff_, exp.first);
+    put32(dst + exposureOff_ + 4, exp.second);
+    const long iso = std::lround(std::max(0.0f, fi.analogGain) * 100.0f);
+    put16(dst + isoOff_, static_cast<uint16_t>(std::min(iso, 65535L)));
+
+    DngFrameRecord rec;
+    rec.sensorTimestampNs = fi.sensorTimestampNs;
+    rec.sequence = fi.sequence;
+    rec.index = fi.index;
+    rec.flags = fi.flags;
+    rec.droppedBefore = fi.droppedBefore;
+    rec.scheduleStep = fi.scheduleStep;
+    std::memcpy(dst + recordOff_, &rec, sizeof(rec));
+
+    if (!fi.clockOffsetNs || fi.sensorTimestampNs <= 0)
+        return;
+    const int64_t ns = fi.sensorTimestampNs + fi.clockOffsetNs;
+    const time_t sec = static_cast<time_t>(ns / 1000000000);
+    // Frames come dozens per second: the date part is formatted once per second
+    // per thread, the microseconds are a few digit stores
+    thread_local time_t cachedSec = -1;
+    thread_local char cachedDate[20];
+    if (sec != cachedSec)
+    {
+        struct tm tm;
+        gmtime_r(&sec, &tm);
+        std::strftime(cachedDate, sizeof(cachedDate), "%Y:%m:%d %H:%M:%S", &tm);
+        cachedSec = sec;
+    }
+    std::memcpy(dst + dateOff_, cachedDate, 19);
+    uint32_t us = static_cast<uint32_t>(ns % 1000000000 / 1000);
+    for (int i = 5; i >= 0; --i, us /= 10)
+        dst[subSecOff_ + i] = static_cast<uint8_t>('0' + us % 10);
+}
 
-    std::ofstream f(path, std::ios::binary);
-    if (!f)
+bool DngWriter::writeFrame(const std::string &path, const uint16_t *pixels, const DngFrameInfo &fi) const
+{
+    if (!pixels)
         return false;
+    if (tiled())
+    {
+        // Tiles need re-arranging, which is the piecewise path's job
+        DngSource src;
+        src.pixels = pixels;
+        return writeFrame(path, src, fi, nullptr);
+    }
 
-    // Header
-    TiffHeader hdr{};
-    hdr.endian = 0x4949; // little-endian
-    hdr.magic = 42;
-    hdr.ifdOffset = sizeof(TiffHeader);
-    f.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    // Per-thread header scratch: sized on first use, reused after that
+    thread_local std::vector<uint8_t> scratch;
+    if (scratch.size() < header_.size())
+        scratch.resize(header_.size());
+    buildHeader(scratch.data(), fi);
 
-    // We’ll assemble IFD entries and data blocks, tracking offsets.
-    std::vector<IfdEntry> ifd;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
 
-    auto writeValue = [&](uint16_t tag, uint16_t type, uint32_t count, uint32_t value)
-    {
-        IfdEntry e{tag, type, count, value};
-        ifd.push_back(e);
-    };
+    struct iovec iov[2];
+    iov[0].iov_base = scratch.data();
+    iov[0].iov_len = header_.size();
+    iov[1].iov_base = const_cast<uint16_t *>(pixels);
+    iov[1].iov_len = pixelBytes();
+    bool ok = util::writevAll(fd, iov, 2);
+    if (::close(fd) != 0)
+        ok = false;
+    return ok;
+}
 
-    auto currentOffset = [&](void) -> uint32_t
+void DngWriter::gatherPiece(const DngSource &src, size_t i, uint16_t *dst, uint32_t &rows) const
+{
+    const uint32_t w = meta_.width, h = meta_.height;
+    uint32_t x0 = 0, y0, cols = w, outW = w;
+    if (tiled())
     {
-        return static_cast<uint32_t>(f.tellp());
-    };
+        x0 = uint32_t(i % tilesAcross_) * tileW_;
+        y0 = uint32_t(i / tilesAcross_) * tileH_;
+        cols = std::min(tileW_, w - x0);
+        outW = tileW_;
+        rows = tileH_;
+    }
+    else
+    {
+        y0 = uint32_t(i) * stripRows_;
+        rows = std::min(stripRows_, h - y0);
+    }
 
-    auto align2 = [&]()
+    const util::raw10::RowFn unpackRow = util::raw10::selected().fn;
+    const size_t pixelStride = src.pixelStride ? src.pixelStride : w;
+    for (uint32_t r = 0; r < rows; r++)
     {
-        if ((currentOffset() & 1) != 0)
+        uint16_t *out = dst + size_t(r) * outW;
+        const uint32_t y = y0 + r;
+        if (y >= h)
         {
-            uint8_t z = 0;
-            f.write(reinterpret_cast<const char *>(&z), 1);
+            // Bottom edge tile: pad with zeros
+            std::memset(out, 0, size_t(outW) * 2);
+            continue;
         }
-    };
+        if (src.packed)
+        {
+            // x0 is a multiple of 16, so it always starts on a 5-byte group
+            const size_t off = size_t(y) * src.packedStride + size_t(x0) / 4 * 5;
+            unpackRow(src.packed + off, src.packedBytes - off, out, cols);
+            if (src.calibration)
+                src.calibration->correctRow(out, src.originY + y, src.originX + x0, cols);
+        }
+        else
+        {
+            std::memcpy(out, src.pixels + size_t(y) * pixelStride + x0, size_t(cols) * 2);
+        }
+        if (cols < outW)
+            std::memset(out + cols, 0, size_t(outW - cols) * 2); // right edge tile
+    }
+}
 
-    // Reserve space for IFD count + entries + nextIFD
-    const uint16_t entryCount = 16 + 6; // approx number of entries (keep slack)
-    std::streampos ifdStart = f.tellp();
-    uint16_t actualCount = 0;
-    f.seekp(ifdStart + std::streamoff(2 + entryCount * sizeof(IfdEntry) + 4)); // skip ahead
+bool DngWriter::sourceOk(const DngSource &src) const
+{
+    // Pieces are gathered as 16-bit samples (gatherPiece()); narrower DNGs are
+    // only written whole, header + samples, by the caller
+    if ((!src.pixels && !src.packed) || meta_.bitsPerSample != 16)
+        return false;
+    const Calibration *cal = src.calibration;
+    if (cal && cal->correctsPixels() &&
+        (uint64_t(src.originX) + meta_.width > cal->header().width ||
+         uint64_t(src.originY) + meta_.height > cal->header().height))
+        return false;
+    return !src.packed ||
+           src.packedBytes >= src.packedStride * (meta_.height - 1) + (size_t(meta_.width) * 10 + 7) / 8;
+}
 
-    // Data blocks we must write first (BitsPerSample array, CFA arrays, ColorMatrix, etc.)
-    auto writeArraySHORT = [&](const std::vector<uint16_t> &arr) -> uint32_t
-    {
-        align2();
-        uint32_t off = currentOffset();
-        for (uint16_t v : arr)
-            f.write(reinterpret_cast<const char *>(&v), sizeof(v));
-        return off;
-    };
+uint32_t DngWriter::pieceRows(size_t i) const
+{
+    return tiled() ? tileH_ : std::min(stripRows_, meta_.height - uint32_t(i) * stripRows_);
+}
 
-    auto writeArrayBYTE = [&](const std::vector<uint8_t> &arr) -> uint32_t
-    {
-        align2();
-        uint32_t off = currentOffset();
-        f.write(reinterpret_cast<const char *>(arr.data()), arr.size());
-        return off;
-    };
+size_t DngWriter::encodedSize() const
+{
+    const size_t samples = tiled() ? size_t(tileW_) * tileH_ : size_t(stripRows_) * meta_.width;
+    if (compressed())
+        return header_.size() + pieces_ * util::ljpeg::maxEncodedSize(tileW_, tileH_);
+    if (tiled())
+        return header_.size() + pieces_ * samples * (meta_.bitsPerSample / 8);
+    return header_.size() + pixelBytes();
+}
 
-    auto writeArrayRATIONAL = [&](const std::vector<std::pair<uint32_t, uint32_t>> &arr) -> uint32_t
+template <typename Target, typename Put>
+uint64_t DngWriter::encodePieces(const DngSource &src, uint8_t *hdr, ThreadPool *pool, Target &&target,
+                                 Put &&put) const
+{
+    // Pieces land in the output in whatever order they finish; each one claims
+    // its range with a fetch_add, so the stores themselves need no lock.
+    std::atomic<uint64_t> cursor{header_.size()};
+    std::atomic<bool> ok{true};
+    const uint32_t w = meta_.width;
+    const size_t pixelStride = src.pixelStride ? src.pixelStride : w;
+    auto encodePiece = [&](size_t i)
     {
-        align2();
-        uint32_t off = currentOffset();
-        for (auto &p : arr)
+        uint32_t rows = pieceRows(i);
+        const size_t samples = size_t(rows) * (tiled() ? tileW_ : w);
+        thread_local std::vector<uint16_t> piece;
+        auto scratch = [&]
         {
-            f.write(reinterpret_cast<const char *>(&p.first), 4);
-            f.write(reinterpret_cast<const char *>(&p.second), 4);
+            const size_t maxSamples = tiled() ? size_t(tileW_) * tileH_ : size_t(stripRows_) * w;
+            if (piece.size() < maxSamples)
+                piece.resize(maxSamples);
+            return piece.data();
+        };
+
+        const void *data;
+        uint64_t bytes = samples * (meta_.bitsPerSample / 8); // 2: sourceOk() only takes 16-bit
+        uint64_t off;
+        if (!compressed())
+        {
+            off = cursor.fetch_add(bytes, std::memory_order_relaxed);
+            if (!tiled() && src.pixels && pixelStride == w)
+            {
+                // Unpacked, contiguous strip: straight from the caller's buffer
+                data = src.pixels + size_t(i) * stripRows_ * w;
+            }
+            else if (uint16_t *inPlace = target(off, bytes))
+            {
+                // The output is memory: unpack/gather right where the piece goes
+                gatherPiece(src, i, inPlace, rows);
+                data = nullptr;
+            }
+            else
+            {
+                uint16_t *out = scratch();
+                gatherPiece(src, i, out, rows);
+                data = out;
+            }
+        }
+        else
+        {
+            uint16_t *out = scratch();
+            gatherPiece(src, i, out, rows);
+            thread_local std::vector<uint8_t> jpeg;
+            const size_t cap = util::ljpeg::maxEncodedSize(tileW_, tileH_);
+            if (jpeg.size() < cap)
+                jpeg.resize(cap);
+            bytes = util::ljpeg::encode(out, tileW_, rows, tileW_, static_cast<uint8_t>(meta_.bitsPerSample),
+                                        jpeg.data(), jpeg.size());
+            if (bytes == 0)
+            {
+                ok.store(false, std::memory_order_relaxed);
+                return;
+            }
+            data = jpeg.data();
+            off = cursor.fetch_add(bytes, std::memory_order_relaxed);
         }
-        return off;
+
+        if (data && !put(data, bytes, off))
+            ok.store(false, std::memory_order_relaxed);
+        put32(hdr + offsetsOff_ + 4 * i, static_cast<uint32_t>(off));
+        put32(hdr + countsOff_ + 4 * i, static_cast<uint32_t>(bytes));
     };
 
-    auto writeAscii = [&](const std::string &s) -> uint32_t
+    if (pool)
+        pool->parallelFor(pieces_, encodePiece);
+    else
+        for (size_t i = 0; i < pieces_; i++)
+            encodePiece(i);
+    return ok.load() ? cursor.load() : 0;
+}
+
+size_t DngWriter::encode(const DngSource &src, const DngFrameInfo &fi, uint8_t *dst, size_t dstSize,
+                         ThreadPool *pool) const
+{
+    if (!dst || dstSize < header_.size() || !sourceOk(src))
+        return 0;
+    buildHeader(dst, fi);
+
+    auto target = [&](uint64_t off, uint64_t bytes) -> uint16_t *
     {
-        std::string z = s;
-        z.push_back('\0');
-        uint32_t off = currentOffset();
-        f.write(z.data(), z.size());
-        return off;
+        uint8_t *p = dst + off;
+        if (off + bytes > dstSize || reinterpret_cast<uintptr_t>(p) % alignof(uint16_t) != 0)
+            return nullptr;
+        return reinterpret_cast<uint16_t *>(p);
     };
-
-    // BitsPerSample = 16 for a single sample per pixel (Bayer)
-    uint32_t bpsOff = writeArraySHORT({meta.bitsPerSample});
-    // SamplesPerPixel = 1 (Bayer)
-    const uint16_t spp = 1;
-
-    // CFARepeatPatternDim = {2,2}
-    uint32_t cfaDimOff = writeArraySHORT({2, 2});
-
-    // CFAPattern 2x2
-    auto patt = bayerPattern2x2(meta.bayer);
-    uint32_t cfaPattOff = writeArrayBYTE({patt[0], patt[1], patt[2], patt[3]});
-
-    // CFAPlaneColor = {0,1,2}
-    uint32_t cfaPlaneColorOff = writeArrayBYTE({0, 1, 2});
-
-    // DefaultScale (optional, 1/1,1/1)
-    uint32_t defaultScaleOff = writeArrayRATIONAL({{1, 1}, {1, 1}});
-
-    // DNGVersion
-    uint32_t dngVerOff = writeArrayBYTE({1, 4, 0, 0}); // DNG 1.4.0.0
-
-    // UniqueCameraModel
-    uint32_t ucmOff = writeAscii("Raspberry Pi Global Shutter Camera IMX296");
-
-    // BlackLevel & WhiteLevel
-    uint32_t blackOff = writeArraySHORT({meta.blackLevel});
-    uint32_t whiteOff = writeArraySHORT({meta.whiteLevel});
-
-    // CalibrationIlluminant1
-    uint16_t illuminant = static_cast<uint16_t>(meta.cfaIlluminant);
-
-    // ColorMatrix1 (placeholder identity-ish)
-    // 3x3 matrix as rationals. Use identity to avoid lying—RAW editors will still open fine.
-    uint32_t cmOff = writeArrayRATIONAL({
-        {1, 1},
-        {0, 1},
-        {0, 1},
-        {0, 1},
-        {1, 1},
-        {0, 1},
-        {0, 1},
-        {0, 1},
-        {1, 1},
-    });
-
-    // Image data (strip)
-    align2();
-    uint32_t stripOffset = currentOffset();
-    const size_t bytes = size_t(w) * h * 2; // 16-bit
-    f.write(reinterpret_cast<const char *>(pixels.data()), bytes);
-    uint32_t stripByteCount = bytes;
-
-    // Now assemble IFD
-    auto push = [&](uint16_t tag, uint16_t type, uint32_t count, uint32_t value)
+    auto put = [&](const void *data, uint64_t bytes, uint64_t off)
     {
-        IfdEntry e{tag, type, count, value};
-        ifd.push_back(e);
-        actualCount++;
+        if (off + bytes > dstSize)
+            return false;
+        std::memcpy(dst + off, data, bytes);
+        return true;
     };
+    return static_cast<size_t>(encodePieces(src, dst, pool, target, put));
+}
 
-    push(TAG_ImageWidth, TYPE_LONG, 1, w);
-    push(TAG_ImageLength, TYPE_LONG, 1, h);
-    push(TAG_BitsPerSample, TYPE_SHORT, 1, bpsOff);
-    push(TAG_Compression, TYPE_SHORT, 1, 1);     // no compression
-    push(TAG_Photometric, TYPE_SHORT, 1, 32803); // CFA
-    push(TAG_SamplesPerPixel, TYPE_SHORT, 1, spp);
-    push(TAG_PlanarConfig, TYPE_SHORT, 1, 1); // contig
-    push(TAG_RowsPerStrip, TYPE_LONG, 1, h);
-    push(TAG_StripOffsets, TYPE_LONG, 1, stripOffset);
-    push(TAG_StripByteCounts, TYPE_LONG, 1, stripByteCount);
-    push(TAG_CFARepeatPattern, TYPE_SHORT, 2, cfaDimOff);
-    push(TAG_CFAPattern, TYPE_BYTE, 4, cfaPattOff);
-    push(TAG_CFAPlaneColor, TYPE_BYTE, 3, cfaPlaneColorOff);
-    push(TAG_DNGVersion, TYPE_BYTE, 4, dngVerOff);
-    push(TAG_UniqueCameraModel, TYPE_ASCII, static_cast<uint32_t>(std::strlen("Raspberry Pi Global Shutter Camera IMX296") + 1), ucmOff);
-    push(TAG_BlackLevel, TYPE_SHORT, 1, blackOff);
-    push(TAG_WhiteLevel, TYPE_SHORT, 1, whiteOff);
-    push(TAG_DefaultScale, TYPE_RATIONAL, 2, defaultScaleOff);
-    push(TAG_CalibrationIlluminant1, TYPE_SHORT, 1, illuminant);
-    push(TAG_ColorMatrix1, TYPE_RATIONAL, 9, cmOff);
-
-    // Write IFD
-    std::streampos endPos = f.tellp();
-    f.seekp(ifdStart);
-    f.write(reinterpret_cast<const char *>(&actualCount), 2);
-    for (uint16_t i = 0; i < actualCount; i++)
+bool DngWriter::writeFrame(const std::string &path, const DngSource &src, const DngFrameInfo &fi,
+                           ThreadPool *pool, uint64_t *fileBytes) const
+{
+    if (!sourceOk(src))
+        return false;
+    const size_t pixelStride = src.pixelStride ? src.pixelStride : meta_.width;
+    if (!tiled() && pieces_ == 1 && src.pixels && pixelStride == meta_.width)
     {
-        f.write(reinterpret_cast<const char *>(&ifd[i]), sizeof(IfdEntry));
+        if (fileBytes)
+            *fileBytes = headerSize() + pixelBytes();
+        return writeFrame(path, src.pixels, fi);
     }
-    uint32_t next = 0;
-    f.write(reinterpret_cast<const char *>(&next), 4);
-    f.seekp(endPos);
 
-    return true;
+    thread_local std::vector<uint8_t> scratch;
+    if (scratch.size() < header_.size())
+        scratch.resize(header_.size());
+    uint8_t *hdr = scratch.data();
+    buildHeader(hdr, fi);
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    // Same pieces as encode(); they just go through pwrite() instead of memcpy()
+    auto noTarget = [](uint64_t, uint64_t) -> uint16_t * { return nullptr; };
+    auto put = [fd](const void *data, uint64_t bytes, uint64_t off)
+    { return util::pwriteAll(fd, data, bytes, off); };
+    const uint64_t end = encodePieces(src, hdr, pool, noTarget, put);
+
+    // Header last: it carries the offsets the pieces ended up at
+    bool good = end != 0 && util::pwriteAll(fd, hdr, header_.size(), 0);
+    if (::close(fd) != 0)
+        good = false;
+    if (fileBytes)
+        *fileBytes = end;
+    return good;
+}
+
+bool DngWriter::write(const std::string &path, const DngMeta &meta,
+                      const std::vector<uint16_t> &pixels)
+{
+    if (pixels.size() != size_t(meta.width) * meta.height)
+        return false;
+    return write(path, meta, pixels.data());
+}
+
+bool DngWriter::write(const std::string &path, const DngMeta &meta,
+                      const uint16_t *pixels, size_t pixelStride)
+{
+    DngWriter writer(meta);
+    DngFrameInfo fi;
+    fi.exposureSeconds = meta.exposureSeconds;
+    fi.analogGain = meta.analogGain;
+    DngSource src;
+    src.pixels = pixels;
+    src.pixelStride = pixelStride;
+    return writer.writeFrame(path, src, fi, nullptr);
 }
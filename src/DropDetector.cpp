@@ -0,0 +1,50 @@
+#include "DropDetector.hpp"
+#include <cmath>
+
+DropDetector::DropDetector(int64_t frameIntervalNs, double tolerance)
+    : intervalNs_(frameIntervalNs > 0 ? frameIntervalNs : 0),
+      toleranceNs_(static_cast<int64_t>(std::llround(double(intervalNs_) * tolerance)))
+{
+}
+
+DropDetector::Result DropDetector::observe(uint64_t sequence, int64_t sensorTimestampNs)
+{
+    Result r;
+    bump(frames_);
+    if (!have_)
+    {
+        have_ = true;
+        lastSequence_ = sequence;
+        lastTimestampNs_ = sensorTimestampNs;
+        return r;
+    }
+
+    // A sequence that doesn't move forward (driver restart, no numbering) tells
+    // us nothing about drops; carry on from here.
+    const uint64_t seqDelta = sequence > lastSequence_ ? sequence - lastSequence_ : 0;
+    if (seqDelta > 1)
+    {
+        const uint64_t missing = seqDelta - 1;
+        r.dropsBefore = static_cast<uint32_t>(missing > UINT32_MAX ? UINT32_MAX : missing);
+        r.flags |= FrameDropBefore;
+        bump(dropped_, missing);
+        bump(gaps_);
+    }
+
+    if (intervalNs_ && seqDelta && sensorTimestampNs > 0 && lastTimestampNs_ > 0)
+    {
+        const int64_t actual = sensorTimestampNs - lastTimestampNs_;
+        const int64_t expected = int64_t(seqDelta) * intervalNs_;
+        const int64_t err = actual > expected ? actual - expected : expected - actual;
+        jitter_.record(uint64_t(err));
+        if (err > toleranceNs_)
+        {
+            r.flags |= FrameOffInterval;
+            bump(offInterval_);
+        }
+    }
+
+    lastSequence_ = sequence;
+    lastTimestampNs_ = sensorTimestampNs;
+    return r;
+}
@@ -0,0 +1,90 @@
+#include "ExposureSchedule.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool ExposureSchedule::parseStep(const std::string &text, const char *sep, float defaultGain)
+{
+    // "US" or "US<sep>GAIN", blanks around either
+    const char *p = text.c_str();
+    char *end = nullptr;
+    const long us = std::strtol(p, &end, 10);
+    if (end == p || us <= 0 || us > INT32_MAX)
+        return false;
+    p = end + std::strspn(end, " \t\r");
+    float gain = defaultGain;
+    if (*p)
+    {
+        // A separator, or just blanks where those separate (files)
+        if (std::strchr(sep, *p))
+            ++p;
+        else if (p == end || !std::strchr(sep, ' '))
+            return false;
+        gain = std::strtof(p, &end);
+        if (end == p || !(gain > 0.0f))
+            return false;
+        p = end + std::strspn(end, " \t\r");
+    }
+    if (*p)
+        return false;
+    steps_.push_back({static_cast<int32_t>(us), gain});
+    return true;
+}
+
+bool ExposureSchedule::parse(const std::string &spec, float defaultGain)
+{
+    steps_.clear();
+    if (!spec.empty() && spec[0] == '@')
+    {
+        const std::string path = spec.substr(1);
+        std::ifstream f(path);
+        if (!f)
+        {
+            std::cerr << "Can't read exposure schedule " << path << "\n";
+            return false;
+        }
+        std::string line;
+        for (unsigned n = 1; std::getline(f, line); ++n)
+        {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            if (!parseStep(line, " ,", defaultGain))
+            {
+                std::cerr << path << ":" << n << ": expected \"US [GAIN]\"\n";
+                return false;
+            }
+        }
+    }
+    else
+    {
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (!parseStep(item, ":", defaultGain))
+            {
+                std::cerr << "Bad exposure schedule step \"" << item << "\" (use US[:GAIN],...)\n";
+                return false;
+            }
+        }
+    }
+    if (steps_.empty())
+    {
+        std::cerr << "Empty exposure schedule\n";
+        return false;
+    }
+    return true;
+}
+
+int32_t ExposureSchedule::maxExposureUs() const
+{
+    int32_t m = 0;
+    for (const ExposureStep &s : steps_)
+        m = std::max(m, s.exposureUs);
+    return m;
+}
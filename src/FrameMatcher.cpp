@@ -0,0 +1,98 @@
+#include "FrameMatcher.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+    // More than this many sets pending means a camera stopped delivering
+    constexpr size_t kMaxOpen = 64;
+} // namespace
+
+FrameMatcher::FrameMatcher(unsigned cameras, int64_t toleranceNs)
+    : cameras_(std::max(1u, std::min(cameras, 32u))), toleranceNs_(toleranceNs),
+      all_(cameras_ >= 32 ? ~0u : (1u << cameras_) - 1), lastNs_(cameras_, std::numeric_limits<int64_t>::min())
+{
+}
+
+uint64_t FrameMatcher::add(unsigned camera, int64_t timestampNs)
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    if (camera >= cameras_)
+        return nextId_++;
+    const uint32_t bit = 1u << camera;
+    lastNs_[camera] = std::max(lastNs_[camera], timestampNs);
+
+    // Closest open set still missing this camera
+    Set *best = nullptr;
+    int64_t bestDist = toleranceNs_ + 1;
+    for (Set &s : open_)
+    {
+        const int64_t d = timestampNs > s.firstNs ? timestampNs - s.firstNs : s.firstNs - timestampNs;
+        if (!(s.have & bit) && d < bestDist)
+        {
+            best = &s;
+            bestDist = d;
+        }
+    }
+    if (!best)
+    {
+        open_.push_back(Set{nextId_++, timestampNs, timestampNs, timestampNs, 0});
+        best = &open_.back();
+    }
+    best->have |= bit;
+    best->minNs = std::min(best->minNs, timestampNs);
+    best->maxNs = std::max(best->maxNs, timestampNs);
+    const uint64_t id = best->id;
+    expire();
+    return id;
+}
+
+void FrameMatcher::reset()
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    open_.clear();
+    std::fill(lastNs_.begin(), lastNs_.end(), std::numeric_limits<int64_t>::min());
+    nextId_ = matched_ = incomplete_ = 0;
+    lastSkewNs_ = 0;
+    skew_.reset();
+}
+
+void FrameMatcher::expire()
+{
+    std::deque<Set>::iterator it = open_.begin();
+    while (it != open_.end())
+    {
+        bool done = it->have == all_;
+        if (done)
+        {
+            lastSkewNs_ = it->maxNs - it->minNs;
+            skew_.record(uint64_t(lastSkewNs_));
+            matched_++;
+        }
+        else
+        {
+            // Cameras deliver in order: one that's past firstNs + tolerance
+            // will never fill this set
+            done = true;
+            for (unsigned c = 0; c < cameras_ && done; c++)
+                if (!(it->have & (1u << c)) && lastNs_[c] <= it->firstNs + toleranceNs_)
+                    done = false;
+            if (!done && open_.size() > kMaxOpen && it == open_.begin())
+                done = true;
+            if (done)
+                incomplete_++;
+        }
+        it = done ? open_.erase(it) : it + 1;
+    }
+}
+
+FrameMatcher::Stats FrameMatcher::stats() const
+{
+    std::lock_guard<std::mutex> lk(mu_);
+    Stats s;
+    s.matched = matched_;
+    s.incomplete = incomplete_;
+    s.lastSkewNs = lastSkewNs_;
+    s.skew = skew_.summary();
+    return s;
+}
@@ -0,0 +1,109 @@
+#include "FramePool.hpp"
+#include <cstdlib>
+
+PixelBuffer &PixelBuffer::operator=(PixelBuffer &&o) noexcept
+{
+    if (this != &o)
+    {
+        reset();
+        pool_ = o.pool_;
+        slot_ = o.slot_;
+        base_ = o.base_;
+        data_ = o.data_;
+        size_ = o.size_;
+        o.pool_ = nullptr;
+        o.base_ = nullptr;
+        o.data_ = nullptr;
+        o.size_ = 0;
+    }
+    return *this;
+}
+
+void PixelBuffer::reset()
+{
+    if (pool_ && data_)
+        pool_->giveBack(slot_);
+    pool_ = nullptr;
+    base_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+FramePool::FramePool(size_t buffers, size_t pixelsPerBuffer, size_t headroomBytes)
+    : pixels_(pixelsPerBuffer), headroom_((headroomBytes + 1) & ~size_t(1)) // keep data() 16-bit aligned
+{
+    // Headroom for misses so even those don't reallocate the bookkeeping
+    slots_.reserve(buffers * 2 + 8);
+    free_.reserve(buffers * 2 + 8);
+    for (size_t i = 0; i < buffers; i++)
+    {
+        uint8_t *p = allocate();
+        if (!p)
+            break;
+        free_.push_back(static_cast<uint32_t>(slots_.size()));
+        slots_.push_back(p);
+    }
+    stats_.buffers = slots_.size();
+}
+
+FramePool::~FramePool()
+{
+    for (uint8_t *p : slots_)
+        std::free(p);
+}
+
+size_t FramePool::bufferBytes() const
+{
+    return ((headroom_ + pixels_ * sizeof(uint16_t)) + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+uint8_t *FramePool::allocate() const
+{
+    // Page-aligned so buffers can also feed O_DIRECT writes; deliberately not zeroed
+    const size_t bytes = bufferBytes();
+    void *p = nullptr;
+    if (posix_memalign(&p, kAlignment, bytes ? bytes : kAlignment) != 0)
+        return nullptr;
+    return static_cast<uint8_t *>(p);
+}
+
+PixelBuffer FramePool::lease()
+{
+    PixelBuffer b;
+    std::lock_guard<std::mutex> lk(m_);
+    if (free_.empty())
+    {
+        uint8_t *p = allocate();
+        if (!p)
+            return b;
+        stats_.misses++;
+        free_.push_back(static_cast<uint32_t>(slots_.size()));
+        slots_.push_back(p);
+        stats_.buffers = slots_.size();
+    }
+    b.slot_ = free_.back();
+    free_.pop_back();
+    b.pool_ = this;
+    b.base_ = slots_[b.slot_];
+    b.data_ = reinterpret_cast<uint16_t *>(b.base_ + headroom_);
+    b.size_ = pixels_;
+
+    stats_.leases++;
+    stats_.inUse++;
+    if (stats_.inUse > stats_.maxInUse)
+        stats_.maxInUse = stats_.inUse;
+    return b;
+}
+
+void FramePool::giveBack(uint32_t slot)
+{
+    std::lock_guard<std::mutex> lk(m_);
+    free_.push_back(slot);
+    stats_.inUse--;
+}
+
+FramePool::Stats FramePool::stats() const
+{
+    std::lock_guard<std::mutex> lk(m_);
+    return stats_;
+}
@@ -0,0 +1,131 @@
+#include "IoUtil.hpp"
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace util
+{
+
+    bool writevAll(int fd, struct iovec *iov, int iovcnt)
+    {
+        while (iovcnt > 0)
+        {
+            // Skip fully-written (or empty) entries
+            if (iov->iov_len == 0)
+            {
+                ++iov;
+                --iovcnt;
+                continue;
+            }
+            const int n = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+            ssize_t w = ::writev(fd, iov, n);
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            size_t left = static_cast<size_t>(w);
+            while (left > 0 && iovcnt > 0)
+            {
+                const size_t take = left < iov->iov_len ? left : iov->iov_len;
+                iov->iov_base = static_cast<char *>(iov->iov_base) + take;
+                iov->iov_len -= take;
+                left -= take;
+                if (iov->iov_len == 0)
+                {
+                    ++iov;
+                    --iovcnt;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool pwriteAll(int fd, const void *buf, size_t len, uint64_t offset)
+    {
+        const char *p = static_cast<const char *>(buf);
+        while (len > 0)
+        {
+            ssize_t w = ::pwrite(fd, p, len, static_cast<off_t>(offset));
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            p += w;
+            len -= static_cast<size_t>(w);
+            offset += static_cast<uint64_t>(w);
+        }
+        return true;
+    }
+
+    bool preadAll(int fd, void *buf, size_t len, uint64_t offset)
+    {
+        char *p = static_cast<char *>(buf);
+        while (len > 0)
+        {
+            ssize_t r = ::pread(fd, p, len, static_cast<off_t>(offset));
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            if (r == 0)
+                return false; // short file
+            p += r;
+            len -= static_cast<size_t>(r);
+            offset += static_cast<uint64_t>(r);
+        }
+        return true;
+    }
+
+    bool writeFile(const char *path, const void *data, size_t bytes)
+    {
+        int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+        struct iovec iov{const_cast<void *>(data), bytes};
+        bool ok = writevAll(fd, &iov, 1);
+        if (::close(fd) != 0)
+            ok = false;
+        return ok;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data_)
+            ::munmap(const_cast<uint8_t *>(data_), size_);
+    }
+
+    bool MappedFile::open(const char *path)
+    {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        const bool ok = map(fd);
+        ::close(fd); // the mapping keeps the file
+        return ok;
+    }
+
+    bool MappedFile::map(int fd)
+    {
+        struct stat st{};
+        if (data_ || ::fstat(fd, &st) != 0 || st.st_size <= 0)
+            return false;
+        void *p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            return false;
+        // Frames are mostly read front to back: let readahead run far ahead
+        ::madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+        data_ = static_cast<const uint8_t *>(p);
+        size_ = size_t(st.st_size);
+        return true;
+    }
+
+} // namespace util
@@ -0,0 +1,172 @@
+#include "JobServer.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+JobServer::~JobServer()
+{
+    if (clientFd_ >= 0)
+        ::close(clientFd_);
+    if (listenFd_ >= 0)
+    {
+        ::close(listenFd_);
+        ::unlink(path_.c_str());
+    }
+}
+
+bool JobServer::listen(const std::string &path)
+{
+    struct sockaddr_un sa{};
+    sa.sun_family = AF_UNIX;
+    if (listenFd_ >= 0 || path.empty() || path.size() >= sizeof(sa.sun_path))
+    {
+        std::cerr << "Serve: socket path must be 1.." << sizeof(sa.sun_path) - 1 << " characters\n";
+        return false;
+    }
+    std::memcpy(sa.sun_path, path.c_str(), path.size() + 1);
+
+    // A socket file left by a server that died: nobody answers on it
+    const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0)
+    {
+        if (::connect(probe, reinterpret_cast<struct sockaddr *>(&sa), sizeof(sa)) == 0)
+        {
+            ::close(probe);
+            std::cerr << "Serve: " << path << " is in use by another server\n";
+            return false;
+        }
+        if (errno == ECONNREFUSED)
+            ::unlink(path.c_str());
+        ::close(probe);
+    }
+
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0 || ::bind(listenFd_, reinterpret_cast<struct sockaddr *>(&sa), sizeof(sa)) != 0 ||
+        ::listen(listenFd_, 4) != 0)
+    {
+        std::cerr << "Serve: cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+        if (listenFd_ >= 0)
+            ::close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    path_ = path;
+    return true;
+}
+
+bool JobServer::parse(const std::string &line, CaptureJob &job, bool &quit, std::string &error)
+{
+    std::istringstream is(line);
+    std::string verb, kv;
+    is >> verb;
+    quit = verb == "quit";
+    if (quit)
+        return true;
+    if (verb != "capture")
+    {
+        error = "expected capture or quit";
+        return false;
+    }
+    job = CaptureJob{};
+    while (is >> kv)
+    {
+        const size_t eq = kv.find('=');
+        const std::string key = kv.substr(0, eq), value = eq == std::string::npos ? "" : kv.substr(eq + 1);
+        char *end = nullptr;
+        const double v = std::strtod(value.c_str(), &end);
+        const bool number = !value.empty() && *end == '\0';
+        if (key == "frames" && number && v >= 1 && v <= 1e9)
+            job.frames = unsigned(v);
+        else if (key == "exposure-us" && number && v >= 1 && v <= 1e8)
+            job.exposureUs = int(v);
+        else if (key == "gain" && number && v > 0)
+            job.analogueGain = float(v);
+        else if (key == "outdir" && !value.empty())
+            job.outDir = value;
+        else
+        {
+            error = "bad field: " + kv;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string JobServer::readLine(int fd) const
+{
+    // A client that connects and says nothing must not hold the camera hostage
+    std::string line;
+    char buf[256];
+    while (line.find('\n') == std::string::npos && line.size() < 4096)
+    {
+        pollfd p{fd, POLLIN, 0};
+        if (::poll(&p, 1, 5000) <= 0)
+            break;
+        const ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        line.append(buf, size_t(n));
+    }
+    return line.substr(0, line.find_first_of("\r\n"));
+}
+
+JobServer::Next JobServer::next(CaptureJob &job, const Wakeup &wakeup, const volatile std::sig_atomic_t *stop)
+{
+    for (;;)
+    {
+        if (stop && *stop)
+            return Next::Stop;
+        pollfd p[2] = {{listenFd_, POLLIN, 0}, {wakeup.fd(), POLLIN, 0}};
+        if (::poll(p, wakeup.ok() ? 2 : 1, -1) < 0 && errno != EINTR)
+            return Next::Stop;
+        if (p[1].revents)
+            wakeup.wait(0); // whatever rang (a signal is checked above)
+        if (!(p[0].revents & POLLIN))
+            continue;
+
+        clientFd_ = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (clientFd_ < 0)
+            continue;
+        const std::string line = readLine(clientFd_);
+        bool quit = false;
+        std::string error;
+        if (!parse(line, job, quit, error))
+        {
+            reply("error " + error + "\n");
+            continue;
+        }
+        if (quit)
+        {
+            reply("ok bye\n");
+            return Next::Quit;
+        }
+        return Next::Job;
+    }
+}
+
+void JobServer::reply(const std::string &text)
+{
+    if (clientFd_ < 0)
+        return;
+    size_t off = 0;
+    while (off < text.size())
+    {
+        const ssize_t n = ::send(clientFd_, text.data() + off, text.size() - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break; // the client went away; the run still happened
+        off += size_t(n);
+    }
+    ::close(clientFd_);
+    clientFd_ = -1;
+}
@@ -0,0 +1,112 @@
+#include "LatencyHistogram.hpp"
+#include <algorithm>
+
+int LatencyHistogram::bucketOf(uint64_t v)
+{
+    if (v < uint64_t(kSub))
+        return int(v);
+    // Top kSubBits bits below the leading one pick the sub-bucket
+    const int msb = 63 - __builtin_clzll(v);
+    const int shift = msb - kSubBits;
+    return (shift + 1) * kSub + int((v >> shift) & (kSub - 1));
+}
+
+uint64_t LatencyHistogram::bucketTop(int b)
+{
+    if (b < kSub)
+        return uint64_t(b);
+    const int shift = b / kSub - 1;
+    return ((uint64_t(kSub + b % kSub) + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    buckets_[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t m = max_.load(std::memory_order_relaxed);
+    while (ns > m && !max_.compare_exchange_weak(m, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto &b : buckets_)
+        b.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const
+{
+    uint64_t counts[kBuckets];
+    uint64_t total = 0;
+    for (int b = 0; b < kBuckets; b++)
+    {
+        counts[b] = buckets_[b].load(std::memory_order_relaxed);
+        total += counts[b];
+    }
+    return summarize(counts, total, sum_.load(std::memory_order_relaxed), max_.load(std::memory_order_relaxed));
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary(const Snapshot &since, Snapshot *now) const
+{
+    uint64_t counts[kBuckets];
+    uint64_t total = 0, top = 0;
+    for (int b = 0; b < kBuckets; b++)
+    {
+        const uint64_t c = buckets_[b].load(std::memory_order_relaxed);
+        counts[b] = c > since.buckets[b] ? c - since.buckets[b] : 0;
+        total += counts[b];
+        if (counts[b])
+            top = bucketTop(b);
+        if (now)
+            now->buckets[b] = c;
+    }
+    const uint64_t sum = sum_.load(std::memory_order_relaxed);
+    const uint64_t windowSum = sum > since.sum ? sum - since.sum : 0;
+    if (now)
+        now->sum = sum;
+    // The window's largest value lies in its highest bucket, and can't be above the run's
+    return summarize(counts, total, windowSum, std::min(top, max_.load(std::memory_order_relaxed)));
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize(const uint64_t *counts, uint64_t total, uint64_t sum,
+                                                      uint64_t max)
+{
+    Summary s;
+    s.count = total;
+    s.max = max;
+    if (!total)
+        return s;
+    s.mean = double(sum) / double(total);
+    // Ranks are taken against our own snapshot of the buckets, so p50 <= p99
+    // even while other threads keep recording.
+    const uint64_t rank50 = (total + 1) / 2;
+    const uint64_t rank99 = total - total / 100;
+    uint64_t seen = 0;
+    bool have50 = false;
+    for (int b = 0; b < kBuckets; b++)
+    {
+        seen += counts[b];
+        if (!have50 && seen >= rank50)
+        {
+            s.p50 = bucketTop(b);
+            have50 = true;
+        }
+        if (seen >= rank99)
+        {
+            s.p99 = bucketTop(b);
+            break;
+        }
+    }
+    // The bucket edge can overshoot what was actually seen
+    if (s.max)
+    {
+        s.p50 = s.p50 < s.max ? s.p50 : s.max;
+        s.p99 = s.p99 < s.max ? s.p99 : s.max;
+    }
+    return s;
+}
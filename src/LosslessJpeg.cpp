@@ -0,0 +1,513 @@
+#include "LosslessJpeg.hpp"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace util
+{
+    namespace ljpeg
+    {
+        namespace
+        {
+            constexpr int kSymbols = 17; // difference categories 0..16
+
+            // Category (SSSS) of a difference and the extra bits that follow its
+            // Huffman code. Branch-free: 31 - clz(2a + 1) is the bit length of a,
+            // and category 16 (d == -32768) ends up with no extra bits.
+            inline uint32_t category(int32_t d, uint32_t &extra)
+            {
+                const uint32_t a = static_cast<uint32_t>(d < 0 ? -d : d);
+                const uint32_t ssss = 31 - __builtin_clz(2 * a + 1);
+                extra = static_cast<uint32_t>(d + (d >> 31)) & ((1u << (ssss & 15)) - 1);
+                return ssss;
+            }
+
+            // One row's differences in coding order (the two components interleaved).
+            // Differences are modulo 2^16, as T.81 H.1.2.1 asks. Row starts are
+            // predicted from above, or from 2^(P-1) on the first row.
+            inline void diffRow(const uint16_t *row, const uint16_t *above, uint32_t width,
+                                uint16_t first, int16_t *out)
+            {
+                out[0] = int16_t(uint16_t(row[0] - (above ? above[0] : first)));
+                out[1] = int16_t(uint16_t(row[1] - (above ? above[1] : first)));
+                for (uint32_t x = 2; x < width; x++)
+                    out[x] = int16_t(uint16_t(row[x] - row[x - 2]));
+            }
+
+            struct Table
+            {
+                uint8_t bits[17]{};        // codes per length (bits[0] unused)
+                uint8_t values[kSymbols]{}; // symbols by increasing code length
+                int count{0};
+                uint16_t code[kSymbols]{};
+                uint8_t length[kSymbols]{};
+            };
+
+            // Length-limited optimal code, T.81 Annex K.2 (the libjpeg approach):
+            // a reserved dummy symbol keeps any code from being all ones.
+            void buildTable(const uint32_t *histogram, Table &t)
+            {
+                uint64_t freq[kSymbols + 1];
+                int codesize[kSymbols + 1] = {};
+                int others[kSymbols + 1];
+                for (int i = 0; i < kSymbols; i++)
+                    freq[i] = histogram[i];
+                freq[kSymbols] = 1;
+                for (int i = 0; i <= kSymbols; i++)
+                    others[i] = -1;
+
+                for (;;)
+                {
+                    int c1 = -1, c2 = -1;
+                    for (int i = 0; i <= kSymbols; i++)
+                        if (freq[i] && (c1 < 0 || freq[i] <= freq[c1]))
+                            c1 = i;
+                    for (int i = 0; i <= kSymbols; i++)
+                        if (freq[i] && i != c1 && (c2 < 0 || freq[i] <= freq[c2]))
+                            c2 = i;
+                    if (c2 < 0)
+                        break;
+
+                    freq[c1] += freq[c2];
+                    freq[c2] = 0;
+                    codesize[c1]++;
+                    while (others[c1] >= 0)
+                    {
+                        c1 = others[c1];
+                        codesize[c1]++;
+                    }
+                    others[c1] = c2;
+                    codesize[c2]++;
+                    while (others[c2] >= 0)
+                    {
+                        c2 = others[c2];
+                        codesize[c2]++;
+                    }
+                }
+
+                int bits[33] = {};
+                for (int i = 0; i <= kSymbols; i++)
+                    if (codesize[i])
+                        bits[codesize[i]]++;
+                // Fold anything longer than 16 bits back in
+                for (int i = 32; i > 16; i--)
+                {
+                    while (bits[i] > 0)
+                    {
+                        int j = i - 2;
+                        while (bits[j] == 0)
+                            j--;
+                        bits[i] -= 2;
+                        bits[i - 1]++;
+                        bits[j + 1] += 2;
+                        bits[j]--;
+                    }
+                }
+                // Drop the dummy symbol (it has one of the longest codes)
+                int longest = 16;
+                while (bits[longest] == 0)
+                    longest--;
+                bits[longest]--;
+
+                for (int i = 1; i <= 16; i++)
+                    t.bits[i] = static_cast<uint8_t>(bits[i]);
+                t.count = 0;
+                for (int len = 1; len <= 32; len++)
+                    for (int s = 0; s < kSymbols; s++)
+                        if (codesize[s] == len)
+                            t.values[t.count++] = static_cast<uint8_t>(s);
+
+                // Canonical codes (Annex C)
+                std::memset(t.length, 0, sizeof(t.length));
+                uint16_t code = 0;
+                int k = 0;
+                for (int len = 1; len <= 16; len++)
+                {
+                    for (int n = 0; n < t.bits[len]; n++, k++)
+                    {
+                        t.code[t.values[k]] = code++;
+                        t.length[t.values[k]] = static_cast<uint8_t>(len);
+                    }
+                    code <<= 1;
+                }
+            }
+
+            // Next 32 bits of the entropy-coded segment, 0xFF bytes stuffed with a 0
+            inline uint8_t *putWord(uint8_t *o, uint32_t w)
+            {
+                const uint32_t nw = ~w;
+                if (((nw - 0x01010101u) & ~nw & 0x80808080u) == 0) // no 0xFF byte in w
+                {
+                    o[0] = uint8_t(w >> 24);
+                    o[1] = uint8_t(w >> 16);
+                    o[2] = uint8_t(w >> 8);
+                    o[3] = uint8_t(w);
+                    return o + 4;
+                }
+                for (int shift = 24; shift >= 0; shift -= 8)
+                {
+                    const uint8_t b = uint8_t(w >> shift);
+                    *o++ = b;
+                    if (b == 0xFF)
+                        *o++ = 0;
+                }
+                return o;
+            }
+
+            inline uint8_t *put16be(uint8_t *p, uint32_t v)
+            {
+                p[0] = uint8_t(v >> 8);
+                p[1] = uint8_t(v);
+                return p + 2;
+            }
+
+            inline uint32_t get16be(const uint8_t *p) { return uint32_t(p[0]) << 8 | p[1]; }
+
+            // Canonical code from DHT counts/values: codes of up to 8 bits come
+            // from one lookup, longer ones from the per-length ranges (Annex F.2.2.3)
+            struct DecodeTable
+            {
+                bool present{false};
+                uint16_t fast[256]{}; // length << 8 | symbol, 0: longer than 8 bits
+                int32_t maxCode[18]{};
+                int32_t valPtr[17]{};
+                int32_t minCode[17]{};
+                uint8_t values[256]{};
+                int count{0};
+
+                bool build(const uint8_t *bits, const uint8_t *vals, int n)
+                {
+                    if (n > 256)
+                        return false;
+                    std::memcpy(values, vals, size_t(n));
+                    count = n;
+                    std::memset(fast, 0, sizeof(fast));
+                    int32_t code = 0;
+                    int k = 0;
+                    for (int len = 1; len <= 16; len++)
+                    {
+                        valPtr[len] = k;
+                        minCode[len] = code;
+                        maxCode[len] = bits[len - 1] ? code + bits[len - 1] - 1 : -1;
+                        for (int i = 0; i < bits[len - 1]; i++, k++, code++)
+                        {
+                            if (len > 8)
+                                continue;
+                            const int span = 1 << (8 - len);
+                            for (int j = 0; j < span; j++)
+                                fast[(code << (8 - len)) + j] = uint16_t(len << 8 | values[k]);
+                        }
+                        if (code > (1 << len))
+                            return false; // over-subscribed
+                        code <<= 1;
+                    }
+                    maxCode[17] = INT32_MAX; // sentinel: runs off the end → error below
+                    present = true;
+                    return true;
+                }
+            };
+
+            // Entropy-coded segment, MSB first. 0xFF 0x00 is a stuffed 0xFF; any
+            // other marker ends the data, after which we read zeros.
+            struct BitReader
+            {
+                const uint8_t *p, *end;
+                uint64_t acc{0};
+                int n{0};
+
+                void fill()
+                {
+                    while (n <= 56)
+                    {
+                        uint8_t b = 0;
+                        if (p < end)
+                        {
+                            b = *p;
+                            if (b != 0xFF)
+                                p++;
+                            else if (p + 1 < end && p[1] == 0)
+                                p += 2;
+                            else
+                            {
+                                b = 0; // a marker
+                                end = p;
+                            }
+                        }
+                        acc |= uint64_t(b) << (56 - n);
+                        n += 8;
+                    }
+                }
+                uint32_t peek(int k) const { return uint32_t(acc >> (64 - k)); }
+                void skip(int k)
+                {
+                    acc <<= k;
+                    n -= k;
+                }
+            };
+
+            inline int decodeSymbol(BitReader &br, const DecodeTable &t)
+            {
+                const uint16_t f = t.fast[br.peek(8)];
+                if (f)
+                {
+                    br.skip(f >> 8);
+                    return f & 0xFF;
+                }
+                const uint32_t bits = br.peek(16);
+                for (int len = 9; len <= 16; len++)
+                {
+                    const int32_t code = int32_t(bits >> (16 - len));
+                    if (code <= t.maxCode[len])
+                    {
+                        const int32_t i = t.valPtr[len] + code - t.minCode[len];
+                        if (i < 0 || i >= t.count)
+                            return -1;
+                        br.skip(len);
+                        return t.values[i];
+                    }
+                }
+                return -1;
+            }
+        } // namespace
+
+        size_t maxEncodedSize(uint32_t width, uint32_t height)
+        {
+            // 31 bits per sample, doubled for stuffing, plus markers/tables
+            return size_t(width) * height * 8 + 256;
+        }
+
+        size_t encode(const uint16_t *src, uint32_t width, uint32_t height, size_t stride,
+                      uint8_t precision, uint8_t *dst, size_t dstSize)
+        {
+            if (!src || !dst || width < 2 || (width & 1) || width / 2 > 65535 || height == 0 ||
+                height > 65535 || precision < 2 || precision > 16)
+                return 0;
+
+            // Pass 1: differences (kept for pass 2) and a histogram of their
+            // categories. Two histograms so that runs of one category don't
+            // serialize on a single counter.
+            thread_local std::vector<int16_t> diffs;
+            if (diffs.size() < size_t(width) * height)
+                diffs.resize(size_t(width) * height);
+            const uint16_t first = uint16_t(1u << (precision - 1));
+            uint32_t hist[2][kSymbols] = {};
+            for (uint32_t y = 0; y < height; y++)
+            {
+                const uint16_t *row = src + size_t(y) * stride;
+                int16_t *d = diffs.data() + size_t(y) * width;
+                diffRow(row, y ? row - stride : nullptr, width, first, d);
+                uint32_t extra;
+                for (uint32_t x = 0; x < width; x += 2)
+                {
+                    hist[0][category(d[x], extra)]++;
+                    hist[1][category(d[x + 1], extra)]++;
+                }
+            }
+            for (int i = 0; i < kSymbols; i++)
+                hist[0][i] += hist[1][i];
+
+            Table t;
+            buildTable(hist[0], t);
+
+            // Headers: SOI, DHT, SOF3, SOS
+            const size_t headerBytes = 2 + (4 + 1 + 16 + t.count) + (2 + 14) + (2 + 10);
+            if (dstSize < headerBytes + 2)
+                return 0;
+            uint8_t *p = dst;
+            p = put16be(p, 0xFFD8);
+
+            p = put16be(p, 0xFFC4);
+            p = put16be(p, 2 + 1 + 16 + t.count);
+            *p++ = 0x00; // DC table 0
+            std::memcpy(p, t.bits + 1, 16);
+            p += 16;
+            std::memcpy(p, t.values, t.count);
+            p += t.count;
+
+            p = put16be(p, 0xFFC3); // lossless, Huffman
+            p = put16be(p, 8 + 3 * 2);
+            *p++ = precision;
+            p = put16be(p, height);
+            p = put16be(p, width / 2);
+            *p++ = 2;
+            for (uint8_t c = 1; c <= 2; c++)
+            {
+                *p++ = c;
+                *p++ = 0x11; // 1×1 sampling
+                *p++ = 0;
+            }
+
+            p = put16be(p, 0xFFDA);
+            p = put16be(p, 6 + 2 * 2);
+            *p++ = 2;
+            for (uint8_t c = 1; c <= 2; c++)
+            {
+                *p++ = c;
+                *p++ = 0x00; // both components use table 0
+            }
+            *p++ = 1; // predictor 1
+            *p++ = 0;
+            *p++ = 0; // point transform 0
+
+            // Pass 2: entropy-coded segment. Code and extra bits go into the
+            // accumulator together and leave it 32 bits at a time. Room is checked
+            // a row at a time against the worst case, so the inner loop has no
+            // bounds checks.
+            uint32_t codeBits[kSymbols], codeLen[kSymbols];
+            for (int c = 0; c < kSymbols; c++)
+            {
+                codeBits[c] = uint32_t(t.code[c]) << (c & 15);
+                codeLen[c] = t.length[c] + (c & 15);
+            }
+            uint8_t *const end = dst + dstSize - 2; // EOI
+            const size_t rowWorst = size_t(width) * 8 + 16;
+            uint64_t acc = 0;
+            uint32_t nbits = 0;
+            for (uint32_t y = 0; y < height; y++)
+            {
+                if (size_t(end - p) < rowWorst)
+                    return 0;
+                const int16_t *d = diffs.data() + size_t(y) * width;
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    uint32_t extra;
+                    const uint32_t c = category(d[x], extra);
+                    acc = (acc << codeLen[c]) | codeBits[c] | extra;
+                    nbits += codeLen[c];
+                    if (nbits >= 32)
+                    {
+                        nbits -= 32;
+                        p = putWord(p, static_cast<uint32_t>(acc >> nbits));
+                    }
+                }
+            }
+            // Whatever is left, padded with 1s to a whole byte
+            while (nbits >= 8)
+            {
+                nbits -= 8;
+                const uint8_t b = uint8_t(acc >> nbits);
+                *p++ = b;
+                if (b == 0xFF)
+                    *p++ = 0;
+            }
+            if (nbits)
+            {
+                const uint8_t b = uint8_t((acc << (8 - nbits)) | ((1u << (8 - nbits)) - 1));
+                *p++ = b;
+                if (b == 0xFF)
+                    *p++ = 0;
+            }
+
+            p = put16be(p, 0xFFD9);
+            return size_t(p - dst);
+        }
+
+        bool decode(const uint8_t *src, size_t bytes, uint16_t *dst, uint32_t width, uint32_t height,
+                    size_t stride)
+        {
+            if (!src || !dst || bytes < 4 || get16be(src) != 0xFFD8)
+                return false;
+
+            DecodeTable tables[4];
+            uint32_t precision = 0, lines = 0, columns = 0, comps = 0;
+            uint8_t compId[4]{}, compTable[4]{};
+            const uint8_t *p = src + 2, *end = src + bytes;
+            const uint8_t *scan = nullptr;
+            while (!scan)
+            {
+                if (end - p < 4 || p[0] != 0xFF)
+                    return false;
+                const uint32_t marker = get16be(p), len = get16be(p + 2);
+                const uint8_t *seg = p + 4;
+                if (len < 2 || size_t(end - p - 2) < len)
+                    return false;
+                p += 2 + len;
+                const uint8_t *segEnd = p;
+                switch (marker)
+                {
+                case 0xFFC4: // DHT, one or more tables
+                    while (seg < segEnd)
+                    {
+                        if (segEnd - seg < 17 || (seg[0] & 0xF0) || (seg[0] & 0x0F) > 3)
+                            return false;
+                        int n = 0;
+                        for (int i = 1; i <= 16; i++)
+                            n += seg[i];
+                        if (segEnd - seg < 17 + n || !tables[seg[0] & 3].build(seg + 1, seg + 17, n))
+                            return false;
+                        seg += 17 + n;
+                    }
+                    break;
+                case 0xFFC3: // SOF3
+                    if (len < 8)
+                        return false;
+                    precision = seg[0];
+                    lines = get16be(seg + 1);
+                    columns = get16be(seg + 3);
+                    comps = seg[5];
+                    if (comps < 1 || comps > 4 || len < 8 + 3 * comps)
+                        return false;
+                    for (uint32_t c = 0; c < comps; c++)
+                        compId[c] = seg[6 + 3 * c];
+                    break;
+                case 0xFFDA: // SOS: the data follows
+                {
+                    if (!comps || len < 6 + 2 * comps || seg[0] != comps)
+                        return false;
+                    for (uint32_t c = 0; c < comps; c++)
+                    {
+                        if (seg[1 + 2 * c] != compId[c])
+                            return false; // components in frame order only
+                        compTable[c] = seg[2 + 2 * c] >> 4;
+                        if (!tables[compTable[c]].present)
+                            return false;
+                    }
+                    const uint8_t *tail = seg + 1 + 2 * comps;
+                    if (tail[0] != 1 || (tail[2] & 0x0F) != 0)
+                        return false; // predictor 1, no point transform
+                    scan = p;
+                    break;
+                }
+                case 0xFFDD: // DRI: restart intervals are not something we write
+                    if (len < 4 || get16be(seg) != 0)
+                        return false;
+                    break;
+                default:
+                    if (marker < 0xFFC0 || marker == 0xFFD8 || marker == 0xFFD9)
+                        return false;
+                    break; // APPn, COM, …
+                }
+            }
+            if (precision < 2 || precision > 16 || lines != height || size_t(columns) * comps != width)
+                return false;
+
+            BitReader br{scan, end};
+            const uint16_t first = uint16_t(1u << (precision - 1));
+            for (uint32_t y = 0; y < height; y++)
+            {
+                uint16_t *row = dst + size_t(y) * stride;
+                const uint16_t *above = y ? row - stride : nullptr;
+                for (uint32_t x = 0; x < width; x++)
+                {
+                    br.fill();
+                    const int ssss = decodeSymbol(br, tables[compTable[x % comps]]);
+                    if (ssss < 0 || ssss > 16)
+                        return false;
+                    int32_t diff = 0;
+                    if (ssss == 16)
+                        diff = 32768;
+                    else if (ssss)
+                    {
+                        const int32_t v = int32_t(br.peek(ssss));
+                        br.skip(ssss);
+                        diff = v < (1 << (ssss - 1)) ? v - (1 << ssss) + 1 : v;
+                    }
+                    const uint16_t pred = x >= comps ? row[x - comps] : above ? above[x] : first;
+                    row[x] = uint16_t(pred + diff);
+                }
+            }
+            return true;
+        }
+
+    } // namespace ljpeg
+} // namespace util
@@ -0,0 +1,264 @@
+#include "OutputMode.hpp"
+#include "Calibration.hpp"
+#include "Raw10Kernels.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+bool OutputMode::setBin(const std::string &how)
+{
+    if (how == "sum")
+        spatial_ = Spatial::BinSum;
+    else if (how == "avg" || how == "mean")
+        spatial_ = Spatial::BinAverage;
+    else
+    {
+        std::cerr << "--bin takes sum or avg\n";
+        return false;
+    }
+    return true;
+}
+
+bool OutputMode::setChannel(const std::string &name, const std::string &bayer)
+{
+    static const char *const kPositions[] = {"TL", "TR", "BL", "BR"};
+    for (unsigned c = 0; c < 4; ++c)
+        if (name == kPositions[c])
+        {
+            channel_ = c;
+            spatial_ = Spatial::Channel;
+            return true;
+        }
+
+    // Colours by the mosaic: Gr shares a row with R, Gb with B
+    const size_t r = bayer.find('R'), b = bayer.find('B');
+    if (bayer.size() != 4 || r == std::string::npos || b == std::string::npos)
+    {
+        std::cerr << "--channel " << name << ": unknown mosaic " << bayer << "\n";
+        return false;
+    }
+    if (name == "R")
+        channel_ = unsigned(r);
+    else if (name == "B")
+        channel_ = unsigned(b);
+    else if (name == "Gr")
+        channel_ = unsigned(r) ^ 1;
+    else if (name == "Gb")
+        channel_ = unsigned(b) ^ 1;
+    else
+    {
+        std::cerr << "--channel takes R, Gr, Gb, B or TL, TR, BL, BR\n";
+        return false;
+    }
+    spatial_ = Spatial::Channel;
+    return true;
+}
+
+bool OutputMode::setBits(const std::string &spec)
+{
+    unsigned bits = 0, shift = 0;
+    char tail = 0;
+    const int n = std::sscanf(spec.c_str(), "%u:%u%c", &bits, &shift, &tail);
+    if (n == 1 && bits == 16)
+    {
+        bits_ = 16;
+        return true;
+    }
+    if ((n == 1 || n == 2) && bits == 8 && shift <= 4)
+    {
+        bits_ = 8;
+        shift_ = n == 2 ? int(shift) : -1;
+        return true;
+    }
+    std::cerr << "--bits takes 16, 8 or 8:SHIFT (0..4)\n";
+    return false;
+}
+
+bool OutputMode::loadLut(const std::string &path)
+{
+    std::ifstream f(path);
+    if (!f)
+    {
+        std::cerr << "Can't read LUT " << path << "\n";
+        return false;
+    }
+    std::vector<uint8_t> lut;
+    std::string line;
+    for (unsigned n = 1; std::getline(f, line); ++n)
+    {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        char *end = nullptr;
+        const long v = std::strtol(line.c_str(), &end, 10);
+        if (end == line.c_str() || end[std::strspn(end, " \t\r")] != '\0' || v < 0 || v > 255 || lut.size() >= 4096)
+        {
+            std::cerr << path << ":" << n << ": expected one value 0..255 per line (at most 4096)\n";
+            return false;
+        }
+        lut.push_back(uint8_t(v));
+    }
+    if (lut.empty())
+    {
+        std::cerr << "LUT " << path << " is empty\n";
+        return false;
+    }
+    lut.resize(4096, lut.back()); // covers a 2x2 sum, whichever --bin comes later
+    lut_ = std::move(lut);
+    bits_ = 8;
+    return true;
+}
+
+std::string OutputMode::describe() const
+{
+    static const char *const kPositions[] = {"top-left", "top-right", "bottom-left", "bottom-right"};
+    std::string s;
+    switch (spatial_)
+    {
+    case Spatial::Full:
+        s = "full size";
+        break;
+    case Spatial::BinSum:
+        s = "2x2 sum";
+        break;
+    case Spatial::BinAverage:
+        s = "2x2 mean";
+        break;
+    case Spatial::Channel:
+        s = std::string(kPositions[channel_]) + " CFA channel";
+        break;
+    }
+    if (bits_ == 16)
+        return s + ", 16-bit";
+    if (!lut_.empty())
+        return s + ", 8-bit (LUT)";
+    return s + ", 8-bit (>> " + std::to_string(shift()) + ")";
+}
+
+uint16_t OutputMode::narrow(uint32_t v) const
+{
+    if (!lut_.empty())
+        return lut_[std::min<uint32_t>(v, 4095)];
+    return uint16_t(std::min<uint32_t>(v >> shift(), 255));
+}
+
+uint16_t OutputMode::whiteLevel() const
+{
+    return bits_ == 16 ? uint16_t(maxValue()) : narrow(maxValue());
+}
+
+void OutputMode::blackLevels(const uint16_t in[4], uint16_t out[4]) const
+{
+    uint32_t v[4];
+    switch (spatial_)
+    {
+    case Spatial::Full:
+        std::copy(in, in + 4, v);
+        break;
+    case Spatial::BinSum:
+        std::fill(v, v + 4, uint32_t(in[0]) + in[1] + in[2] + in[3]);
+        break;
+    case Spatial::BinAverage:
+        std::fill(v, v + 4, (uint32_t(in[0]) + in[1] + in[2] + in[3] + 2) / 4);
+        break;
+    case Spatial::Channel:
+        std::fill(v, v + 4, uint32_t(in[channel_]));
+        break;
+    }
+    for (unsigned c = 0; c < 4; ++c)
+        out[c] = bits_ == 16 ? uint16_t(v[c]) : narrow(v[c]);
+}
+
+bool OutputMode::reduce(const uint8_t *src, size_t srcBytes, size_t stride, uint32_t width, uint32_t height,
+                        uint8_t *dst, size_t dstBytes, bool bigEndian, const Calibration *cal, uint32_t x0,
+                        uint32_t y0) const
+{
+    const size_t lineBytes = (size_t(width) * 10 + 7) / 8;
+    if (stride == 0)
+        stride = lineBytes;
+    const uint32_t outW = this->width(width), outH = this->height(height);
+    // Lines read: all of them, or up to the last whole quad
+    const uint32_t lines = spatial_ == Spatial::Full ? height : 2 * outH;
+    if (!src || !dst || outW == 0 || outH == 0 || stride < lineBytes || dstBytes < bytes(width, height) ||
+        srcBytes < stride * (lines - 1) + lineBytes)
+        return false;
+    if (cal && !cal->correctsPixels())
+        cal = nullptr;
+    if (cal && (uint64_t(x0) + width > cal->header().width || uint64_t(y0) + height > cal->header().height))
+        return false;
+
+    const util::raw10::RowFn unpackRow = util::raw10::selected().fn;
+    const util::raw10::RowOps &ops = util::raw10::rowOps();
+    // Two lines of samples and one of reduced values: a few KB, in L1 for the
+    // whole row
+    thread_local std::vector<uint16_t> scratch;
+    if (scratch.size() < 3 * size_t(width))
+        scratch.resize(3 * size_t(width));
+    uint16_t *r0 = scratch.data(), *r1 = r0 + width, *val = r1 + width;
+    auto line = [&](uint32_t y, uint16_t *out)
+    {
+        const size_t off = y * stride;
+        unpackRow(src + off, srcBytes - off, out, width);
+        if (cal)
+            cal->correctRow(out, y0 + y, x0, width);
+    };
+
+    for (uint32_t y = 0; y < outH; ++y)
+    {
+        // Spatial step: into val[] (the samples themselves when Full)
+        const uint16_t *v = val;
+        switch (spatial_)
+        {
+        case Spatial::Full:
+            line(y, r0);
+            v = r0;
+            break;
+        case Spatial::Channel:
+        {
+            line(2 * y + (channel_ >> 1), r0);
+            ops.pick(r0, val, outW, channel_ & 1);
+            break;
+        }
+        case Spatial::BinSum:
+        case Spatial::BinAverage:
+        {
+            line(2 * y, r0);
+            line(2 * y + 1, r1);
+            if (spatial_ == Spatial::BinAverage)
+                ops.bin(r0, r1, val, outW, 2, 2);
+            else
+                ops.bin(r0, r1, val, outW, 0, 0);
+            break;
+        }
+        }
+
+        // Depth step, straight to the destination
+        if (bits_ == 8)
+        {
+            uint8_t *out = dst + size_t(y) * outW;
+            if (!lut_.empty())
+            {
+                const uint8_t *lut = lut_.data();
+                for (uint32_t x = 0; x < outW; ++x)
+                    out[x] = lut[v[x]];
+            }
+            else
+                ops.narrow(v, out, outW, shift());
+        }
+        else if (bigEndian)
+        {
+            uint8_t *out = dst + size_t(y) * outW * 2;
+            for (uint32_t x = 0; x < outW; ++x)
+            {
+                out[2 * x] = uint8_t(v[x] >> 8);
+                out[2 * x + 1] = uint8_t(v[x]);
+            }
+        }
+        else
+            std::memcpy(dst + size_t(y) * outW * 2, v, size_t(outW) * 2); // dst need not be 2-byte aligned
+    }
+    return true;
+}
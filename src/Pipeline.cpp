@@ -0,0 +1,204 @@
+#include "Pipeline.hpp"
+#include "AllocStats.hpp"
+#include "IoUtil.hpp"
+#include <algorithm>
+
+Pipeline::Pipeline(RecycleFn recycle)
+    : recycle_(std::move(recycle))
+{
+}
+
+Pipeline::~Pipeline()
+{
+    finish();
+}
+
+void Pipeline::addStage(const std::string &name, unsigned workers, size_t capacity, StageFn fn)
+{
+    if (started_)
+        return;
+    stages_.push_back(std::make_unique<Stage>(name, workers, capacity, std::move(fn)));
+}
+
+bool Pipeline::start()
+{
+    if (started_ || stages_.empty())
+        return false;
+    started_ = true;
+    for (size_t i = 0; i < stages_.size(); i++)
+    {
+        Stage &s = *stages_[i];
+        for (unsigned t = 0; t < s.workers; t++)
+            s.threads.emplace_back(&Pipeline::run, this, i, t);
+    }
+    return true;
+}
+
+bool Pipeline::submit(Frame &&f)
+{
+    if (!f.completedNs)
+        f.completedNs = util::monotonicNs();
+    if (f.sensorTimestampNs > 0 && f.completedNs > f.sensorTimestampNs)
+        sensorLatency_.record(uint64_t(f.completedNs - f.sensorTimestampNs));
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+
+    if (!started_ || stages_.front()->queue.tryPush(std::move(f)))
+        return started_;
+    // tryPush leaves f untouched on failure, so we still own the request
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    retire(f);
+    return false;
+}
+
+void Pipeline::release(Frame &f)
+{
+    libcamera::Request *req = f.request;
+    f.request = nullptr;
+    f.buffer = nullptr;
+    if (req && recycle_)
+    {
+        recycle_(req);
+        if (f.completedNs)
+            requeueLatency_.record(uint64_t(std::max<int64_t>(0, util::monotonicNs() - f.completedNs)));
+    }
+}
+
+void Pipeline::shed(Frame &f)
+{
+    shed_.fetch_add(1, std::memory_order_relaxed);
+    retire(f);
+}
+
+size_t Pipeline::shedOldest(size_t keep)
+{
+    if (!started_)
+        return 0;
+    BoundedQueue<Frame> &q = stages_.front()->queue;
+    size_t n = 0;
+    Frame f;
+    while (q.size() > keep && q.tryPop(f))
+    {
+        shed(f);
+        n++;
+    }
+    return n;
+}
+
+double Pipeline::fill() const
+{
+    double most = 0.0;
+    for (const auto &s : stages_)
+        most = std::max(most, double(s->queue.size()) / double(s->queue.capacity()));
+    return most;
+}
+
+void Pipeline::retire(Frame &f)
+{
+    release(f);
+    f.pixels.reset(); // straight back to the pool
+    const uint64_t n = retired_.fetch_add(1, std::memory_order_acq_rel) + 1;
+    if (onRetire_)
+        onRetire_(n);
+}
+
+void Pipeline::run(size_t stageIdx, unsigned worker)
+{
+    Stage &s = *stages_[stageIdx];
+    if (onThreadInit_)
+        onThreadInit_(s.name, worker);
+    Stage *next = stageIdx + 1 < stages_.size() ? stages_[stageIdx + 1].get() : nullptr;
+
+    Frame f;
+    while (s.queue.pop(f))
+    {
+        const uint64_t index = f.index;
+        const int64_t completedNs = f.completedNs;
+        const uint64_t allocsBefore = util::threadHeapAllocations();
+        const int64_t t0 = util::monotonicNs();
+        const bool ok = s.fn(f);
+        const int64_t t1 = util::monotonicNs();
+        if (index >= warmup_)
+            s.allocs.fetch_add(util::threadHeapAllocations() - allocsBefore, std::memory_order_relaxed);
+        s.service.record(uint64_t(t1 - t0));
+        if (ok)
+        {
+            s.processed.fetch_add(1, std::memory_order_relaxed);
+            s.done.record(uint64_t(std::max<int64_t>(0, t1 - completedNs)));
+            if (!next)
+            {
+                // EWMA over ~8 frames; racing workers may lose an update, which
+                // a smoothed signal doesn't mind
+                const int64_t prev = writerLatency_.load(std::memory_order_relaxed);
+                const int64_t sample = std::max<int64_t>(0, t1 - completedNs);
+                writerLatency_.store(prev + (sample - prev) / 8, std::memory_order_relaxed);
+            }
+        }
+        else
+            s.failed.fetch_add(1, std::memory_order_relaxed);
+        if (f.bytesWritten)
+        {
+            s.bytes.fetch_add(f.bytesWritten, std::memory_order_relaxed);
+            f.bytesWritten = 0;
+        }
+
+        if (!ok || !next)
+        {
+            retire(f);
+            continue;
+        }
+        // Blocks while the next stage is full: that's our backpressure.
+        if (!next->queue.push(std::move(f)))
+            retire(f);
+    }
+}
+
+void Pipeline::finish()
+{
+    if (!started_ || finished_)
+        return;
+    finished_ = true;
+    // Close front to back: each stage drains completely before the next one
+    // is told that no more input is coming.
+    for (auto &s : stages_)
+    {
+        s->queue.close();
+        for (auto &t : s->threads)
+            t.join();
+        s->threads.clear();
+    }
+}
+
+std::vector<Pipeline::StageStats> Pipeline::stats() const
+{
+    std::vector<StageStats> out;
+    out.reserve(stages_.size());
+    for (const auto &s : stages_)
+    {
+        StageStats st;
+        st.name = s->name;
+        st.depth = s->queue.size();
+        st.maxDepth = s->queue.maxSize();
+        st.capacity = s->queue.capacity();
+        st.processed = s->processed.load(std::memory_order_relaxed);
+        st.failed = s->failed.load(std::memory_order_relaxed);
+        st.allocs = s->allocs.load(std::memory_order_relaxed);
+        st.bytes = s->bytes.load(std::memory_order_relaxed);
+        st.done = s->done.summary();
+        st.service = s->service.summary();
+        out.push_back(st);
+    }
+    return out;
+}
+
+std::vector<Pipeline::StageStats> Pipeline::stats(Window &window) const
+{
+    std::vector<StageStats> out = stats();
+    window.done.resize(stages_.size());
+    window.service.resize(stages_.size());
+    for (size_t i = 0; i < stages_.size(); i++)
+    {
+        out[i].done = stages_[i]->done.summary(window.done[i], &window.done[i]);
+        out[i].service = stages_[i]->service.summary(window.service[i], &window.service[i]);
+    }
+    return out;
+}
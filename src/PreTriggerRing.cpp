@@ -0,0 +1,135 @@
+#include "PreTriggerRing.hpp"
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+PreTriggerRing::PreTriggerRing(size_t preFrames, size_t postFrames, const SeqFileHeader &hdr,
+                               const std::string &outDir, AsyncWriter &writer)
+    : ring_(preFrames), post_(postFrames), hdr_(hdr), outDir_(outDir), writer_(writer)
+{
+}
+
+PreTriggerRing::~PreTriggerRing()
+{
+    finish();
+}
+
+bool PreTriggerRing::push(PixelBuffer &&record, const SeqFrameInfo &info, unsigned triggers)
+{
+    // Bursts complete and every write of them landed: finalize their indexes
+    if (writer_.inFlight() == 0 && !closeLanded())
+        return false;
+
+    if (bursting())
+    {
+        if (triggers)
+            remaining_ = post_;
+        remaining_--;
+        const bool ok = write(std::move(record), info);
+        if (!bursting())
+            std::cout << "Burst " << bursts_ << " queued: " << path_ << "\n";
+        return ok;
+    }
+
+    // Ring mode: this frame replaces the oldest
+    if (!ring_.empty())
+    {
+        Slot &s = ring_[(head_ + count_) % ring_.size()];
+        s.record = std::move(record); // drops the oldest frame's buffer, if full
+        s.info = info;
+        if (count_ < ring_.size())
+            count_++;
+        else
+            head_ = (head_ + 1) % ring_.size();
+    }
+    if (!triggers)
+        return true;
+
+    // Trigger: everything in the ring (this frame included) goes out first
+    if (!startBurst())
+        return false;
+    bool ok = true;
+    if (ring_.empty())
+        ok = write(std::move(record), info);
+    for (; count_ > 0; count_--, head_ = (head_ + 1) % ring_.size())
+    {
+        Slot &s = ring_[head_];
+        ok = write(std::move(s.record), s.info) && ok;
+    }
+    head_ = 0;
+    remaining_ = post_;
+    if (!bursting())
+        std::cout << "Burst " << bursts_ << " queued: " << path_ << "\n";
+    return ok;
+}
+
+bool PreTriggerRing::startBurst()
+{
+    // The last one's writes may still be landing: it's closed once the writer
+    // is idle (push()), rather than making this frame wait for them
+    if (seq_)
+        closing_.push_back({std::move(seq_), path_});
+
+    char stamp[48];
+    const std::time_t now = std::time(nullptr);
+    const size_t n = std::strftime(stamp, sizeof(stamp), "imx296_burst_%Y%m%d_%H%M%S", std::localtime(&now));
+    std::snprintf(stamp + n, sizeof(stamp) - n, "_%03llu", static_cast<unsigned long long>(bursts_));
+    path_ = outDir_;
+    if (!path_.empty() && path_.back() != '/')
+        path_ += '/';
+    path_ += stamp;
+    path_ += SeqWriter::extension();
+
+    seq_.reset(new SeqWriter);
+    if (!seq_->open(path_, hdr_, ring_.size() + post_, writer_.direct()))
+    {
+        std::cerr << "Failed to create " << path_ << "\n";
+        seq_.reset();
+        return false;
+    }
+    bursts_++;
+    std::cout << "Trigger: burst " << bursts_ << " → " << path_ << "\n";
+    return true;
+}
+
+bool PreTriggerRing::write(PixelBuffer &&record, const SeqFrameInfo &info)
+{
+    if (!seq_ || !record)
+        return false;
+    const size_t payloadBytes = size_t(hdr_.stride) * hdr_.height;
+    const size_t bytes = seq_->recordBytes(payloadBytes);
+    uint8_t *rec = record.base();
+    const uint64_t at = seq_->stage(info, payload(record), payloadBytes, rec);
+    if (!writer_.writeAt(seq_->fd(), at, std::move(record), rec, bytes, &SeqWriter::onWriteFailed, seq_.get()))
+    {
+        seq_->discard(at);
+        return false;
+    }
+    written_++;
+    bytes_ += bytes;
+    return true;
+}
+
+bool PreTriggerRing::closeLanded()
+{
+    if (seq_ && !bursting())
+        closing_.push_back({std::move(seq_), path_});
+    bool ok = true;
+    for (Closing &c : closing_)
+        if (!c.seq->close())
+        {
+            std::cerr << "Failed to finalize " << c.path << "\n";
+            ok = false;
+        }
+    closing_.clear();
+    return ok;
+}
+
+bool PreTriggerRing::finish()
+{
+    if (!seq_ && closing_.empty())
+        return true;
+    writer_.drain();
+    remaining_ = 0;
+    return closeLanded();
+}
@@ -0,0 +1,219 @@
+#include "PreviewSink.hpp"
+#include "ThreadPlacement.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+PreviewSink::PreviewSink(unsigned cameras)
+    : slots_(std::max(1u, cameras))
+{
+}
+
+PreviewSink::~PreviewSink()
+{
+    stop_.store(true, std::memory_order_release);
+    wake_.notify();
+    if (thread_.joinable())
+        thread_.join();
+    for (Client &c : clients_)
+        ::close(c.fd);
+    if (listenFd_ >= 0)
+        ::close(listenFd_);
+}
+
+bool PreviewSink::listen(const std::string &spec)
+{
+    if (listenFd_ >= 0 || !wake_.ok())
+        return false;
+
+    // PORT or ADDR:PORT
+    const size_t colon = spec.rfind(':');
+    const std::string addr = colon == std::string::npos ? "0.0.0.0" : spec.substr(0, colon);
+    const std::string port = colon == std::string::npos ? spec : spec.substr(colon + 1);
+    char *end = nullptr;
+    const unsigned long p = std::strtoul(port.c_str(), &end, 10);
+    struct sockaddr_in sa{};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(static_cast<uint16_t>(p));
+    if (port.empty() || *end || p == 0 || p > 65535 || ::inet_pton(AF_INET, addr.c_str(), &sa.sin_addr) != 1)
+    {
+        std::cerr << "Preview: expected PORT or ADDR:PORT, got " << spec << "\n";
+        return false;
+    }
+
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    if (listenFd_ < 0 || ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        ::bind(listenFd_, reinterpret_cast<struct sockaddr *>(&sa), sizeof(sa)) != 0 ||
+        ::listen(listenFd_, kMaxClients) != 0)
+    {
+        std::cerr << "Preview: cannot listen on " << addr << ":" << p << ": " << std::strerror(errno) << "\n";
+        if (listenFd_ >= 0)
+            ::close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    endpoint_ = addr + ":" + std::to_string(p);
+    thread_ = std::thread([this]
+                          {
+        ThreadPlacement::enter(ThreadRole::Writer, "preview");
+        run(); });
+    return true;
+}
+
+uint8_t *PreviewSink::frameBuffer(unsigned camera, uint32_t width, uint32_t height)
+{
+    if (camera >= slots_.size())
+        return nullptr;
+    // `back` only ever changes in publish(), on this same producer thread
+    Image &img = *slots_[camera].back;
+    img.hdr.camera = static_cast<uint16_t>(camera);
+    img.hdr.width = width;
+    img.hdr.height = height;
+    img.hdr.payloadBytes = width * height;
+    img.pixels.resize(size_t(width) * height); // allocates for the first three images only
+    return img.pixels.data();
+}
+
+void PreviewSink::publish(unsigned camera, uint64_t index, int64_t timestampNs)
+{
+    if (camera >= slots_.size())
+        return;
+    Slot &s = slots_[camera];
+    s.back->hdr.index = index;
+    s.back->hdr.timestampNs = timestampNs;
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        std::swap(s.back, s.ready);
+        s.fresh = true;
+    }
+    published_.fetch_add(1, std::memory_order_relaxed);
+    wake_.notify();
+}
+
+PreviewSink::Stats PreviewSink::stats() const
+{
+    Stats st;
+    st.published = published_.load(std::memory_order_relaxed);
+    st.sent = sent_.load(std::memory_order_relaxed);
+    st.skipped = skipped_.load(std::memory_order_relaxed);
+    st.clients = clientCount_.load(std::memory_order_relaxed);
+    return st;
+}
+
+void PreviewSink::acceptClients()
+{
+    for (;;)
+    {
+        const int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return; // EAGAIN: nobody else waiting
+        if (clients_.size() >= kMaxClients)
+        {
+            ::close(fd);
+            continue;
+        }
+        const int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Client c;
+        c.fd = fd;
+        clients_.push_back(std::move(c));
+    }
+}
+
+bool PreviewSink::flush(Client &c)
+{
+    while (c.busy())
+    {
+        const ssize_t n = ::send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0)
+        {
+            c.sent += static_cast<size_t>(n);
+            if (!c.busy())
+                sent_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK); // full socket buffer: later
+    }
+    return true;
+}
+
+void PreviewSink::run()
+{
+    std::vector<struct pollfd> fds;
+    while (!stop_.load(std::memory_order_acquire))
+    {
+        // Wakeup, new connections, and every client: POLLOUT while an image is
+        // half sent, otherwise just to notice hang-ups
+        fds.clear();
+        fds.push_back({wake_.fd(), POLLIN, 0});
+        fds.push_back({listenFd_, POLLIN, 0});
+        for (const Client &c : clients_)
+            fds.push_back({c.fd, short(c.busy() ? POLLOUT : 0), 0});
+        if (::poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR)
+            break;
+
+        if (fds[0].revents & POLLIN)
+            wake_.wait(0);
+        std::vector<bool> gone(clients_.size(), false);
+        for (size_t i = 0; i < clients_.size(); ++i)
+        {
+            const short ev = fds[i + 2].revents;
+            if (ev & (POLLERR | POLLHUP | POLLNVAL))
+                gone[i] = true;
+            else if ((ev & POLLOUT) && !flush(clients_[i]))
+                gone[i] = true;
+        }
+
+        // Newest image per camera: whoever is idle gets it now, busy clients skip it
+        for (Slot &s : slots_)
+        {
+            {
+                std::lock_guard<std::mutex> lk(m_);
+                if (!s.fresh)
+                    continue;
+                std::swap(s.ready, s.sending);
+                s.fresh = false;
+            }
+            const Image &img = *s.sending;
+            for (size_t i = 0; i < clients_.size(); ++i)
+            {
+                Client &c = clients_[i];
+                if (gone[i])
+                    continue;
+                if (c.busy())
+                {
+                    skipped_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                c.out.resize(sizeof(PreviewHeader) + img.pixels.size());
+                std::memcpy(c.out.data(), &img.hdr, sizeof(PreviewHeader));
+                std::memcpy(c.out.data() + sizeof(PreviewHeader), img.pixels.data(), img.pixels.size());
+                c.sent = 0;
+                if (!flush(c))
+                    gone[i] = true;
+            }
+        }
+
+        for (size_t i = clients_.size(); i-- > 0;)
+            if (gone[i])
+            {
+                ::close(clients_[i].fd);
+                clients_.erase(clients_.begin() + i);
+            }
+        if (fds[1].revents & POLLIN)
+            acceptClients();
+        clientCount_.store(static_cast<unsigned>(clients_.size()), std::memory_order_relaxed);
+    }
+}
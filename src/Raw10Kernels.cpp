@@ -0,0 +1,190 @@
+#include "Raw10Kernels.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__arm__) && !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace util
+{
+    namespace raw10
+    {
+
+        void unpackRowScalar(const uint8_t *src, size_t /*srcBytes*/, uint16_t *dst, uint32_t width)
+        {
+            uint32_t x = 0;
+            // Whole groups: no per-pixel bounds checks
+            for (; x + 4 <= width; x += 4, src += 5)
+            {
+                const uint8_t b4 = src[4];
+                dst[x + 0] = uint16_t(src[0] | ((b4 & 0x03) << 8));
+                dst[x + 1] = uint16_t(src[1] | (((b4 >> 2) & 0x03) << 8));
+                dst[x + 2] = uint16_t(src[2] | (((b4 >> 4) & 0x03) << 8));
+                dst[x + 3] = uint16_t(src[3] | (((b4 >> 6) & 0x03) << 8));
+            }
+            // Last partial group (width not a multiple of 4)
+            if (x < width)
+            {
+                const uint8_t b4 = src[4];
+                for (uint32_t k = 0; x < width; ++x, ++k)
+                    dst[x] = uint16_t(src[k] | (((b4 >> (2 * k)) & 0x03) << 8));
+            }
+        }
+
+        std::vector<Kernel> available()
+        {
+            std::vector<Kernel> k{{"scalar", &unpackRowScalar}};
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("ssse3"))
+                k.push_back({"ssse3", &unpackRowSsse3});
+            if (__builtin_cpu_supports("avx2"))
+                k.push_back({"avx2", &unpackRowAvx2});
+#elif defined(__aarch64__)
+            // Advanced SIMD is mandatory on ARMv8-A
+            k.push_back({"neon", &unpackRowNeon});
+#elif defined(__arm__)
+            if (getauxval(AT_HWCAP) & HWCAP_NEON)
+                k.push_back({"neon", &unpackRowNeon});
+#endif
+            return k;
+        }
+
+        static Kernel pick()
+        {
+            const std::vector<Kernel> k = available();
+            if (const char *force = std::getenv("GS_UNPACK_KERNEL"))
+            {
+                for (const auto &c : k)
+                {
+                    if (std::strcmp(c.name, force) == 0)
+                        return c;
+                }
+                std::cerr << "GS_UNPACK_KERNEL=" << force << " not available here, using " << k.back().name << "\n";
+            }
+            return k.back();
+        }
+
+        const Kernel &selected()
+        {
+            static const Kernel k = pick();
+            return k;
+        }
+
+        void unpackFrame(const uint8_t *src, size_t srcBytes, size_t stride,
+                         uint32_t width, uint32_t height, uint16_t *dst)
+        {
+            const RowFn unpackRow = selected().fn;
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                const size_t rowOff = y * stride;
+                unpackRow(src + rowOff, srcBytes - rowOff, dst + size_t(y) * width, width);
+            }
+        }
+
+        bool unpack(const uint8_t *src, size_t srcBytes, size_t stride, uint32_t width, uint32_t height,
+                    uint16_t *dst, size_t dstSize, const Kernel *kernel)
+        {
+            const size_t lineBytes = (size_t(width) * 10 + 7) / 8; // pixel bytes per line
+            if (stride == 0)
+                stride = lineBytes;
+            if (!src || !dst || width == 0 || height == 0 || stride < lineBytes ||
+                dstSize < size_t(width) * height || srcBytes < stride * (height - 1) + lineBytes)
+                return false;
+
+            const RowFn unpackRow = (kernel ? *kernel : selected()).fn;
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                const size_t rowOff = y * stride;
+                unpackRow(src + rowOff, srcBytes - rowOff, dst + size_t(y) * width, width);
+            }
+            return true;
+        }
+
+        bool bin2x2To8(const uint8_t *src, size_t srcBytes, size_t stride, uint32_t width, uint32_t height,
+                       uint8_t *dst, size_t dstSize)
+        {
+            const size_t lineBytes = (size_t(width) * 10 + 7) / 8;
+            if (stride == 0)
+                stride = lineBytes;
+            const uint32_t outW = width / 2, outH = height / 2;
+            if (!src || !dst || outW == 0 || outH == 0 || stride < lineBytes ||
+                dstSize < size_t(outW) * outH || srcBytes < stride * (2 * outH - 1) + lineBytes)
+                return false;
+
+            // One 5-byte group is two quads wide: sum the 4 samples of each quad
+            // (12 bits) and keep the top 8
+            auto sample = [](const uint8_t *g, unsigned k)
+            { return uint32_t(g[k]) | ((uint32_t(g[4]) >> (2 * k)) & 0x03) << 8; };
+            for (uint32_t y = 0; y < outH; ++y)
+            {
+                const uint8_t *r0 = src + size_t(2 * y) * stride;
+                const uint8_t *r1 = r0 + stride;
+                uint8_t *out = dst + size_t(y) * outW;
+                uint32_t x = 0;
+                for (; x + 2 <= outW; x += 2, r0 += 5, r1 += 5)
+                {
+                    out[x] = uint8_t((sample(r0, 0) + sample(r0, 1) + sample(r1, 0) + sample(r1, 1)) >> 4);
+                    out[x + 1] = uint8_t((sample(r0, 2) + sample(r0, 3) + sample(r1, 2) + sample(r1, 3)) >> 4);
+                }
+                if (x < outW) // width % 4 == 2: half a group left
+                    out[x] = uint8_t((sample(r0, 0) + sample(r0, 1) + sample(r1, 0) + sample(r1, 1)) >> 4);
+            }
+            return true;
+        }
+
+        namespace
+        {
+            void binRowScalar(const uint16_t *r0, const uint16_t *r1, uint16_t *dst, uint32_t outW, unsigned round,
+                              unsigned shift)
+            {
+                for (uint32_t x = 0; x < outW; ++x)
+                    dst[x] = uint16_t((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + round) >> shift);
+            }
+
+            void pickRowScalar(const uint16_t *src, uint16_t *dst, uint32_t outW, unsigned phase)
+            {
+                for (uint32_t x = 0; x < outW; ++x)
+                    dst[x] = src[2 * x + phase];
+            }
+
+            void narrowRowScalar(const uint16_t *src, uint8_t *dst, uint32_t n, unsigned shift)
+            {
+                for (uint32_t x = 0; x < n; ++x)
+                {
+                    const uint32_t v = uint32_t(src[x]) >> shift;
+                    dst[x] = uint8_t(v > 255 ? 255 : v);
+                }
+            }
+        } // namespace
+
+        const RowOps &scalarRowOps()
+        {
+            static const RowOps ops{"scalar", &binRowScalar, &pickRowScalar, &narrowRowScalar};
+            return ops;
+        }
+
+        static const RowOps &pickRowOps()
+        {
+#if defined(__SSE2__)
+            return sse2RowOps(); // baseline on x86-64
+#elif defined(__aarch64__)
+            return neonRowOps();
+#elif defined(__arm__)
+            return (getauxval(AT_HWCAP) & HWCAP_NEON) ? neonRowOps() : scalarRowOps();
+#else
+            return scalarRowOps();
+#endif
+        }
+
+        const RowOps &rowOps()
+        {
+            static const RowOps &ops = pickRowOps();
+            return ops;
+        }
+
+    } // namespace raw10
+} // namespace util
@@ -0,0 +1,115 @@
+#include "Raw10Kernels.hpp"
+
+/*
+ * NEON RAW10 unpack (Pi 4 Cortex-A72 / Pi 5 Cortex-A76).
+ * Same idea as the x86 kernels: two table lookups build [MSB byte, 0] and
+ * [LSB byte, 0] lanes, a multiply by 256/64/16/4 lines each pixel's two LSBs
+ * up with bits 8..9, then mask and OR. 16 pixels per iteration.
+ *
+ * On 32-bit ARM this file is built with -mfpu=neon (see CMakeLists.txt) and the
+ * dispatcher checks HWCAP_NEON before calling in.
+ *
+ * OutputMode's row steps: vld2 splits even and odd samples for binning and
+ * channel picks, vqmovn is the saturating narrow to 8 bits.
+ */
+
+#if defined(__aarch64__) || defined(__arm__)
+#include <arm_neon.h>
+
+namespace util
+{
+    namespace raw10
+    {
+
+        namespace
+        {
+            inline uint8x16_t lookup(uint8x16_t tbl, uint8x16_t idx)
+            {
+#if defined(__aarch64__)
+                return vqtbl1q_u8(tbl, idx);
+#else
+                uint8x8x2_t t{{vget_low_u8(tbl), vget_high_u8(tbl)}};
+                return vcombine_u8(vtbl2_u8(t, vget_low_u8(idx)), vtbl2_u8(t, vget_high_u8(idx)));
+#endif
+            }
+
+            inline uint16x8_t unpack8(const uint8_t *p)
+            {
+                // Out-of-range indices (0xFF) read as zero in both vtbl and vqtbl
+                static const uint8_t kLo[16] = {0, 0xFF, 1, 0xFF, 2, 0xFF, 3, 0xFF, 5, 0xFF, 6, 0xFF, 7, 0xFF, 8, 0xFF};
+                static const uint8_t kHi[16] = {4, 0xFF, 4, 0xFF, 4, 0xFF, 4, 0xFF, 9, 0xFF, 9, 0xFF, 9, 0xFF, 9, 0xFF};
+                static const uint16_t kMul[8] = {256, 64, 16, 4, 256, 64, 16, 4};
+
+                const uint8x16_t v = vld1q_u8(p);
+                const uint16x8_t lo = vreinterpretq_u16_u8(lookup(v, vld1q_u8(kLo)));
+                uint16x8_t hi = vreinterpretq_u16_u8(lookup(v, vld1q_u8(kHi)));
+                hi = vandq_u16(vmulq_u16(hi, vld1q_u16(kMul)), vdupq_n_u16(0x0300));
+                return vorrq_u16(lo, hi);
+            }
+        } // namespace
+
+        void unpackRowNeon(const uint8_t *src, size_t srcBytes, uint16_t *dst, uint32_t width)
+        {
+            // 16 pixels = 20 bytes per step; the second 16-byte load ends at byte 26
+            uint32_t x = 0;
+            size_t off = 0;
+            for (; x + 16 <= width && off + 26 <= srcBytes; x += 16, off += 20)
+            {
+                vst1q_u16(dst + x, unpack8(src + off));
+                vst1q_u16(dst + x + 8, unpack8(src + off + 10));
+            }
+            if (x < width)
+                unpackRowScalar(src + off, srcBytes - off, dst + x, width - x);
+        }
+
+        namespace
+        {
+            void binRowNeon(const uint16_t *r0, const uint16_t *r1, uint16_t *dst, uint32_t outW, unsigned round,
+                            unsigned shift)
+            {
+                const uint16x8_t rnd = vdupq_n_u16(uint16_t(round));
+                const int16x8_t right = vdupq_n_s16(int16_t(-int(shift)));
+                uint32_t x = 0;
+                for (; x + 8 <= outW; x += 8)
+                {
+                    const uint16x8x2_t a = vld2q_u16(r0 + 2 * x);
+                    const uint16x8x2_t b = vld2q_u16(r1 + 2 * x);
+                    uint16x8_t v = vaddq_u16(vaddq_u16(a.val[0], a.val[1]), vaddq_u16(b.val[0], b.val[1]));
+                    v = vshlq_u16(vaddq_u16(v, rnd), right);
+                    vst1q_u16(dst + x, v);
+                }
+                scalarRowOps().bin(r0 + 2 * x, r1 + 2 * x, dst + x, outW - x, round, shift);
+            }
+
+            void pickRowNeon(const uint16_t *src, uint16_t *dst, uint32_t outW, unsigned phase)
+            {
+                uint32_t x = 0;
+                for (; x + 8 <= outW; x += 8)
+                    vst1q_u16(dst + x, vld2q_u16(src + 2 * x).val[phase & 1]);
+                scalarRowOps().pick(src + 2 * x, dst + x, outW - x, phase);
+            }
+
+            void narrowRowNeon(const uint16_t *src, uint8_t *dst, uint32_t n, unsigned shift)
+            {
+                const int16x8_t right = vdupq_n_s16(int16_t(-int(shift)));
+                uint32_t x = 0;
+                for (; x + 16 <= n; x += 16)
+                {
+                    const uint8x8_t a = vqmovn_u16(vshlq_u16(vld1q_u16(src + x), right));
+                    const uint8x8_t b = vqmovn_u16(vshlq_u16(vld1q_u16(src + x + 8), right));
+                    vst1q_u8(dst + x, vcombine_u8(a, b));
+                }
+                scalarRowOps().narrow(src + x, dst + x, n - x, shift);
+            }
+        } // namespace
+
+        const RowOps &neonRowOps()
+        {
+            static const RowOps ops{"neon", &binRowNeon, &pickRowNeon, &narrowRowNeon};
+            return ops;
+        }
+
+    } // namespace raw10
+} // namespace util
+
+#endif
@@ -0,0 +1,61 @@
+#include "Raw10PFile.hpp"
+#include "IoUtil.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+bool Raw10PFile::write(const std::string &path, const Raw10PHeader &hdr,
+                       const uint8_t *packed, size_t bytes)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<Raw10PHeader *>(&hdr);
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = const_cast<uint8_t *>(packed);
+    iov[1].iov_len = bytes;
+
+    bool ok = util::writevAll(fd, iov, 2);
+    if (::close(fd) != 0)
+        ok = false;
+    return ok;
+}
+
+namespace
+{
+    bool valid(const Raw10PHeader &hdr)
+    {
+        const Raw10PHeader ref{};
+        return std::memcmp(hdr.magic, ref.magic, sizeof(hdr.magic)) == 0 && hdr.version == 1 && hdr.width &&
+               hdr.height && hdr.stride >= (size_t(hdr.width) * 10 + 7) / 8;
+    }
+} // namespace
+
+bool Raw10PFile::read(const std::string &path, Raw10PHeader &hdr, std::vector<uint8_t> &packed)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f)
+        return false;
+    if (!f.read(reinterpret_cast<char *>(&hdr), sizeof(hdr)))
+        return false;
+
+    if (!valid(hdr))
+        return false;
+
+    packed.resize(size_t(hdr.stride) * hdr.height);
+    return bool(f.read(reinterpret_cast<char *>(packed.data()), packed.size()));
+}
+
+bool Raw10PFile::view(const uint8_t *file, size_t bytes, Raw10PHeader &hdr, const uint8_t *&packed)
+{
+    if (!file || bytes < sizeof(hdr))
+        return false;
+    std::memcpy(&hdr, file, sizeof(hdr));
+    if (!valid(hdr) || bytes - sizeof(hdr) < size_t(hdr.stride) * hdr.height)
+        return false;
+    packed = file + sizeof(hdr);
+    return true;
+}
@@ -0,0 +1,174 @@
+#include "Raw10Kernels.hpp"
+
+/*
+ * SSSE3 / AVX2 RAW10 unpack for x86 hosts (reprocessing dumps on a workstation).
+ * Compiled with per-function target attributes, so the rest of the build keeps
+ * the baseline ISA and the dispatcher only calls these after a CPUID check.
+ *
+ * Per 8 pixels (10 bytes): one shuffle spreads bytes 0..3 / 5..8 into the low byte
+ * of each 16-bit lane, a second copies the matching LSB byte (4 or 9) into it.
+ * Multiplying that by 256/64/16/4 moves pixel k's two LSBs to bits 8..9, then
+ * mask and OR.
+ *
+ * The OutputMode row steps only need SSE2, which every x86-64 has: pmaddwd
+ * against ones adds neighbouring samples, and packuswb is the saturating
+ * narrow to 8 bits. The compiler's own versions of these loops come out several
+ * times slower at baseline ISA.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+namespace util
+{
+    namespace raw10
+    {
+
+        namespace
+        {
+            __attribute__((target("ssse3"))) inline __m128i unpack8(__m128i v)
+            {
+                const __m128i loIdx = _mm_setr_epi8(0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1);
+                const __m128i hiIdx = _mm_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1);
+                const __m128i mul = _mm_setr_epi16(256, 64, 16, 4, 256, 64, 16, 4);
+                const __m128i mask = _mm_set1_epi16(0x0300);
+                const __m128i lo = _mm_shuffle_epi8(v, loIdx);
+                const __m128i hi = _mm_and_si128(_mm_mullo_epi16(_mm_shuffle_epi8(v, hiIdx), mul), mask);
+                return _mm_or_si128(lo, hi);
+            }
+
+            __attribute__((target("avx2"))) inline __m256i unpack16(const uint8_t *p)
+            {
+                // Lane 0 = bytes 0..15, lane 1 = bytes 10..25; vpshufb works per lane
+                const __m256i v = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 10)), 1);
+                const __m256i loIdx = _mm256_setr_epi8(0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1,
+                                                       0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1);
+                const __m256i hiIdx = _mm256_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1,
+                                                       4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1);
+                const __m256i mul = _mm256_setr_epi16(256, 64, 16, 4, 256, 64, 16, 4,
+                                                      256, 64, 16, 4, 256, 64, 16, 4);
+                const __m256i mask = _mm256_set1_epi16(0x0300);
+                const __m256i lo = _mm256_shuffle_epi8(v, loIdx);
+                const __m256i hi = _mm256_and_si256(_mm256_mullo_epi16(_mm256_shuffle_epi8(v, hiIdx), mul), mask);
+                return _mm256_or_si256(lo, hi);
+            }
+        } // namespace
+
+        __attribute__((target("ssse3"))) void unpackRowSsse3(const uint8_t *src, size_t srcBytes, uint16_t *dst, uint32_t width)
+        {
+            // 16 pixels = 20 bytes per step; the second 16-byte load ends at byte 26
+            uint32_t x = 0;
+            size_t off = 0;
+            for (; x + 16 <= width && off + 26 <= srcBytes; x += 16, off += 20)
+            {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + off));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + off + 10));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), unpack8(a));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x + 8), unpack8(b));
+            }
+            if (x < width)
+                unpackRowScalar(src + off, srcBytes - off, dst + x, width - x);
+        }
+
+        __attribute__((target("avx2"))) void unpackRowAvx2(const uint8_t *src, size_t srcBytes, uint16_t *dst, uint32_t width)
+        {
+            // 32 pixels = 40 bytes per step; the last 16-byte load ends at byte 46
+            uint32_t x = 0;
+            size_t off = 0;
+            for (; x + 32 <= width && off + 46 <= srcBytes; x += 32, off += 40)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), unpack16(src + off));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x + 16), unpack16(src + off + 20));
+            }
+            // One more 16-pixel step before dropping to scalar
+            if (x + 16 <= width && off + 26 <= srcBytes)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), unpack16(src + off));
+                x += 16;
+                off += 20;
+            }
+            if (x < width)
+                unpackRowScalar(src + off, srcBytes - off, dst + x, width - x);
+        }
+
+#if defined(__SSE2__)
+        namespace
+        {
+            // Sums of horizontal pairs of 8 + 8 samples; fits: a quad is at most 4092
+            inline __m128i pairSums(__m128i a, __m128i b)
+            {
+                const __m128i ones = _mm_set1_epi16(1);
+                return _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+            }
+
+            void binRowSse2(const uint16_t *r0, const uint16_t *r1, uint16_t *dst, uint32_t outW, unsigned round,
+                            unsigned shift)
+            {
+                const __m128i rnd = _mm_set1_epi16(int16_t(round));
+                const __m128i cnt = _mm_cvtsi32_si128(int(shift));
+                uint32_t x = 0;
+                for (; x + 8 <= outW; x += 8)
+                {
+                    const __m128i *p0 = reinterpret_cast<const __m128i *>(r0 + 2 * x);
+                    const __m128i *p1 = reinterpret_cast<const __m128i *>(r1 + 2 * x);
+                    const __m128i a = _mm_add_epi16(_mm_loadu_si128(p0), _mm_loadu_si128(p1));
+                    const __m128i b = _mm_add_epi16(_mm_loadu_si128(p0 + 1), _mm_loadu_si128(p1 + 1));
+                    const __m128i v = _mm_srl_epi16(_mm_add_epi16(pairSums(a, b), rnd), cnt);
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), v);
+                }
+                scalarRowOps().bin(r0 + 2 * x, r1 + 2 * x, dst + x, outW - x, round, shift);
+            }
+
+            void pickRowSse2(const uint16_t *src, uint16_t *dst, uint32_t outW, unsigned phase)
+            {
+                // Even samples: mask the odd ones away; odd: shift them down. Then
+                // pack 32 → 16 bits (10-bit values, so no saturation).
+                const __m128i lo = _mm_set1_epi32(0xFFFF);
+                uint32_t x = 0;
+                for (; x + 8 <= outW; x += 8)
+                {
+                    const __m128i *p = reinterpret_cast<const __m128i *>(src + 2 * x);
+                    __m128i a = _mm_loadu_si128(p), b = _mm_loadu_si128(p + 1);
+                    if (phase)
+                    {
+                        a = _mm_srli_epi32(a, 16);
+                        b = _mm_srli_epi32(b, 16);
+                    }
+                    else
+                    {
+                        a = _mm_and_si128(a, lo);
+                        b = _mm_and_si128(b, lo);
+                    }
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_packs_epi32(a, b));
+                }
+                scalarRowOps().pick(src + 2 * x, dst + x, outW - x, phase);
+            }
+
+            void narrowRowSse2(const uint16_t *src, uint8_t *dst, uint32_t n, unsigned shift)
+            {
+                const __m128i cnt = _mm_cvtsi32_si128(int(shift));
+                uint32_t x = 0;
+                for (; x + 16 <= n; x += 16)
+                {
+                    const __m128i *p = reinterpret_cast<const __m128i *>(src + x);
+                    const __m128i a = _mm_srl_epi16(_mm_loadu_si128(p), cnt);
+                    const __m128i b = _mm_srl_epi16(_mm_loadu_si128(p + 1), cnt);
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_packus_epi16(a, b));
+                }
+                scalarRowOps().narrow(src + x, dst + x, n - x, shift);
+            }
+        } // namespace
+
+        const RowOps &sse2RowOps()
+        {
+            static const RowOps ops{"sse2", &binRowSse2, &pickRowSse2, &narrowRowSse2};
+            return ops;
+        }
+#endif
+
+    } // namespace raw10
+} // namespace util
+
+#endif
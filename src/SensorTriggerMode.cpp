@@ -0,0 +1,43 @@
+#include "SensorTriggerMode.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+SensorTriggerMode::~SensorTriggerMode()
+{
+    if (enabled_ && !writeParameter(previous_))
+        std::cerr << "Failed to restore " << parameterPath() << " to " << previous_ << "\n";
+}
+
+bool SensorTriggerMode::writeParameter(const std::string &value)
+{
+    std::ofstream f(parameterPath());
+    f << value << "\n";
+    f.flush();
+    return bool(f);
+}
+
+bool SensorTriggerMode::enable()
+{
+    std::ifstream in(parameterPath());
+    if (!(in >> previous_))
+    {
+        std::cerr << "External trigger: " << parameterPath() << " not found (imx296 driver without "
+                  << "trigger_mode, or no IMX296 here)\n";
+        return false;
+    }
+    if (previous_ == "1")
+    {
+        enabled_ = false; // someone else turned it on; leave it to them
+        return true;
+    }
+    if (!writeParameter("1"))
+    {
+        std::cerr << "External trigger: can't write " << parameterPath() << ": " << std::strerror(errno)
+                  << " (run as root)\n";
+        return false;
+    }
+    enabled_ = true;
+    return true;
+}
@@ -0,0 +1,297 @@
+#include "SeqFile.hpp"
+#include "IoUtil.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr uint32_t kMaxAlignment = 1u << 16;
+
+    // Preallocation step: big enough that fallocate() is rare, small enough
+    // that a short capture doesn't pin much disk until close() trims it
+    constexpr uint64_t kPreallocateChunk = 64ull << 20;
+
+    // Padding source; alignment is capped, so one shared block covers every case.
+    const uint8_t kZeros[kMaxAlignment] = {};
+
+    uint64_t alignUp(uint64_t v, uint32_t a) { return (v + a - 1) & ~uint64_t(a - 1); }
+
+    bool validAlignment(uint32_t a) { return a >= 512 && a <= kMaxAlignment && (a & (a - 1)) == 0; }
+} // namespace
+
+// --- SeqWriter ---
+
+SeqWriter::~SeqWriter()
+{
+    close();
+}
+
+bool SeqWriter::open(const std::string &path, const SeqFileHeader &hdr, size_t expectedFrames, bool direct)
+{
+    if (fd_ >= 0 || !validAlignment(hdr.alignment))
+        return false;
+
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+        return false;
+
+    hdr_ = hdr;
+    hdr_.indexOffset = 0;
+    hdr_.frameCount = 0;
+    index_.clear();
+    index_.reserve(expectedFrames);
+    {
+        std::lock_guard<std::mutex> lk(discardM_);
+        discarded_.clear();
+    }
+
+    // Header block, padded so the first record is aligned
+    struct iovec iov[2];
+    iov[0].iov_base = &hdr_;
+    iov[0].iov_len = sizeof(hdr_);
+    iov[1].iov_base = const_cast<uint8_t *>(kZeros);
+    iov[1].iov_len = hdr_.alignment - sizeof(hdr_);
+    if (!util::writevAll(fd_, iov, 2))
+    {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    offset_ = hdr_.alignment;
+    allocated_ = offset_;
+
+    // The header block went out buffered from an unaligned struct; from here on
+    // every write is a whole aligned record. F_SETFL fails where O_DIRECT isn't
+    // supported, and we just stay buffered.
+    direct_ = false;
+    if (direct)
+    {
+        const int fl = ::fcntl(fd_, F_GETFL);
+        direct_ = fl >= 0 && ::fcntl(fd_, F_SETFL, fl | O_DIRECT) == 0;
+    }
+    return true;
+}
+
+void SeqWriter::reserve(uint64_t end)
+{
+    if (end <= allocated_)
+        return;
+    const uint64_t len = std::max(kPreallocateChunk, end - allocated_);
+    // KEEP_SIZE: the file only grows as records land, so a crash mid-capture
+    // leaves no zero tail for SeqReader to walk into
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(allocated_), static_cast<off_t>(len)) == 0)
+        allocated_ += len;
+    else
+        allocated_ = UINT64_MAX; // not supported here; don't keep asking
+}
+
+size_t SeqWriter::recordBytes(size_t payloadBytes) const
+{
+    return alignUp(sizeof(SeqFrameHeader) + payloadBytes, hdr_.alignment);
+}
+
+SeqFrameHeader SeqWriter::frameHeader(const SeqFrameInfo &info, size_t bytes) const
+{
+    SeqFrameHeader fh;
+    fh.payloadBytes = bytes;
+    fh.recordBytes = recordBytes(bytes);
+    fh.sequence = info.sequence;
+    fh.timestampNs = info.timestampNs;
+    fh.exposureUs = info.exposureUs;
+    fh.analogueGain = info.analogueGain;
+    fh.flags = info.flags;
+    fh.droppedBefore = info.droppedBefore;
+    fh.scheduleStep = info.scheduleStep;
+    return fh;
+}
+
+uint64_t SeqWriter::stage(const SeqFrameInfo &info, const uint8_t *payload, size_t bytes, uint8_t *record)
+{
+    const SeqFrameHeader fh = frameHeader(info, bytes);
+    std::memcpy(record, &fh, sizeof(fh));
+    if (payload != record + sizeof(fh))
+        std::memcpy(record + sizeof(fh), payload, bytes);
+    std::memset(record + sizeof(fh) + bytes, 0, fh.recordBytes - sizeof(fh) - bytes);
+
+    const uint64_t at = offset_;
+    reserve(at + fh.recordBytes);
+    index_.push_back({at, info.sequence, info.timestampNs});
+    offset_ += fh.recordBytes;
+    return at;
+}
+
+void SeqWriter::discard(uint64_t at)
+{
+    std::lock_guard<std::mutex> lk(discardM_);
+    discarded_.push_back(at);
+}
+
+bool SeqWriter::append(const SeqFrameInfo &info, const uint8_t *payload, size_t bytes)
+{
+    if (fd_ < 0)
+        return false;
+
+    SeqFrameHeader fh = frameHeader(info, bytes);
+    reserve(offset_ + fh.recordBytes);
+
+    struct iovec iov[3];
+    iov[0].iov_base = &fh;
+    iov[0].iov_len = sizeof(fh);
+    iov[1].iov_base = const_cast<uint8_t *>(payload);
+    iov[1].iov_len = bytes;
+    iov[2].iov_base = const_cast<uint8_t *>(kZeros);
+    iov[2].iov_len = fh.recordBytes - sizeof(fh) - bytes;
+    if (!util::writevAll(fd_, iov, 3))
+        return false;
+
+    index_.push_back({offset_, info.sequence, info.timestampNs});
+    offset_ += fh.recordBytes;
+    return true;
+}
+
+bool SeqWriter::close()
+{
+    if (fd_ < 0)
+        return true;
+
+    // Index and header aren't aligned; write them through the page cache
+    if (direct_)
+    {
+        const int fl = ::fcntl(fd_, F_GETFL);
+        if (fl >= 0)
+            ::fcntl(fd_, F_SETFL, fl & ~O_DIRECT);
+        direct_ = false;
+    }
+
+    // Records that never reached the disk aren't indexed; their space stays a hole
+    {
+        std::lock_guard<std::mutex> lk(discardM_);
+        if (!discarded_.empty())
+        {
+            std::sort(discarded_.begin(), discarded_.end());
+            index_.erase(std::remove_if(index_.begin(), index_.end(), [&](const SeqIndexEntry &e)
+                                        { return std::binary_search(discarded_.begin(), discarded_.end(), e.offset); }),
+                         index_.end());
+            discarded_.clear();
+        }
+    }
+
+    SeqIndexFooter footer;
+    footer.count = index_.size();
+
+    struct iovec iov[2];
+    iov[0].iov_base = index_.data();
+    iov[0].iov_len = index_.size() * sizeof(SeqIndexEntry);
+    iov[1].iov_base = &footer;
+    iov[1].iov_len = sizeof(footer);
+    // stage()d records went out by offset and never moved the file position
+    bool ok = ::lseek(fd_, static_cast<off_t>(offset_), SEEK_SET) >= 0 && util::writevAll(fd_, iov, 2);
+
+    // Only now does the header point at the index: a torn close leaves a scannable file
+    if (ok)
+    {
+        hdr_.indexOffset = offset_;
+        hdr_.frameCount = index_.size();
+        ok = util::pwriteAll(fd_, &hdr_, sizeof(hdr_), 0);
+    }
+    // Hand back whatever was preallocated past the end
+    const uint64_t end = offset_ + index_.size() * sizeof(SeqIndexEntry) + sizeof(footer);
+    if (ok && allocated_ != UINT64_MAX && allocated_ > end)
+        ok = ::ftruncate(fd_, static_cast<off_t>(end)) == 0;
+    if (::close(fd_) != 0)
+        ok = false;
+    fd_ = -1;
+    return ok;
+}
+
+// --- SeqReader ---
+
+SeqReader::~SeqReader()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+bool SeqReader::open(const std::string &path)
+{
+    if (fd_ >= 0)
+        return false;
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+        return false;
+
+    struct stat st{};
+    if (::fstat(fd_, &st) != 0 || !util::preadAll(fd_, &hdr_, sizeof(hdr_), 0))
+        return false;
+
+    const SeqFileHeader ref{};
+    if (std::memcmp(hdr_.magic, ref.magic, sizeof(ref.magic)) != 0 || hdr_.version != 1 ||
+        !validAlignment(hdr_.alignment) || !hdr_.width || !hdr_.height)
+        return false;
+
+    const uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    finalized_ = false;
+    if (hdr_.indexOffset)
+    {
+        const uint64_t indexBytes = hdr_.frameCount * sizeof(SeqIndexEntry);
+        SeqIndexFooter footer;
+        if (hdr_.indexOffset + indexBytes + sizeof(footer) <= fileSize &&
+            util::preadAll(fd_, &footer, sizeof(footer), hdr_.indexOffset + indexBytes) &&
+            footer.magic == SeqIndexFooter{}.magic && footer.count == hdr_.frameCount)
+        {
+            index_.resize(hdr_.frameCount);
+            finalized_ = util::preadAll(fd_, index_.data(), indexBytes, hdr_.indexOffset);
+        }
+    }
+    return finalized_ || scan(fileSize);
+}
+
+bool SeqReader::scan(uint64_t fileSize)
+{
+    // No usable index (capture interrupted): walk the records from the first block
+    index_.clear();
+    uint64_t off = hdr_.alignment;
+    SeqFrameHeader fh;
+    while (off + sizeof(fh) <= fileSize && util::preadAll(fd_, &fh, sizeof(fh), off))
+    {
+        if (fh.magic != SeqFrameHeader{}.magic || fh.recordBytes < sizeof(fh) + fh.payloadBytes ||
+            off + sizeof(fh) + fh.payloadBytes > fileSize)
+            break;
+        index_.push_back({off, fh.sequence, fh.timestampNs});
+        off += fh.recordBytes;
+    }
+    return true;
+}
+
+bool SeqReader::read(size_t i, SeqFrameHeader &fh, std::vector<uint8_t> &payload) const
+{
+    if (fd_ < 0 || i >= index_.size())
+        return false;
+    const uint64_t off = index_[i].offset;
+    if (!util::preadAll(fd_, &fh, sizeof(fh), off) || fh.magic != SeqFrameHeader{}.magic)
+        return false;
+    payload.resize(fh.payloadBytes);
+    return util::preadAll(fd_, payload.data(), payload.size(), off + sizeof(fh));
+}
+
+bool SeqReader::map()
+{
+    return fd_ >= 0 && (map_.data() || map_.map(fd_));
+}
+
+bool SeqReader::view(size_t i, SeqFrameHeader &fh, const uint8_t *&payload) const
+{
+    if (!map_.data() || i >= index_.size())
+        return false;
+    const uint64_t off = index_[i].offset;
+    if (off + sizeof(fh) > map_.size())
+        return false;
+    std::memcpy(&fh, map_.data() + off, sizeof(fh));
+    if (fh.magic != SeqFrameHeader{}.magic || off + sizeof(fh) + fh.payloadBytes > map_.size())
+        return false;
+    payload = map_.data() + off + sizeof(fh);
+    return true;
+}
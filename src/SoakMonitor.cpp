@@ -0,0 +1,395 @@
+#include "SoakMonitor.hpp"
+#include "AllocStats.hpp"
+#include "IoUtil.hpp"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+namespace
+{
+    void appendf(std::string &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    void appendf(std::string &out, const char *fmt, ...)
+    {
+        // Most pieces fit the stack buffer; the echoed command line may not, so
+        // format again straight into the string at the size vsnprintf asked for
+        char buf[512];
+        va_list ap, again;
+        va_start(ap, fmt);
+        va_copy(again, ap);
+        const int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        if (n > 0 && size_t(n) < sizeof(buf))
+            out.append(buf, size_t(n));
+        else if (n > 0)
+        {
+            const size_t at = out.size();
+            out.resize(at + size_t(n) + 1);
+            std::vsnprintf(&out[at], size_t(n) + 1, fmt, again);
+            out.resize(at + size_t(n));
+        }
+        va_end(again);
+    }
+
+    std::string jsonString(const std::string &s)
+    {
+        std::string out = "\"";
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                out += c;
+        }
+        return out + "\"";
+    }
+
+    unsigned long long ull(uint64_t v) { return static_cast<unsigned long long>(v); }
+
+    // Resident set from /proc/self/statm (pages), 0 if unreadable
+    uint64_t rssKiB()
+    {
+        std::ifstream f("/proc/self/statm");
+        uint64_t size = 0, resident = 0;
+        if (!(f >> size >> resident))
+            return 0;
+        return resident * uint64_t(::sysconf(_SC_PAGESIZE)) / 1024;
+    }
+
+    // The number after "key": somewhere past `from` in our own report format
+    bool findNumber(const std::string &doc, size_t from, const char *key, double &out)
+    {
+        const size_t at = doc.find(std::string("\"") + key + "\":", from);
+        if (at == std::string::npos)
+            return false;
+        const char *p = doc.c_str() + at + std::strlen(key) + 3;
+        char *end = nullptr;
+        out = std::strtod(p, &end);
+        return end != p;
+    }
+} // namespace
+
+bool SoakMonitor::parseDuration(const std::string &s, double &seconds)
+{
+    char *end = nullptr;
+    const double v = std::strtod(s.c_str(), &end);
+    double unit = 0.0;
+    if (end != s.c_str())
+    {
+        const std::string suffix(end);
+        if (suffix.empty() || suffix == "s")
+            unit = 1.0;
+        else if (suffix == "m")
+            unit = 60.0;
+        else if (suffix == "h")
+            unit = 3600.0;
+    }
+    if (unit == 0.0 || !(v > 0.0))
+    {
+        std::cerr << "--soak takes a duration such as 3600, 90s, 45m or 1.5h\n";
+        return false;
+    }
+    seconds = v * unit;
+    return true;
+}
+
+bool SoakMonitor::parseTolerance(const std::string &s, Tolerance &tol)
+{
+    double fps = 0.0, p99 = tol.p99 * 100.0;
+    char tail = 0;
+    const int n = std::sscanf(s.c_str(), "%lf/%lf%c", &fps, &p99, &tail);
+    if ((n != 1 && n != 2) || fps < 0.0 || fps >= 100.0 || p99 < 0.0)
+    {
+        std::cerr << "--soak-tolerance takes FPS%[/P99%], e.g. 2/25\n";
+        return false;
+    }
+    tol.fps = fps / 100.0;
+    tol.p99 = p99 / 100.0;
+    return true;
+}
+
+SoakMonitor::SoakMonitor(double durationSec, double intervalSec, double targetFps, const std::string &config)
+    : durationNs_(static_cast<int64_t>(durationSec * 1e9)),
+      intervalNs_(static_cast<int64_t>(std::max(intervalSec, 0.1) * 1e9)), targetFps_(targetFps), config_(config)
+{
+}
+
+void SoakMonitor::addCamera(const std::string &label, const Pipeline &pipeline, const DropDetector *drops)
+{
+    Camera c;
+    c.label = label;
+    c.pipeline = &pipeline;
+    c.drops = drops;
+    cameras_.push_back(std::move(c));
+}
+
+void SoakMonitor::start()
+{
+    startNs_ = lastNs_ = util::monotonicNs();
+    for (Camera &c : cameras_)
+    {
+        const auto stages = c.pipeline->stats(c.window); // opens the first window
+        c.stageNames.clear();
+        c.lastBytes = 0;
+        for (const auto &st : stages)
+        {
+            c.stageNames.push_back(st.name);
+            c.lastBytes += st.bytes;
+        }
+        c.lastFrames = c.pipeline->submitted();
+    }
+    // One sample per interval for the whole soak: no reallocation while it runs
+    samples_.clear();
+    samples_.reserve(size_t(durationNs_ / intervalNs_) + 2);
+    Sample first;
+    first.rssKiB = rssKiB();
+    first.heapAllocs = util::heapAllocations();
+    for (const Camera &c : cameras_)
+    {
+        CameraSample cs;
+        cs.frames = c.lastFrames;
+        first.cameras.push_back(cs);
+    }
+    samples_.push_back(std::move(first));
+}
+
+int SoakMonitor::msUntilDue() const
+{
+    if (!startNs_)
+        return -1;
+    const int64_t now = util::monotonicNs();
+    const int64_t due = std::min(lastNs_ + intervalNs_, startNs_ + durationNs_);
+    return due > now ? int((due - now + 999999) / 1000000) : 0;
+}
+
+bool SoakMonitor::expired() const
+{
+    return startNs_ && util::monotonicNs() - startNs_ >= durationNs_;
+}
+
+void SoakMonitor::sample(std::ostream &os, bool force)
+{
+    if (!startNs_)
+        return;
+    const int64_t now = util::monotonicNs();
+    if (now - lastNs_ < intervalNs_ && !(force && now > lastNs_))
+        return;
+    const double dt = double(now - lastNs_) / 1e9;
+
+    Sample s;
+    s.t = double(now - startNs_) / 1e9;
+    s.rssKiB = rssKiB();
+    s.heapAllocs = util::heapAllocations();
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "Soak [" << std::setw(7) << s.t << "/" << durationNs_ / 1e9 << " s]";
+    for (Camera &c : cameras_)
+    {
+        const auto stages = c.pipeline->stats(c.window);
+        CameraSample cs;
+        uint64_t bytes = 0;
+        for (const auto &st : stages)
+        {
+            bytes += st.bytes;
+            cs.allocs += st.allocs;
+            StageSample ss;
+            ss.p50 = st.done.p50;
+            ss.p99 = st.done.p99;
+            ss.max = st.done.max;
+            ss.depth = st.depth;
+            cs.stages.push_back(ss);
+        }
+        cs.frames = c.pipeline->submitted();
+        cs.dropped = c.pipeline->dropped();
+        cs.shed = c.pipeline->shedCount();
+        cs.missing = c.drops ? c.drops->dropped() : 0;
+        cs.fps = double(cs.frames - c.lastFrames) / dt;
+        cs.mbPerSec = double(bytes - c.lastBytes) / 1e6 / dt;
+        c.lastFrames = cs.frames;
+        c.lastBytes = bytes;
+
+        line << " " << (c.label.empty() ? std::string() : c.label + " ") << cs.fps << " fps, lost "
+             << cs.missing + cs.dropped;
+        if (!cs.stages.empty())
+            line << ", p99 " << std::setprecision(2) << cs.stages.back().p99 / 1e6 << " ms" << std::setprecision(1);
+        line << " |";
+        s.cameras.push_back(std::move(cs));
+    }
+    line << " RSS " << s.rssKiB / 1024.0 << " MiB, heap allocs " << s.heapAllocs - samples_.front().heapAllocs;
+    os << line.str() << "\n";
+
+    samples_.push_back(std::move(s));
+    lastNs_ = now;
+}
+
+SoakMonitor::Summary SoakMonitor::summarize() const
+{
+    Summary sum;
+    if (samples_.empty())
+        return sum;
+    const Sample &last = samples_.back();
+    sum.seconds = last.t;
+    sum.rssStartKiB = samples_.front().rssKiB;
+    sum.rssEndKiB = last.rssKiB;
+    bool haveFps = false;
+    for (size_t i = 0; i < samples_.size(); i++)
+    {
+        const Sample &s = samples_[i];
+        sum.rssMaxKiB = std::max(sum.rssMaxKiB, s.rssKiB);
+        // A last sample from a fraction of an interval is too noisy to judge the rate on
+        const double dt = i ? s.t - samples_[i - 1].t : 0.0;
+        for (const CameraSample &cs : s.cameras)
+        {
+            if (i && dt * 2e9 >= double(intervalNs_))
+            {
+                sum.minIntervalFps = haveFps ? std::min(sum.minIntervalFps, cs.fps) : cs.fps;
+                haveFps = true;
+            }
+            if (!cs.stages.empty())
+                sum.worstIntervalP99 = std::max(sum.worstIntervalP99, cs.stages.back().p99);
+        }
+    }
+    for (size_t c = 0; c < cameras_.size() && c < last.cameras.size(); c++)
+    {
+        const CameraSample &cs = last.cameras[c];
+        const double fps = sum.seconds > 0 ? double(cs.frames) / sum.seconds : 0.0;
+        sum.fps = c ? std::min(sum.fps, fps) : fps;
+        sum.lost += cs.missing + cs.dropped;
+        sum.shed += cs.shed;
+        sum.allocs += cs.allocs;
+        // Whole run, drained frames included
+        const auto stages = cameras_[c].pipeline->stats();
+        if (!stages.empty())
+        {
+            sum.p99 = std::max(sum.p99, stages.back().done.p99);
+            sum.max = std::max(sum.max, stages.back().done.max);
+        }
+    }
+    return sum;
+}
+
+bool SoakMonitor::sustained() const
+{
+    const Summary s = summarize();
+    return s.lost == 0 && s.shed == 0 && (targetFps_ <= 0 || s.fps >= 0.99 * targetFps_);
+}
+
+void SoakMonitor::report(std::ostream &os) const
+{
+    const Summary s = summarize();
+    os << std::fixed << std::setprecision(1) << "Soak: " << s.seconds << " s, " << std::setprecision(2) << s.fps
+       << " fps sustained (slowest interval " << s.minIntervalFps << "), " << s.lost << " lost, " << s.shed
+       << " shed, completion → written p99/max " << s.p99 / 1e6 << "/" << s.max / 1e6 << " ms (worst interval p99 "
+       << s.worstIntervalP99 / 1e6 << "), RSS " << std::setprecision(1) << s.rssStartKiB / 1024.0 << " → "
+       << s.rssEndKiB / 1024.0 << " MiB (max " << s.rssMaxKiB / 1024.0 << "), " << s.allocs
+       << " heap allocs in stages after warm-up: " << (sustained() ? "sustained" : "NOT sustained");
+    if (targetFps_ > 0)
+        os << " at " << std::setprecision(1) << targetFps_ << " fps";
+    os << "\n" << std::defaultfloat;
+}
+
+bool SoakMonitor::writeReport(const std::string &path) const
+{
+    const Summary s = summarize();
+    // Latencies in nanoseconds, like --stats-json
+    std::string out = "{\n";
+    appendf(out, "  \"soak\": {\"duration_s\": %.3f, \"interval_s\": %.3f, \"target_fps\": %.3f, \"config\": %s},\n",
+            durationNs_ / 1e9, intervalNs_ / 1e9, targetFps_, jsonString(config_).c_str());
+    appendf(out, "  \"summary\": {\"seconds\": %.3f, \"fps\": %.3f, \"min_interval_fps\": %.3f, \"lost\": %llu, "
+                 "\"shed\": %llu,\n              \"latency_p99_ns\": %llu, \"latency_max_ns\": %llu, "
+                 "\"worst_interval_p99_ns\": %llu, \"stage_allocs\": %llu,\n              \"rss_start_kib\": %llu, "
+                 "\"rss_max_kib\": %llu, \"rss_end_kib\": %llu, \"sustained\": %s},\n",
+            s.seconds, s.fps, s.minIntervalFps, ull(s.lost), ull(s.shed), ull(s.p99), ull(s.max),
+            ull(s.worstIntervalP99), ull(s.allocs), ull(s.rssStartKiB), ull(s.rssMaxKiB), ull(s.rssEndKiB),
+            sustained() ? "true" : "false");
+
+    // Whole-run histograms per stage
+    out += "  \"cameras\": [\n";
+    for (size_t c = 0; c < cameras_.size(); c++)
+    {
+        const Camera &cam = cameras_[c];
+        out += "    {\"label\": " + jsonString(cam.label) + ", \"stages\": [\n";
+        const auto stages = cam.pipeline->stats();
+        for (size_t i = 0; i < stages.size(); i++)
+        {
+            const auto &st = stages[i];
+            appendf(out, "      {\"name\": %s, \"processed\": %llu, \"failed\": %llu, \"max_depth\": %zu, "
+                         "\"capacity\": %zu, \"allocs\": %llu,\n       \"done_ns\": {\"p50\": %llu, \"p99\": %llu, "
+                         "\"max\": %llu, \"mean\": %.0f}, \"service_ns\": {\"p50\": %llu, \"p99\": %llu, "
+                         "\"max\": %llu, \"mean\": %.0f}}%s\n",
+                    jsonString(st.name).c_str(), ull(st.processed), ull(st.failed), st.maxDepth, st.capacity,
+                    ull(st.allocs), ull(st.done.p50), ull(st.done.p99), ull(st.done.max), st.done.mean,
+                    ull(st.service.p50), ull(st.service.p99), ull(st.service.max), st.service.mean,
+                    i + 1 < stages.size() ? "," : "");
+        }
+        out += c + 1 < cameras_.size() ? "    ]},\n" : "    ]}\n";
+    }
+    out += "  ],\n";
+
+    // The time series: counters cumulative, rates and latencies per interval
+    out += "  \"samples\": [\n";
+    for (size_t i = 0; i < samples_.size(); i++)
+    {
+        const Sample &smp = samples_[i];
+        appendf(out, "    {\"t_s\": %.3f, \"rss_kib\": %llu, \"heap_allocs\": %llu, \"cameras\": [", smp.t,
+                ull(smp.rssKiB), ull(smp.heapAllocs));
+        for (size_t c = 0; c < smp.cameras.size(); c++)
+        {
+            const CameraSample &cs = smp.cameras[c];
+            appendf(out, "%s{\"fps\": %.2f, \"mb_per_s\": %.2f, \"frames\": %llu, \"missing\": %llu, "
+                         "\"dropped\": %llu, \"shed\": %llu, \"allocs\": %llu, \"stages\": {",
+                    c ? ", " : "", cs.fps, cs.mbPerSec, ull(cs.frames), ull(cs.missing), ull(cs.dropped),
+                    ull(cs.shed), ull(cs.allocs));
+            const std::vector<std::string> &names = cameras_[c].stageNames;
+            for (size_t k = 0; k < cs.stages.size() && k < names.size(); k++)
+            {
+                const StageSample &ss = cs.stages[k];
+                appendf(out, "%s%s: {\"p50\": %llu, \"p99\": %llu, \"max\": %llu, \"depth\": %zu}", k ? ", " : "",
+                        jsonString(names[k]).c_str(), ull(ss.p50), ull(ss.p99), ull(ss.max), ss.depth);
+            }
+            out += "}}";
+        }
+        out += i + 1 < samples_.size() ? "]},\n" : "]}\n";
+    }
+    out += "  ]\n}\n";
+    return util::writeFile(path.c_str(), out.data(), out.size());
+}
+
+bool SoakMonitor::compare(const std::string &baselinePath, const Tolerance &tol, std::ostream &os) const
+{
+    std::ifstream f(baselinePath);
+    std::stringstream buf;
+    if (f)
+        buf << f.rdbuf();
+    const std::string doc = buf.str();
+    const size_t at = doc.find("\"summary\":");
+    double fps = 0.0, p99 = 0.0;
+    if (at == std::string::npos || !findNumber(doc, at, "fps", fps) ||
+        !findNumber(doc, at, "latency_p99_ns", p99))
+    {
+        std::cerr << "Can't read a soak summary from baseline " << baselinePath << "\n";
+        return false;
+    }
+
+    const Summary s = summarize();
+    bool ok = true;
+    os << std::fixed << std::setprecision(2) << "Baseline " << baselinePath << ": fps " << fps << " → " << s.fps;
+    if (s.fps < fps * (1.0 - tol.fps))
+    {
+        os << " (REGRESSED, more than " << tol.fps * 100 << "% down)";
+        ok = false;
+    }
+    os << ", p99 " << p99 / 1e6 << " → " << s.p99 / 1e6 << " ms";
+    if (p99 > 0 && double(s.p99) > p99 * (1.0 + tol.p99))
+    {
+        os << " (REGRESSED, more than " << tol.p99 * 100 << "% up)";
+        ok = false;
+    }
+    os << "\n" << std::defaultfloat;
+    return ok;
+}
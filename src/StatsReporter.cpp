@@ -0,0 +1,158 @@
+#include "StatsReporter.hpp"
+#include "IoUtil.hpp"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+namespace
+{
+    uint64_t totalBytes(const std::vector<Pipeline::StageStats> &stages)
+    {
+        uint64_t b = 0;
+        for (const auto &s : stages)
+            b += s.bytes;
+        return b;
+    }
+
+    void appendf(std::string &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    void appendf(std::string &out, const char *fmt, ...)
+    {
+        char buf[512];
+        va_list ap;
+        va_start(ap, fmt);
+        const int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        if (n > 0)
+            out.append(buf, std::min<size_t>(size_t(n), sizeof(buf) - 1));
+    }
+
+    void appendSummary(std::string &out, const char *name, const LatencyHistogram::Summary &s)
+    {
+        appendf(out, "\"%s\": {\"count\": %llu, \"p50\": %llu, \"p99\": %llu, \"max\": %llu, \"mean\": %.0f}",
+                name, static_cast<unsigned long long>(s.count), static_cast<unsigned long long>(s.p50),
+                static_cast<unsigned long long>(s.p99), static_cast<unsigned long long>(s.max), s.mean);
+    }
+
+    // Stage names are ours ("unpack", "write", …) but keep the JSON valid regardless
+    std::string jsonString(const std::string &s)
+    {
+        std::string out = "\"";
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+                out += c;
+        }
+        return out + "\"";
+    }
+} // namespace
+
+StatsReporter::StatsReporter(const Pipeline &pipeline, double intervalSec, const DropDetector *drops)
+    : pipeline_(pipeline), drops_(drops), intervalNs_(static_cast<int64_t>(intervalSec * 1e9))
+{
+}
+
+void StatsReporter::start()
+{
+    startNs_ = lastNs_ = util::monotonicNs();
+    lastSubmitted_ = pipeline_.submitted();
+    lastBytes_ = totalBytes(pipeline_.stats());
+}
+
+int StatsReporter::msUntilTick() const
+{
+    if (intervalNs_ <= 0 || !startNs_)
+        return -1;
+    const int64_t left = lastNs_ + intervalNs_ - util::monotonicNs();
+    return left > 0 ? int((left + 999999) / 1000000) : 0;
+}
+
+void StatsReporter::tick(std::ostream &os)
+{
+    if (intervalNs_ <= 0 || !startNs_)
+        return;
+    const int64_t now = util::monotonicNs();
+    if (now - lastNs_ < intervalNs_)
+        return;
+
+    const auto stages = pipeline_.stats();
+    const uint64_t submitted = pipeline_.submitted();
+    const uint64_t bytes = totalBytes(stages);
+    const double dt = double(now - lastNs_) / 1e9;
+
+    std::string line = label_.empty() ? std::string() : label_ + " ";
+    appendf(line, "[%7.1fs] %6.1f fps  done %llu  dropped %llu |", double(now - startNs_) / 1e9,
+            double(submitted - lastSubmitted_) / dt,
+            static_cast<unsigned long long>(stages.empty() ? 0 : stages.back().processed),
+            static_cast<unsigned long long>(pipeline_.dropped()));
+    if (drops_)
+        appendf(line, " missing %llu  off-interval %llu |", static_cast<unsigned long long>(drops_->dropped()),
+                static_cast<unsigned long long>(drops_->offInterval()));
+    for (const auto &s : stages)
+        appendf(line, " %s %zu/%zu", s.name.c_str(), s.depth, s.capacity);
+    appendf(line, " | %.1f MB/s", double(bytes - lastBytes_) / 1e6 / dt);
+    if (!stages.empty() && stages.back().done.count)
+    {
+        const auto &d = stages.back().done;
+        appendf(line, " | latency p50 %.2f p99 %.2f max %.2f ms", d.p50 / 1e6, d.p99 / 1e6, d.max / 1e6);
+    }
+    os << line << "\n";
+
+    lastNs_ = now;
+    lastSubmitted_ = submitted;
+    lastBytes_ = bytes;
+}
+
+bool StatsReporter::writeJson(const std::string &path) const
+{
+    const auto stages = pipeline_.stats();
+    const uint64_t bytes = totalBytes(stages);
+    const double seconds = startNs_ ? double(util::monotonicNs() - startNs_) / 1e9 : 0.0;
+
+    // Latencies are in nanoseconds throughout
+    std::string out = "{\n";
+    if (!label_.empty())
+        appendf(out, "  \"camera\": %s,\n", jsonString(label_).c_str());
+    appendf(out, "  \"duration_s\": %.3f,\n", seconds);
+    appendf(out, "  \"frames\": {\"submitted\": %llu, \"dropped\": %llu, \"retired\": %llu},\n",
+            static_cast<unsigned long long>(pipeline_.submitted()),
+            static_cast<unsigned long long>(pipeline_.dropped()),
+            static_cast<unsigned long long>(pipeline_.retired()));
+    appendf(out, "  \"fps\": %.3f,\n", seconds > 0 ? double(pipeline_.submitted()) / seconds : 0.0);
+    appendf(out, "  \"bytes_written\": %llu,\n", static_cast<unsigned long long>(bytes));
+    appendf(out, "  \"mb_per_s\": %.3f,\n", seconds > 0 ? double(bytes) / 1e6 / seconds : 0.0);
+    out += "  ";
+    appendSummary(out, "sensor_to_completion_ns", pipeline_.sensorLatency());
+    out += ",\n  ";
+    appendSummary(out, "completion_to_requeue_ns", pipeline_.requeueLatency());
+    out += ",\n";
+    if (drops_)
+    {
+        // What the sensor's sequence numbers and timestamps say about frames we never saw
+        appendf(out, "  \"sensor\": {\"frames\": %llu, \"missing\": %llu, \"gaps\": %llu, \"off_interval\": %llu, "
+                     "\"interval_ns\": %lld,\n    ",
+                static_cast<unsigned long long>(drops_->frames()), static_cast<unsigned long long>(drops_->dropped()),
+                static_cast<unsigned long long>(drops_->gaps()), static_cast<unsigned long long>(drops_->offInterval()),
+                static_cast<long long>(drops_->intervalNs()));
+        appendSummary(out, "jitter_ns", drops_->jitter());
+        out += "},\n";
+    }
+    out += "  \"stages\": [\n";
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        const auto &s = stages[i];
+        out += "    {\"name\": " + jsonString(s.name);
+        appendf(out, ", \"processed\": %llu, \"failed\": %llu, \"max_depth\": %zu, \"capacity\": %zu, "
+                     "\"allocs\": %llu, \"bytes\": %llu,\n     ",
+                static_cast<unsigned long long>(s.processed), static_cast<unsigned long long>(s.failed),
+                s.maxDepth, s.capacity, static_cast<unsigned long long>(s.allocs),
+                static_cast<unsigned long long>(s.bytes));
+        appendSummary(out, "done_ns", s.done);
+        out += ",\n     ";
+        appendSummary(out, "service_ns", s.service);
+        out += i + 1 < stages.size() ? "},\n" : "}\n";
+    }
+    out += "  ]\n}\n";
+    return util::writeFile(path.c_str(), out.data(), out.size());
+}
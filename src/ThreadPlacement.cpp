@@ -0,0 +1,192 @@
+#include "ThreadPlacement.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/mman.h>
+
+namespace
+{
+    struct RoleState
+    {
+        ThreadPlacement::Policy policy;
+        std::map<std::string, unsigned> threads; // name (up to '#') → count
+        bool failed{false};
+    };
+
+    std::mutex g_m;
+    RoleState g_roles[3];
+    bool g_configured = false;
+    long g_lockedKiB = -1;
+
+    const char *roleName(ThreadRole r)
+    {
+        switch (r)
+        {
+        case ThreadRole::Capture:
+            return "capture";
+        case ThreadRole::Worker:
+            return "workers";
+        case ThreadRole::Writer:
+            return "writers";
+        }
+        return "?";
+    }
+
+    std::string cpuListString(const std::vector<int> &cpus)
+    {
+        // Back to ranges: {0, 1, 3} → "0-1,3"
+        std::string s;
+        for (size_t i = 0; i < cpus.size();)
+        {
+            size_t j = i;
+            while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+                j++;
+            if (!s.empty())
+                s += ',';
+            s += std::to_string(cpus[i]);
+            if (j > i)
+                s += '-' + std::to_string(cpus[j]);
+            i = j + 1;
+        }
+        return s;
+    }
+
+    long vmLockedKiB()
+    {
+        std::ifstream f("/proc/self/status");
+        std::string line;
+        while (std::getline(f, line))
+            if (line.compare(0, 6, "VmLck:") == 0)
+                return std::atol(line.c_str() + 6); // "VmLck:	  1234 kB"
+        return -1;
+    }
+} // namespace
+
+void ThreadPlacement::configure(ThreadRole role, const Policy &policy)
+{
+    std::lock_guard<std::mutex> lk(g_m);
+    g_roles[int(role)].policy = policy;
+    if (!policy.cpus.empty() || policy.fifoPriority > 0)
+        g_configured = true;
+}
+
+bool ThreadPlacement::configured()
+{
+    std::lock_guard<std::mutex> lk(g_m);
+    return g_configured;
+}
+
+void ThreadPlacement::enter(ThreadRole role, const std::string &name, bool rename)
+{
+    std::lock_guard<std::mutex> lk(g_m);
+    RoleState &st = g_roles[int(role)];
+    st.threads[name.substr(0, name.find('#'))]++;
+    if (rename)
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str()); // the kernel keeps 15 characters
+    if (!g_configured)
+        return;
+
+    const Policy &p = st.policy;
+    if (!p.cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : p.cpus)
+            CPU_SET(c, &set);
+        const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err && !st.failed)
+        {
+            std::cerr << "Note: can't pin " << roleName(role) << " to CPU " << cpuListString(p.cpus) << ": "
+                      << std::strerror(err) << "\n";
+            st.failed = true;
+        }
+    }
+    if (p.fifoPriority > 0)
+    {
+        sched_param sp{};
+        sp.sched_priority = std::min(p.fifoPriority, sched_get_priority_max(SCHED_FIFO));
+        const int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        if (err && !st.failed)
+        {
+            std::cerr << "Note: can't run " << roleName(role) << " under SCHED_FIFO: " << std::strerror(err)
+                      << " (needs root or CAP_SYS_NICE / an rtprio limit)\n";
+            st.failed = true;
+        }
+    }
+}
+
+bool ThreadPlacement::lockMemory()
+{
+    if (::mlockall(MCL_CURRENT) != 0)
+    {
+        std::cerr << "mlockall failed: " << std::strerror(errno)
+                  << " (raise the memlock limit, e.g. LimitMEMLOCK=infinity, or run as root)\n";
+        return false;
+    }
+    std::lock_guard<std::mutex> lk(g_m);
+    g_lockedKiB = vmLockedKiB();
+    return true;
+}
+
+void ThreadPlacement::report(std::ostream &os)
+{
+    std::lock_guard<std::mutex> lk(g_m);
+    if (!g_configured && g_lockedKiB < 0)
+        return;
+    for (int r = 0; r < 3; r++)
+    {
+        const RoleState &st = g_roles[r];
+        os << "Threads " << roleName(ThreadRole(r)) << ": ";
+        os << (st.policy.cpus.empty() ? "any CPU" : "CPU " + cpuListString(st.policy.cpus));
+        if (st.policy.fifoPriority > 0)
+            os << ", SCHED_FIFO " << st.policy.fifoPriority;
+        if (st.failed)
+            os << " (not fully applied)";
+        if (!st.threads.empty())
+        {
+            os << " ←";
+            for (const auto &t : st.threads)
+                os << " " << t.first << (t.second > 1 ? "×" + std::to_string(t.second) : std::string());
+        }
+        else if (ThreadRole(r) == ThreadRole::Capture)
+            os << " (from the first frame)";
+        os << "\n";
+    }
+    if (g_lockedKiB >= 0)
+        os << "Memory locked: " << (g_lockedKiB >> 10) << " MiB\n";
+}
+
+bool ThreadPlacement::parseCpuList(const std::string &s, std::vector<int> &cpus)
+{
+    cpus.clear();
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        int a = -1, b = -1;
+        char dash = 0;
+        std::istringstream is(item);
+        if (!(is >> a) || a < 0)
+            return false;
+        b = a;
+        if (is >> dash && (dash != '-' || !(is >> b) || b < a))
+            return false;
+        if (!(is >> std::ws).eof())
+            return false;
+        if (b >= CPU_SETSIZE)
+            return false;
+        for (int c = a; c <= b; c++)
+            cpus.push_back(c);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return !cpus.empty();
+}
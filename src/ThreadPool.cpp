@@ -0,0 +1,97 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned threads, void (*init)(unsigned))
+{
+    workers_.reserve(threads);
+    for (unsigned i = 0; i < threads; i++)
+        workers_.emplace_back([this, init, i]
+                              {
+            if (init)
+                init(i);
+            worker(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : workers_)
+        t.join();
+}
+
+bool ThreadPool::drain(Job &job)
+{
+    bool any = false;
+    for (;;)
+    {
+        const size_t i = job.next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= job.n)
+            return any;
+        job.call(job.ctx, i);
+        job.done.fetch_add(1, std::memory_order_acq_rel);
+        any = true;
+    }
+}
+
+void ThreadPool::run(Job &job)
+{
+    if (job.n == 0)
+        return;
+
+    if (!workers_.empty() && job.n > 1)
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            job.link = jobs_;
+            jobs_ = &job;
+        }
+        wake_.notify_all();
+    }
+
+    drain(job);
+
+    std::unique_lock<std::mutex> lk(m_);
+    // Unlink first so no worker picks the job up again, then wait out stragglers
+    for (Job **p = &jobs_; *p; p = &(*p)->link)
+    {
+        if (*p == &job)
+        {
+            *p = job.link;
+            break;
+        }
+    }
+    finished_.wait(lk, [&]
+                   { return job.users == 0 && job.done.load(std::memory_order_acquire) == job.n; });
+}
+
+void ThreadPool::worker()
+{
+    std::unique_lock<std::mutex> lk(m_);
+    for (;;)
+    {
+        // First active job that still has unclaimed items
+        Job *job = jobs_;
+        while (job && job->next.load(std::memory_order_relaxed) >= job->n)
+            job = job->link;
+
+        if (!job)
+        {
+            if (stop_)
+                return;
+            wake_.wait(lk);
+            continue;
+        }
+
+        // `users` keeps the owner from returning (and the job going out of scope)
+        // while we may still touch it.
+        job->users++;
+        lk.unlock();
+        drain(*job);
+        lk.lock();
+        job->users--;
+        finished_.notify_all();
+    }
+}
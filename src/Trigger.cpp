@@ -0,0 +1,168 @@
+#include "Trigger.hpp"
+#include "ThreadPlacement.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#if __has_include(<linux/gpio.h>)
+#include <linux/gpio.h>
+#endif
+
+static_assert(std::atomic<unsigned>::is_always_lock_free, "Trigger::fire() runs in a signal handler");
+
+std::atomic<unsigned> Trigger::pending_{0};
+
+Trigger::Trigger()
+{
+    if (::pipe2(stopPipe_, O_CLOEXEC) != 0)
+        stopPipe_[0] = stopPipe_[1] = -1;
+}
+
+Trigger::~Trigger()
+{
+    if (stopPipe_[1] >= 0)
+    {
+        const char c = 0;
+        (void)!::write(stopPipe_[1], &c, 1);
+    }
+    for (auto &t : threads_)
+        t.join();
+    if (gpioFd_ >= 0)
+        ::close(gpioFd_);
+    for (int fd : stopPipe_)
+        if (fd >= 0)
+            ::close(fd);
+}
+
+bool Trigger::watch(const std::string &spec)
+{
+    if (spec == "signal")
+    {
+        struct sigaction sa{};
+        sa.sa_handler = &Trigger::fire;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        return ::sigaction(SIGUSR1, &sa, nullptr) == 0;
+    }
+    if (spec == "stdin")
+        return watchStdin();
+    if (spec.compare(0, 5, "gpio:") == 0)
+    {
+        // gpio:CHIP:LINE[:EDGE]
+        const size_t a = spec.find(':', 5);
+        if (a == std::string::npos)
+            return false;
+        const size_t b = spec.find(':', a + 1);
+        const std::string chip = spec.substr(5, a - 5);
+        const std::string line = spec.substr(a + 1, b == std::string::npos ? std::string::npos : b - a - 1);
+        const std::string edge = b == std::string::npos ? "rising" : spec.substr(b + 1);
+        char *end = nullptr;
+        const unsigned long n = std::strtoul(line.c_str(), &end, 10);
+        if (chip.empty() || line.empty() || *end)
+            return false;
+        return watchGpio(chip, static_cast<unsigned>(n), edge);
+    }
+    return false;
+}
+
+bool Trigger::waitReadable(int fd) const
+{
+    struct pollfd p[2] = {{fd, POLLIN, 0}, {stopPipe_[0], POLLIN, 0}};
+    for (;;)
+    {
+        const int r = ::poll(p, 2, -1);
+        if (r < 0 && errno == EINTR)
+            continue;
+        return r > 0 && !(p[1].revents & POLLIN) && (p[0].revents & (POLLIN | POLLHUP | POLLERR));
+    }
+}
+
+bool Trigger::watchStdin()
+{
+    if (stopPipe_[0] < 0)
+        return false;
+    threads_.emplace_back([this]
+                          {
+        ThreadPlacement::enter(ThreadRole::Writer, "trigger-stdin");
+        char buf[256];
+        while (waitReadable(STDIN_FILENO))
+        {
+            const ssize_t n = ::read(STDIN_FILENO, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return; // EOF: nothing more will come
+            for (ssize_t i = 0; i < n; i++)
+                if (buf[i] == '\n')
+                    fire();
+        } });
+    return true;
+}
+
+bool Trigger::watchGpio(const std::string &chip, unsigned line, const std::string &edge)
+{
+#if defined(GPIO_V2_GET_LINE_IOCTL)
+    if (stopPipe_[0] < 0 || gpioFd_ >= 0)
+        return false;
+
+    uint64_t flags = GPIO_V2_LINE_FLAG_INPUT;
+    if (edge == "rising")
+        flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    else if (edge == "falling")
+        flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    else if (edge == "both")
+        flags |= GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    else
+        return false;
+
+    const std::string path = chip.find('/') == std::string::npos ? "/dev/" + chip : chip;
+    const int chipFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (chipFd < 0)
+    {
+        std::cerr << "Trigger: can't open " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct gpio_v2_line_request req{};
+    req.offsets[0] = line;
+    req.num_lines = 1;
+    req.config.flags = flags;
+    std::strncpy(req.consumer, "gs_cam trigger", sizeof(req.consumer) - 1);
+    const int r = ::ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+    ::close(chipFd); // the line fd stays valid on its own
+    if (r < 0)
+    {
+        std::cerr << "Trigger: can't request line " << line << " on " << path << ": " << std::strerror(errno)
+                  << "\n";
+        return false;
+    }
+    gpioFd_ = req.fd;
+
+    threads_.emplace_back([this]
+                          {
+        ThreadPlacement::enter(ThreadRole::Writer, "trigger-gpio");
+        struct gpio_v2_line_event ev[16];
+        while (waitReadable(gpioFd_))
+        {
+            const ssize_t n = ::read(gpioFd_, ev, sizeof(ev));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return;
+            for (size_t i = 0; i < size_t(n) / sizeof(ev[0]); i++)
+                fire();
+        } });
+    return true;
+#else
+    (void)chip;
+    (void)line;
+    (void)edge;
+    std::cerr << "Trigger: built without GPIO character device support\n";
+    return false;
+#endif
+}
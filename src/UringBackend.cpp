@@ -0,0 +1,351 @@
+#include "WriteBackend.hpp"
+#include "ThreadPlacement.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // liburing would hide all of this, but it's one more dependency on the Pi for
+    // three syscalls and two ring buffers.
+    int uringSetup(unsigned entries, io_uring_params *p)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+    }
+
+    unsigned roundUpPow2(unsigned v)
+    {
+        unsigned p = 1;
+        while (p < v)
+            p <<= 1;
+        return p;
+    }
+
+    /*
+     * One ring, written by whichever thread calls submit() (serialized by sqM_) and
+     * reaped by a single completion thread. Each write owns a slot for its whole
+     * life: the slot index is the SQE's user_data, and the iovec the kernel reads
+     * lives there too. Short writes are resubmitted for the remainder from the
+     * reaper, so a slot can go round the ring more than once.
+     *
+     * WRITEV rather than WRITE keeps this working back to 5.1.
+     *
+     * Once an SQE's tail is published it can't be taken back, so a slot is in
+     * flight from then on whatever io_uring_enter() says: every enter submits
+     * all pending SQEs, and one a failed enter left behind goes with the next.
+     * A ring that refused a submission takes no new writes (failed_).
+     */
+    class UringBackend : public WriteBackend
+    {
+    public:
+        ~UringBackend() override
+        {
+            if (ringFd_ < 0)
+                return;
+            if (reaper_.joinable())
+            {
+                {
+                    // SQEs a failed enter left behind go now, or their slots never come back
+                    std::lock_guard<std::mutex> lk(sqM_);
+                    if (pending() && !enter())
+                    {
+                        std::cerr << "io_uring: " << pending() << " write(s) stranded in the ring\n";
+                        reaper_.detach(); // still waiting on the ring: leave it mapped
+                        return;
+                    }
+                }
+                {
+                    std::unique_lock<std::mutex> lk(m_);
+                    idle_.wait(lk, [&]
+                               { return free_.size() == slots_.size(); });
+                }
+                // A NOP with user_data 0 tells the reaper to leave
+                std::lock_guard<std::mutex> lk(sqM_);
+                io_uring_sqe *sqe = nextSqe();
+                std::memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = 0;
+                commitSqe();
+                if (!enter())
+                    std::cerr << "io_uring: failed to stop the completion thread\n";
+            }
+            if (reaper_.joinable())
+                reaper_.join();
+            if (sqes_ != MAP_FAILED)
+                ::munmap(sqes_, sqesBytes_);
+            if (cqMap_ != MAP_FAILED && cqMap_ != sqMap_)
+                ::munmap(cqMap_, cqMapBytes_);
+            if (sqMap_ != MAP_FAILED)
+                ::munmap(sqMap_, sqMapBytes_);
+            ::close(ringFd_);
+        }
+
+        bool init(unsigned depth)
+        {
+            // One spare entry for the shutdown NOP
+            io_uring_params p{};
+            const unsigned entries = roundUpPow2(depth + 1);
+            ringFd_ = uringSetup(entries, &p);
+            if (ringFd_ < 0)
+                return false;
+
+            sqMapBytes_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cqMapBytes_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+            if (single)
+                sqMapBytes_ = cqMapBytes_ = std::max(sqMapBytes_, cqMapBytes_);
+
+            sqMap_ = ::mmap(nullptr, sqMapBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_,
+                            IORING_OFF_SQ_RING);
+            if (sqMap_ == MAP_FAILED)
+                return false;
+            cqMap_ = single ? sqMap_
+                            : ::mmap(nullptr, cqMapBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     ringFd_, IORING_OFF_CQ_RING);
+            if (cqMap_ == MAP_FAILED)
+                return false;
+            sqesBytes_ = p.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe *>(::mmap(nullptr, sqesBytes_, PROT_READ | PROT_WRITE,
+                                                       MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+            if (sqes_ == MAP_FAILED)
+                return false;
+
+            auto *sq = static_cast<uint8_t *>(sqMap_);
+            sqHead_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+            sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+            sqMask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+            sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+            auto *cq = static_cast<uint8_t *>(cqMap_);
+            cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+            cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+            cqMask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+            sqTailLocal_ = *sqTail_;
+
+            slots_.resize(depth ? depth : 1);
+            free_.reserve(slots_.size());
+            for (size_t i = slots_.size(); i-- > 0;)
+                free_.push_back(static_cast<unsigned>(i));
+
+            reaper_ = std::thread([this]
+                                  {
+                ThreadPlacement::enter(ThreadRole::Writer, "uring-reap");
+                reap(); });
+            return true;
+        }
+
+        const char *name() const override { return "io_uring"; }
+
+        bool submit(const WriteOp &op) override
+        {
+            if (failed_.load(std::memory_order_acquire))
+                return false;
+            unsigned idx;
+            {
+                std::unique_lock<std::mutex> lk(m_);
+                slotFree_.wait(lk, [&]
+                               { return !free_.empty(); });
+                idx = free_.back();
+                free_.pop_back();
+            }
+            Slot &s = slots_[idx];
+            s.op = op;
+            s.written = 0;
+            queue(idx); // its CQE finishes it, even if this enter failed
+            return true;
+        }
+
+    private:
+        struct Slot
+        {
+            WriteOp op;
+            size_t written{0};
+            struct iovec iov{};
+        };
+
+        io_uring_sqe *nextSqe() { return &sqes_[sqTailLocal_ & sqMask_]; }
+
+        void commitSqe()
+        {
+            sqArray_[sqTailLocal_ & sqMask_] = sqTailLocal_ & sqMask_;
+            sqTailLocal_++;
+            __atomic_store_n(sqTail_, sqTailLocal_, __ATOMIC_RELEASE);
+        }
+
+        // SQEs published but not yet taken by the kernel
+        unsigned pending() const
+        {
+            return __atomic_load_n(sqTail_, __ATOMIC_ACQUIRE) - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        }
+
+        // Submit everything pending; true once the kernel has taken it all (the
+        // reaper may have taken some first). Called with sqM_ held.
+        bool enter()
+        {
+            for (;;)
+            {
+                const int r = uringEnter(ringFd_, pending(), 0, 0);
+                if (r >= 0)
+                    return pending() == 0;
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                    return false;
+            }
+        }
+
+        void fail()
+        {
+            if (!failed_.exchange(true, std::memory_order_acq_rel))
+                std::cerr << "io_uring: the kernel didn't take a submission; queued writes still complete, "
+                             "new ones are refused\n";
+        }
+
+        // (Re)queue whatever is left of slot idx's write. The slot is in flight
+        // from commitSqe() on: never release it here.
+        void queue(unsigned idx)
+        {
+            Slot &s = slots_[idx];
+            s.iov.iov_base = const_cast<uint8_t *>(static_cast<const uint8_t *>(s.op.buf) + s.written);
+            s.iov.iov_len = s.op.len - s.written;
+
+            std::lock_guard<std::mutex> lk(sqM_);
+            io_uring_sqe *sqe = nextSqe();
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = s.op.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(&s.iov);
+            sqe->len = 1;
+            sqe->off = s.op.offset + s.written;
+            sqe->user_data = idx + 1;
+            commitSqe();
+            if (!enter())
+                fail();
+        }
+
+        void release(unsigned idx)
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            free_.push_back(idx);
+            slotFree_.notify_one();
+            if (free_.size() == slots_.size())
+                idle_.notify_all();
+        }
+
+        void finish(unsigned idx, bool ok)
+        {
+            const WriteOp op = slots_[idx].op;
+            release(idx);
+            if (op.done)
+                op.done(op.ctx, ok);
+        }
+
+        void reap()
+        {
+            for (;;)
+            {
+                // Also submits anything a failed enter left in the ring
+                if (uringEnter(ringFd_, pending(), 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                {
+                    std::cerr << "io_uring_enter: " << std::strerror(errno) << "\n";
+                    return;
+                }
+                unsigned head = *cqHead_;
+                const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+                bool stop = false;
+                for (; head != tail; head++)
+                {
+                    const io_uring_cqe cqe = cqes_[head & cqMask_];
+                    if (cqe.user_data == 0)
+                    {
+                        stop = true;
+                        continue;
+                    }
+                    const unsigned idx = static_cast<unsigned>(cqe.user_data - 1);
+                    Slot &s = slots_[idx];
+                    if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN)
+                    {
+                        finish(idx, false);
+                        continue;
+                    }
+                    if (cqe.res == 0 && s.written < s.op.len)
+                    {
+                        finish(idx, false); // no progress: don't spin on it
+                        continue;
+                    }
+                    if (cqe.res > 0)
+                        s.written += static_cast<size_t>(cqe.res);
+                    if (s.written < s.op.len)
+                    {
+                        queue(idx); // in flight again until its next CQE
+                        continue;
+                    }
+                    finish(idx, true);
+                }
+                __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+                if (stop)
+                    return;
+            }
+        }
+
+        int ringFd_{-1};
+        void *sqMap_{MAP_FAILED};
+        void *cqMap_{MAP_FAILED};
+        size_t sqMapBytes_{0};
+        size_t cqMapBytes_{0};
+        io_uring_sqe *sqes_{static_cast<io_uring_sqe *>(MAP_FAILED)};
+        size_t sqesBytes_{0};
+
+        unsigned *sqHead_{nullptr};
+        unsigned *sqTail_{nullptr};
+        unsigned *sqArray_{nullptr};
+        unsigned sqMask_{0};
+        unsigned sqTailLocal_{0}; // guarded by sqM_
+        unsigned *cqHead_{nullptr};
+        unsigned *cqTail_{nullptr};
+        unsigned cqMask_{0};
+        io_uring_cqe *cqes_{nullptr};
+
+        std::atomic<bool> failed_{false};
+        std::mutex sqM_;
+        std::mutex m_; // free_
+        std::condition_variable slotFree_;
+        std::condition_variable idle_;
+        std::vector<Slot> slots_;
+        std::vector<unsigned> free_;
+        std::thread reaper_;
+    };
+} // namespace
+
+std::unique_ptr<WriteBackend> makeUringBackend(unsigned depth)
+{
+    std::unique_ptr<UringBackend> b(new UringBackend);
+    if (!b->init(depth))
+        return nullptr;
+    return b;
+}
+
+#else
+
+std::unique_ptr<WriteBackend> makeUringBackend(unsigned)
+{
+    return nullptr;
+}
+
+#endif
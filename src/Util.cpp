@@ -1,6 +1,8 @@
 #include "Util.hpp"
+#include "Raw10Kernels.hpp"
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <cstdlib>
 #include <cstring>
 #include <stdexcept>
 #include <sstream>
@@ -24,6 +26,48 @@ namespace util
         return false;
     }
 
+    bool parseSize(const std::string &s, uint32_t &width, uint32_t &height)
+    {
+        const size_t x = s.find_first_of("xX");
+        if (x == std::string::npos || x == 0 || x + 1 >= s.size())
+            return false;
+        char *end = nullptr;
+        const unsigned long w = std::strtoul(s.c_str(), &end, 10);
+        if (end != s.c_str() + x)
+            return false;
+        const unsigned long h = std::strtoul(s.c_str() + x + 1, &end, 10);
+        if (*end != '\0' || w == 0 || h == 0 || w > UINT32_MAX || h > UINT32_MAX)
+            return false;
+        width = static_cast<uint32_t>(w);
+        height = static_cast<uint32_t>(h);
+        return true;
+    }
+
+    bool parseRect(const std::string &s, uint32_t &x, uint32_t &y, uint32_t &width, uint32_t &height)
+    {
+        const size_t c1 = s.find(',');
+        const size_t c2 = c1 == std::string::npos ? c1 : s.find(',', c1 + 1);
+        if (c2 == std::string::npos || c1 == 0 || c2 == c1 + 1)
+            return false;
+        char *end = nullptr;
+        const unsigned long px = std::strtoul(s.c_str(), &end, 10);
+        if (end != s.c_str() + c1)
+            return false;
+        const unsigned long py = std::strtoul(s.c_str() + c1 + 1, &end, 10);
+        if (end != s.c_str() + c2 || px > UINT32_MAX || py > UINT32_MAX)
+            return false;
+        // The size part as WxH, or W,H
+        std::string size = s.substr(c2 + 1);
+        const size_t c3 = size.find(',');
+        if (c3 != std::string::npos)
+            size[c3] = 'x';
+        if (!parseSize(size, width, height))
+            return false;
+        x = static_cast<uint32_t>(px);
+        y = static_cast<uint32_t>(py);
+        return true;
+    }
+
     bool ensureDir(const std::string &path)
     {
         struct stat st{};
@@ -55,74 +99,42 @@ namespace util
         return oss.str();
     }
 
+    const uint8_t *mappedPlane(const libcamera::FrameBuffer *fb, size_t &length)
+    {
+        if (!fb || fb->planes().size() != 1)
+            return nullptr;
+
+        // CaptureSession::mapBuffers() maps each plane from the page it starts in
+        // and records where the frame itself begins, so there is no offset left
+        // to add here.
+        const PlaneView *view = reinterpret_cast<const PlaneView *>(fb->cookie());
+        if (!view || !view->data)
+            return nullptr;
+
+        length = view->length;
+        return view->data;
+    }
+
     /*
      * RAW10 CSI-2 packed format: 4 pixels (10 bits each) → 5 bytes.
-     * libcamera buffers may have per-plane strides. We assume single-plane RAW stream.
+     * Lines are `stride` bytes apart (the ISP pads them for alignment); only the
+     * first width*10/8 bytes of each carry pixels. We assume single-plane RAW stream.
      */
     bool unpackRaw10To16(const libcamera::FrameBuffer *fb,
-                         uint32_t width, uint32_t height,
+                         uint32_t width, uint32_t height, size_t stride,
                          std::vector<uint16_t> &dst)
     {
-        if (!fb)
-            return false;
-        if (dst.size() != static_cast<size_t>(width) * height)
-            return false;
-        if (fb->planes().size() != 1)
-            return false;
-
-        const auto &p = fb->planes()[0];
-        const size_t offset = p.offset;
-        const size_t length = p.length;
-
-        // Memory mapping
-        // FrameBuffer::Plane::fd is exported; on RPi this is mmap'able via libcamera::MappedBuffer.
-        // For simplicity here, we assume contiguous span provided by libcamera in Request complete.
-        // In production, use libcamera::MappedBuffer to safely map and unmap.
-        void *base = fb->cookie(); // we’ll stash the mapped pointer in cookie from main.cpp
-        if (!base)
-            return false;
-
-        const uint8_t *src = static_cast<const uint8_t *>(base) + offset;
-
-        const size_t packedStride = (width * 10 + 7) / 8; // bytes per line when packed
-        const size_t expected = packedStride * height;
-        if (length < expected)
-            return false;
-
-        size_t outIdx = 0;
-        for (uint32_t y = 0; y < height; ++y)
-        {
-            const uint8_t *line = src + y * packedStride;
-            uint32_t x = 0;
-            while (x < width)
-            {
-                // Group of 4 pixels → 5 bytes
-                uint8_t b0 = line[0];
-                uint8_t b1 = line[1];
-                uint8_t b2 = line[2];
-                uint8_t b3 = line[3];
-                uint8_t b4 = line[4];
-
-                uint16_t p0 = ((b0) | ((b4 & 0x03) << 8));
-                uint16_t p1 = ((b1) | (((b4 >> 2) & 0x03) << 8));
-                uint16_t p2 = ((b2) | (((b4 >> 4) & 0x03) << 8));
-                uint16_t p3 = ((b3) | (((b4 >> 6) & 0x03) << 8));
-
-                // Store left-aligned in 16-bit (10 LSBs used)
-                if (x < width)
-                    dst[outIdx++] = p0;
-                if (x + 1 < width)
-                    dst[outIdx++] = p1;
-                if (x + 2 < width)
-                    dst[outIdx++] = p2;
-                if (x + 3 < width)
-                    dst[outIdx++] = p3;
+        return unpackRaw10To16(fb, width, height, stride, dst.data(), dst.size());
+    }
 
-                line += 5;
-                x += 4;
-            }
-        }
-        return true;
+    bool unpackRaw10To16(const libcamera::FrameBuffer *fb,
+                         uint32_t width, uint32_t height, size_t stride,
+                         uint16_t *dst, size_t dstSize)
+    {
+        size_t length = 0;
+        const uint8_t *src = mappedPlane(fb, length);
+        // Row kernel (scalar/SSSE3/AVX2/NEON) is chosen once by CPU feature detection
+        return src && raw10::unpack(src, length, stride, width, height, dst, dstSize);
     }
 
 } // namespace util
@@ -0,0 +1,47 @@
+#include "Wakeup.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+Wakeup::Wakeup()
+{
+    fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd_ < 0)
+        std::cerr << "eventfd failed, errno " << errno << "\n";
+}
+
+Wakeup::~Wakeup()
+{
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void Wakeup::notify() const
+{
+    const uint64_t one = 1;
+    // Only fails if the counter would overflow, and then a wakeup is pending anyway
+    const int saved = errno; // we may be inside a signal handler
+    const ssize_t n = write(fd_, &one, sizeof(one));
+    (void)n;
+    errno = saved;
+}
+
+bool Wakeup::wait(int timeoutMs) const
+{
+    // No eventfd: fall back to polling, since nobody could wake us
+    if (fd_ < 0)
+    {
+        poll(nullptr, 0, timeoutMs < 0 || timeoutMs > 10 ? 10 : timeoutMs);
+        return false;
+    }
+    pollfd p{fd_, POLLIN, 0};
+    const int n = poll(&p, 1, timeoutMs);
+    if (n <= 0)
+        return false; // timeout, or EINTR from a signal that rings us right after
+    uint64_t count = 0;
+    return read(fd_, &count, sizeof(count)) == sizeof(count);
+}
@@ -0,0 +1,101 @@
+#include "WriteBackend.hpp"
+#include "BoundedQueue.hpp"
+#include "IoUtil.hpp"
+#include "ThreadPlacement.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Fallback for kernels without io_uring: the same number of writes in
+    // flight, just each one parked in a blocking pwrite() on its own thread.
+    class PwriteBackend : public WriteBackend
+    {
+    public:
+        explicit PwriteBackend(unsigned depth)
+            : depth_(depth ? depth : 1), queue_(depth_)
+        {
+            threads_.reserve(depth_);
+            for (unsigned i = 0; i < depth_; i++)
+                threads_.emplace_back([this, i]
+                                      {
+                    ThreadPlacement::enter(ThreadRole::Writer, "pwrite#" + std::to_string(i));
+                    worker(); });
+        }
+
+        ~PwriteBackend() override
+        {
+            queue_.close(); // workers finish what's queued, then exit
+            for (auto &t : threads_)
+                t.join();
+        }
+
+        const char *name() const override { return "pwrite"; }
+
+        bool submit(const WriteOp &op) override
+        {
+            {
+                std::unique_lock<std::mutex> lk(m_);
+                slot_.wait(lk, [&]
+                           { return inFlight_ < depth_; });
+                inFlight_++;
+            }
+            WriteOp copy = op;
+            if (queue_.push(std::move(copy)))
+                return true;
+            finished();
+            return false;
+        }
+
+    private:
+        void worker()
+        {
+            WriteOp op;
+            while (queue_.pop(op))
+            {
+                const bool ok = util::pwriteAll(op.fd, op.buf, op.len, op.offset);
+                // Free the slot first: done() may well submit the next write
+                finished();
+                if (op.done)
+                    op.done(op.ctx, ok);
+            }
+        }
+
+        void finished()
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            inFlight_--;
+            slot_.notify_one();
+        }
+
+        const unsigned depth_;
+        BoundedQueue<WriteOp> queue_;
+        std::mutex m_;
+        std::condition_variable slot_;
+        unsigned inFlight_{0};
+        std::vector<std::thread> threads_;
+    };
+} // namespace
+
+std::unique_ptr<WriteBackend> makePwriteBackend(unsigned depth)
+{
+    return std::unique_ptr<WriteBackend>(new PwriteBackend(depth));
+}
+
+std::unique_ptr<WriteBackend> WriteBackend::create(WriteBackendKind kind, unsigned depth)
+{
+    switch (kind)
+    {
+    case WriteBackendKind::IoUring:
+        return makeUringBackend(depth);
+    case WriteBackendKind::Pwrite:
+        return makePwriteBackend(depth);
+    case WriteBackendKind::Auto:
+        break;
+    }
+    if (auto b = makeUringBackend(depth))
+        return b;
+    return makePwriteBackend(depth);
+}
@@ -1,46 +1,106 @@
 #include <libcamera/libcamera.h>
 #include <libcamera/formats.h>
-#include <libcamera/framebuffer_allocator.h>
-#include <libcamera/request.h>
 #include <libcamera/stream.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
-#include <cstring>
 #include <csignal>
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <sstream>
 #include <vector>
-#include <chrono>
-#include <filesystem>
+#include <limits>
 
 #include "Imx296Defaults.hpp"
+#include "AsyncWriter.hpp"
+#include "Backpressure.hpp"
+#include "CaptureSession.hpp"
 #include "DngWriter.hpp"
+#include "ExposureSchedule.hpp"
+#include "FrameMatcher.hpp"
+#include "IoUtil.hpp"
+#include "JobServer.hpp"
+#include "PreviewSink.hpp"
+#include "SensorTriggerMode.hpp"
+#include "SoakMonitor.hpp"
+#include "ThreadPlacement.hpp"
+#include "ThreadPool.hpp"
+#include "Trigger.hpp"
 #include "Util.hpp"
+#include "Wakeup.hpp"
 
-using namespace std::chrono_literals;
-
+// What the main thread sleeps on; rung by the pipeline, the camera thread and onSigInt
+static Wakeup g_wakeup;
 static volatile std::sig_atomic_t g_stop = 0;
-static void onSigInt(int) { g_stop = 1; }
+static void onSigInt(int)
+{
+    g_stop = 1;
+    g_wakeup.notify();
+}
 
-// Simple mapped buffer wrapper: in production use libcamera::MappedBuffer
-struct BufferMap
+// --list-modes: every raw format and size the camera offers, with the fastest
+// frame rate each allows. Those limits only exist for a configured camera, so
+// each mode is configured in turn.
+static void printModes(libcamera::Camera *camera, libcamera::CameraConfiguration &config)
 {
-    libcamera::FrameBuffer *fb{nullptr};
-    void *addr{nullptr};
-    size_t len{0};
-};
+    libcamera::StreamConfiguration &cfg = config.at(0);
+    const libcamera::StreamFormats formats = cfg.formats(); // validate() may touch cfg
+    for (const libcamera::PixelFormat &pf : formats.pixelformats())
+    {
+        for (const libcamera::Size &size : formats.sizes(pf))
+        {
+            cfg.pixelFormat = pf;
+            cfg.size = size;
+            std::cout << "  " << pf.toString() << " " << size.toString();
+            if (config.validate() == libcamera::CameraConfiguration::Status::Invalid || camera->configure(&config))
+            {
+                std::cout << "  (can't be configured)\n";
+                continue;
+            }
+            if (cfg.pixelFormat != pf || cfg.size != size)
+                std::cout << " -> " << cfg.pixelFormat.toString() << " " << cfg.size.toString();
+            std::cout << "  stride " << cfg.stride;
+            const auto it = camera->controls().find(&libcamera::controls::FrameDurationLimits);
+            if (it != camera->controls().end() && !it->second.min().isNone())
+            {
+                const int64_t minNs = it->second.min().get<int64_t>();
+                if (minNs > 0)
+                    std::cout << "  up to " << std::fixed << std::setprecision(1) << 1e9 / double(minNs) << " fps";
+            }
+            std::cout << "\n";
+        }
+    }
+}
 
 static std::string usageStr()
 {
     return R"(gs_cam - Raspberry Pi Global Shutter Camera (IMX296) RAW10 capture
 
 Usage:
-  gs_cam [--camera <id|model-substr>] [--frames N]
+  gs_cam [--camera <id|model-substr>]... [--list-modes] [--frames N]
+         [--size WxH] [--roi X,Y,WxH]
          [--exposure-us US] [--gain X.Y] [--fps X.Y]
+         [--exposure-schedule US[:GAIN],...|@FILE [--schedule-lead N]] [--external-trigger]
          [--bayer RGGB|BGGR|GRBG|GBRG]
-         [--outdir DIR] [--outfmt DNG|RAW]
+         [--outdir DIR] [--outfmt DNG|RAW|RAW10P|SEQ|PGM|TIFF]
+         [--bin sum|avg | --channel R|Gr|Gb|B|TL|TR|BL|BR] [--bits 16|8[:SHIFT] | --lut FILE]
+         [--workers N] [--writers N] [--buffers N] [--pool-buffers N]
+         [--dng-strip-rows N | --dng-tile WxH] [--dng-compression none|ljpeg]
+         [--stats-interval SEC] [--stats-json PATH] [--max-drops N]
+         [--degrade drop-oldest|decimate|raw10p|no-compression[:HIGH/LOW[:HIGHMS/LOWMS]]]...
+         [--writer sync|auto|uring|pwrite] [--write-depth N] [--no-direct]
+         [--pretrigger N [--posttrigger M] [--trigger signal|stdin|gpio:CHIP:LINE[:EDGE]]...]
+         [--preview [ADDR:]PORT [--preview-every N]]
+         [--calibration FILE]... [--black-level N|TL,TR,BL,BR] [--defects FILE]
+         [--calibrate-dark N]
+         [--cpu-capture LIST] [--cpu-workers LIST] [--cpu-writers LIST] [--rt-priority N] [--mlock]
+         [--serve SOCKET]
+         [--soak DURATION [--soak-interval SEC] [--soak-report PATH]
+                          [--baseline FILE [--soak-tolerance FPS%/P99%]]]
 
 Defaults:
   frames        : )" +
@@ -57,25 +117,132 @@ Defaults:
            Imx296Defaults::defaultOutDir() + R"(
   outfmt        : )" +
            Imx296Defaults::defaultOutFmt() + R"(
+  exposure-schedule: off (per-frame exposure/gain steps, repeating; each step rides on
+                  the request --schedule-lead frames ahead of its own, and SEQ
+                  records note the step the metadata shows, or that none fits.
+                  @FILE: "US [GAIN]" per line)
+  schedule-lead : )" +
+           std::to_string(Imx296Defaults::defaultScheduleLead()) + R"( (frames from a request to its controls taking effect)
+  external-trigger: off (IMX296 XTR mode: a low pulse on the trigger input starts each
+                  frame and sets its exposure; --fps no longer paces capture. Needs
+                  root for the imx296 trigger_mode parameter, restored at exit)
+  size          : pipeline default (raw stream size; picks the sensor mode, see --list-modes)
+  roi           : whole frame (only this window of each frame is unpacked and written;
+                  X rounded down to a multiple of 4, Y/W/H to even)
+  workers       : )" +
+           std::to_string(Imx296Defaults::defaultWorkerCount()) + R"( (unpack threads)
+  writers       : )" +
+           std::to_string(Imx296Defaults::defaultWriterCount()) + R"( (encode/write threads)
+  buffers       : )" +
+           std::to_string(Imx296Defaults::defaultBufferCount()) + R"( (camera buffers = requests queued to the sensor;
+                  the pipeline may adjust it, the effective count is printed at start)
+  pool-buffers  : auto (working copies behind the camera queue for unpacked/async
+                  frames: enough for every queue slot and worker, plus the write
+                  depth and pre-trigger ring)
+  dng layout    : one strip (--dng-strip-rows / --dng-tile: pieces are unpacked
+                  and written in parallel on the worker threads)
+  dng-compression: none (ljpeg: lossless JPEG tiles, about 256x256 to fit the frame
+                  (208x272 at 1456x1088) unless --dng-tile)
+  bin / channel : off (half-size output straight from the packed rows: each 2x2 quad
+                  summed (12-bit) or averaged, or one CFA position of it; DNG becomes
+                  LinearRaw. PGM/TIFF are grayscale at any size)
+  bits          : 16 (8: the top 8 bits, or value >> SHIFT, saturating; --lut FILE maps
+                  each value through one 0..255 entry per line instead)
+  stats-interval: 1 (seconds between live stats lines; 0 = off)
+  stats-json    : none (write latency histograms and counters there at exit)
+  max-drops     : off (abort the run, exit code 2, once more frames than this are lost)
+  degrade       : off (when the fullest queue reaches HIGH% (75), or writer latency
+                  HIGHMS, shed the oldest queued frame / every other frame, write
+                  DNG/RAW as packed .r10p, or drop lossless JPEG; back to normal
+                  below LOW% (25) and LOWMS. Shed frames don't count for max-drops)
+  writer        : sync (auto/uring/pwrite: queue DNG, RAW and SEQ writes asynchronously,
+                  O_DIRECT from pool buffers; auto = io_uring if available, else pwrite threads)
+  write-depth   : 8 (async writes in flight; with --pretrigger at least N+1, so a flush
+                  never waits)
+  no-direct     : async writes go through the page cache instead of O_DIRECT
+  pretrigger    : off (keep the last N packed frames in RAM and write nothing until a
+                  trigger; then the ring plus the next M frames go to one .gsq burst.
+                  Runs until Ctrl-C; posttrigger defaults to N, trigger to signal = SIGUSR1)
+  preview       : off (serve 2x2-binned 8-bit images over TCP while recording; a slow
+                  viewer only misses images, never frames)
+  preview-every : about 10 previews/s (every Nth frame)
+  calibration   : none (.gscal from --calibrate-dark: dark frame, black levels and hot
+                  pixels, applied as each row is unpacked; one per --camera, in order)
+  black-level   : 0, or the calibration's (one value, or one per 2x2 CFA position)
+  defects       : none (text file, "x y" per line: pixels replaced from their neighbours)
+  calibrate-dark: off (average N frames with the lens covered and write the calibration
+                  to --calibration, or outdir/imx296_dark.gscal; nothing else is saved)
+  cpu-capture   : any (CPUs for libcamera's completion thread, e.g. 3 or 2-3)
+  cpu-workers   : any (CPUs for the stages ahead of the re-queue: unpack, ring, preview)
+  cpu-writers   : any (CPUs for file-writing stages, the DNG encode pool and async writes)
+  rt-priority   : off (SCHED_FIFO: capture thread at N, workers at N-1; writers stay normal)
+  mlock         : off (lock pools and camera buffers in RAM once allocated: no page faults)
+  serve         : off (stay up with the cameras configured and pools allocated, and run
+                  "capture [frames=N] [exposure-us=US] [gain=X] [outdir=DIR]" jobs sent
+                  to this Unix socket; each reply is the run's report, then ok/error)
+  soak          : off (qualify a setup: capture for DURATION (s, or 45m, 1.5h) instead of
+                  --frames, sampling fps, lost frames, per-stage p99, RSS and heap allocs
+                  every soak-interval (10 s) into soak-report (outdir/imx296_soak.json).
+                  Exit code 2 if frames were lost or the rate fell below --fps)
+  baseline      : none (a previous soak report: exit code 3 if sustained fps fell or the
+                  completion → written p99 grew by more than soak-tolerance (2/25 %))
 
 Examples:
   gs_cam --frames 300 --exposure-us 6000 --gain 2.0 --fps 60 --outfmt DNG
+  gs_cam --camera i2c@88000 --camera i2c@80000 --frames 600 --outfmt SEQ
+                  (two cameras, frames paired by sensor timestamp)
+  gs_cam --frames 300 --exposure-schedule 1000,4000,16000 --outfmt SEQ
+                  (exposure brackets of three, frame by frame)
+  gs_cam --frames 3000 --outfmt DNG --degrade raw10p:60/20 --degrade decimate:90/50
+                  (packed frames once the queues are 60% full, half of them past 90%)
+  gs_cam --frames 1000 --bin avg --bits 8 --outfmt PGM
+                  (728x544 8-bit luminance, 1/8 of the bytes)
+  gs_cam --serve /run/gs_cam.sock --outfmt SEQ --writer auto
+                  (then: echo "capture frames=200" | socat - UNIX-CONNECT:/run/gs_cam.sock)
+  gs_cam --soak 1h --fps 60 --outfmt SEQ --writer uring --baseline nvme_soak.json
+                  (an hour at 60 fps, judged against an earlier run on the same setup)
 )";
 }
 
 int main(int argc, char **argv)
 {
+    const int64_t mainNs = util::monotonicNs(); // time to first frame counts from here
     std::signal(SIGINT, onSigInt);
+    std::signal(SIGTERM, onSigInt); // systemd stop: finalize the output like Ctrl-C
 
     // --- CLI parsing (quick and clean) ---
-    std::string camMatch;
-    unsigned frames = Imx296Defaults::defaultFrameCount();
-    int exposureUs = Imx296Defaults::defaultExposureUs();
-    float analogueGain = Imx296Defaults::defaultAnalogueGain();
-    float fps = Imx296Defaults::defaultFps();
-    std::string bayer = Imx296Defaults::defaultBayer();
-    std::string outDir = Imx296Defaults::defaultOutDir();
+    std::vector<std::string> camMatches; // one per --camera; none: the first camera
+    bool listModes = false;
+    CaptureOptions opt;
+    opt.frames = Imx296Defaults::defaultFrameCount();
+    opt.exposureUs = Imx296Defaults::defaultExposureUs();
+    opt.analogueGain = Imx296Defaults::defaultAnalogueGain();
+    opt.fps = Imx296Defaults::defaultFps();
+    opt.bayer = Imx296Defaults::defaultBayer();
+    opt.outDir = Imx296Defaults::defaultOutDir();
     std::string outFmt = Imx296Defaults::defaultOutFmt();
+    opt.workers = Imx296Defaults::defaultWorkerCount();
+    opt.writers = Imx296Defaults::defaultWriterCount();
+    opt.bufferCount = Imx296Defaults::defaultBufferCount();
+    opt.scheduleLead = Imx296Defaults::defaultScheduleLead();
+    opt.statsInterval = 1.0;
+    std::string statsJson;
+    WriteBackendKind writerKind = WriteBackendKind::Auto;
+    opt.writeDepth = 8;
+    long long preTriggerFrames = -1; // < 0: normal capture
+    long long postTriggerFrames = -1; // < 0: same as pre
+    std::vector<std::string> triggerSpecs;
+    std::string previewSpec;
+    std::vector<std::string> calibrationPaths; // one per --camera, or none
+    std::string scheduleSpec;
+    ThreadPlacement::Policy capturePolicy, workerPolicy, writerPolicy;
+    int rtPriority = 0;
+    bool lockMemory = false;
+    std::string servePath;
+    std::string binSpec, channelSpec; // applied once --bayer is known
+    double soakSeconds = 0.0, soakInterval = 10.0;
+    std::string soakReport, baselinePath;
+    SoakMonitor::Tolerance soakTolerance;
 
     for (int i = 1; i < argc; i++)
     {
@@ -91,38 +258,81 @@ int main(int argc, char **argv)
         {
             if (!need("--camera"))
                 return 1;
-            camMatch = argv[++i];
+            camMatches.push_back(argv[++i]);
+        }
+        else if (a == "--list-modes")
+        {
+            listModes = true;
+        }
+        else if (a == "--size")
+        {
+            if (!need("--size"))
+                return 1;
+            std::string in = argv[++i];
+            if (!util::parseSize(in, opt.sizeW, opt.sizeH))
+            {
+                std::cerr << "Invalid size: " << in << " (use WxH, e.g. 1456x544)\n";
+                return 1;
+            }
+        }
+        else if (a == "--roi")
+        {
+            if (!need("--roi"))
+                return 1;
+            std::string in = argv[++i];
+            if (!util::parseRect(in, opt.roiX, opt.roiY, opt.roiW, opt.roiH))
+            {
+                std::cerr << "Invalid ROI: " << in << " (use X,Y,WxH, e.g. 0,272,1456x544)\n";
+                return 1;
+            }
+            opt.haveRoi = true;
         }
         else if (a == "--frames")
         {
             if (!need("--frames"))
                 return 1;
-            frames = std::stoul(argv[++i]);
+            opt.frames = std::stoul(argv[++i]);
         }
         else if (a == "--exposure-us")
         {
             if (!need("--exposure-us"))
                 return 1;
-            exposureUs = std::stoi(argv[++i]);
+            opt.exposureUs = std::stoi(argv[++i]);
         }
         else if (a == "--gain")
         {
             if (!need("--gain"))
                 return 1;
-            analogueGain = std::stof(argv[++i]);
+            opt.analogueGain = std::stof(argv[++i]);
+        }
+        else if (a == "--exposure-schedule")
+        {
+            if (!need("--exposure-schedule"))
+                return 1;
+            scheduleSpec = argv[++i];
+        }
+        else if (a == "--schedule-lead")
+        {
+            if (!need("--schedule-lead"))
+                return 1;
+            opt.scheduleLead = std::stoul(argv[++i]);
+        }
+        else if (a == "--external-trigger")
+        {
+            opt.externalTrigger = true;
         }
         else if (a == "--fps")
         {
             if (!need("--fps"))
                 return 1;
-            fps = std::stof(argv[++i]);
+            opt.fps = std::stof(argv[++i]);
         }
         else if (a == "--bayer")
         {
             if (!need("--bayer"))
                 return 1;
             std::string in = argv[++i];
-            if (!util::parseBayer(in, bayer))
+            if (!util::parseBayer(in, opt.bayer))
             {
                 std::cerr << "Invalid bayer pattern: " << in << "\n";
                 return 1;
@@ -132,7 +342,7 @@ int main(int argc, char **argv)
         {
             if (!need("--outdir"))
                 return 1;
-            outDir = argv[++i];
+            opt.outDir = argv[++i];
         }
         else if (a == "--outfmt")
         {
@@ -140,6 +350,273 @@ int main(int argc, char **argv)
                 return 1;
             outFmt = argv[++i];
         }
+        else if (a == "--workers")
+        {
+            if (!need("--workers"))
+                return 1;
+            opt.workers = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (a == "--writers")
+        {
+            if (!need("--writers"))
+                return 1;
+            opt.writers = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (a == "--buffers")
+        {
+            if (!need("--buffers"))
+                return 1;
+            opt.bufferCount = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (a == "--pool-buffers")
+        {
+            if (!need("--pool-buffers"))
+                return 1;
+            opt.poolBuffers = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (a == "--dng-strip-rows")
+        {
+            if (!need("--dng-strip-rows"))
+                return 1;
+            opt.dngStripRows = std::stoul(argv[++i]);
+        }
+        else if (a == "--dng-tile")
+        {
+            if (!need("--dng-tile"))
+                return 1;
+            std::string in = argv[++i];
+            if (!util::parseSize(in, opt.dngTileW, opt.dngTileH))
+            {
+                std::cerr << "Invalid tile size: " << in << " (use WxH, e.g. 256x256)\n";
+                return 1;
+            }
+        }
+        else if (a == "--stats-interval")
+        {
+            if (!need("--stats-interval"))
+                return 1;
+            opt.statsInterval = std::max(0.0, std::stod(argv[++i]));
+        }
+        else if (a == "--stats-json")
+        {
+            if (!need("--stats-json"))
+                return 1;
+            statsJson = argv[++i];
+        }
+        else if (a == "--max-drops")
+        {
+            if (!need("--max-drops"))
+                return 1;
+            opt.maxDrops = std::stoll(argv[++i]);
+        }
+        else if (a == "--degrade")
+        {
+            if (!need("--degrade"))
+                return 1;
+            DegradeRule rule;
+            if (!Backpressure::parse(argv[++i], rule))
+            {
+                std::cerr << "Bad --degrade: " << argv[i]
+                          << " (use drop-oldest|decimate|raw10p|no-compression[:HIGH/LOW[:HIGHMS/LOWMS]])\n";
+                return 1;
+            }
+            for (const DegradeRule &r : opt.degrade)
+                if (r.action == rule.action)
+                {
+                    std::cerr << "--degrade " << Backpressure::name(rule.action) << " given twice\n";
+                    return 1;
+                }
+            opt.degrade.push_back(rule);
+        }
+        else if (a == "--preview")
+        {
+            if (!need("--preview"))
+                return 1;
+            previewSpec = argv[++i];
+        }
+        else if (a == "--preview-every")
+        {
+            if (!need("--preview-every"))
+                return 1;
+            opt.previewEvery = unsigned(std::max(1, std::stoi(argv[++i])));
+        }
+        else if (a == "--calibration")
+        {
+            if (!need("--calibration"))
+                return 1;
+            calibrationPaths.push_back(argv[++i]);
+        }
+        else if (a == "--defects")
+        {
+            if (!need("--defects"))
+                return 1;
+            opt.defectsPath = argv[++i];
+        }
+        else if (a == "--black-level")
+        {
+            if (!need("--black-level"))
+                return 1;
+            unsigned b[4];
+            const int n = std::sscanf(argv[++i], "%u,%u,%u,%u", &b[0], &b[1], &b[2], &b[3]);
+            if ((n != 1 && n != 4) || *std::max_element(b, b + n) > 1023)
+            {
+                std::cerr << "--black-level takes N or TL,TR,BL,BR (0..1023)\n";
+                return 1;
+            }
+            for (int k = 0; k < 4; k++)
+                opt.black[k] = static_cast<uint16_t>(b[n == 1 ? 0 : k]);
+            opt.haveBlack = true;
+        }
+        else if (a == "--calibrate-dark")
+        {
+            if (!need("--calibrate-dark"))
+                return 1;
+            opt.calibrateDarkFrames = unsigned(std::max(1, std::stoi(argv[++i])));
+        }
+        else if (a == "--cpu-capture" || a == "--cpu-workers" || a == "--cpu-writers")
+        {
+            if (!need(a.c_str()))
+                return 1;
+            ThreadPlacement::Policy &p =
+                a == "--cpu-capture" ? capturePolicy : a == "--cpu-workers" ? workerPolicy : writerPolicy;
+            if (!ThreadPlacement::parseCpuList(argv[++i], p.cpus))
+            {
+                std::cerr << a << " takes CPU numbers and ranges, e.g. 3 or 0-1,3\n";
+                return 1;
+            }
+        }
+        else if (a == "--rt-priority")
+        {
+            if (!need("--rt-priority"))
+                return 1;
+            rtPriority = std::stoi(argv[++i]);
+            if (rtPriority < 1 || rtPriority > 99)
+            {
+                std::cerr << "--rt-priority takes 1..99\n";
+                return 1;
+            }
+        }
+        else if (a == "--mlock")
+        {
+            lockMemory = true;
+        }
+        else if (a == "--writer")
+        {
+            if (!need("--writer"))
+                return 1;
+            std::string in = argv[++i];
+            opt.asyncWrites = in != "sync";
+            if (in == "auto")
+                writerKind = WriteBackendKind::Auto;
+            else if (in == "uring")
+                writerKind = WriteBackendKind::IoUring;
+            else if (in == "pwrite")
+                writerKind = WriteBackendKind::Pwrite;
+            else if (in != "sync")
+            {
+                std::cerr << "Unknown writer: " << in << " (use sync, auto, uring or pwrite)\n";
+                return 1;
+            }
+        }
+        else if (a == "--write-depth")
+        {
+            if (!need("--write-depth"))
+                return 1;
+            opt.writeDepth = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (a == "--no-direct")
+        {
+            opt.directIo = false;
+        }
+        else if (a == "--pretrigger")
+        {
+            if (!need("--pretrigger"))
+                return 1;
+            preTriggerFrames = std::max(0ll, std::stoll(argv[++i]));
+        }
+        else if (a == "--posttrigger")
+        {
+            if (!need("--posttrigger"))
+                return 1;
+            postTriggerFrames = std::max(0ll, std::stoll(argv[++i]));
+        }
+        else if (a == "--trigger")
+        {
+            if (!need("--trigger"))
+                return 1;
+            triggerSpecs.push_back(argv[++i]);
+        }
+        else if (a == "--serve")
+        {
+            if (!need("--serve"))
+                return 1;
+            servePath = argv[++i];
+        }
+        else if (a == "--soak")
+        {
+            if (!need("--soak") || !SoakMonitor::parseDuration(argv[++i], soakSeconds))
+                return 1;
+        }
+        else if (a == "--soak-interval")
+        {
+            if (!need("--soak-interval"))
+                return 1;
+            soakInterval = std::stod(argv[++i]);
+        }
+        else if (a == "--soak-report")
+        {
+            if (!need("--soak-report"))
+                return 1;
+            soakReport = argv[++i];
+        }
+        else if (a == "--baseline")
+        {
+            if (!need("--baseline"))
+                return 1;
+            baselinePath = argv[++i];
+        }
+        else if (a == "--soak-tolerance")
+        {
+            if (!need("--soak-tolerance") || !SoakMonitor::parseTolerance(argv[++i], soakTolerance))
+                return 1;
+        }
+        else if (a == "--bin")
+        {
+            if (!need("--bin"))
+                return 1;
+            binSpec = argv[++i];
+        }
+        else if (a == "--channel")
+        {
+            if (!need("--channel"))
+                return 1;
+            channelSpec = argv[++i];
+        }
+        else if (a == "--bits")
+        {
+            if (!need("--bits") || !opt.output.setBits(argv[++i]))
+                return 1;
+        }
+        else if (a == "--lut")
+        {
+            if (!need("--lut") || !opt.output.loadLut(argv[++i]))
+                return 1;
+        }
+        else if (a == "--dng-compression")
+        {
+            if (!need("--dng-compression"))
+                return 1;
+            std::string in = argv[++i];
+            if (in == "none")
+                opt.dngCompression = DngCompression::None;
+            else if (in == "ljpeg")
+                opt.dngCompression = DngCompression::LosslessJpeg;
+            else
+            {
+                std::cerr << "Unknown DNG compression: " << in << " (use none or ljpeg)\n";
+                return 1;
+            }
+        }
         else
         {
             std::cerr << "Unknown arg: " << a << "\n"
@@ -148,301 +625,563 @@ int main(int argc, char **argv)
         }
     }
 
-    if (!util::ensureDir(outDir))
+    opt.writeDng = (outFmt == "DNG" || outFmt == "dng");
+    opt.writeRaw = (outFmt == "RAW" || outFmt == "raw");
+    opt.writeRaw10p = (outFmt == "RAW10P" || outFmt == "raw10p");
+    opt.writeSeq = (outFmt == "SEQ" || outFmt == "seq");
+    opt.writePgm = (outFmt == "PGM" || outFmt == "pgm");
+    opt.writeTiff = (outFmt == "TIFF" || outFmt == "tiff");
+    if (!opt.writeDng && !opt.writeRaw && !opt.writeRaw10p && !opt.writeSeq && !opt.writePgm && !opt.writeTiff)
     {
-        std::cerr << "Failed to create/access outdir: " << outDir << "\n";
+        std::cerr << "Unknown outfmt: " << outFmt << " (use DNG, RAW, RAW10P, SEQ, PGM or TIFF)\n";
         return 1;
     }
-
-    // --- libcamera setup ---
-    libcamera::CameraManager cm;
-    if (cm.start())
+    if (!binSpec.empty() && !channelSpec.empty())
     {
-        std::cerr << "CameraManager start failed.\n";
+        std::cerr << "--bin and --channel both halve the frame; pick one.\n";
         return 1;
     }
+    if ((!binSpec.empty() && !opt.output.setBin(binSpec)) ||
+        (!channelSpec.empty() && !opt.output.setChannel(channelSpec, opt.bayer)))
+        return 1;
+
+    // Strips/tiles (and compressed tiles): encoded straight from the packed
+    // plane, no unpack stage
+    opt.dngPieces = opt.writeDng && (opt.dngStripRows > 0 || opt.dngTileW > 0 ||
+                                     opt.dngCompression != DngCompression::None);
 
-    // Choose camera
-    libcamera::Camera *camera = nullptr;
-    for (auto &c : cm.cameras())
+    // Pre-trigger bursts are .gsq containers written in the background, whatever
+    // the outfmt; capture runs until Ctrl-C.
+    opt.preTrigger = preTriggerFrames >= 0;
+    if (opt.preTrigger)
     {
-        const auto id = c->id();
-        const auto props = c->properties();
-        std::string model = props.get(libcamera::properties::Model) ? *props.get(libcamera::properties::Model) : "";
-        if (camMatch.empty() || id.find(camMatch) != std::string::npos || model.find(camMatch) != std::string::npos)
+        if (postTriggerFrames < 0)
+            postTriggerFrames = preTriggerFrames;
+        if (preTriggerFrames + postTriggerFrames == 0)
+        {
+            std::cerr << "--pretrigger 0 needs --posttrigger M > 0\n";
+            return 1;
+        }
+        if (camMatches.size() > 1)
         {
-            camera = c.get();
-            break;
+            std::cerr << "--pretrigger works with one camera.\n";
+            return 1;
         }
+        if (triggerSpecs.empty())
+            triggerSpecs.push_back("signal");
+        opt.preTriggerFrames = size_t(preTriggerFrames);
+        opt.postTriggerFrames = size_t(postTriggerFrames);
+        opt.frames = std::numeric_limits<unsigned>::max();
+        opt.asyncWrites = true;
+        // A trigger hands the whole ring (and the frame that fired it) to the
+        // writer at once; with fewer slots the ring stage would sit there while
+        // the post-trigger frames pile up behind it
+        opt.writeDepth = std::max(opt.writeDepth, unsigned(preTriggerFrames) + 1);
     }
-    if (!camera)
+    // A calibration file describes one sensor
+    const size_t cameraCount = std::max<size_t>(1, camMatches.size());
+    if (!calibrationPaths.empty() && calibrationPaths.size() != cameraCount)
     {
-        std::cerr << "No camera found (tip: try --camera imx296).\n";
-        cm.stop();
+        std::cerr << "Give one --calibration per --camera (" << cameraCount << ").\n";
         return 1;
     }
-
-    if (camera->acquire())
+    // Dark calibration: N frames of the whole mode into the accumulator, no other output
+    if (opt.calibrateDarkFrames)
     {
-        std::cerr << "Failed to acquire camera.\n";
-        cm.stop();
-        return 1;
+        if (opt.preTrigger || opt.haveRoi)
+        {
+            std::cerr << "--calibrate-dark takes whole frames; drop --pretrigger and --roi.\n";
+            return 1;
+        }
+        opt.frames = opt.calibrateDarkFrames;
+        opt.writeDng = opt.writeRaw = opt.writeRaw10p = opt.writeSeq = opt.dngPieces = false;
+        opt.asyncWrites = false;
     }
-
-    std::unique_ptr<libcamera::CameraConfiguration> config = camera->generateConfiguration({libcamera::StreamRole::Raw});
-    if (!config || config->size() != 1)
+    // Each degradation has to mean something for this output
+    for (const DegradeRule &r : opt.degrade)
     {
-        std::cerr << "Failed to generate RAW config.\n";
-        camera->release();
-        cm.stop();
-        return 1;
+        const char *why = nullptr;
+        if (opt.calibrateDarkFrames)
+            why = "--calibrate-dark needs every frame";
+        else if (r.action == DegradeAction::PackedRaw10 && (!(opt.writeDng || opt.writeRaw) || opt.preTrigger))
+            why = "only DNG and RAW output can fall back to packed frames";
+        else if (r.action == DegradeAction::NoCompression &&
+                 (!opt.writeDng || opt.dngCompression == DngCompression::None))
+            why = "needs DNG output with --dng-compression ljpeg";
+        if (why)
+        {
+            std::cerr << "--degrade " << Backpressure::name(r.action) << ": " << why << "\n";
+            return 1;
+        }
     }
-
-    libcamera::StreamConfiguration &streamCfg = config->at(0);
-
-    // Request RAW10 packed format (CSI-2). If not supported, libcamera will pick nearest.
-    streamCfg.pixelFormat = libcamera::formats::SBGGR10_CSI2P; // mosaic overridden later by DNG tag; buffer layout is the same
-    // Let pipeline pick a good resolution; but if you want, set explicit sensor native (IMX296 ~ 1440x1080ish depending mode).
-    // streamCfg.size = {1440, 1080};
-
-    if (config->validate() == libcamera::CameraConfiguration::Status::Invalid)
+    // Reduced samples are made in the unpack stage and written whole
+    if (opt.output.reduces() &&
+        (opt.writeRaw10p || opt.writeSeq || opt.dngPieces || opt.preTrigger || opt.calibrateDarkFrames))
     {
-        std::cerr << "Camera configuration invalid.\n";
-        camera->release();
-        cm.stop();
+        std::cerr << "--bin/--channel/--bits/--lut need DNG (one strip, uncompressed), RAW, PGM or TIFF output.\n";
         return 1;
     }
-    if (camera->configure(config.get()))
+    // Jobs are bounded runs of the normal capture path
+    if (!servePath.empty() && (opt.preTrigger || opt.calibrateDarkFrames))
     {
-        std::cerr << "Camera configure failed.\n";
-        camera->release();
-        cm.stop();
+        std::cerr << "--serve runs capture jobs; drop --pretrigger and --calibrate-dark.\n";
         return 1;
     }
-
-    libcamera::FrameBufferAllocator allocator(camera);
-    if (allocator.allocate(streamCfg.stream()))
+    // A soak is one normal capture that ends on the clock instead of a frame count
+    if (soakSeconds > 0)
     {
-        std::cerr << "Buffer allocation failed.\n";
-        camera->release();
-        cm.stop();
-        return 1;
+        if (!servePath.empty() || opt.preTrigger || opt.calibrateDarkFrames)
+        {
+            std::cerr << "--soak is one timed capture; drop --serve, --pretrigger and --calibrate-dark.\n";
+            return 1;
+        }
+        opt.frames = std::numeric_limits<unsigned>::max();
+        if (soakReport.empty())
+            soakReport = opt.outDir + "/imx296_soak.json";
     }
-    auto buffers = allocator.buffers(streamCfg.stream());
-    if (buffers.empty())
+    else if (!baselinePath.empty())
     {
-        std::cerr << "No buffers allocated.\n";
-        camera->release();
-        cm.stop();
+        std::cerr << "--baseline compares a --soak run.\n";
         return 1;
     }
-
-    // Queue all buffers
-    std::vector<std::unique_ptr<libcamera::Request>> requests;
-    requests.reserve(buffers.size());
-    for (auto &buf : buffers)
+    // Steps without a gain take --gain, wherever it was on the command line
+    if (!scheduleSpec.empty())
     {
-        auto req = camera->createRequest();
-        if (!req)
-        {
-            std::cerr << "Failed to create request.\n";
-            camera->release();
-            cm.stop();
+        ExposureSchedule schedule;
+        if (!schedule.parse(scheduleSpec, opt.analogueGain))
             return 1;
-        }
-        if (req->addBuffer(streamCfg.stream(), buf.get()))
+        if (opt.calibrateDarkFrames)
         {
-            std::cerr << "Failed to add buffer to request.\n";
-            camera->release();
-            cm.stop();
+            std::cerr << "--calibrate-dark averages frames of one exposure; drop --exposure-schedule.\n";
             return 1;
         }
-        // We'll store the mmap address in fb->cookie for easy access in Util::unpackRaw10To16
-        // In production, use MappedBuffer RAII per frame.
-        // Map whole plane (single plane expected)
-        libcamera::FrameBuffer *fb = buf.get();
-        if (fb->planes().size() != 1)
+        opt.exposureSchedule = schedule.steps();
+    }
+    // RAW10P streams straight out of the camera buffer and the strip/tile DNG
+    // path writes its own pieces; both stay synchronous.
+    if (opt.asyncWrites && !opt.preTrigger && (opt.writeRaw10p || opt.dngPieces))
+    {
+        std::cerr << "Note: --writer only applies to single-strip DNG/TIFF, RAW, PGM and SEQ; writing synchronously.\n";
+        opt.asyncWrites = false;
+    }
+    // Thread placement before any of our threads exist; the capture thread sits
+    // just above the workers, so a completion is never stuck behind an unpack
+    capturePolicy.fifoPriority = rtPriority;
+    workerPolicy.fifoPriority = rtPriority > 1 ? rtPriority - 1 : rtPriority;
+    ThreadPlacement::configure(ThreadRole::Capture, capturePolicy);
+    ThreadPlacement::configure(ThreadRole::Worker, workerPolicy);
+    ThreadPlacement::configure(ThreadRole::Writer, writerPolicy);
+
+    // The stdin/gpio watchers are threads too, so they start after that
+    Trigger trigger;
+    for (const auto &spec : triggerSpecs)
+    {
+        if (!trigger.watch(spec))
         {
-            std::cerr << "Unexpected plane count.\n";
-            camera->release();
-            cm.stop();
+            std::cerr << "Bad or unavailable trigger: " << spec
+                      << " (use signal, stdin or gpio:CHIP:LINE[:rising|falling|both])\n";
             return 1;
         }
-        int fd = fb->planes()[0].fd.get();
-        size_t len = fb->planes()[0].length;
-        void *addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-        if (addr == MAP_FAILED)
+    }
+
+    std::unique_ptr<WriteBackend> writeBackend;
+    if (opt.asyncWrites)
+    {
+        writeBackend = WriteBackend::create(writerKind, opt.writeDepth);
+        if (!writeBackend)
         {
-            std::perror("mmap");
-            camera->release();
-            cm.stop();
+            std::cerr << "io_uring is not available here (try --writer pwrite).\n";
             return 1;
         }
-        fb->setCookie(addr); // stash pointer
-        requests.push_back(std::move(req));
     }
 
-    // Controls: exposure, gain, frame duration (fps)
-    libcamera::ControlList controls = camera->properties(); // not used; need Request controls
-    // We'll set per-request controls before first start.
+    if (!listModes && !util::ensureDir(opt.outDir))
+    {
+        std::cerr << "Failed to create/access outdir: " << opt.outDir << "\n";
+        return 1;
+    }
 
-    // Calculate frame duration from FPS
-    int64_t frameDurationNs = static_cast<int64_t>(1e9 / std::max(1.0f, fps));
-    // Minimal sanity
-    if (frameDurationNs < 1'000'000)
-        frameDurationNs = 1'000'000;
+    // Set before any camera streams (the driver reads it at stream on), put
+    // back after the last one stopped
+    SensorTriggerMode triggerMode;
+    if (opt.externalTrigger && !listModes && !triggerMode.enable())
+        return 1;
 
-    // Build control list we’ll apply to the first N requests (libcamera lets controls per request)
-    auto applyControls = [&](libcamera::Request *req)
+    // --- libcamera setup ---
+    libcamera::CameraManager cm;
+    if (cm.start())
     {
-        libcamera::ControlList cl(camera->controls());
-        if (camera->controls().contains(libcamera::controls::ExposureTime))
+        std::cerr << "CameraManager start failed.\n";
+        return 1;
+    }
+    const int64_t managerNs = util::monotonicNs();
+
+    // Choose cameras: each --camera takes the first unclaimed one it matches
+    std::vector<std::shared_ptr<libcamera::Camera>> cameras;
+    if (camMatches.empty())
+        camMatches.push_back(std::string());
+    const auto all = cm.cameras();
+    for (const auto &match : camMatches)
+    {
+        std::shared_ptr<libcamera::Camera> pick;
+        for (const auto &c : all)
         {
-            cl.set(libcamera::controls::ExposureTime, exposureUs); // microseconds
+            if (std::find(cameras.begin(), cameras.end(), c) != cameras.end())
+                continue;
+            const auto id = c->id();
+            const auto props = c->properties();
+            std::string model = props.get(libcamera::properties::Model) ? *props.get(libcamera::properties::Model) : "";
+            if (match.empty() || id.find(match) != std::string::npos || model.find(match) != std::string::npos)
+            {
+                pick = c;
+                break;
+            }
         }
-        if (camera->controls().contains(libcamera::controls::AnalogueGain))
+        if (!pick)
         {
-            // AnalogueGain is commonly an integer in 1/256ths; on RPi it may accept float-ish. We try int*256 if needed.
-            // Attempt float first; libcamera will coerce as needed.
-            cl.set(libcamera::controls::AnalogueGain, analogueGain);
+            std::cerr << "No camera found" << (match.empty() ? "" : " for " + match)
+                      << " (tip: try --camera imx296).\n";
+            cm.stop();
+            return 1;
         }
-        if (camera->controls().contains(libcamera::controls::FrameDurationLimits))
+        cameras.push_back(pick);
+    }
+
+    if (listModes)
+    {
+        for (const auto &camera : cameras)
         {
-            cl.set(libcamera::controls::FrameDurationLimits, libcamera::Span<const int64_t>({frameDurationNs, frameDurationNs}));
+            std::unique_ptr<libcamera::CameraConfiguration> config;
+            if (camera->acquire() ||
+                !(config = camera->generateConfiguration({libcamera::StreamRole::Raw})) || config->size() != 1)
+            {
+                std::cerr << "Can't configure " << camera->id() << "\n";
+                camera->release();
+                continue;
+            }
+            std::cout << "Raw modes of " << camera->id() << ":\n";
+            printModes(camera.get(), *config);
+            camera->release();
         }
-        // Disable AE/AGC if exposed
-        if (camera->controls().contains(libcamera::controls::AeEnable))
+        cm.stop();
+        return 0;
+    }
+
+    // Frames count as saved once their write completes, on a backend thread
+    std::atomic<unsigned> saved{0};
+    std::unique_ptr<AsyncWriter> asyncWriter;
+    if (opt.asyncWrites)
+        asyncWriter.reset(new AsyncWriter(std::move(writeBackend), opt.writeDepth, opt.directIo, [&](bool ok)
+                                          {
+            if (ok)
+                saved++;
+            else
+                std::cerr << "Async write failed.\n"; }));
+    // Shared by all writer threads (of every camera); each frame's pieces are spread over it
+    // (and by a dark calibration's row bands)
+    ThreadPool encodePool(opt.dngPieces || opt.calibrateDarkFrames ? opt.workers : 0, [](unsigned i)
+                          { ThreadPlacement::enter(ThreadRole::Writer, "encode#" + std::to_string(i)); });
+    // Several cameras: frames that started within half a frame of each other are one set
+    std::unique_ptr<FrameMatcher> matcher;
+    if (cameras.size() > 1)
+        matcher.reset(new FrameMatcher(unsigned(cameras.size()), CaptureSession::frameDurationNs(opt.fps) / 2));
+
+    // Live preview: one listening socket for every camera
+    std::unique_ptr<PreviewSink> preview;
+    if (!previewSpec.empty())
+    {
+        preview.reset(new PreviewSink(unsigned(cameras.size())));
+        if (!preview->listen(previewSpec))
         {
-            cl.set(libcamera::controls::AeEnable, false);
+            cm.stop();
+            return 1;
         }
-        // Global shutter is sensor-defined for IMX296; no rolling->global switch control needed.
-        if (req->controls().merge(cl))
-            std::cerr << "Warning: failed to merge controls into request.\n";
-    };
+        if (!opt.previewEvery)
+            opt.previewEvery = unsigned(std::max(1.0f, std::round(opt.fps / 10.0f)));
+        std::cout << "Preview on tcp://" << preview->endpoint() << "\n";
+    }
 
-    // Signal handler for completed frames
-    unsigned saved = 0;
-    const uint32_t outW = streamCfg.size.width;
-    const uint32_t outH = streamCfg.size.height;
-    const bool writeDng = (outFmt == "DNG" || outFmt == "dng");
-    const bool writeRaw = (outFmt == "RAW" || outFmt == "raw");
-    if (!writeDng && !writeRaw)
+    CaptureShared shared;
+    shared.writer = asyncWriter.get();
+    shared.encodePool = &encodePool;
+    shared.trigger = &trigger;
+    shared.matcher = matcher.get();
+    shared.wakeup = &g_wakeup;
+    shared.preview = preview.get();
+    shared.saved = &saved;
+    shared.stop = &g_stop;
+
+    // One session per camera: its own buffers, controls and pipeline
+    std::vector<std::unique_ptr<CaptureSession>> sessions;
+    bool ok = true;
+    for (size_t i = 0; i < cameras.size() && ok; i++)
     {
-        std::cerr << "Unknown outfmt: " << outFmt << " (use DNG or RAW)\n";
-        goto shutdown;
+        const std::string label = cameras.size() > 1 ? "cam" + std::to_string(i) : std::string();
+        CaptureOptions camOpt = opt;
+        if (!calibrationPaths.empty())
+            camOpt.calibrationPath = calibrationPaths[i];
+        sessions.emplace_back(new CaptureSession(cameras[i], unsigned(i), label, camOpt, shared));
+        ok = sessions.back()->open();
     }
+    // Everything hot is allocated and mapped by now
+    if (ok && lockMemory)
+        ok = ThreadPlacement::lockMemory();
+    const int64_t openedNs = util::monotonicNs();
 
-    auto reqComplete = [&](libcamera::Request *req)
+    // --soak: watches every camera's pipeline; the report echoes the command line
+    std::unique_ptr<SoakMonitor> soak;
+    if (ok && soakSeconds > 0)
     {
-        if (req->status() == libcamera::Request::RequestCancelled)
-            return;
+        std::string config;
+        for (int i = 0; i < argc; i++)
+            config += (i ? " " : "") + std::string(argv[i]);
+        soak.reset(new SoakMonitor(soakSeconds, soakInterval, opt.externalTrigger ? 0.0f : opt.fps, config));
+        for (const auto &s : sessions)
+            soak->addCamera(s->label(), s->pipeline(), s->drops());
+    }
 
-        const auto &buffers = req->buffers();
-        auto it = buffers.begin();
-        if (it == buffers.end())
+    // Main thread sleeps while streaming (pipeline workers do the heavy lifting)
+    // and only wakes for the last frame, a drop, a signal, the first frame or
+    // the next stats line. Anything that happens between the check and wait()
+    // leaves the eventfd readable, so nothing is missed.
+    auto allDone = [&]
+    {
+        for (const auto &s : sessions)
+            if (!s->done())
+                return false;
+        return true;
+    };
+    struct RunResult
+    {
+        bool ok{false};
+        bool aborted{false};
+        double firstFrameMs{-1.0}; // from `sinceNs`; < 0: no frame
+        uint64_t frames{0};
+        uint64_t lost{0};
+    };
+    bool placementShown = false;
+    // One run: start every camera, stream until done, stop, drain and report
+    // to `out`. `phases` are the steps before `sinceNs` for the first-frame line.
+    auto capture = [&](std::ostream &out, int64_t sinceNs, const std::string &phases)
+    {
+        RunResult r;
+        const int64_t startNs = util::monotonicNs();
+        r.ok = true;
+        for (size_t i = 0; i < sessions.size() && r.ok; i++)
+            r.ok = sessions[i]->start();
+        if (r.ok && !placementShown)
         {
-            std::cerr << "No buffer in request.\n";
-            return;
+            ThreadPlacement::report(std::cout);
+            placementShown = true;
         }
-        libcamera::FrameBuffer *fb = it->second;
+        const int64_t startedNs = util::monotonicNs();
+        if (r.ok && soak)
+            soak->start();
 
-        // Unpack RAW10
-        std::vector<uint16_t> pixels(size_t(outW) * outH);
-        if (!util::unpackRaw10To16(fb, outW, outH, pixels))
+        while (r.ok && !g_stop && !allDone())
         {
-            std::cerr << "Unpack RAW10 failed.\n";
-            return;
+            int timeoutMs = soak ? soak->msUntilDue() : -1;
+            for (const auto &s : sessions)
+            {
+                const int ms = s->reporter().msUntilTick();
+                if (ms >= 0 && (timeoutMs < 0 || ms < timeoutMs))
+                    timeoutMs = ms;
+            }
+            g_wakeup.wait(timeoutMs);
+            // Time to first frame: once every camera has delivered one
+            if (r.firstFrameMs < 0)
+            {
+                bool all = true;
+                int64_t last = 0;
+                for (const auto &s : sessions)
+                {
+                    all = all && s->firstFrameNs();
+                    last = std::max(last, s->firstFrameNs());
+                }
+                if (all)
+                {
+                    r.firstFrameMs = (last - sinceNs) / 1e6;
+                    out << "Time to first frame: " << std::fixed << std::setprecision(1) << r.firstFrameMs << " ms ("
+                        << phases << "start " << (startedNs - startNs) / 1e6 << " ms, first frame "
+                        << (last - startedNs) / 1e6 << " ms)\n"
+                        << std::defaultfloat;
+                }
+            }
+            // Lost frames: never delivered by the sensor/ISP, or refused by a full pipeline
+            uint64_t lost = 0;
+            for (const auto &s : sessions)
+            {
+                s->reporter().tick(std::cout);
+                lost += s->lost();
+            }
+            if (opt.maxDrops >= 0 && lost > static_cast<uint64_t>(opt.maxDrops))
+            {
+                out << "Aborting: " << lost << " frame(s) lost (--max-drops " << opt.maxDrops << ")\n";
+                r.aborted = true;
+                break;
+            }
+            if (soak)
+            {
+                soak->sample(std::cout);
+                if (soak->expired())
+                    break;
+            }
         }
+        if (soak)
+            soak->sample(std::cout, true); // the last stretch, before the queues drain
 
-        // Save
-        std::ostringstream name;
-        name << "imx296_" << std::setw(6) << std::setfill('0') << saved;
-        std::string fileBase = util::joinPath(outDir, name.str());
+        // Every camera stops before any pipeline drains, so no camera keeps
+        // capturing into a sink that's closing
+        for (auto &s : sessions)
+            s->stopCapture();
+        for (auto &s : sessions)
+            s->finish(); // drain frames already handed off
+        if (asyncWriter)
+            asyncWriter->drain(); // and their writes, before a container's index goes out
+        for (auto &s : sessions)
+            s->closeOutputs();
 
-        if (writeDng)
+        for (const auto &s : sessions)
         {
-            DngMeta meta;
-            meta.width = outW;
-            meta.height = outH;
-            meta.bayer = toBayer(bayer);
-            meta.bitsPerSample = 16;
-            meta.whiteLevel = 1023;
-            meta.blackLevel = 0;
-            meta.analogGain = analogueGain;
-            meta.exposureSeconds = exposureUs / 1e6f;
-
-            if (!DngWriter::write(fileBase + ".dng", meta, pixels))
-            {
-                std::cerr << "DNG write failed.\n";
-            }
+            s->report(out);
+            r.frames = std::max(r.frames, s->frames());
+            r.lost += s->lost();
         }
-        else
+        if (matcher)
         {
-            // Dump as raw16 little-endian (10 bits valid)
-            std::ofstream raw(fileBase + ".raw", std::ios::binary);
-            raw.write(reinterpret_cast<const char *>(pixels.data()), pixels.size() * 2);
+            const FrameMatcher::Stats ms = matcher->stats();
+            out << "Matched " << ms.matched << " set(s) of " << matcher->cameras() << " frames, " << ms.incomplete
+                << " incomplete, skew p50/p99/max " << std::fixed << std::setprecision(1) << ms.skew.p50 / 1e3
+                << "/" << ms.skew.p99 / 1e3 << "/" << ms.skew.max / 1e3 << " us\n"
+                << std::defaultfloat;
         }
-
-        saved++;
-        if (saved >= frames || g_stop)
+        if (preview)
         {
-            camera->stop(); // stop streaming; safe to do from callback
-            return;
+            const PreviewSink::Stats ps = preview->stats();
+            out << "Preview: " << ps.published << " image(s), " << ps.sent << " sent, " << ps.skipped
+                << " skipped by busy viewers\n";
         }
-
-        // Re-queue buffer for continued streaming
-        req->reuse(libcamera::Request::ReuseBuffers);
-        applyControls(req);
-        if (camera->queueRequest(req))
-            std::cerr << "Re-queue request failed.\n";
-    };
-
-    camera->requestCompleted.connect(reqComplete);
-
-    // Queue all initial requests
-    for (auto &r : requests)
-    {
-        applyControls(r.get());
-        if (camera->queueRequest(r.get()))
+        if (!statsJson.empty())
         {
-            std::cerr << "Queue request failed.\n";
-            goto shutdown;
+            for (const auto &s : sessions)
+            {
+                // One file per camera: stats.json → stats_cam0.json, …
+                std::string path = statsJson;
+                if (!s->label().empty())
+                {
+                    const size_t dot = path.find_last_of('.');
+                    const size_t slash = path.find_last_of('/');
+                    const size_t at = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? dot
+                                                                                                              : path.size();
+                    path.insert(at, "_" + s->label());
+                }
+                if (s->reporter().writeJson(path))
+                    out << "Stats written to " << path << "\n";
+                else
+                    std::cerr << "Failed to write " << path << "\n";
+            }
         }
-    }
+        if (asyncWriter)
+        {
+            const AsyncWriter::Stats ws = asyncWriter->stats();
+            out << "Writer " << asyncWriter->backendName() << ": " << ws.writes << " write(s), " << ws.failed
+                << " failed, max in flight " << ws.maxInFlight << "/" << opt.writeDepth;
+            if (ws.directFiles || ws.bufferedFiles)
+                out << ", files O_DIRECT/buffered " << ws.directFiles << "/" << ws.bufferedFiles;
+            else if (opt.writeSeq && !sessions.empty())
+                out << (sessions.front()->seqDirect() ? ", O_DIRECT" : ", buffered");
+            out << ", queued→on disk p50/p99/max " << std::fixed << std::setprecision(2) << ws.latency.p50 / 1e6
+                << "/" << ws.latency.p99 / 1e6 << "/" << ws.latency.max / 1e6 << " ms\n"
+                << std::defaultfloat;
+        }
+        return r;
+    };
 
-    if (camera->start())
+    bool aborted = false;
+    bool regressed = false; // --baseline
+    if (ok && !servePath.empty())
     {
-        std::cerr << "Camera start failed.\n";
-        goto shutdown;
-    }
+        // Daemon: the cameras stay configured and the pools warm; each job is
+        // rearm() + capture(), reported back to the client
+        JobServer server;
+        ok = server.listen(servePath);
+        if (ok)
+            std::cout << "Ready in " << std::fixed << std::setprecision(1) << (openedNs - mainNs) / 1e6
+                      << " ms; serving capture jobs on " << servePath << "\n"
+                      << std::defaultfloat;
+        CaptureJob job;
+        while (ok)
+        {
+            const JobServer::Next next = server.next(job, g_wakeup, &g_stop);
+            if (next != JobServer::Next::Job)
+                break; // quit (already answered) or a signal
+            const int64_t jobNs = util::monotonicNs();
+            const std::string outDir = job.outDir.empty() ? opt.outDir : job.outDir;
+            std::string error;
+            if (!util::ensureDir(outDir))
+                error = "can't create outdir " + outDir;
+            for (size_t i = 0; i < sessions.size() && error.empty(); i++)
+                if (!sessions[i]->rearm(job))
+                    error = "camera " + std::to_string(i) + " can't be rearmed";
+            if (!error.empty())
+            {
+                std::cerr << "Job refused: " << error << "\n";
+                server.reply("error " + error + "\n");
+                continue;
+            }
+            if (matcher)
+                matcher->reset();
+            saved = 0;
 
-    // Simple loop while streaming (callbacks do the heavy lifting)
-    while (!g_stop && saved < frames)
-    {
-        std::this_thread::sleep_for(10ms);
+            std::ostringstream out;
+            const RunResult r = capture(out, jobNs, "");
+            if (saved)
+                out << "Saved " << saved << " frame(s) to " << outDir << "\n";
+            if (!r.ok)
+                out << "error capture failed\n";
+            else
+                out << (r.aborted || g_stop ? "error" : "ok") << " frames=" << r.frames << " saved=" << saved
+                    << " lost=" << r.lost << " first-frame-ms=" << std::fixed << std::setprecision(1)
+                    << r.firstFrameMs << "\n";
+            std::cout << out.str();
+            server.reply(out.str());
+            ok = r.ok;
+        }
     }
-
-shutdown:
-    // Unmap buffers
-    for (auto &buf : buffers)
+    else if (ok)
     {
-        libcamera::FrameBuffer *fb = buf.get();
-        if (fb && fb->cookie())
+        // Startup phases up to the cameras being ready to stream
+        std::ostringstream phases;
+        phases << std::fixed << std::setprecision(1) << "CameraManager " << (managerNs - mainNs) / 1e6
+               << " ms, configure/map " << (openedNs - managerNs) / 1e6 << " ms, ";
+        const RunResult r = capture(std::cout, mainNs, phases.str());
+        ok = r.ok;
+        aborted = r.aborted;
+        // Judged while the pipelines are still there for the whole-run histograms
+        if (ok && soak)
         {
-            void *addr = fb->cookie();
-            munmap(addr, fb->planes()[0].length);
-            fb->setCookie(nullptr);
+            soak->report(std::cout);
+            if (soak->writeReport(soakReport))
+                std::cout << "Soak report written to " << soakReport << "\n";
+            else
+                std::cerr << "Failed to write " << soakReport << "\n";
+            aborted = aborted || !soak->sustained();
+            if (!baselinePath.empty() && !soak->compare(baselinePath, soakTolerance, std::cout))
+                regressed = true;
         }
     }
 
-    allocator.free(streamCfg.stream());
-
-    camera->release();
+    // Unmaps, frees and releases each camera
+    sessions.clear();
     cm.stop();
 
-    if (saved)
+    if (saved && servePath.empty())
     {
-        std::cout << "Saved " << saved << " frame(s) to " << outDir << "\n";
+        std::cout << "Saved " << saved << " frame(s) to " << opt.outDir << "\n";
     }
-    return 0;
+    if (!ok)
+        return 1;
+    if (regressed)
+        return 3;
+    return aborted ? 2 : 0;
 }
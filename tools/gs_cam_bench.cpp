@@ -0,0 +1,473 @@
+/*
+ * gs_cam_bench - time the capture hot paths on synthetic frames: RAW10 unpack
+ * with every kernel this CPU has, the reduced outputs (binned, one CFA channel,
+ * 8-bit), DNG encode to memory and to disk (plain and lossless JPEG), and the
+ * unpack → write pipeline with N workers.
+ * Needs no camera and no libcamera; it only links the core.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DngWriter.hpp"
+#include "FramePool.hpp"
+#include "IoUtil.hpp"
+#include "LatencyHistogram.hpp"
+#include "OutputMode.hpp"
+#include "Pipeline.hpp"
+#include "Raw10Kernels.hpp"
+#include "ThreadPool.hpp"
+
+static std::string usageStr()
+{
+    return R"(gs_cam_bench - benchmark unpack, DNG encode and the worker pipeline offline
+
+Usage:
+  gs_cam_bench [--sizes WxH[,WxH...]] [--seconds S] [--workers N] [--writers N]
+               [--dir DIR|none] [--only unpack,reduce,dng,disk,pipeline] [--json PATH]
+
+  --sizes    frame sizes to test (default: 1456x1088,728x544,1456x272,4056x3040)
+  --seconds  minimum time per case (default: 1; every case runs at least 3 frames)
+  --workers  unpack threads in the pipeline case, encode threads for tiled DNG
+             (default: all cores)
+  --writers  write threads in the pipeline case (default: 1)
+  --dir      where the disk cases write their files (default: /tmp);
+             none skips them
+  --only     run just these groups
+  --json     also write the results there
+
+MB/s counts what each case produces: 16-bit pixels for unpack, output samples
+for reduce, file bytes for DNG.
+)";
+}
+
+namespace
+{
+    struct Size
+    {
+        uint32_t w{0}, h{0};
+    };
+
+    // A synthetic RAW10 frame, strided like an ISP buffer
+    struct Synthetic
+    {
+        uint32_t width{0}, height{0};
+        size_t stride{0};
+        std::vector<uint8_t> packed;
+    };
+
+    struct Result
+    {
+        std::string name;
+        Size size;
+        uint64_t frames{0};
+        double seconds{0.0};
+        uint64_t bytes{0}; // produced, over all frames
+
+        double fps() const { return seconds > 0 ? frames / seconds : 0.0; }
+        double mbps() const { return seconds > 0 ? bytes / seconds / 1e6 : 0.0; }
+        double nsPerPixel() const
+        {
+            const double px = double(frames) * size.w * size.h;
+            return px > 0 ? seconds * 1e9 / px : 0.0;
+        }
+    };
+
+    bool parseSizes(const std::string &s, std::vector<Size> &out)
+    {
+        out.clear();
+        size_t pos = 0;
+        while (pos <= s.size())
+        {
+            const size_t comma = std::min(s.find(',', pos), s.size());
+            Size sz;
+            if (std::sscanf(s.substr(pos, comma - pos).c_str(), "%ux%u", &sz.w, &sz.h) != 2 ||
+                sz.w == 0 || sz.h == 0 || sz.w % 4 != 0 || sz.h % 2 != 0)
+                return false;
+            out.push_back(sz);
+            pos = comma + 1;
+        }
+        return !out.empty();
+    }
+
+    // Something that compresses like a real scene: a smooth gradient per CFA
+    // channel plus a few LSBs of noise. Pure noise (or a flat field) would make
+    // the LJ92 numbers meaningless.
+    Synthetic makeFrame(uint32_t width, uint32_t height)
+    {
+        Synthetic f;
+        f.width = width;
+        f.height = height;
+        f.stride = (size_t(width) * 5 / 4 + 31) & ~size_t(31); // ISP lines are 32-byte aligned
+        f.packed.assign(f.stride * height, 0);
+
+        uint32_t rng = 0x12345678u;
+        uint16_t px[4];
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            uint8_t *line = f.packed.data() + f.stride * y;
+            for (uint32_t x = 0; x < width; x += 4)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    rng = rng * 1664525u + 1013904223u;
+                    const uint32_t channel = ((y & 1) << 1) | ((x + i) & 1);
+                    const uint32_t v = 64 + (x + i) * 600 / width + y * 200 / height + channel * 40 + (rng >> 28);
+                    px[i] = static_cast<uint16_t>(std::min<uint32_t>(v, 1023));
+                }
+                // Grouped exactly as unpackRowScalar() takes it apart again
+                uint8_t *g = line + x / 4 * 5;
+                for (int i = 0; i < 4; ++i)
+                    g[i] = static_cast<uint8_t>(px[i]);
+                g[4] = static_cast<uint8_t>((px[0] >> 8) | (px[1] >> 8) << 2 | (px[2] >> 8) << 4 | (px[3] >> 8) << 6);
+            }
+        }
+        return f;
+    }
+
+    // Call fn() until `minSeconds` have passed (and at least 3 times), after one
+    // untimed warm-up call. fn returns the bytes it produced.
+    template <typename F>
+    Result timeCase(const std::string &name, Size size, double minSeconds, F &&fn)
+    {
+        Result r;
+        r.name = name;
+        r.size = size;
+        fn();
+        const int64_t start = util::monotonicNs();
+        const int64_t budget = static_cast<int64_t>(minSeconds * 1e9);
+        int64_t now = start;
+        while (r.frames < 3 || now - start < budget)
+        {
+            r.bytes += fn();
+            ++r.frames;
+            now = util::monotonicNs();
+        }
+        r.seconds = (now - start) / 1e9;
+        return r;
+    }
+
+    DngMeta metaFor(uint32_t width, uint32_t height, DngCompression compression)
+    {
+        DngMeta meta;
+        meta.width = width;
+        meta.height = height;
+        meta.compression = compression;
+        meta.dataAlignment = FramePool::kAlignment;
+        return meta;
+    }
+
+    // The files every disk case cycles through, so the page cache does not just
+    // overwrite the same pages
+    constexpr unsigned kDiskFiles = 8;
+
+    std::string benchPath(const std::string &dir, unsigned n)
+    {
+        return dir + "/gs_cam_bench_" + std::to_string(n) + ".dng";
+    }
+
+    void printResult(const Result &r)
+    {
+        std::cout << "  " << std::left << std::setw(28) << r.name << std::right << std::fixed
+                  << std::setw(10) << std::setprecision(1) << r.fps()
+                  << std::setw(11) << std::setprecision(1) << r.mbps()
+                  << std::setw(10) << std::setprecision(3) << r.nsPerPixel()
+                  << std::setw(8) << r.frames << "\n";
+    }
+
+    bool writeJson(const std::string &path, const std::vector<Result> &results, unsigned workers,
+                   unsigned writers)
+    {
+        std::ofstream os(path);
+        if (!os)
+            return false;
+        os << "{\n  \"kernel\": \"" << util::raw10::selected().name << "\",\n"
+           << "  \"workers\": " << workers << ",\n  \"writers\": " << writers << ",\n"
+           << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result &r = results[i];
+            os << "    {\"name\": \"" << r.name << "\", \"width\": " << r.size.w << ", \"height\": " << r.size.h
+               << ", \"frames\": " << r.frames << ", \"seconds\": " << r.seconds
+               << ", \"fps\": " << r.fps() << ", \"mbps\": " << r.mbps()
+               << ", \"ns_per_pixel\": " << r.nsPerPixel() << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n}\n";
+        return bool(os);
+    }
+
+    // capture → unpack (N workers) → write (M writers), fed as fast as the first
+    // queue takes frames. Frames stand in for camera buffers by index only; every
+    // one of them unpacks the same synthetic plane.
+    Result benchPipeline(const Synthetic &f, const DngWriter &dng, const std::string &dir, double minSeconds,
+                         unsigned workers, unsigned writers)
+    {
+        const size_t pixels = size_t(f.width) * f.height;
+        const size_t capacity = std::max<size_t>(8, 2 * workers);
+        FramePool pool(capacity * 2 + workers + writers, pixels);
+
+        Pipeline pipe([](libcamera::Request *) {});
+        pipe.addStage("unpack", workers, capacity,
+                      [&](Frame &fr)
+                      {
+                          fr.pixels = pool.lease();
+                          return fr.pixels &&
+                                 util::raw10::unpack(f.packed.data(), f.packed.size(), f.stride, f.width, f.height,
+                                                     fr.pixels.data(), fr.pixels.size());
+                      });
+        pipe.addStage("write", writers, capacity,
+                      [&](Frame &fr)
+                      {
+                          if (dir.empty())
+                          {
+                              fr.bytesWritten = dng.headerSize() + dng.pixelBytes();
+                              return true;
+                          }
+                          if (!dng.writeFrame(benchPath(dir, fr.index % kDiskFiles), fr.pixels.data(), DngFrameInfo{}))
+                              return false;
+                          fr.bytesWritten = dng.headerSize() + dng.pixelBytes();
+                          return true;
+                      });
+        pipe.setWarmupFrames(capacity);
+
+        Result r;
+        r.name = "pipeline " + std::to_string(workers) + "x unpack" + (dir.empty() ? "" : " + write");
+        r.size = {f.width, f.height};
+        if (!pipe.start())
+            return r;
+
+        const int64_t start = util::monotonicNs();
+        const int64_t budget = static_cast<int64_t>(minSeconds * 1e9);
+        uint64_t index = 0;
+        while (index < 3 || util::monotonicNs() - start < budget)
+        {
+            // Keep the first queue full without making submit() drop frames
+            if (pipe.submitted() - pipe.retired() >= capacity)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            Frame fr;
+            fr.index = index++;
+            pipe.submit(std::move(fr));
+        }
+        pipe.finish();
+        r.seconds = (util::monotonicNs() - start) / 1e9;
+
+        const auto stats = pipe.stats();
+        r.frames = stats.back().processed;
+        r.bytes = stats.back().bytes;
+        return r;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<Size> sizes{{1456, 1088}, {728, 544}, {1456, 272}, {4056, 3040}};
+    double seconds = 1.0;
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    unsigned writers = 1;
+    std::string dir = "/tmp";
+    std::string only = "unpack,reduce,dng,disk,pipeline";
+    std::string jsonPath;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string a = argv[i];
+        if (a == "--sizes" && i + 1 < argc)
+        {
+            if (!parseSizes(argv[++i], sizes))
+            {
+                std::cerr << "--sizes takes WxH[,WxH...] (width a multiple of 4, height even)\n";
+                return 1;
+            }
+        }
+        else if (a == "--seconds" && i + 1 < argc)
+            seconds = std::max(0.0, std::atof(argv[++i]));
+        else if (a == "--workers" && i + 1 < argc)
+            workers = std::max(1, std::atoi(argv[++i]));
+        else if (a == "--writers" && i + 1 < argc)
+            writers = std::max(1, std::atoi(argv[++i]));
+        else if (a == "--dir" && i + 1 < argc)
+            dir = argv[++i];
+        else if (a == "--only" && i + 1 < argc)
+            only = argv[++i];
+        else if (a == "--json" && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (a == "-h" || a == "--help")
+        {
+            std::cout << usageStr();
+            return 0;
+        }
+        else
+        {
+            std::cerr << "Unknown argument: " << a << "\n"
+                      << usageStr();
+            return 1;
+        }
+    }
+    if (dir == "none")
+        dir.clear();
+    auto wants = [&](const char *group)
+    { return ("," + only + ",").find(std::string(",") + group + ",") != std::string::npos; };
+
+    ThreadPool encodePool(workers > 1 ? workers - 1 : 0); // the caller encodes too
+    std::vector<Result> results;
+    auto add = [&](const Result &r)
+    {
+        printResult(r);
+        results.push_back(r);
+    };
+
+    std::cout << "unpack kernel: " << util::raw10::selected().name << ", " << workers << " worker(s), "
+              << writers << " writer(s)\n";
+    for (const Size &size : sizes)
+    {
+        const Synthetic f = makeFrame(size.w, size.h);
+        const size_t pixels = size_t(size.w) * size.h;
+        std::vector<uint16_t> unpacked(pixels);
+        util::raw10::unpack(f.packed.data(), f.packed.size(), f.stride, f.width, f.height, unpacked.data(),
+                            unpacked.size());
+
+        std::cout << "\n"
+                  << size.w << "x" << size.h << "\n  " << std::left << std::setw(28) << "case" << std::right
+                  << std::setw(10) << "frames/s" << std::setw(11) << "MB/s" << std::setw(10) << "ns/px"
+                  << std::setw(8) << "frames" << "\n";
+
+        if (wants("unpack"))
+        {
+            std::vector<uint16_t> dst(pixels);
+            for (const auto &k : util::raw10::available())
+            {
+                add(timeCase(std::string("unpack ") + k.name, size, seconds, [&]
+                             {
+                                 if (!util::raw10::unpack(f.packed.data(), f.packed.size(), f.stride, f.width,
+                                                          f.height, dst.data(), dst.size(), &k))
+                                     return size_t(0);
+                                 return pixels * 2; }));
+                if (dst != unpacked)
+                    std::cerr << "  " << k.name << " does not match the selected kernel!\n";
+            }
+        }
+
+        if (wants("reduce"))
+        {
+            // Each mode against the same thing done the long way on the unpacked
+            // frame: value(x, y) from the 16-bit samples
+            struct Mode
+            {
+                const char *name, *bin, *channel, *bits;
+                uint32_t (*value)(const uint16_t *s, uint32_t w, uint32_t x, uint32_t y);
+            };
+            const Mode modes[] = {
+                {"reduce 8-bit", "", "", "8", [](const uint16_t *s, uint32_t w, uint32_t x, uint32_t y)
+                 { return uint32_t(s[size_t(y) * w + x] >> 2); }},
+                {"reduce bin2 sum 16-bit", "sum", "", "16", [](const uint16_t *s, uint32_t w, uint32_t x, uint32_t y)
+                 {
+                     const uint16_t *p = s + size_t(2 * y) * w + 2 * x;
+                     return uint32_t(p[0] + p[1] + p[w] + p[w + 1]);
+                 }},
+                {"reduce bin2 avg 8-bit", "avg", "", "8", [](const uint16_t *s, uint32_t w, uint32_t x, uint32_t y)
+                 {
+                     const uint16_t *p = s + size_t(2 * y) * w + 2 * x;
+                     return uint32_t((p[0] + p[1] + p[w] + p[w + 1] + 2) / 4 >> 2);
+                 }},
+                {"reduce channel TR 16-bit", "", "TR", "16", [](const uint16_t *s, uint32_t w, uint32_t x, uint32_t y)
+                 { return uint32_t(s[size_t(2 * y) * w + 2 * x + 1]); }},
+            };
+            for (const Mode &m : modes)
+            {
+                OutputMode om;
+                if ((*m.bin && !om.setBin(m.bin)) || (*m.channel && !om.setChannel(m.channel, "RGGB")) ||
+                    !om.setBits(m.bits))
+                    continue;
+                const size_t bytes = om.bytes(size.w, size.h);
+                std::vector<uint8_t> out(bytes);
+                add(timeCase(m.name, size, seconds, [&]
+                             {
+                                 return om.reduce(f.packed.data(), f.packed.size(), f.stride, f.width, f.height,
+                                                  out.data(), out.size())
+                                            ? bytes
+                                            : size_t(0); }));
+                const uint32_t ow = om.width(size.w), oh = om.height(size.h);
+                size_t bad = 0;
+                for (uint32_t y = 0; y < oh; ++y)
+                    for (uint32_t x = 0; x < ow; ++x)
+                    {
+                        const size_t i = size_t(y) * ow + x;
+                        const uint32_t got = om.bits() == 8 ? out[i] : uint32_t(out[2 * i] | out[2 * i + 1] << 8);
+                        bad += got != m.value(unpacked.data(), size.w, x, y);
+                    }
+                if (bad)
+                    std::cerr << "  " << m.name << ": " << bad << " sample(s) differ from the unpacked frame!\n";
+            }
+        }
+
+        const DngWriter plain(metaFor(size.w, size.h, DngCompression::None));
+        const DngWriter lj92(metaFor(size.w, size.h, DngCompression::LosslessJpeg));
+
+        if (wants("dng"))
+        {
+            DngSource pixelsSrc;
+            pixelsSrc.pixels = unpacked.data();
+            std::vector<uint8_t> file(std::max(plain.encodedSize(), lj92.encodedSize()));
+            add(timeCase("dng memory", size, seconds, [&]
+                         { return plain.encode(pixelsSrc, DngFrameInfo{}, file.data(), file.size()); }));
+
+            // LJ92 tiles on the calling thread only: the single-core cost per frame
+            size_t codedBytes = 0;
+            add(timeCase("dng memory ljpeg 1 core", size, seconds, [&]
+                         {
+                             codedBytes = lj92.encode(pixelsSrc, DngFrameInfo{}, file.data(), file.size());
+                             return codedBytes; }));
+            std::cout << "  (ljpeg: " << std::setprecision(2)
+                      << (codedBytes ? double(plain.encodedSize()) / codedBytes : 0.0) << ":1)\n";
+        }
+
+        if (wants("disk") && !dir.empty())
+        {
+            unsigned n = 0;
+            add(timeCase("dng disk", size, seconds, [&]
+                         {
+                             if (!plain.writeFrame(benchPath(dir, n++ % kDiskFiles), unpacked.data(), DngFrameInfo{}))
+                                 return size_t(0);
+                             return plain.headerSize() + plain.pixelBytes(); }));
+
+            // Straight from the packed plane, tiles spread over the encode pool
+            DngSource src;
+            src.packed = f.packed.data();
+            src.packedStride = f.stride;
+            src.packedBytes = f.packed.size();
+            add(timeCase("dng disk ljpeg " + std::to_string(workers) + " core(s)", size, seconds, [&]
+                         {
+                             uint64_t bytes = 0;
+                             if (!lj92.writeFrame(benchPath(dir, n++ % kDiskFiles), src, DngFrameInfo{},
+                                                  &encodePool, &bytes))
+                                 return size_t(0);
+                             return size_t(bytes); }));
+        }
+
+        if (wants("pipeline"))
+            add(benchPipeline(f, plain, wants("disk") ? dir : std::string(), seconds, workers, writers));
+    }
+
+    if (!dir.empty())
+        for (unsigned n = 0; n < kDiskFiles; ++n)
+            std::remove(benchPath(dir, n).c_str());
+
+    if (!jsonPath.empty() && !writeJson(jsonPath, results, workers, writers))
+    {
+        std::cerr << "Failed to write " << jsonPath << "\n";
+        return 1;
+    }
+    return 0;
+}
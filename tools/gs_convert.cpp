@@ -0,0 +1,553 @@
+/*
+ * gs_convert - turn gs_cam's packed captures and sequence containers into DNG
+ * on any machine.
+ * Needs no camera and no libcamera; it only links the core (unpack + DNG).
+ *
+ * Inputs are mapped, not read: frames go from the page cache straight into the
+ * strip/tile unpack, and all frames of all inputs are spread over a ThreadPool,
+ * so a workstation converts at disk speed rather than one core's.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Calibration.hpp"
+#include "DngReader.hpp"
+#include "DngWriter.hpp"
+#include "DropDetector.hpp"
+#include "IoUtil.hpp"
+#include "Raw10Kernels.hpp"
+#include "Raw10PFile.hpp"
+#include "SeqFile.hpp"
+#include "ThreadPool.hpp"
+
+namespace fs = std::filesystem;
+
+static std::string usageStr()
+{
+    return R"(gs_convert - convert gs_cam captures (.r10p, .gsq) to DNG
+
+Usage:
+  gs_convert [--outdir DIR] [--bayer RGGB|BGGR|GRBG|GBRG]
+             [--range FIRST[:LAST]] [--sequence FIRST[:LAST]] [--compression none|ljpeg]
+             [--calibration FILE.gscal] [--jobs N] [--verify] FILE|DIR...
+
+  DIR        every .r10p and .gsq in it, in name order
+  --outdir   where to put the .dng files (default: next to each input)
+  --bayer    override the CFA pattern recorded in the capture
+  --range    frames to extract (inclusive): indices in sequence containers,
+             file numbers (imx296_NNNNNN.r10p) for loose frames
+  --sequence sequence containers: frames whose sensor sequence number is in range
+  --jobs     threads converting frames (default: one per core)
+  --verify   read every DNG back and check it holds exactly the source samples
+             (after --calibration) and its frame record; exit code 1 if not
+  --compression
+             ljpeg: lossless JPEG compressed tiles (about half the size)
+  --calibration
+             black levels, dark frame and hot pixels from gs_cam --calibrate-dark,
+             applied to packed captures as they are unpacked (same mode, no --roi)
+)";
+}
+
+struct Range
+{
+    uint64_t first{0};
+    uint64_t last{UINT64_MAX};
+};
+
+static bool parseRange(const std::string &s, Range &r)
+{
+    try
+    {
+        size_t colon = s.find(':');
+        r.first = std::stoull(s.substr(0, colon));
+        r.last = colon == std::string::npos ? r.first : std::stoull(s.substr(colon + 1));
+        return r.first <= r.last;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+static DngMeta metaFor(uint32_t width, uint32_t height, BayerPattern bayer, DngCompression compression,
+                       const Calibration *cal)
+{
+    DngMeta meta;
+    if (cal)
+        std::copy(cal->blackLevels(), cal->blackLevels() + 4, meta.blackLevel);
+    meta.width = width;
+    meta.height = height;
+    meta.bayer = bayer;
+    meta.compression = compression;
+    return meta;
+}
+
+// One capture file, mapped once and shared by every frame taken from it
+struct Input
+{
+    fs::path path;
+    bool seq{false};
+    SeqReader reader;      // .gsq
+    util::MappedFile file; // .r10p
+    const uint8_t *packed{nullptr};
+    uint32_t width{0}, height{0}, stride{0};
+    bool packedPayload{true}; // RAW10 (stride bytes/line) or 16-bit samples
+    int64_t clockOffsetNs{0};
+    std::unique_ptr<DngWriter> dng;
+};
+
+// One DNG to produce
+struct Job
+{
+    Input *in{nullptr};
+    size_t record{0}; // .gsq: index entry
+    uint64_t index{0};
+    fs::path out;
+};
+
+struct Totals
+{
+    std::atomic<uint64_t> converted{0}, failed{0}, mismatched{0};
+    std::atomic<uint64_t> missing{0}; // sensor drops recorded in the containers
+    std::atomic<uint64_t> bytesIn{0}, bytesOut{0};
+};
+
+// Lines from several threads at once: whole lines only
+static void say(std::ostream &os, const std::string &line)
+{
+    static std::mutex m;
+    std::lock_guard<std::mutex> lk(m);
+    os << line << "\n";
+}
+
+// The calibration, if it was taken in this capture's mode
+static bool calibrationFits(const fs::path &in, const Calibration *cal, uint32_t width, uint32_t height)
+{
+    if (!cal || cal->fits(width, height))
+        return true;
+    std::cerr << in.string() << ": " << width << "x" << height << ", but the calibration is for "
+              << cal->header().width << "x" << cal->header().height << "\n";
+    return false;
+}
+
+// Trailing digits of a file name (imx296_000123.r10p → 123), or -1
+static long long fileNumber(const fs::path &p)
+{
+    const std::string stem = p.stem().string();
+    size_t i = stem.size();
+    while (i > 0 && std::isdigit(static_cast<unsigned char>(stem[i - 1])))
+        i--;
+    return i == stem.size() ? -1 : std::stoll(stem.substr(i));
+}
+
+static bool openInput(Input &in, const BayerPattern *bayerOverride, DngCompression compression,
+                      const Calibration *cal)
+{
+    BayerPattern bayer;
+    if (in.seq)
+    {
+        if (!in.reader.open(in.path.string()) || !in.reader.map())
+        {
+            std::cerr << in.path.string() << ": not a readable sequence container\n";
+            return false;
+        }
+        if (!in.reader.finalized())
+            std::cerr << in.path.string() << ": no index (capture interrupted?), recovered " << in.reader.frames()
+                      << " frame(s)\n";
+        const SeqFileHeader &hdr = in.reader.header();
+        in.width = hdr.width;
+        in.height = hdr.height;
+        in.stride = hdr.stride;
+        in.packedPayload = hdr.format == static_cast<uint8_t>(SeqFormat::Raw10Packed);
+        in.clockOffsetNs = hdr.clockOffsetNs;
+        bayer = static_cast<BayerPattern>(hdr.bayer & 3);
+    }
+    else
+    {
+        Raw10PHeader hdr;
+        if (!in.file.open(in.path.c_str()) || !Raw10PFile::view(in.file.data(), in.file.size(), hdr, in.packed))
+        {
+            std::cerr << in.path.string() << ": not a readable RAW10P file\n";
+            return false;
+        }
+        in.width = hdr.width;
+        in.height = hdr.height;
+        in.stride = hdr.stride;
+        bayer = static_cast<BayerPattern>(hdr.bayer & 3);
+    }
+    if (!calibrationFits(in.path, cal, in.width, in.height))
+        return false;
+    in.dng.reset(new DngWriter(metaFor(in.width, in.height, bayerOverride ? *bayerOverride : bayer, compression, cal)));
+    return true;
+}
+
+// What the DNG should hold: the payload unpacked (and corrected) into `ref`.
+// Always with the scalar kernel, whichever one the writer used, so a bug in a
+// vector kernel can't verify its own output.
+static bool reference(const Input &in, const uint8_t *payload, size_t bytes, const Calibration *cal,
+                      std::vector<uint16_t> &ref)
+{
+    static const util::raw10::Kernel kScalar{"scalar", &util::raw10::unpackRowScalar};
+    ref.resize(size_t(in.width) * in.height);
+    if (!in.packedPayload)
+    {
+        if (bytes < ref.size() * 2)
+            return false;
+        std::memcpy(ref.data(), payload, ref.size() * 2);
+        return true;
+    }
+    return cal ? cal->unpack(payload, bytes, in.stride, in.width, in.height, ref.data(), ref.size(), 0, 0, &kScalar)
+               : util::raw10::unpack(payload, bytes, in.stride, in.width, in.height, ref.data(), ref.size(),
+                                     &kScalar);
+}
+
+// Read the DNG back and compare every sample (and the frame record) with the source
+static bool verifyFrame(const Job &job, const uint8_t *payload, size_t bytes, const DngFrameInfo &fi,
+                        const Calibration *cal)
+{
+    thread_local std::vector<uint16_t> ref;
+    thread_local DngImage img;
+    util::MappedFile written;
+    const Input &in = *job.in;
+    const std::string name = job.out.filename().string();
+    if (!written.open(job.out.c_str()) || !DngReader::decode(written.data(), written.size(), img))
+    {
+        say(std::cerr, name + ": verify: can't read the DNG back");
+        return false;
+    }
+    if (!reference(in, payload, bytes, cal, ref))
+    {
+        say(std::cerr, name + ": verify: source frame is short");
+        return false;
+    }
+    if (img.width != in.width || img.height != in.height)
+    {
+        say(std::cerr, name + ": verify: " + std::to_string(img.width) + "x" + std::to_string(img.height) +
+                           " instead of " + std::to_string(in.width) + "x" + std::to_string(in.height));
+        return false;
+    }
+    const auto diff = std::mismatch(ref.begin(), ref.end(), img.pixels.begin());
+    if (diff.first != ref.end())
+    {
+        const size_t at = size_t(diff.first - ref.begin());
+        size_t bad = 0;
+        for (size_t i = at; i < ref.size(); i++)
+            bad += ref[i] != img.pixels[i];
+        say(std::cerr, name + ": verify: " + std::to_string(bad) + " sample(s) differ, first at (" +
+                           std::to_string(at % in.width) + ", " + std::to_string(at / in.width) + "): " +
+                           std::to_string(*diff.first) + " → " + std::to_string(*diff.second));
+        return false;
+    }
+    if (!img.hasRecord || img.record.sequence != fi.sequence || img.record.index != fi.index ||
+        img.record.sensorTimestampNs != fi.sensorTimestampNs)
+    {
+        say(std::cerr, name + ": verify: frame record doesn't match the source");
+        return false;
+    }
+    return true;
+}
+
+static bool convertFrame(const Job &job, const Calibration *cal, ThreadPool *piecePool, bool verify, Totals &t)
+{
+    const Input &in = *job.in;
+    const uint8_t *payload = in.packed;
+    size_t bytes = size_t(in.stride) * in.height;
+    DngFrameInfo fi;
+    fi.index = job.index;
+    if (in.seq)
+    {
+        SeqFrameHeader fh;
+        if (!in.reader.view(job.record, fh, payload))
+        {
+            say(std::cerr, in.path.string() + ": record " + std::to_string(job.record) + " is unreadable");
+            return false;
+        }
+        bytes = fh.payloadBytes;
+        if (fh.flags & FrameDropBefore)
+        {
+            say(std::cerr, job.out.filename().string() + ": " + std::to_string(fh.droppedBefore) +
+                               " sensor frame(s) missing before sequence " + std::to_string(fh.sequence));
+            t.missing += fh.droppedBefore;
+        }
+        fi.exposureSeconds = fh.exposureUs / 1e6f;
+        fi.analogGain = fh.analogueGain;
+        fi.sensorTimestampNs = fh.timestampNs;
+        fi.sequence = fh.sequence;
+        fi.flags = fh.flags;
+        fi.droppedBefore = fh.droppedBefore;
+        fi.scheduleStep = fh.scheduleStep;
+        fi.clockOffsetNs = in.clockOffsetNs;
+    }
+
+    DngSource src;
+    if (in.packedPayload)
+    {
+        // Straight from the mapping: each strip/tile unpacks its own rows
+        src.packed = payload;
+        src.packedStride = in.stride;
+        src.packedBytes = bytes;
+        src.calibration = cal;
+    }
+    else
+    {
+        const size_t samples = size_t(in.width) * in.height;
+        if (bytes < samples * 2)
+        {
+            say(std::cerr, job.out.filename().string() + ": payload is short");
+            return false;
+        }
+        thread_local std::vector<uint16_t> aligned;
+        if (reinterpret_cast<uintptr_t>(payload) % alignof(uint16_t) == 0)
+            src.pixels = reinterpret_cast<const uint16_t *>(payload);
+        else
+        {
+            aligned.resize(samples);
+            std::memcpy(aligned.data(), payload, samples * 2);
+            src.pixels = aligned.data();
+        }
+    }
+
+    uint64_t written = 0;
+    if (!in.dng->writeFrame(job.out.string(), src, fi, piecePool, &written))
+    {
+        say(std::cerr, job.out.string() + ": DNG write failed");
+        return false;
+    }
+    t.bytesIn += bytes;
+    t.bytesOut += written;
+    if (verify && !verifyFrame(job, payload, bytes, fi, cal))
+    {
+        t.mismatched++;
+        return false;
+    }
+    return true;
+}
+
+// Files given directly, and the captures inside directories given, in name order
+static void expandInputs(const std::vector<fs::path> &args, std::vector<fs::path> &out)
+{
+    for (const auto &a : args)
+    {
+        std::error_code ec;
+        if (!fs::is_directory(a, ec))
+        {
+            out.push_back(a);
+            continue;
+        }
+        std::vector<fs::path> found;
+        for (const auto &e : fs::directory_iterator(a, ec))
+        {
+            const fs::path &p = e.path();
+            if (e.is_regular_file(ec) &&
+                (p.extension() == SeqWriter::extension() || p.extension() == Raw10PFile::extension()))
+                found.push_back(p);
+        }
+        std::sort(found.begin(), found.end());
+        out.insert(out.end(), found.begin(), found.end());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string outDir;
+    BayerPattern bayer{BayerPattern::RGGB};
+    bool haveBayer = false;
+    DngCompression compression = DngCompression::None;
+    Range range, sequences;
+    bool haveSequences = false;
+    bool verify = false;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string calibrationPath;
+    std::vector<fs::path> args;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        if (a == "-h" || a == "--help")
+        {
+            std::cout << usageStr();
+            return 0;
+        }
+        else if (a == "--outdir" && i + 1 < argc)
+        {
+            outDir = argv[++i];
+        }
+        else if (a == "--bayer" && i + 1 < argc)
+        {
+            std::string b = argv[++i];
+            for (auto &c : b)
+                c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            if (b != "RGGB" && b != "BGGR" && b != "GRBG" && b != "GBRG")
+            {
+                std::cerr << "Invalid bayer pattern: " << b << "\n";
+                return 1;
+            }
+            bayer = toBayer(b);
+            haveBayer = true;
+        }
+        else if ((a == "--range" || a == "--sequence") && i + 1 < argc)
+        {
+            if (!parseRange(argv[++i], a == "--range" ? range : sequences))
+            {
+                std::cerr << "Invalid " << a.substr(2) << ": " << argv[i] << "\n";
+                return 1;
+            }
+            haveSequences |= a == "--sequence";
+        }
+        else if (a == "--compression" && i + 1 < argc)
+        {
+            const std::string c = argv[++i];
+            if (c == "none")
+                compression = DngCompression::None;
+            else if (c == "ljpeg")
+                compression = DngCompression::LosslessJpeg;
+            else
+            {
+                std::cerr << "Unknown compression: " << c << " (use none or ljpeg)\n";
+                return 1;
+            }
+        }
+        else if (a == "--calibration" && i + 1 < argc)
+        {
+            calibrationPath = argv[++i];
+        }
+        else if (a == "--jobs" && i + 1 < argc)
+        {
+            jobs = unsigned(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (a == "--verify")
+        {
+            verify = true;
+        }
+        else if (!a.empty() && a[0] == '-')
+        {
+            std::cerr << "Unknown arg: " << a << "\n"
+                      << usageStr();
+            return 1;
+        }
+        else
+        {
+            args.emplace_back(a);
+        }
+    }
+
+    std::vector<fs::path> paths;
+    expandInputs(args, paths);
+    if (paths.empty())
+    {
+        std::cout << usageStr();
+        return 1;
+    }
+    if (!outDir.empty())
+    {
+        std::error_code ec;
+        fs::create_directories(outDir, ec);
+        if (ec)
+        {
+            std::cerr << "Failed to create/access outdir: " << outDir << "\n";
+            return 1;
+        }
+    }
+
+    Calibration calibration;
+    if (!calibrationPath.empty() && !calibration.load(calibrationPath))
+    {
+        std::cerr << calibrationPath << ": not a readable calibration file\n";
+        return 1;
+    }
+    const Calibration *cal = calibrationPath.empty() ? nullptr : &calibration;
+
+    // Every input is opened and mapped up front, then all frames of all of them
+    // become one flat job list: a container of 10,000 frames and 10,000 loose
+    // .r10p files spread over the cores the same way
+    Totals totals;
+    std::vector<std::unique_ptr<Input>> inputs;
+    std::vector<Job> work;
+    bool noSequence = false;
+    for (const auto &path : paths)
+    {
+        const bool seq = path.extension() == SeqWriter::extension();
+        if (!seq && path.extension() != Raw10PFile::extension())
+        {
+            std::cerr << path.string() << ": unsupported input (expected " << Raw10PFile::extension() << " or "
+                      << SeqWriter::extension() << ")\n";
+            totals.failed++;
+            continue;
+        }
+        std::unique_ptr<Input> in(new Input);
+        in->path = path;
+        in->seq = seq;
+        if (!openInput(*in, haveBayer ? &bayer : nullptr, compression, cal))
+        {
+            totals.failed++;
+            continue;
+        }
+        const fs::path dir = outDir.empty() ? path.parent_path() : fs::path(outDir);
+        if (!seq)
+        {
+            // Loose frames: --range picks by file number; they carry no sequence
+            const long long n = fileNumber(path);
+            if (n >= 0 && (uint64_t(n) < range.first || uint64_t(n) > range.last))
+                continue;
+            noSequence |= haveSequences;
+            fs::path out = dir / path.filename();
+            out.replace_extension(".dng");
+            work.push_back({in.get(), 0, n >= 0 ? uint64_t(n) : 0, out});
+        }
+        for (uint64_t i = range.first; seq && i < in->reader.frames() && i <= range.last; i++)
+        {
+            const uint64_t s = in->reader.entry(i).sequence;
+            if (haveSequences && (s < sequences.first || s > sequences.last))
+                continue;
+            char name[32];
+            std::snprintf(name, sizeof(name), "_%06llu.dng", static_cast<unsigned long long>(i));
+            work.push_back({in.get(), i, i, dir / (path.stem().string() + name)});
+        }
+        inputs.push_back(std::move(in));
+    }
+    if (noSequence)
+        std::cerr << "Note: " << Raw10PFile::extension() << " files record no sequence number; --sequence "
+                  << "only selects frames in " << SeqWriter::extension() << " containers\n";
+
+    // Frames are claimed one at a time by whichever thread is free. A single frame
+    // spreads its strips/tiles over the pool instead.
+    ThreadPool pool(jobs - 1);
+    ThreadPool *piecePool = work.size() == 1 ? &pool : nullptr;
+    const auto t0 = std::chrono::steady_clock::now();
+    pool.parallelFor(work.size(), [&](size_t i)
+                     {
+        if (convertFrame(work[i], cal, piecePool, verify, totals))
+            totals.converted++;
+        else
+            totals.failed++; });
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    std::cout << "Converted " << totals.converted << " frame(s)";
+    if (totals.failed)
+        std::cout << ", " << totals.failed << " failed";
+    if (totals.missing)
+        std::cout << ", " << totals.missing << " sensor frame(s) missing in the capture";
+    std::cout << "\n";
+    if (totals.converted && secs > 0)
+        std::cout << std::fixed << std::setprecision(1) << secs << " s on " << jobs << " thread(s): "
+                  << totals.converted / secs << " frames/s, " << totals.bytesIn / secs / 1e6 << " MB/s in, "
+                  << totals.bytesOut / secs / 1e6 << " MB/s out\n";
+    if (verify)
+        std::cout << "Verify: " << totals.converted << " frame(s) bit-exact" << (totals.mismatched ? ", " : "")
+                  << (totals.mismatched ? std::to_string(totals.mismatched) + " mismatched" : std::string()) << "\n";
+    return totals.failed ? 1 : 0;
+}